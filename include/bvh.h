@@ -0,0 +1,139 @@
+#ifndef _BVH_H
+#define _BVH_H
+
+// Hierarquia de volumes envolventes (BVH) estática sobre os triângulos da
+// pista, para os raios das rodas (altura do chão sob cada roda) e para a
+// colisão dos carros com as paredes (esfera varrida ao longo do movimento).
+//
+// Construção: divisão pela heurística de área de superfície (SAH), avaliada
+// em 16 "bins" por eixo sobre os centróides dos triângulos. As folhas têm
+// até 4 triângulos, ou mais quando não vale a pena dividir. Os nós ficam em
+// um vetor em profundidade ("flattened"): o filho esquerdo de um nó interno
+// é o nó seguinte, e o nó guarda o índice do filho direito. Cada nó ocupa 32
+// bytes, dois nós por linha de cache.
+//
+// Os triângulos são guardados na ordem das folhas já na forma usada pelo
+// teste de Möller–Trumbore (um vértice e as duas arestas que saem dele).
+//
+// Consultas:
+//
+//   - raycast(): um raio, escalar;
+//
+//   - raycastPacket(): 4 raios juntos (as 4 rodas de um carro), com os
+//     testes raio-caixa e raio-triângulo feitos nos 4 raios de uma vez com
+//     SSE. Os raios das rodas são quase paralelos e próximos, e percorrem
+//     praticamente os mesmos nós. Em outras arquiteturas é usado o teste
+//     escalar, com o mesmo resultado;
+//
+//   - raycastWheels(): os pacotes de vários carros, divididos entre as
+//     threads de "threadpool.h";
+//
+//   - sweepSphere(): primeiro contato de uma esfera que se move em linha
+//     reta com a face, as arestas ou os vértices dos triângulos.
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glm/vec3.hpp>
+
+#include "mesh.h"
+
+// Triângulo da malha, em coordenadas globais
+struct BVHTriangle
+{
+    glm::vec3 v0, v1, v2;
+};
+
+// Adiciona a "triangles" os triângulos de uma malha (veja "mesh.h")
+void BVH_AppendMesh(const MeshView& mesh, std::vector<BVHTriangle>* triangles);
+
+// Raio origin + t*direction, com t em [0, max_t]. A direção não precisa ser
+// unitária; "t" é medido em unidades de "direction".
+struct BVHRay
+{
+    glm::vec3 origin;
+    glm::vec3 direction;
+    float     max_t;
+};
+
+// Resultado de uma consulta. "triangle" é o índice no vetor passado para
+// BVH::build(), ou -1 se nada foi atingido.
+struct BVHHit
+{
+    float     t;
+    int32_t   triangle;
+    glm::vec3 normal;   // Normal unitária do triângulo, contra o raio ou a esfera
+};
+
+// Nó de 32 bytes. Folha: triângulos [offset, offset + count). Interno:
+// count == 0, e "offset" guarda o índice do filho direito nos 30 bits baixos
+// e o eixo da divisão nos 2 altos (o filho do lado negativo do eixo é
+// visitado primeiro pelos raios que andam no sentido positivo).
+struct BVHNode
+{
+    float    bbox_min[3];
+    uint32_t offset;
+    float    bbox_max[3];
+    uint32_t count;
+};
+
+class BVH
+{
+public:
+    BVH();
+
+    // (Re)constrói a árvore. Uma árvore vazia não atinge nada.
+    void build(const std::vector<BVHTriangle>& triangles);
+
+    bool isEmpty() const { return nodes.empty(); }
+    size_t getNumNodes() const { return nodes.size(); }
+    size_t getNumTriangles() const { return triangle_index.size(); }
+    int getDepth() const { return depth; }
+
+    // Hash dos vértices dos triângulos passados para build(), na ordem em
+    // que foram passados; zero para uma árvore vazia. Identifica a pista nos
+    // replays (veja "replay.h").
+    uint64_t getGeometryHash() const { return geometry_hash; }
+    void getBounds(glm::vec3* bbox_min, glm::vec3* bbox_max) const;
+
+    // Primeiro triângulo atingido pelo raio
+    bool raycast(const BVHRay& ray, BVHHit* hit) const;
+
+    // Os 4 raios de "rays" de uma vez; retorna quantos atingiram algo
+    int raycastPacket(const BVHRay rays[4], BVHHit hits[4]) const;
+
+    // rays[4*i .. 4*i+3] são as rodas do carro i, para i em [0, num_cars).
+    // Retorna o número total de raios que atingiram algo.
+    size_t raycastWheels(const BVHRay* rays, size_t num_cars, BVHHit* hits) const;
+
+    // Esfera de raio "radius" com centro indo de "start" a "end". Em "hit",
+    // "t" é a fração do movimento em [0, 1] no primeiro contato (zero se a
+    // esfera já toca algum triângulo em "start" e se move na direção dele;
+    // encostada, ela pode se afastar ou deslizar). Triângulos com
+    // |normal.y| > max_normal_y são ignorados: com um valor como 0.7, só as
+    // paredes são consideradas, e não o chão em que o carro está apoiado.
+    bool sweepSphere(const glm::vec3& start, const glm::vec3& end, float radius, float max_normal_y, BVHHit* hit) const;
+
+private:
+    uint32_t buildNode(uint32_t begin, uint32_t end, int level);
+
+    std::vector<BVHNode>   nodes;
+    std::vector<float>     tris;           // v0, e1 e e2 (9 floats) na ordem das folhas
+    std::vector<uint32_t>  triangle_index; // Índice original de tris[i]
+    std::vector<glm::vec3> normals;        // Por índice original
+    int                    depth;
+    uint64_t               geometry_hash;
+
+    // Usados somente durante build()
+    std::vector<float>     build_bounds;   // min e max de cada triângulo (6 floats)
+    std::vector<float>     build_centroid; // 3 floats por triângulo
+};
+
+// Tempo de construção, raios por segundo (um a um, em pacotes de 4 rodas e
+// em pacotes divididos entre as threads) e esferas varridas por segundo em
+// uma malha, com a verificação dos raios contra o teste de todos os
+// triângulos
+void BVH_Benchmark(const char* name, const std::vector<BVHTriangle>& triangles);
+
+#endif // _BVH_H
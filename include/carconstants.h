@@ -0,0 +1,51 @@
+#ifndef _CARCONSTANTS_H
+#define _CARCONSTANTS_H
+
+// Constantes da física do carro: valores padrão de CarParams e do preset
+// DefaultCarPreset ("carparams.h"), usados pela classe Car ("car.cpp"), e
+// constantes da simulação em lote de CarPool ("carpool.h").
+
+#define CAR_MASS 1.0f
+
+#define MAX_VEL 50.0f
+#define MIN_VEL 2.0f // Velocidade minima para quando estiver freiando, parar
+#define ACCELERATION 10.0f
+#define ACCELERATION_REVERSE 0.0001f
+#define BRAKE_ACCELERATION 0.005f
+
+#define VELOCITY_DECAY_RATIO 0.01f
+#define SIDE_VELOCITY_DECAY_RATIO 0.05f
+#define TURNING_DECAY_RATIO 5.0f
+
+#define ZERO_VELOCITY_THRESHOLD 0.000006f
+#define ZERO_TURNANGLE_THRESHOLD 0.000066f
+#define ZERO_TURNVEL_THRESHOLD 0.000006f
+
+#define MAX_SIDE_GRIP 0.30f
+#define MIN_CORRELATION_GRIP 0.99f
+#define SLIDING_TURN_COEFICIENT 3.00f
+#define NOT_SLIDING_TURN_COEFICIENT 0.30f
+
+#define TURN_SPEED_COEFICIENT 0.6f
+
+#define ACCELERATE_TYRE_SPEED_COEFICIENT 60.0f
+
+#define SLIDING_DRAG_COEFICIENT 20.0f
+
+// Modelo de pneus ("tyremodel.h"): coeficientes B, C e E das curvas de
+// Pacejka, e pico D de cada uma (aceleração)
+#define TYRE_LATERAL_B 10.0f
+#define TYRE_LATERAL_C 1.5f // Depois do pico cai até ~70%: o carro se recupera da derrapagem
+#define TYRE_LATERAL_E 0.5f // Pico em ~0.23 (13 graus)
+#define TYRE_LATERAL_GRIP 20.0f
+#define TYRE_LATERAL_MAX_SLIP 1.5f // Tangente da deriva no fim da tabela (~56 graus)
+
+#define TYRE_LONGITUDINAL_B 12.0f
+#define TYRE_LONGITUDINAL_C 1.65f
+#define TYRE_LONGITUDINAL_E 0.97f
+#define TYRE_LONGITUDINAL_GRIP 20.0f // Saturada (rodas girando em falso), ~ACCELERATION
+#define TYRE_LONGITUDINAL_MAX_SLIP 2.0f
+
+#define TYRE_MIN_SLIP_SPEED 1.0f
+
+#endif // _CARCONSTANTS_H
@@ -0,0 +1,152 @@
+#ifndef _CARPARAMS_H
+#define _CARPARAMS_H
+
+// Parâmetros de dirigibilidade do carro. Os valores padrão são as
+// constantes de "carconstants.h", e podem ser trocados em tempo de execução,
+// por carro (Car::setParams()), ou lidos de um arquivo de configuração
+// (CarParamsSet::load()).
+//
+// A física de Car ("car.cpp") é um template sobre a origem dos parâmetros:
+//
+//   - RuntimeCarParams lê os valores de um CarParams;
+//   - os presets abaixo (DefaultCarPreset, ...) devolvem constantes
+//     "constexpr", de forma que o compilador gera para eles o mesmo código
+//     que gerava quando os parâmetros eram #defines.
+//
+// Car::setParams() escolhe o kernel especializado sempre que os valores são
+// exatamente os de um preset, e o genérico caso contrário.
+//
+// Formato do arquivo de configuração:
+//
+//   # Valores antes de qualquer seção alteram o preset "default"
+//   max_velocity = 55
+//
+//   [drift]              # altera o preset "drift" (ou cria um novo a partir de "default")
+//   max_side_grip = 0.1
+//
+//   [meu_kart : grip]    # novo preset a partir de "grip"
+//   acceleration = 12
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "carconstants.h"
+
+// Lista dos parâmetros: X(nome, valor padrão)
+#define CAR_PARAMS_FIELDS(X)                                                     \
+    X(mass,                             CAR_MASS)                                \
+    X(max_velocity,                     MAX_VEL)                                 \
+    X(min_velocity,                     MIN_VEL)                                 \
+    X(acceleration,                     ACCELERATION)                            \
+    X(velocity_decay_ratio,             VELOCITY_DECAY_RATIO)                    \
+    X(turning_decay_ratio,              TURNING_DECAY_RATIO)                     \
+    X(zero_turnangle_threshold,         ZERO_TURNANGLE_THRESHOLD)                \
+    X(max_side_grip,                    MAX_SIDE_GRIP)                           \
+    X(min_correlation_grip,             MIN_CORRELATION_GRIP)                    \
+    X(sliding_turn_coeficient,          SLIDING_TURN_COEFICIENT)                 \
+    X(not_sliding_turn_coeficient,      NOT_SLIDING_TURN_COEFICIENT)             \
+    X(turn_speed_coeficient,            TURN_SPEED_COEFICIENT)                   \
+    X(accelerate_tyre_speed_coeficient, ACCELERATE_TYRE_SPEED_COEFICIENT)        \
+    X(sliding_drag_coeficient,          SLIDING_DRAG_COEFICIENT)
+
+struct CarParams
+{
+#define CAR_PARAMS_DECLARE(name, value) float name;
+    CAR_PARAMS_FIELDS(CAR_PARAMS_DECLARE)
+#undef CAR_PARAMS_DECLARE
+};
+
+// Parâmetros lidos de um CarParams, com a mesma interface dos presets
+struct RuntimeCarParams
+{
+    explicit RuntimeCarParams(const CarParams& params) : params(&params) {}
+
+#define CAR_PARAMS_GETTER(name, value) float name() const { return params->name; }
+    CAR_PARAMS_FIELDS(CAR_PARAMS_GETTER)
+#undef CAR_PARAMS_GETTER
+
+    const CarParams* params;
+};
+
+// Presets conhecidos em tempo de compilação. Um preset novo herda de
+// DefaultCarPreset, redefine os valores que mudam, e precisa ser incluído em
+// CarPresetKernel, CarParams_FindKernel() e no "switch" de Car::update().
+struct DefaultCarPreset
+{
+#define CAR_PARAMS_CONSTANT(name, value) static constexpr float name() { return value; }
+    CAR_PARAMS_FIELDS(CAR_PARAMS_CONSTANT)
+#undef CAR_PARAMS_CONSTANT
+};
+
+// Pouca aderência: derrapa com facilidade e gira mais derrapando
+struct DriftCarPreset : DefaultCarPreset
+{
+    static constexpr float max_side_grip() { return 0.12f; }
+    static constexpr float sliding_turn_coeficient() { return 4.0f; }
+    static constexpr float sliding_drag_coeficient() { return 12.0f; }
+};
+
+// Muita aderência: quase não derrapa, e curvas mais fechadas
+struct GripCarPreset : DefaultCarPreset
+{
+    static constexpr float max_side_grip() { return 0.60f; }
+    static constexpr float min_correlation_grip() { return 0.95f; }
+    static constexpr float not_sliding_turn_coeficient() { return 0.36f; }
+};
+
+// Valores de um preset em um CarParams
+template <class Preset>
+CarParams CarParams_FromPreset()
+{
+    CarParams params;
+#define CAR_PARAMS_COPY(name, value) params.name = Preset::name();
+    CAR_PARAMS_FIELDS(CAR_PARAMS_COPY)
+#undef CAR_PARAMS_COPY
+    return params;
+}
+
+// Kernels da física de Car
+enum CarPresetKernel
+{
+    CAR_KERNEL_RUNTIME,
+    CAR_KERNEL_DEFAULT,
+    CAR_KERNEL_DRIFT,
+    CAR_KERNEL_GRIP
+};
+
+// Kernel especializado cujos valores são exatamente "params", ou
+// CAR_KERNEL_RUNTIME se nenhum for
+CarPresetKernel CarParams_FindKernel(const CarParams& params);
+const char* CarParams_KernelName(CarPresetKernel kernel);
+
+CarParams CarParams_Default();
+bool CarParams_Equal(const CarParams& a, const CarParams& b);
+
+// Altera o parâmetro de nome "key" (os nomes de CAR_PARAMS_FIELDS). Retorna
+// false se o nome não existir.
+bool CarParams_Set(CarParams* params, const std::string& key, float value);
+
+// Conjunto de presets por nome. Começa com os presets de compilação
+// ("default", "drift" e "grip").
+class CarParamsSet
+{
+public:
+    CarParamsSet();
+
+    // Lê um arquivo de configuração no formato acima, alterando e criando
+    // presets. Em caso de erro, retorna false e descreve o problema em
+    // "error".
+    bool load(const std::string& filename, std::string* error);
+
+    // NULL se o preset não existir
+    const CarParams* find(const std::string& name) const;
+    void set(const std::string& name, const CarParams& params) { presets[name] = params; }
+
+    std::vector<std::string> getNames() const;
+
+private:
+    std::map<std::string, CarParams> presets;
+};
+
+#endif // _CARPARAMS_H
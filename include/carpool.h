@@ -0,0 +1,111 @@
+#ifndef _CARPOOL_H
+#define _CARPOOL_H
+
+// Simulação em lote de muitos carros (corridas com muitos carros controlados
+// pelo computador, treinamento). Reproduz a física da classe Car
+// ("car.cpp": updatePosition(), updateRotation(), updateVelocity() e
+// updateForwardsVector()), mas com o estado de todos os carros guardado em
+// forma "structure of arrays", o que permite avançar 8 carros de uma vez
+// com AVX2.
+//
+// Como em Car, o movimento é no plano XZ (a velocidade vertical é sempre
+// zero) e somente a rotação em torno do eixo Y muda. As ramificações por
+// carro de Car (derrapando ou não, freando, acelerando) viram seleções com
+// máscaras, e a norma da velocidade é calculada uma única vez em cada etapa
+// do passo em vez de a cada uso.
+//
+// O resultado do kernel AVX2 difere do escalar somente por arredondamentos
+// (a ordem de algumas operações e o seno/cosseno polinomial); o escalar
+// segue Car o mais de perto possível.
+//
+// Com um mapa de alturas ("heightfield.h"), followGround() coloca todos os
+// carros na altura do chão após o passo, com consultas em lote.
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
+class Heightfield;
+
+enum CarPoolBackend
+{
+    CARPOOL_SCALAR,
+    CARPOOL_AVX2
+};
+
+class CarPool
+{
+public:
+    CarPool();
+
+    // Adiciona um carro parado na posição (x, 0, z) e virado para "yaw"
+    // (rotação em torno do eixo Y, em radianos). Retorna seu índice.
+    size_t add(float x, float z, float yaw);
+    void clear();
+    size_t size() const { return num_cars; }
+
+    // Controles do carro, aplicados a cada passo até serem trocados. "steer"
+    // é +1 para a esquerda (Car::turnLeft()), -1 para a direita e 0 para
+    // nenhuma curva.
+    void setControls(size_t car, bool accelerate, bool brake, float steer);
+
+    // Avança todos os carros "dt" segundos com a implementação "backend"
+    void step(float dt) { step(dt, backend); }
+    void step(float dt, CarPoolBackend backend);
+
+    void setBackend(CarPoolBackend value) { backend = value; }
+    CarPoolBackend getBackend() const { return backend; }
+
+    // Altura do chão sob cada carro e a sua normal, divididos entre as
+    // threads. Sem esta chamada, os carros ficam em y = 0.
+    void followGround(const Heightfield& ground);
+
+    glm::vec4 getPosition(size_t car) const { return glm::vec4(position_x[car], position_y[car], position_z[car], 1.0f); }
+    glm::vec3 getGroundNormal(size_t car) const { return glm::vec3(normal_x[car], normal_y[car], normal_z[car]); }
+    glm::vec4 getVelocity(size_t car) const { return glm::vec4(velocity_x[car], 0.0f, velocity_z[car], 0.0f); }
+    float getYaw(size_t car) const { return yaw[car]; }
+    bool isSliding(size_t car) const { return sliding[car] != 0; }
+
+    // Usados pela resposta a colisões (veja "carcollision.h"): move o carro
+    // e soma "dv" à sua velocidade. O impulso faz o carro derrapar, senão o
+    // próximo passo projetaria a velocidade na direção "para frente".
+    void translate(size_t car, float dx, float dz) { position_x[car] += dx; position_z[car] += dz; }
+    void applyImpulse(size_t car, float dvx, float dvz)
+    {
+        velocity_x[car] += dvx;
+        velocity_z[car] += dvz;
+        sliding[car] = 1;
+    }
+
+private:
+    void stepScalar(float dt, size_t begin, size_t end);
+    void stepAVX2(float dt, size_t begin, size_t end);
+
+    CarPoolBackend     backend;
+    size_t             num_cars;
+
+    // Os vetores têm tamanho múltiplo de 8, com carros parados no final
+    std::vector<float>   position_x, position_z;
+    std::vector<float>   position_y;             // Altura do chão (veja followGround())
+    std::vector<float>   normal_x, normal_y, normal_z;
+    std::vector<float>   velocity_x, velocity_z;
+    std::vector<float>   forwards_x, forwards_z; // Vetor "para frente" do carro, calculado no fim do passo
+    std::vector<float>   yaw;
+    std::vector<float>   turn_angle;
+    std::vector<float>   steer;
+    std::vector<uint8_t> accelerate, brake, sliding;
+};
+
+// Melhor implementação suportada pelo processador
+CarPoolBackend CarPool_BestBackend();
+const char* CarPool_BackendName(CarPoolBackend backend);
+
+// Compara o tempo por passo do kernel escalar e do AVX2 com 1 mil, 10 mil e
+// 100 mil carros com controles aleatórios, e a maior diferença de posição
+// entre os dois após "steps" passos.
+void CarPool_Benchmark(int steps);
+
+#endif // _CARPOOL_H
@@ -0,0 +1,121 @@
+#ifndef _CULLING_H
+#define _CULLING_H
+
+// Descarte ("culling") de objetos fora do campo de visão da câmera. Os seis
+// planos do frustum são extraídos diretamente da matriz projection*view
+// (método de Gribb e Hartmann), e cada objeto é representado pela sua
+// axis-aligned bounding box (AABB) transformada para coordenadas globais
+// (método de Arvo: centro transformado pela matriz e meia-extensão pelo
+// valor absoluto da parte 3x3 da matriz).
+//
+// As caixas são guardadas em forma "structure of arrays" e testadas em
+// grupos de 4 (SSE) ou 8 (AVX, se o processador suportar) caixas contra
+// cada plano. Em outras arquiteturas é usado o teste escalar.
+//
+// Uso por quadro:
+//
+//   culler.beginFrame(projection * view);
+//   size_t first = culler.getNumBoxes();
+//   ... culler.add(model, bbox_min, bbox_max) para cada objeto ...
+//   culler.cull(first);
+//   ... culler.isVisible(i) ...
+//
+// Vários grupos podem ser adicionados e testados no mesmo quadro; as
+// estatísticas acumulam até o próximo beginFrame().
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
+// Implementação do teste das caixas
+enum CullingBackend
+{
+    CULLING_SCALAR,
+    CULLING_SSE,
+    CULLING_AVX
+};
+
+// Contagem de objetos testados, descartados e enviados para desenho
+struct CullingStats
+{
+    size_t tested;
+    size_t culled;
+    size_t submitted;
+};
+
+// Planos do frustum na forma (a,b,c,d): um ponto p está do lado de dentro de
+// um plano se a*p.x + b*p.y + c*p.z + d >= 0. Ordem: esquerdo, direito,
+// inferior, superior, próximo e distante.
+struct Frustum
+{
+    glm::vec4 planes[6];
+};
+
+// Extrai os planos do frustum da matriz que leva coordenadas globais para
+// coordenadas de recorte ("clip space"), isto é, projection*view. Funciona
+// com Matrix_Perspective() e com Matrix_Orthographic().
+void Culling_ExtractFrustum(const glm::mat4& projection_view, Frustum* frustum);
+
+// Transforma uma AABB em coordenadas do modelo para uma AABB em coordenadas
+// globais, dada pelo centro e pela meia-extensão em cada eixo.
+void Culling_TransformBox(const glm::mat4& model, const glm::vec3& bbox_min, const glm::vec3& bbox_max,
+                          glm::vec3* center, glm::vec3* extent);
+
+// Testa as caixas [begin, end) dos vetores (centro e meia-extensão em cada
+// eixo) contra o frustum e escreve 1 em visible[i] se a caixa i estiver
+// (ao menos em parte) dentro dele, ou 0 caso contrário. Retorna o número de
+// caixas visíveis. Os vetores devem ter 7 elementos de preenchimento após
+// "end", pois os testes SIMD leem grupos completos de 4 ou 8 caixas.
+size_t Culling_TestBoxes(CullingBackend backend, const Frustum& frustum,
+                         const float* center_x, const float* center_y, const float* center_z,
+                         const float* extent_x, const float* extent_y, const float* extent_z,
+                         size_t begin, size_t end, uint8_t* visible);
+
+// Melhor implementação suportada pelo processador
+CullingBackend Culling_BestBackend();
+const char* Culling_BackendName(CullingBackend backend);
+
+class BoxCuller
+{
+public:
+    BoxCuller();
+
+    // Começa um novo quadro: descarta as caixas e as estatísticas
+    void beginFrame(const glm::mat4& projection_view);
+
+    // Adiciona a caixa de um objeto e retorna seu índice
+    size_t add(const glm::mat4& model, const glm::vec3& bbox_min, const glm::vec3& bbox_max);
+
+    // Testa as caixas adicionadas a partir do índice "first"
+    void cull(size_t first);
+
+    bool isVisible(size_t index) const { return visible[index] != 0; }
+    size_t getNumBoxes() const { return num_boxes; }
+
+    // Estatísticas acumuladas desde o último beginFrame()
+    const CullingStats& getStats() const { return stats; }
+
+    // Desliga o descarte (todas as caixas são consideradas visíveis)
+    void setEnabled(bool value) { enabled = value; }
+    bool isEnabled() const { return enabled; }
+
+private:
+    Frustum              frustum;
+    CullingBackend       backend;
+    bool                 enabled;
+    size_t               num_boxes;
+    std::vector<float>   center_x, center_y, center_z;
+    std::vector<float>   extent_x, extent_y, extent_z;
+    std::vector<uint8_t> visible;
+    CullingStats         stats;
+};
+
+// Compara as implementações do teste em "num_boxes" caixas aleatórias,
+// verificando que todas dão o mesmo resultado.
+void Culling_Benchmark(size_t num_boxes, int repetitions);
+
+#endif // _CULLING_H
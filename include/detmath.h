@@ -0,0 +1,58 @@
+#ifndef _DETMATH_H
+#define _DETMATH_H
+
+// Funções matemáticas com resultado idêntico, bit a bit, em qualquer
+// máquina, para o modo determinístico da física (Car::setDeterministic()).
+//
+// Somas, produtos, divisões e raízes quadradas de floats são corretamente
+// arredondados pelo padrão IEEE 754, e dão o mesmo resultado em qualquer
+// processador, desde que:
+//
+//   - os cálculos sejam feitos em precisão simples (SSE, e não a pilha x87
+//     com precisão estendida: FLT_EVAL_METHOD == 0);
+//   - o compilador não junte produto e soma em FMA (-ffp-contract=off,
+//     usado pelo CMakeLists.txt e pelos Makefiles: sem ele o GCC usa FMA
+//     com -march=native, e o Clang sempre que o processador tem FMA) nem
+//     reordene operações (-ffast-math);
+//   - o arredondamento seja para o mais próximo e os denormais não sejam
+//     zerados (veja DetMath_ResetFloatingPoint()).
+//
+// Por isso norm(), normalize() e os produtos de matrizes não precisam ser
+// substituídos. Já seno, cosseno, arco tangente etc. da biblioteca C mudam
+// entre versões da biblioteca e sistemas operacionais; as funções abaixo os
+// substituem por polinômios (os de "sinf", "cosf" e "atanf" da biblioteca
+// Cephes) calculados só com essas operações, em uma ordem fixa. O erro é da
+// ordem de 1e-7, como o das funções da biblioteca.
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__FAST_MATH__)
+#error "O modo determinístico não funciona com -ffast-math"
+#endif
+
+// Seno e cosseno de "x" em radianos
+void DetMath_SinCos(float x, float* sin_x, float* cos_x);
+float DetMath_Sin(float x);
+float DetMath_Cos(float x);
+
+// Arco tangente, em [-pi/2, pi/2], e arco tangente de y/x no quadrante de
+// (x, y), em [-pi, pi], como std::atan2()
+float DetMath_Atan(float x);
+float DetMath_Atan2(float y, float x);
+
+// Arco cosseno em [0, pi]; "x" é limitado a [-1, 1]
+float DetMath_Acos(float x);
+
+// Arredondamento para o mais próximo e denormais preservados (sem "flush to
+// zero" nem "denormals are zero", que algumas bibliotecas de áudio e
+// drivers ligam). O estado é de cada thread: deve ser chamada na thread que
+// executa a simulação. Retorna false se o estado precisou ser corrigido.
+bool DetMath_ResetFloatingPoint();
+
+// Hash FNV-1a de 64 bits dos bits de "count" floats, em little-endian em
+// qualquer máquina. Começa com DETMATH_HASH_SEED.
+#define DETMATH_HASH_SEED 14695981039346656037ULL
+uint64_t DetMath_HashFloats(uint64_t hash, const float* values, size_t count);
+
+#endif // _DETMATH_H
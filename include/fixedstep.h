@@ -0,0 +1,69 @@
+#ifndef _FIXEDSTEP_H
+#define _FIXEDSTEP_H
+
+// Escalonador de passo fixo para a simulação. A física é integrada sempre
+// com o mesmo intervalo de tempo (por exemplo 1/240 s), independentemente da
+// taxa de quadros: o tempo de cada quadro é acumulado, e a cada quadro são
+// executados tantos passos quanto couberem no tempo acumulado. O que sobra
+// (uma fração de passo) é usado para interpolar o desenho entre os dois
+// últimos estados da simulação.
+//
+// Uso por quadro:
+//
+//   int steps = scheduler.advance(frame_delta);
+//   for (int i = 0; i < steps; ++i)
+//       ... simula scheduler.getStepSeconds() segundos ...
+//   ... desenha com interpolação scheduler.getAlpha() ...
+//
+// O número de passos por quadro é limitado (setMaxSubsteps()): se um quadro
+// demorar demais, o tempo excedente é descartado e a simulação fica mais
+// lenta que o relógio, em vez de gastar cada vez mais tempo simulando.
+//
+// Os tempos são inteiros em nanossegundos (veja "timebase.h"), então o
+// acumulador não perde precisão com o tempo de execução.
+
+#include "timebase.h"
+
+class FixedStepScheduler
+{
+public:
+    // "step" é a duração de um passo da simulação, e "max_substeps" o maior
+    // número de passos executados em um quadro
+    FixedStepScheduler(TimeNs step, int max_substeps);
+
+    // Acumula o tempo do quadro e retorna quantos passos devem ser
+    // executados
+    int advance(TimeNs frame_delta);
+
+    // Fração de passo acumulada após advance(), em [0,1): peso do estado
+    // mais recente na interpolação entre os dois últimos estados
+    float getAlpha() const { return (float)((double)accumulator / step); }
+
+    // Tempo acumulado que ainda não completou um passo
+    TimeNs getAccumulated() const { return accumulator; }
+
+    TimeNs getStep() const { return step; }
+    double getStepSeconds() const { return Time_ToSeconds(step); }
+    void setStep(TimeNs value);
+
+    int getMaxSubsteps() const { return max_substeps; }
+    void setMaxSubsteps(int value) { max_substeps = value > 0 ? value : 1; }
+
+    // Tempo total descartado pelo limite de passos por quadro
+    TimeNs getDroppedTime() const { return dropped_time; }
+
+private:
+    TimeNs step;
+    int    max_substeps;
+    TimeNs accumulator;
+    TimeNs dropped_time;
+};
+
+// Verifica FixedStepScheduler e TimeBase com um FakeClock: número de passos
+// e getAlpha() por quadro, o limite de passos e o tempo descartado, a
+// fração mantida por setStep(), e que o tempo do relógio é sempre igual ao
+// simulado mais o descartado mais o acumulado, em uma sequência de quadros
+// irregulares. Imprime cada verificação e retorna false se alguma falhou.
+bool FixedStep_Check();
+
+#endif // _FIXEDSTEP_H
@@ -0,0 +1,131 @@
+#ifndef _GEOMETRYARENA_H
+#define _GEOMETRYARENA_H
+
+// "Arena" de geometria: um único VAO, com um buffer de vértices e um buffer de
+// índices grandes, onde as malhas de todos os modelos estáticos são
+// sub-alocadas. Cada objeto guarda somente o seu "base vertex" e a posição
+// dos seus índices, de forma que todos os objetos de uma arena são
+// desenhados com o mesmo VAO (uma única troca de VAO por quadro).
+//
+// O espaço livre de cada buffer é controlado por uma lista de blocos livres
+// ordenada por posição ("first fit"), e blocos vizinhos são unificados ao
+// serem liberados. Assim, malhas podem ser descarregadas e recarregadas sem
+// fragmentar a arena. Se não houver espaço, o buffer cresce (o conteúdo é
+// copiado na própria GPU com glCopyBufferSubData()).
+//
+// Cada arena tem ainda um segundo VAO, com os mesmos buffers, para o desenho
+// instanciado: os atributos de instância deste VAO são reapontados a cada
+// grupo de instâncias (veja "instancing.h") sem alterar o VAO principal.
+
+#include <cstddef>
+#include <map>
+
+#include <glad/glad.h>
+
+// Formato dos vértices guardados em uma arena. Todos os vértices de uma
+// arena têm o mesmo formato, pois compartilham o mesmo VAO.
+enum GeometryLayout
+{
+    GEOMETRY_LAYOUT_FLOAT,  // FloatVertex (32 bytes)
+    GEOMETRY_LAYOUT_COMPACT // CompactVertex de "vertexformat.h" (16 bytes)
+};
+
+// Vértice intercalado do formato com floats. A coordenada W da posição (1.0)
+// e da normal (0.0) não é armazenada; veja "shader_vertex.glsl".
+struct FloatVertex
+{
+    float position[3];
+    float normal[3];
+    float texcoord[2];
+};
+
+// Controle do espaço livre de um buffer de "capacity" unidades.
+class RangeAllocator
+{
+public:
+    RangeAllocator();
+
+    void reset(size_t capacity);
+
+    // Reserva "size" unidades consecutivas. Retorna false se não houver um
+    // bloco livre grande o suficiente.
+    bool allocate(size_t size, size_t* offset);
+
+    // Libera um bloco previamente reservado com allocate()
+    void release(size_t offset, size_t size);
+
+    // Aumenta a capacidade; o espaço novo fica livre no final
+    void grow(size_t new_capacity);
+
+    size_t getCapacity() const { return capacity; }
+    size_t getUsed() const { return used; }
+    size_t getNumFreeBlocks() const { return free_blocks.size(); }
+    size_t getLargestFreeBlock() const;
+
+private:
+    void insertFreeBlock(size_t offset, size_t size);
+
+    std::map<size_t, size_t> free_blocks; // Posição -> tamanho de cada bloco livre
+    size_t capacity;
+    size_t used;
+};
+
+// Espaço reservado para uma malha dentro de uma arena
+struct GeometryAllocation
+{
+    size_t first_vertex; // Primeiro vértice (em vértices) dentro do buffer de vértices
+    size_t num_vertices;
+    size_t index_offset; // Posição (em bytes) dos índices dentro do buffer de índices
+    size_t index_bytes;
+};
+
+class GeometryArena
+{
+public:
+    GeometryArena();
+
+    // Cria o VAO e os buffers. Precisa de um contexto OpenGL.
+    void init(GeometryLayout layout, size_t vertex_capacity, size_t index_capacity_bytes);
+    bool isInitialized() const { return vertex_array_object_id != 0; }
+
+    GeometryLayout getLayout() const { return layout; }
+    size_t getVertexSize() const;
+
+    // Reserva espaço para uma malha e envia seus dados para a GPU. Os
+    // índices devem ser relativos ao início da malha (somados a
+    // GeometryAllocation::first_vertex como "base vertex" no desenho).
+    GeometryAllocation add(const void* vertices, size_t num_vertices, const void* indices, size_t index_bytes);
+
+    // Libera o espaço de uma malha adicionada com add()
+    void remove(const GeometryAllocation& allocation);
+
+    // "Liga" o VAO da arena
+    void bind() const { glBindVertexArray(vertex_array_object_id); }
+
+    // "Liga" o VAO usado no desenho instanciado
+    void bindInstanced() const { glBindVertexArray(instanced_vertex_array_object_id); }
+
+    // Imprime ocupação e fragmentação dos buffers
+    void printStats(const char* name) const;
+
+private:
+    GeometryArena(const GeometryArena&);
+    GeometryArena& operator=(const GeometryArena&);
+
+    void setupVertexArrays();
+    void growBuffer(GLuint* buffer_id, size_t old_bytes, size_t new_bytes);
+
+    GeometryLayout layout;
+    GLuint         vertex_array_object_id;
+    GLuint         instanced_vertex_array_object_id;
+    GLuint         vertex_buffer_id;
+    GLuint         index_buffer_id;
+    RangeAllocator vertices;    // Em vértices
+    RangeAllocator index_bytes; // Em bytes, sempre múltiplos de 4
+};
+
+// Benchmark sem OpenGL do controle de espaço livre: simula muitos ciclos de
+// descarga e recarga de malhas de tamanhos variados e imprime a fragmentação.
+void GeometryArena_BenchmarkAllocator(int cycles);
+
+#endif // _GEOMETRYARENA_H
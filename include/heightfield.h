@@ -0,0 +1,104 @@
+#ifndef _HEIGHTFIELD_H
+#define _HEIGHTFIELD_H
+
+// Chão da pista como um mapa de alturas: uma grade regular no plano XZ com
+// a altura do chão em cada ponto. Em pistas abertas quase toda consulta de
+// colisão é "altura e normal sob esta roda", e a grade responde com quatro
+// leituras e uma interpolação bilinear, sem percorrer a BVH de triângulos
+// (veja "bvh.h").
+//
+// As alturas ficam em blocos ("tiles") de 4x4 amostras, 64 bytes, uma linha
+// de cache: as quatro amostras de uma consulta estão quase sempre no mesmo
+// tile. Os tiles de cada região de 16x16 tiles (64x64 amostras, 16 KB) são
+// guardados na ordem de Morton (bits de X e Z intercalados), de modo que
+// tiles próximos no plano ficam próximos na memória em qualquer direção; as
+// regiões ficam em ordem de linhas. Como a ordem de Morton separa os bits de
+// X e de Z, o endereço de uma amostra é a soma de uma parte que só depende
+// de X e outra que só depende de Z.
+//
+// Consultas em lote (sampleBatch()) processam 4 (SSE) ou 8 (AVX2, com
+// "gather") posições de uma vez, com as operações na mesma ordem do código
+// escalar: todas as implementações dão o mesmo resultado.
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glm/vec3.hpp>
+
+#include "bvh.h"
+
+enum HeightfieldBackend
+{
+    HEIGHTFIELD_SCALAR,
+    HEIGHTFIELD_SSE,
+    HEIGHTFIELD_AVX2
+};
+
+class Heightfield
+{
+public:
+    Heightfield();
+
+    // Define as alturas a partir de uma grade em ordem de linhas:
+    // heights[j*width + i] é a altura no ponto (origin_x + i*cell_size,
+    // origin_z + j*cell_size). A grade precisa ter ao menos 2x2 amostras.
+    void setHeights(size_t width, size_t depth, float origin_x, float origin_z, float cell_size, const float* heights);
+
+    // Rasteriza os triângulos no plano XZ com amostras a cada "cell_size":
+    // cada amostra fica com a altura do triângulo mais alto sobre ela, e as
+    // amostras sem nenhum triângulo com a menor altura da malha. Triângulos
+    // verticais (paredes) não contribuem.
+    void bake(const std::vector<BVHTriangle>& triangles, float cell_size);
+
+    void clear();
+    bool isEmpty() const { return width == 0; }
+    size_t getWidth() const { return width; }
+    size_t getDepth() const { return depth; }
+    float getCellSize() const { return cell_size; }
+    float getSample(size_t i, size_t j) const { return data()[offsetX(i) + offsetZ(j)]; }
+
+    // Altura e normal (unitária, para cima) do chão em (x, z), interpolando
+    // as quatro amostras em volta. Fora da grade, vale a borda mais próxima.
+    void sample(float x, float z, float* height, glm::vec3* normal) const;
+
+    // "count" consultas em forma "structure of arrays". Os vetores de saída
+    // podem ser NULL se o valor não for necessário.
+    void sampleBatch(const float* x, const float* z, size_t count,
+                     float* height, float* normal_x, float* normal_y, float* normal_z) const
+    {
+        sampleBatch(backend, x, z, count, height, normal_x, normal_y, normal_z);
+    }
+    void sampleBatch(HeightfieldBackend backend, const float* x, const float* z, size_t count,
+                     float* height, float* normal_x, float* normal_y, float* normal_z) const;
+
+    void setBackend(HeightfieldBackend value) { backend = value; }
+    HeightfieldBackend getBackend() const { return backend; }
+
+    // Deslocamento de uma amostra no vetor de tiles: offsetX(i) + offsetZ(j)
+    uint32_t offsetX(size_t i) const;
+    uint32_t offsetZ(size_t j) const;
+
+private:
+    const float* data() const { return &storage[aligned]; }
+
+    HeightfieldBackend backend;
+    size_t             width, depth;
+    size_t             regions_x;   // Regiões de 64x64 amostras por linha
+    float              origin_x, origin_z;
+    float              cell_size, inv_cell_size;
+    std::vector<float> storage;
+    size_t             aligned;     // Início do primeiro tile em "storage", alinhado a 64 bytes
+};
+
+// Melhor implementação suportada pelo processador
+HeightfieldBackend Heightfield_BestBackend();
+const char* Heightfield_BackendName(HeightfieldBackend backend);
+
+// Tempo por consulta com cada implementação em um terreno de "size" x
+// "size" amostras, para 1 mil, 10 mil e 100 mil posições aleatórias, e o
+// mesmo teste com as alturas em ordem de linhas (sem tiles), verificando
+// que todas dão o mesmo resultado
+void Heightfield_Benchmark(size_t size, int repetitions);
+
+#endif // _HEIGHTFIELD_H
@@ -0,0 +1,74 @@
+#ifndef _INPUTSCRIPT_H
+#define _INPUTSCRIPT_H
+
+// Sequência de comandos do carro, um por passo da simulação: as teclas que
+// o jogador segurava em cada passo. Usada para gravar partidas no jogo
+// (opção --record-input) e para reproduzi-las sem janela nem OpenGL no
+// simulador "car_sim" (veja "carsim.cpp").
+//
+// Formato de arquivo (texto, uma execução de passos por linha):
+//
+//   # comentário
+//   hz 240
+//   480 A      (480 passos acelerando)
+//   120 AL     (acelerando e virando para a esquerda)
+//   60 -       (nenhuma tecla)
+//
+// As teclas são A (acelerar), B (freio), L (esquerda), R (direita) e V (ré).
+// A linha "hz" é opcional e indica a frequência dos passos em que o script
+// foi gravado.
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#define INPUT_ACCELERATE 0x01
+#define INPUT_BRAKE      0x02
+#define INPUT_LEFT       0x04
+#define INPUT_RIGHT      0x08
+#define INPUT_REVERSE    0x10
+
+class InputScript
+{
+public:
+    InputScript() : hz(0) {}
+
+    // Adiciona "count" passos com as teclas "flags" (INPUT_*)
+    void append(uint8_t flags, size_t count = 1);
+    void clear() { steps.clear(); }
+
+    size_t getNumSteps() const { return steps.size(); }
+    uint8_t getFlags(size_t step) const { return steps[step]; }
+
+    // Frequência dos passos em que o script foi gravado; zero se não
+    // informada
+    int getHz() const { return hz; }
+    void setHz(int value) { hz = value; }
+
+    const std::string& getName() const { return name; }
+    void setName(const std::string& value) { name = value; }
+
+    // Lê um script no formato acima. Em caso de erro, retorna false e
+    // descreve o problema em "error".
+    bool load(const std::string& filename, std::string* error);
+
+    // Grava o script no formato acima, agrupando passos iguais
+    bool save(const std::string& filename) const;
+
+private:
+    std::string          name;
+    int                  hz;
+    std::vector<uint8_t> steps;
+};
+
+// Scripts predefinidos, para testes sem arquivos: "straight" (acelera em
+// linha reta e freia), "slalom" (curvas alternadas acelerando), "circle"
+// (curva contínua para a esquerda) e "handbrake" (curva com freio, que faz o
+// carro derrapar), todos a 240 Hz. Retorna false se o nome não existir.
+bool InputScript_BuiltIn(const std::string& name, InputScript* script);
+
+// Nomes aceitos por InputScript_BuiltIn(), separados por vírgulas
+const char* InputScript_BuiltInNames();
+
+#endif // _INPUTSCRIPT_H
@@ -0,0 +1,86 @@
+#ifndef _INSTANCING_H
+#define _INSTANCING_H
+
+// Desenho instanciado ("instancing") de objetos repetidos na cena, como as
+// partes de vários carros. Durante o quadro, cada cópia de um objeto é
+// adicionada com a sua matriz de modelagem e o seu "object id"; no final,
+// as instâncias de todos os objetos são enviadas para a GPU em um único
+// buffer e cada objeto é desenhado uma única vez com
+// glDrawElementsInstancedBaseVertex(), independentemente do número de
+// cópias.
+//
+// As instâncias de um mesmo objeto ficam consecutivas no buffer. Como o
+// OpenGL 3.3 não tem "base instance", os atributos de instância são
+// apontados para o início do grupo de cada objeto (veja bindAttributes()).
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glad/glad.h>
+#include <glm/mat4x4.hpp>
+
+#include "sceneregistry.h"
+
+// Localizações dos atributos de instância em "shader_vertex.glsl". Uma mat4
+// ocupa quatro localizações consecutivas (uma por coluna), e uma mat3 três.
+#define INSTANCE_MODEL_LOCATION         3
+#define INSTANCE_OBJECT_ID_LOCATION     7
+#define INSTANCE_NORMAL_MATRIX_LOCATION 8
+
+// Dados de uma instância, na ordem em que estão no buffer
+struct InstanceData
+{
+    float   model[16];        // Matriz de modelagem (colunas consecutivas, como em glm)
+    int32_t object_id;        // Identificador do objeto usado em "shader_fragment.glsl"
+    float   normal_matrix[9]; // Inversa transposta da parte 3x3 de "model", calculada na CPU
+};
+
+// Grupo de instâncias consecutivas de um mesmo objeto
+struct InstanceBatch
+{
+    SceneHandle handle;
+    size_t      first_instance;
+    size_t      num_instances;
+};
+
+class InstanceBatcher
+{
+public:
+    InstanceBatcher();
+
+    // Cria o buffer de instâncias. Precisa de um contexto OpenGL.
+    void init();
+
+    // Descarta as instâncias do quadro anterior
+    void clear();
+
+    // Adiciona uma cópia do objeto "handle"
+    void add(SceneHandle handle, const glm::mat4& model, int32_t object_id);
+
+    // Agrupa as instâncias por objeto e as envia para a GPU. O buffer é
+    // realocado ("orphaned") a cada quadro, para não esperar a GPU terminar
+    // de usar os dados do quadro anterior.
+    void upload();
+
+    // Grupos criados pelo último upload(), na ordem em que cada objeto foi
+    // adicionado pela primeira vez
+    size_t getNumBatches() const { return batches.size(); }
+    const InstanceBatch& getBatch(size_t i) const { return batches[i]; }
+    size_t getNumInstances() const { return num_instances; }
+
+    // Aponta os atributos de instância do VAO ligado no momento para o
+    // grupo "batch"
+    void bindAttributes(const InstanceBatch& batch) const;
+
+private:
+    GLuint                                   buffer_id;
+    size_t                                   buffer_capacity; // Em instâncias
+    std::vector<std::vector<InstanceData> >  instances;       // Indexado pelo handle
+    std::vector<SceneHandle>                 used_handles;    // Objetos com instâncias, na ordem de adição
+    std::vector<InstanceData>                staging;         // Instâncias agrupadas, enviadas em upload()
+    std::vector<InstanceBatch>               batches;
+    size_t                                   num_instances;
+};
+
+#endif // _INSTANCING_H
@@ -0,0 +1,51 @@
+#ifndef _MAPPEDFILE_H
+#define _MAPPEDFILE_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Informações básicas de um arquivo no disco, utilizadas para validar caches
+// derivados deste arquivo (veja "meshcache.h").
+struct FileInfo
+{
+    uint64_t size;  // Tamanho em bytes
+    int64_t  mtime; // Data da última modificação (segundos desde a época Unix)
+};
+
+// Preenche "info" com tamanho e data de modificação do arquivo. Retorna false
+// caso o arquivo não exista.
+bool GetFileInfo(const char* filename, FileInfo* info);
+
+// Arquivo mapeado em memória, somente para leitura. O conteúdo do arquivo
+// fica acessível através de getData() sem nenhuma cópia: o sistema operacional
+// carrega as páginas sob demanda.
+class MappedFile
+{
+public:
+    MappedFile();
+    ~MappedFile();
+
+    // Mapeia o arquivo inteiro. Retorna false em caso de erro.
+    bool open(const char* filename);
+    void close();
+
+    bool isOpen() const { return data != NULL; }
+    const unsigned char* getData() const { return data; }
+    size_t getSize() const { return size; }
+
+private:
+    // Não permitimos cópias, pois o destrutor desfaz o mapeamento
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+
+    const unsigned char* data;
+    size_t size;
+#ifdef _WIN32
+    void* file_handle;
+    void* mapping_handle;
+#else
+    int fd;
+#endif
+};
+
+#endif // _MAPPEDFILE_H
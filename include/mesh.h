@@ -0,0 +1,70 @@
+#ifndef _MESH_H
+#define _MESH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <glm/vec3.hpp>
+
+// Informações de um objeto (shape) dentro de uma malha pronta para a GPU.
+// Estas informações são copiadas para SceneObject quando a malha é enviada
+// para a placa de vídeo (veja AddMeshToVirtualScene() em "main.cpp").
+struct MeshShape
+{
+    std::string  name;         // Nome do objeto
+    size_t       first_index;  // Índice do primeiro vértice dentro do vetor de índices
+    size_t       num_indices;  // Número de índices do objeto
+    size_t       first_vertex; // Primeiro vértice do objeto (os vértices de cada objeto são contíguos)
+    size_t       num_vertices; // Número de vértices do objeto
+    glm::vec3    bbox_min;     // Axis-Aligned Bounding Box do objeto
+    glm::vec3    bbox_max;
+};
+
+// Malha de triângulos pronta para ser enviada para a GPU, construída por
+// BuildTriangles() a partir de um ObjModel. Os vetores abaixo são exatamente
+// os buffers enviados para a placa de vídeo.
+struct MeshData
+{
+    std::vector<float>     model_coefficients;   // Posições (X,Y,Z,W) de cada vértice
+    std::vector<float>     normal_coefficients;  // Normais (X,Y,Z,W) de cada vértice (pode ser vazio)
+    std::vector<float>     texture_coefficients; // Coordenadas de textura (U,V) de cada vértice (pode ser vazio)
+    std::vector<uint32_t>  indices;
+    std::vector<MeshShape> shapes;
+};
+
+// "Visão" somente leitura de uma malha pronta para a GPU. Os ponteiros podem
+// apontar para os vetores de um MeshData ou diretamente para um arquivo de
+// cache mapeado em memória (veja "meshcache.h"), evitando cópias.
+struct MeshView
+{
+    const float*    model_coefficients;
+    size_t          num_model_coefficients;
+    const float*    normal_coefficients;
+    size_t          num_normal_coefficients;
+    const float*    texture_coefficients;
+    size_t          num_texture_coefficients;
+    const uint32_t* indices;
+    size_t          num_indices;
+    std::vector<MeshShape> shapes;
+};
+
+// Cria uma MeshView que aponta para os vetores de "data". A visão só é válida
+// enquanto "data" existir e não for modificado.
+inline MeshView MeshView_FromData(const MeshData& data)
+{
+    MeshView view;
+    view.model_coefficients       = data.model_coefficients.data();
+    view.num_model_coefficients   = data.model_coefficients.size();
+    view.normal_coefficients      = data.normal_coefficients.data();
+    view.num_normal_coefficients  = data.normal_coefficients.size();
+    view.texture_coefficients     = data.texture_coefficients.data();
+    view.num_texture_coefficients = data.texture_coefficients.size();
+    view.indices                  = data.indices.data();
+    view.num_indices              = data.indices.size();
+    view.shapes                   = data.shapes;
+    return view;
+}
+
+#endif // _MESH_H
@@ -0,0 +1,47 @@
+#ifndef _MESHCACHE_H
+#define _MESHCACHE_H
+
+// Cache binário de malhas. Na primeira execução ("cache frio") o arquivo OBJ
+// é lido com a tinyobjloader, as normais são computadas e os triângulos são
+// montados; o resultado final (buffers prontos para a GPU + informações de
+// cada objeto) é gravado em um arquivo "<modelo>.obj.meshcache". Nas execuções
+// seguintes ("cache quente") este arquivo é mapeado em memória e enviado
+// diretamente para a GPU, sem nenhum parsing.
+//
+// O cache é identificado pelo caminho do arquivo fonte, sua data de
+// modificação, seu tamanho e um hash do seu conteúdo. Qualquer diferença (ou
+// uma mudança de MESHCACHE_VERSION) invalida o cache, que é então refeito.
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "mesh.h"
+#include "mappedfile.h"
+
+// Incremente sempre que o formato do arquivo ou o processamento feito em
+// BuildTriangles() mudar, invalidando todos os caches existentes.
+#define MESHCACHE_VERSION 2
+
+// Opções de processamento que também fazem parte da chave do cache.
+#define MESHCACHE_FLAG_COMPUTED_NORMALS 0x1
+#define MESHCACHE_FLAG_PARALLEL_PARSER  0x2 // Polígonos com mais de 4 vértices são triangulados de outra forma
+
+// Caminho do arquivo de cache correspondente a um arquivo fonte.
+std::string MeshCache_PathFor(const char* source_filename);
+
+// Tenta carregar o cache de "source_filename". Em caso de sucesso, "file"
+// guarda o mapeamento do cache e "view" aponta para dentro dele (portanto
+// "view" só é válida enquanto "file" estiver aberto). Retorna false se o cache
+// não existir ou estiver desatualizado.
+bool MeshCache_Load(const char* source_filename, uint32_t flags, MappedFile* file, MeshView* view);
+
+// Grava "data" como cache de "source_filename". Retorna false em caso de erro
+// (por exemplo, diretório sem permissão de escrita); neste caso o programa
+// continua funcionando normalmente, apenas sem cache.
+bool MeshCache_Store(const char* source_filename, uint32_t flags, const MeshData& data);
+
+// Hash de 64 bits do conteúdo de um bloco de memória.
+uint64_t MeshCache_Hash(const void* data, size_t size);
+
+#endif // _MESHCACHE_H
@@ -0,0 +1,52 @@
+#ifndef _MESHOPTIMIZER_H
+#define _MESHOPTIMIZER_H
+
+// Otimizações de malhas de triângulos feitas antes do envio para a GPU:
+//
+//   1. "Welding": vértices idênticos (mesma posição, normal e coordenada de
+//      textura) dentro de um mesmo objeto são unificados, e o vetor de índices
+//      passa a referenciar vértices compartilhados.
+//   2. Reordenação dos triângulos para aproveitar a cache de vértices
+//      transformados da GPU (algoritmo de Tom Forsyth, "Linear-Speed Vertex
+//      Cache Optimisation").
+//   3. Reordenação dos vértices na ordem em que são usados pelos triângulos,
+//      melhorando a localidade dos acessos à memória ("vertex fetch").
+//
+// A qualidade da ordem dos triângulos é medida pelo ACMR ("average cache miss
+// ratio"): o número médio de vértices transformados por triângulo. O pior caso
+// é 3.0 (nenhum vértice reaproveitado), e malhas regulares bem ordenadas ficam
+// próximas de 0.5-0.7.
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "mesh.h"
+
+// Tamanho da cache FIFO simulada por MeshOptimizer_ACMR()
+#define MESHOPTIMIZER_ACMR_CACHE_SIZE 16
+
+// Estatísticas de um objeto (MeshShape) antes e depois da otimização
+struct MeshOptimizerStats
+{
+    size_t vertices_before;
+    size_t vertices_after;
+    float  acmr_before;
+    float  acmr_after;
+};
+
+// Otimiza "mesh" (passos 1 a 3 acima), objeto por objeto. Após a otimização
+// os vértices de cada objeto ocupam o intervalo contíguo [first_vertex,
+// first_vertex + num_vertices) dos buffers. Se "stats" não for NULL, recebe as
+// estatísticas de cada objeto (na mesma ordem de mesh->shapes).
+void MeshOptimizer_Optimize(MeshData* mesh, std::vector<MeshOptimizerStats>* stats);
+
+// Reordena os triângulos de "indices" (valores em [0, num_vertices)) para
+// aproveitar a cache de vértices da GPU.
+void MeshOptimizer_OptimizeVertexCache(uint32_t* indices, size_t num_indices, size_t num_vertices);
+
+// ACMR de uma lista de triângulos, simulando uma cache FIFO com "cache_size"
+// vértices.
+float MeshOptimizer_ACMR(const uint32_t* indices, size_t num_indices, unsigned int cache_size = MESHOPTIMIZER_ACMR_CACHE_SIZE);
+
+#endif // _MESHOPTIMIZER_H
@@ -0,0 +1,45 @@
+#ifndef _OBJPARSER_H
+#define _OBJPARSER_H
+
+// Leitor de arquivos OBJ alternativo à tinyobj::LoadObj(), para modelos
+// grandes. O arquivo é mapeado em memória, dividido em blocos (sempre em
+// fronteiras de linha) que são lidos em paralelo pelo thread pool, e os
+// resultados de cada bloco são concatenados nas mesmas estruturas
+// tinyobj::attrib_t e tinyobj::shape_t produzidas pela tinyobjloader, de forma
+// que ComputeNormals() e BuildTriangles() funcionam sem modificações.
+//
+// São suportados os comandos v, vn, vt, f, g, o e s. Diferenças em relação à
+// tinyobjloader:
+//   - materiais (mtllib/usemtl) são ignorados: material_ids é sempre -1;
+//   - cores de vértices e os comandos l, p, t e vw são ignorados;
+//   - quadriláteros são divididos pela menor diagonal (igual à tinyobj), mas
+//     polígonos com mais de 4 vértices são triangulados em leque.
+
+#include <string>
+#include <vector>
+
+#include <tiny_obj_loader.h>
+
+// Implementação utilizada para ler arquivos ".obj"
+enum ObjParserBackend
+{
+    OBJPARSER_TINYOBJ,  // tinyobj::LoadObj(), sequencial
+    OBJPARSER_PARALLEL  // ObjParser_LoadParallel(), paralelo
+};
+
+// Converte o nome de um backend ("tinyobj" ou "parallel"). Retorna false se
+// o nome for desconhecido.
+bool ObjParser_BackendFromName(const std::string& name, ObjParserBackend* backend);
+const char* ObjParser_BackendName(ObjParserBackend backend);
+
+// Lê "filename" em paralelo. Retorna false em caso de erro, com a descrição
+// do erro em "err". Avisos não fatais são adicionados em "warn".
+bool ObjParser_LoadParallel(tinyobj::attrib_t* attrib, std::vector<tinyobj::shape_t>* shapes,
+                            std::string* warn, std::string* err,
+                            const char* filename, bool triangulate = true);
+
+// Benchmark: lê "filename" com os dois backends "repetitions" vezes,
+// imprime os tempos e verifica se os resultados são equivalentes.
+void ObjParser_Benchmark(const char* filename, int repetitions);
+
+#endif // _OBJPARSER_H
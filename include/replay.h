@@ -0,0 +1,270 @@
+#ifndef _REPLAY_H
+#define _REPLAY_H
+
+// Gravação e reprodução de partidas ("replays"), para reproduzir problemas
+// encontrados em testes e para benchmarks com comandos reais.
+//
+// Um replay guarda as transições das teclas do carro (INPUT_*, veja
+// "inputscript.h"), com o passo da simulação em que ocorreram, e a cada
+// "keyframe_interval" passos um keyframe com o estado completo do carro.
+// Como a física é determinística com passo fixo, as teclas bastam para
+// reproduzir a partida; os keyframes permitem ir a qualquer instante sem
+// simular desde o início (ReplayPlayer::seek()) e verificar se a reprodução
+// continua igual à gravação.
+//
+// Formato do arquivo (inteiros em varint LEB128, floats em little-endian):
+//
+//   "KARTRPL3"                 identificação e versão
+//   varint step_ns             duração de um passo em nanossegundos
+//   varint keyframe_interval   passos entre keyframes
+//   varint modes               modos da física (REPLAY_MODE_*)
+//   varint track_hash          hash da geometria da pista em que o carro
+//                              colide (BVH::getGeometryHash()), ou zero se
+//                              a simulação não tinha pista
+//   varint num_params          seguido de num_params floats: os parâmetros
+//                              do carro, na ordem de CAR_PARAMS_FIELDS
+//   registros até o fim do arquivo, cada um com:
+//     byte tag                 REPLAY_TAG_*
+//     varint delta             passos desde o registro anterior
+//     INPUT:    byte com as teclas (INPUT_*) a partir deste passo
+//     KEYFRAME: REPLAY_STATE_FLOATS varints com os bits de cada float do
+//               estado em XOR com os do keyframe anterior (valores que
+//               mudam pouco têm os bits altos iguais, e o varint fica
+//               curto), seguidos de um byte com isSliding
+//     END:      nenhum dado; o passo é o número total de passos
+//
+// Os modos e a pista mudam o resultado da física e devem ser os mesmos na
+// gravação e na reprodução: quem reproduz o replay aplica os modos que
+// dependem só do carro (determinístico e pneus) e recusa o arquivo se não
+// puder reproduzir o resto (o mapa de alturas e a pista, que não são
+// gravados; só o hash da pista). Arquivos "KARTRPL1" são lidos com os modos
+// zerados, e "KARTRPL1" e "KARTRPL2" com o hash da pista zerado.
+//
+// Um keyframe no passo k guarda o estado após k passos, antes de aplicar as
+// teclas do passo k. Se a gravação for interrompida (o jogo fechou sem
+// ReplayRecorder::close()), o arquivo continua legível até o último
+// registro completo.
+//
+// O gravador codifica os registros em um buffer na thread da simulação e o
+// entrega a uma thread própria que faz as escritas no disco, para que a
+// simulação nunca espere pelo sistema de arquivos.
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "carparams.h"
+#include "inputscript.h"
+#include "timebase.h"
+
+#define REPLAY_TAG_INPUT    1
+#define REPLAY_TAG_KEYFRAME 2
+#define REPLAY_TAG_END      3
+
+#define REPLAY_MODE_DETERMINISTIC 0x01 // Car::setDeterministic()
+#define REPLAY_MODE_TYRES         0x02 // Car::setTyreModel()
+#define REPLAY_MODE_HEIGHTFIELD   0x04 // Car::setGround()
+
+// Estado do carro necessário para continuar a simulação (veja
+// Car::getReplayState())
+struct ReplayCarState
+{
+    float position[3];
+    float rotation[3];
+    float velocity[3];
+    float forwards[3];
+    float turn_angle;
+    bool  is_sliding;
+};
+
+#define REPLAY_STATE_FLOATS 13
+
+struct ReplayKeyframe
+{
+    uint64_t       step;
+    ReplayCarState state;
+};
+
+struct ReplayInput
+{
+    uint64_t step;
+    uint8_t  flags;
+};
+
+class ReplayRecorder
+{
+public:
+    ReplayRecorder();
+    ~ReplayRecorder();
+
+    // Cria o arquivo e inicia a thread de escrita. "modes" são os
+    // REPLAY_MODE_* da simulação e "track_hash" o hash da pista (zero se não
+    // há pista). Retorna false se o arquivo não puder ser criado.
+    bool open(const std::string& filename, TimeNs step_ns, const CarParams& params, uint32_t keyframe_interval, uint32_t modes, uint64_t track_hash);
+    bool isOpen() const { return file != NULL; }
+
+    // Uso a cada passo da simulação:
+    //
+    //   if ( recorder.wantsKeyframe() )
+    //       recorder.keyframe(car.getReplayState());
+    //   ... aplica as teclas "input" ao carro e executa o passo ...
+    //   recorder.input(input);
+    //   recorder.advance();
+    bool wantsKeyframe() const { return step % keyframe_interval == 0; }
+    void keyframe(const ReplayCarState& state);
+    void input(uint8_t flags); // Só grava se as teclas mudaram
+    void advance();
+
+    uint64_t getStep() const { return step; }
+
+    // Grava o registro final, espera a thread de escrita e fecha o arquivo.
+    // Retorna false se alguma escrita falhou.
+    bool close();
+
+private:
+    ReplayRecorder(const ReplayRecorder&);
+    ReplayRecorder& operator=(const ReplayRecorder&);
+
+    void writeRecord(uint8_t tag);
+    void submit(); // Entrega "buffer" à thread de escrita
+    void writerLoop();
+
+    FILE*                 file;
+    uint32_t              keyframe_interval;
+    uint64_t              step;
+    uint64_t              last_record_step;
+    int                   last_input; // -1 antes da primeira transição
+    uint32_t              last_bits[REPLAY_STATE_FLOATS];
+    std::vector<uint8_t>  buffer;
+
+    std::thread                       writer;
+    std::mutex                        mutex;
+    std::condition_variable           wakeup;
+    std::vector<std::vector<uint8_t> > queue;
+    bool                              stopping;
+    bool                              failed;
+};
+
+// Replay lido inteiro para a memória
+class ReplayReader
+{
+public:
+    ReplayReader() : step_ns(0), keyframe_interval(0), modes(0), track_hash(0), num_steps(0), truncated(false) {}
+
+    // Lê um arquivo no formato acima. Em caso de erro, retorna false e
+    // descreve o problema em "error".
+    bool load(const std::string& filename, std::string* error);
+
+    TimeNs getStepNs() const { return step_ns; }
+    uint32_t getKeyframeInterval() const { return keyframe_interval; }
+    uint32_t getModes() const { return modes; }
+    uint64_t getTrackHash() const { return track_hash; }
+    const CarParams& getParams() const { return params; }
+    uint64_t getNumSteps() const { return num_steps; }
+
+    // true se o arquivo não tinha o registro final (gravação interrompida)
+    bool isTruncated() const { return truncated; }
+
+    const std::vector<ReplayInput>& getInputs() const { return inputs; }
+    const std::vector<ReplayKeyframe>& getKeyframes() const { return keyframes; }
+
+    // Índice da última transição de teclas até "step" (inclusive), ou -1 se
+    // nenhuma
+    long findInput(uint64_t step) const;
+
+    // Índice do último keyframe até "step" (inclusive). Sempre há um
+    // keyframe no passo zero.
+    size_t findKeyframe(uint64_t step) const;
+
+private:
+    TimeNs                      step_ns;
+    uint32_t                    keyframe_interval;
+    uint32_t                    modes;
+    uint64_t                    track_hash;
+    CarParams                   params;
+    uint64_t                    num_steps;
+    bool                        truncated;
+    std::vector<ReplayInput>    inputs;
+    std::vector<ReplayKeyframe> keyframes;
+};
+
+// Reproduz um replay em um carro. "CarType" é Car (veja "car.cpp"), que não
+// pode ser incluído aqui porque inclui "matrices.h". Os parâmetros do carro
+// são os do replay; os modos (getModes()) devem ser aplicados antes, e a
+// pista deve ser a mesma (getTrackHash()).
+template <class CarType>
+class ReplayPlayer
+{
+public:
+    ReplayPlayer(const ReplayReader& replay, CarType* car)
+        : replay(replay)
+        , car(car)
+        , dt((float)Time_ToSeconds(replay.getStepNs()))
+    {
+        car->setParams(replay.getParams());
+        restore(0);
+    }
+
+    uint64_t getStep() const { return step; }
+    bool isFinished() const { return step >= replay.getNumSteps(); }
+
+    // Executa um passo com as teclas gravadas
+    void advance()
+    {
+        if ( isFinished() )
+            return;
+
+        const std::vector<ReplayInput>& inputs = replay.getInputs();
+        while ( next_input < inputs.size() && inputs[next_input].step <= step )
+            flags = inputs[next_input++].flags;
+
+        car->applyControls((flags & INPUT_ACCELERATE) != 0, (flags & INPUT_BRAKE) != 0,
+                           (flags & INPUT_LEFT) != 0, (flags & INPUT_RIGHT) != 0,
+                           (flags & INPUT_REVERSE) != 0, dt);
+        car->update(dt);
+        step++;
+    }
+
+    // Vai para o passo "target" (limitado ao fim do replay): restaura o
+    // último keyframe antes dele, a não ser que o passo atual já esteja
+    // entre esse keyframe e o alvo, e simula até o alvo
+    void seek(uint64_t target)
+    {
+        if ( target > replay.getNumSteps() )
+            target = replay.getNumSteps();
+
+        size_t keyframe = replay.findKeyframe(target);
+        if ( target < step || replay.getKeyframes()[keyframe].step > step )
+            restore(keyframe);
+        while ( step < target )
+            advance();
+    }
+
+private:
+    void restore(size_t keyframe)
+    {
+        const ReplayKeyframe& k = replay.getKeyframes()[keyframe];
+        car->setReplayState(k.state);
+        step = k.step;
+
+        // As teclas aplicadas no keyframe são as da última transição antes
+        // dele
+        long input = replay.findInput(step);
+        flags = input >= 0 ? replay.getInputs()[input].flags : 0;
+        next_input = (size_t)(input + 1);
+    }
+
+    const ReplayReader& replay;
+    CarType*            car;
+    float               dt;
+    uint64_t            step;
+    uint8_t             flags;
+    size_t              next_input;
+};
+
+#endif // _REPLAY_H
@@ -0,0 +1,80 @@
+#ifndef _SCENEREGISTRY_H
+#define _SCENEREGISTRY_H
+
+// Registro dos objetos da cena virtual. Cada objeto recebe, no carregamento,
+// um "handle" inteiro que é a sua posição em um vetor contíguo de
+// SceneObject. O desenho usa somente handles (sem nenhuma operação com
+// strings por quadro); a busca por nome serve para o carregamento e para
+// ferramentas.
+//
+// Handles são estáveis: um nome sempre corresponde ao mesmo handle, mesmo
+// que o objeto seja removido e carregado novamente (por exemplo, ao
+// recarregar um modelo). Um handle de um objeto removido, ou reservado com
+// reserve() antes do objeto ser carregado, continua válido e simplesmente
+// não desenha nada.
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <glad/glad.h>
+#include <glm/vec3.hpp>
+
+class GeometryArena;
+
+typedef uint32_t SceneHandle;
+
+const SceneHandle SCENE_INVALID_HANDLE = 0xFFFFFFFFu;
+
+// Definimos uma estrutura que armazenará dados necessários para renderizar
+// cada objeto da cena virtual.
+struct SceneObject
+{
+    std::string  name;        // Nome do objeto
+    size_t       first_index; // Índice do primeiro vértice dentro do vetor indices[] definido em BuildTrianglesAndAddToVirtualScene()
+    size_t       num_indices; // Número de índices do objeto dentro do vetor indices[] definido em BuildTrianglesAndAddToVirtualScene()
+    GLenum       index_type;   // GL_UNSIGNED_INT, ou GL_UNSIGNED_SHORT no formato compacto (veja "vertexformat.h")
+    size_t       index_offset; // Posição (em bytes) do primeiro índice dentro do buffer de índices
+    GLint        base_vertex;  // Valor somado pela GPU a cada índice
+    bool         compact_vertices; // Vértices no formato compacto de "vertexformat.h"?
+    GLenum       rendering_mode; // Modo de rasterização (GL_TRIANGLES, GL_TRIANGLE_STRIP, etc.)
+    GeometryArena* arena; // Arena (VAO e buffers compartilhados) onde estão armazenados os atributos do modelo; NULL se o objeto não está carregado
+    glm::vec3    bbox_min; // Axis-Aligned Bounding Box do objeto
+    glm::vec3    bbox_max;
+};
+
+class SceneRegistry
+{
+public:
+    // Adiciona (ou substitui) o objeto com o nome object.name e retorna
+    // o seu handle.
+    SceneHandle add(const SceneObject& object);
+
+    // Remove um objeto. O handle continua válido, mas fica vazio.
+    void remove(SceneHandle handle);
+
+    // Handle do objeto com o nome dado, ou SCENE_INVALID_HANDLE se o nome
+    // nunca foi registrado.
+    SceneHandle find(const std::string& name) const;
+
+    // Como find(), mas reserva um handle vazio se o nome ainda não existir.
+    SceneHandle reserve(const std::string& name);
+
+    // O objeto do handle está carregado (pode ser desenhado)?
+    bool isLoaded(SceneHandle handle) const
+    {
+        return handle < objects.size() && objects[handle].arena != NULL;
+    }
+
+    const SceneObject& get(SceneHandle handle) const { return objects[handle]; }
+
+    size_t size() const { return objects.size(); }
+
+private:
+    std::vector<SceneObject>           objects; // Indexado pelo handle
+    std::map<std::string, SceneHandle> handles; // Usado somente no carregamento
+};
+
+#endif // _SCENEREGISTRY_H
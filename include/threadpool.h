@@ -0,0 +1,87 @@
+#ifndef _THREADPOOL_H
+#define _THREADPOOL_H
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+// Sistema de trabalhos ("jobs") compartilhado pelo programa, com roubo de
+// trabalho ("work stealing"). Cada thread de trabalho tem a sua própria fila
+// dupla: ela empilha e retira trabalhos do fim da sua fila, e quando a fila
+// fica vazia rouba o trabalho mais antigo do início da fila de outra thread.
+// As threads são criadas na primeira utilização e dormem enquanto não há
+// trabalho.
+//
+// Trabalhos são agrupados por contadores (JobCounter): ThreadPool_Wait()
+// espera que todos os trabalhos de um contador terminem, executando outros
+// trabalhos enquanto isso (então esperar de dentro de um trabalho não causa
+// deadlock). Um contador também serve de dependência: um trabalho enviado
+// com "after" só começa quando todos os trabalhos daquele contador
+// terminarem.
+//
+// Chamadas OpenGL só podem ser feitas na thread principal (a que tem o
+// contexto). Trabalhos enviados com ThreadPool_SubmitMainThread() ficam em
+// uma fila separada, executada somente pela thread principal em
+// ThreadPool_RunMainThreadJobs() ou enquanto ela espera em
+// ThreadPool_Wait(). A thread principal é a primeira que usa o sistema.
+//
+// Uso:
+//
+//   JobCounter decoded, uploaded;
+//   for (...) ThreadPool_Submit([=]{ ... decodifica ... }, &decoded);
+//   ThreadPool_SubmitMainThread([=]{ ... glTexImage2D ... }, &uploaded, &decoded);
+//   ThreadPool_Wait(&uploaded);
+
+struct Job;
+
+// Contador de trabalhos pendentes. Deve existir até que todos os seus
+// trabalhos terminem (por exemplo, esperando com ThreadPool_Wait() antes de
+// destruí-lo).
+struct JobCounter
+{
+    JobCounter() : pending(0) {}
+
+    bool isDone() const { return pending.load(std::memory_order_acquire) == 0; }
+
+    // Uso interno de "threadpool.cpp"
+    std::atomic<int>  pending;
+    std::mutex        mutex;
+    std::vector<Job*> dependents; // Trabalhos esperando este contador chegar a zero
+};
+
+// Número de threads que executam trabalhos (incluindo a thread que espera
+// por eles).
+unsigned int ThreadPool_NumThreads();
+
+// Limita o número de threads utilizadas (útil para benchmarks). Zero volta
+// ao padrão, que é o número de núcleos da máquina.
+void ThreadPool_SetMaxThreads(unsigned int max_threads);
+
+// Envia um trabalho para as threads de trabalho. Se "counter" não for NULL,
+// ele é incrementado agora e decrementado quando o trabalho terminar. Se
+// "after" não for NULL, o trabalho só começa quando "after" chegar a zero.
+void ThreadPool_Submit(const std::function<void()>& job, JobCounter* counter, JobCounter* after = NULL);
+
+// Como ThreadPool_Submit(), mas o trabalho é executado na thread principal
+// (para chamadas OpenGL).
+void ThreadPool_SubmitMainThread(const std::function<void()>& job, JobCounter* counter, JobCounter* after = NULL);
+
+// Espera todos os trabalhos de "counter" terminarem, executando trabalhos
+// pendentes enquanto isso. Uma thread de trabalho não deve esperar por
+// trabalhos da thread principal se esta estiver bloqueada esperando por ela.
+void ThreadPool_Wait(JobCounter* counter);
+
+// Executa os trabalhos da fila da thread principal. Chamada uma vez por
+// quadro no laço principal. Retorna o número de trabalhos executados.
+size_t ThreadPool_RunMainThreadJobs();
+
+// Executa body(begin, end) para intervalos disjuntos que cobrem [0, count),
+// distribuídos entre as threads. Cada intervalo tem pelo menos "grain"
+// elementos (exceto possivelmente o último). A função só retorna quando todos
+// os intervalos tiverem sido processados. Chamadas aninhadas (de dentro de um
+// body ou de um trabalho) também são distribuídas.
+void ParallelFor(size_t count, size_t grain, const std::function<void(size_t begin, size_t end)>& body);
+
+#endif // _THREADPOOL_H
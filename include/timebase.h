@@ -0,0 +1,104 @@
+#ifndef _TIMEBASE_H
+#define _TIMEBASE_H
+
+// Base de tempo do jogo. Todos os instantes e intervalos são inteiros de 64
+// bits em nanossegundos, lidos de um relógio monotônico: ao contrário de um
+// float com o valor de glfwGetTime(), a resolução não piora com o tempo de
+// execução (um int64 em nanossegundos cobre cerca de 292 anos).
+//
+// O relógio é trocável: o padrão é SteadyClock (std::chrono::steady_clock),
+// e FakeClock só avança quando pedido, para testes e benchmarks
+// determinísticos (veja FixedStep_Check() em "fixedstep.h").
+//
+// Uso por quadro:
+//
+//   timebase.beginFrame();
+//   ... timebase.getFrameDelta() ...
+//   ... para cada passo da simulação: timebase.advanceSimulation(passo) ...
+
+#include <cstddef>
+#include <cstdint>
+
+typedef int64_t TimeNs;
+
+#define TIME_NS_PER_SECOND      1000000000LL
+#define TIME_NS_PER_MILLISECOND 1000000LL
+
+inline double Time_ToSeconds(TimeNs t) { return (double)t / TIME_NS_PER_SECOND; }
+inline double Time_ToMilliseconds(TimeNs t) { return (double)t / TIME_NS_PER_MILLISECOND; }
+inline TimeNs Time_FromSeconds(double seconds) { return (TimeNs)(seconds * TIME_NS_PER_SECOND + (seconds >= 0.0 ? 0.5 : -0.5)); }
+
+// Fonte de tempo monotônica
+class Clock
+{
+public:
+    virtual ~Clock() {}
+    virtual TimeNs now() const = 0;
+};
+
+// Relógio real (std::chrono::steady_clock)
+class SteadyClock : public Clock
+{
+public:
+    TimeNs now() const;
+};
+
+// Relógio manual: o tempo só muda com set() e advance()
+class FakeClock : public Clock
+{
+public:
+    FakeClock() : current(0) {}
+
+    TimeNs now() const { return current; }
+    void set(TimeNs t) { current = t; }
+    void advance(TimeNs dt) { current += dt; }
+
+private:
+    TimeNs current;
+};
+
+class TimeBase
+{
+public:
+    // Usa SteadyClock se "clock" for NULL. O relógio não é copiado e deve
+    // existir enquanto for usado.
+    explicit TimeBase(const Clock* clock = NULL);
+
+    // Troca o relógio e reinicia a contagem (veja reset())
+    void setClock(const Clock* clock);
+
+    // Reinicia a contagem: o próximo beginFrame() mede o tempo a partir de
+    // agora, e o tempo de simulação e o número de quadros voltam a zero
+    void reset();
+
+    // Instante atual do relógio
+    TimeNs now() const { return clock->now(); }
+
+    // Marca o início de um novo quadro
+    void beginFrame();
+
+    // Instante do início do quadro atual, medido desde reset()
+    TimeNs getFrameTime() const { return frame_start - start; }
+
+    // Duração do quadro anterior: intervalo entre os dois últimos
+    // beginFrame()
+    TimeNs getFrameDelta() const { return frame_delta; }
+
+    // Número de quadros iniciados desde reset()
+    uint64_t getFrameIndex() const { return frame_index; }
+
+    // Tempo simulado, avançado pelos passos da simulação
+    TimeNs getSimulationTime() const { return simulation_time; }
+    void advanceSimulation(TimeNs step) { simulation_time += step; }
+
+private:
+    SteadyClock  steady_clock;
+    const Clock* clock;
+    TimeNs       start;
+    TimeNs       frame_start;
+    TimeNs       frame_delta;
+    uint64_t     frame_index;
+    TimeNs       simulation_time;
+};
+
+#endif // _TIMEBASE_H
@@ -0,0 +1,126 @@
+#ifndef _TYREMODEL_H
+#define _TYREMODEL_H
+
+// Modelo de pneus por curvas de escorregamento, alternativa às regras de
+// derrapagem de Car (MAX_SIDE_GRIP e MIN_CORRELATION_GRIP, que trocam entre
+// dois métodos de integração e dão uma dirigibilidade descontínua).
+//
+// Cada pneu gera uma força lateral em função da deriva (a tangente do
+// ângulo entre a velocidade e a frente do carro) e uma longitudinal em
+// função da razão de escorregamento (diferença entre a velocidade das rodas
+// e a do carro, relativa à do carro), dadas pela "fórmula mágica" de
+// Pacejka:
+//
+//   y(x) = D sin(C atan(B x - E (B x - atan(B x))))
+//
+// A força cresce linearmente com pouco escorregamento, tem um pico e cai um
+// pouco depois dele; a derrapagem é a região depois do pico, e não um
+// estado separado. As duas forças são limitadas juntas por uma elipse de
+// atrito (o pneu não tem aderência lateral máxima enquanto freia ao máximo).
+//
+// Como seno e arco tangente são caros, as curvas são calculadas uma vez, ao
+// definir os parâmetros (setParams()), em tabelas de TYRE_TABLE_SIZE
+// intervalos com interpolação linear. A avaliação não tem desvios: a
+// posição na tabela é limitada com min(), a simetria das curvas (ímpares) é
+// tratada com copysign(), e a elipse com uma divisão por max(1, r). Por
+// isso o lote de 8 carros com AVX2 ("gather" nas tabelas) faz as mesmas
+// operações do código escalar, com o mesmo resultado.
+//
+// As forças são acelerações (unidades/s²), independentes da massa.
+
+#include <cstddef>
+#include <cstdint>
+
+#define TYRE_TABLE_SIZE 128
+
+enum TyreModelBackend
+{
+    TYREMODEL_SCALAR,
+    TYREMODEL_AVX2
+};
+
+// Coeficientes de uma curva de Pacejka. "max_slip" é o fim da tabela: além
+// dele a força é a do fim da tabela.
+struct TyreCurve
+{
+    float b, c, d, e;
+    float max_slip;
+};
+
+struct TyreModelParams
+{
+    TyreCurve lateral;       // Força lateral pela tangente da deriva
+    TyreCurve longitudinal;  // Força longitudinal pela razão de escorregamento
+
+    // Velocidade somada à do carro no denominador dos escorregamentos, para
+    // que fiquem finitos com o carro parado
+    float min_slip_speed;
+};
+
+// Valores próximos do comportamento de Car com os parâmetros padrão: pico
+// lateral igual ao arrasto da derrapagem, e aceleração saturada perto de
+// ACCELERATION
+TyreModelParams TyreModel_DefaultParams();
+
+// A fórmula mágica, calculada diretamente (com as funções de DetMath)
+float TyreModel_Pacejka(const TyreCurve& curve, float slip);
+
+class TyreModel
+{
+public:
+    TyreModel();
+
+    // Troca os parâmetros e recalcula as tabelas
+    void setParams(const TyreModelParams& value);
+    const TyreModelParams& getParams() const { return params; }
+
+    // Forças de um pneu pela tabela, já limitadas pela elipse de atrito.
+    // Têm o sinal do escorregamento: a força lateral deve ser subtraída da
+    // velocidade lateral, e a longitudinal somada à velocidade do carro.
+    void evaluate(float lateral_slip, float longitudinal_slip, float* lateral, float* longitudinal) const;
+
+    // O mesmo com a fórmula calculada a cada chamada (referência)
+    void evaluateExact(float lateral_slip, float longitudinal_slip, float* lateral, float* longitudinal) const;
+
+    // "count" pneus em forma "structure of arrays"
+    void evaluateBatch(const float* lateral_slip, const float* longitudinal_slip, size_t count,
+                       float* lateral, float* longitudinal) const
+    {
+        evaluateBatch(backend, lateral_slip, longitudinal_slip, count, lateral, longitudinal);
+    }
+    void evaluateBatch(TyreModelBackend backend, const float* lateral_slip, const float* longitudinal_slip, size_t count,
+                       float* lateral, float* longitudinal) const;
+    void evaluateBatchExact(const float* lateral_slip, const float* longitudinal_slip, size_t count,
+                            float* lateral, float* longitudinal) const;
+
+    // Escorregamentos do pico das curvas: acima deles o pneu está derrapando
+    float getPeakLateralSlip() const { return peak_lateral_slip; }
+    float getPeakLongitudinalSlip() const { return peak_longitudinal_slip; }
+
+    void setBackend(TyreModelBackend value) { backend = value; }
+    TyreModelBackend getBackend() const { return backend; }
+
+private:
+    TyreModelParams  params;
+    TyreModelBackend backend;
+
+    // Amostras 0..TYRE_TABLE_SIZE das curvas, com a última repetida para
+    // que a interpolação no fim da tabela não precise de teste
+    float lateral_table[TYRE_TABLE_SIZE + 2];
+    float longitudinal_table[TYRE_TABLE_SIZE + 2];
+    float lateral_scale, longitudinal_scale;        // Amostras por unidade de escorregamento
+    float inv_lateral_grip, inv_longitudinal_grip;  // 1/D de cada curva, para a elipse
+    float peak_lateral_slip, peak_longitudinal_slip;
+};
+
+// Melhor implementação suportada pelo processador
+TyreModelBackend TyreModel_BestBackend();
+const char* TyreModel_BackendName(TyreModelBackend backend);
+
+// Erro máximo das tabelas em relação à fórmula, e tempo por pneu da fórmula
+// e das tabelas (escalar e AVX2) com 1 mil, 10 mil e 100 mil pneus com
+// escorregamentos aleatórios, verificando que as implementações das tabelas
+// dão o mesmo resultado
+void TyreModel_Benchmark(int repetitions);
+
+#endif // _TYREMODEL_H
@@ -0,0 +1,93 @@
+#ifndef _UNIFORMBUFFERS_H
+#define _UNIFORMBUFFERS_H
+
+// Constantes dos shaders em "uniform buffer objects" (UBOs). Em vez de
+// enviar cada matriz e parâmetro com glUniform*() a cada desenho, os dados
+// de um quadro inteiro são escritos de uma só vez em um buffer circular
+// ("ring buffer"), e cada desenho somente seleciona o seu trecho do buffer
+// com glBindBufferRange().
+//
+// Há dois blocos, declarados de forma idêntica em "shader_vertex.glsl" e
+// "shader_fragment.glsl" com layout std140:
+//
+//   - PerFrame: matrizes da câmera, posição da câmera e direção da luz,
+//     escritos uma vez por quadro;
+//   - PerDraw: matriz de modelagem, matriz das normais (inversa transposta,
+//     calculada na CPU), bounding box e parâmetros de cada desenho.
+//
+// O buffer circular tem espaço para alguns quadros; antes de reescrever o
+// trecho de um quadro antigo esperamos (com uma "fence") a GPU terminar de
+// usá-lo, de forma que a escrita nunca causa sincronização implícita.
+
+#include <cstddef>
+#include <vector>
+
+#include <glad/glad.h>
+#include <glm/mat4x4.hpp>
+#include <glm/vec4.hpp>
+
+// Pontos de ligação ("binding points") dos blocos; veja LoadShadersFromFiles()
+#define UNIFORM_BINDING_PER_FRAME 0
+#define UNIFORM_BINDING_PER_DRAW  1
+
+// Bloco "PerFrame". Os campos têm o mesmo layout std140 da declaração nos
+// shaders (mat4 e vec4 não têm preenchimento).
+struct PerFrameUniforms
+{
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::vec4 camera_position; // Posição da câmera em coordenadas globais
+    glm::vec4 light_direction; // Sentido (normalizado) da fonte de luz
+};
+
+// Bloco "PerDraw"
+struct PerDrawUniforms
+{
+    glm::mat4  model;
+    glm::mat4  normal_matrix; // Inversa transposta de "model"
+    glm::vec4  bbox_min;      // Axis-Aligned Bounding Box do objeto
+    glm::vec4  bbox_max;
+    glm::ivec4 params;        // x: object_id, y: vértices compactos, z: desenho instanciado
+};
+
+// Buffer circular com um trecho por quadro
+class UniformRing
+{
+public:
+    UniformRing();
+
+    // Cria o buffer com "bytes_per_frame" bytes para cada quadro. O espaço
+    // cresce automaticamente se um quadro precisar de mais.
+    void init(size_t bytes_per_frame);
+
+    // Começa um novo quadro, descartando os dados acumulados
+    void beginFrame();
+
+    // Acumula um bloco de "size" bytes e retorna sua posição dentro do
+    // quadro. As posições respeitam GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT.
+    size_t append(const void* data, size_t size);
+
+    // Copia os blocos acumulados para o trecho do quadro atual na GPU
+    void upload();
+
+    // Liga o bloco na posição "offset" (retornada por append()) ao ponto de
+    // ligação "binding". Deve ser chamada após upload().
+    void bindRange(GLuint binding, size_t offset, size_t size) const;
+
+    // Termina o quadro: marca o trecho como em uso pela GPU e avança
+    void endFrame();
+
+private:
+    static const int NUM_SEGMENTS = 3;
+
+    void waitSegment(int segment);
+
+    GLuint                     buffer_id;
+    size_t                     segment_size;
+    size_t                     alignment;
+    int                        current_segment;
+    GLsync                     fences[NUM_SEGMENTS];
+    std::vector<unsigned char> staging;
+};
+
+#endif // _UNIFORMBUFFERS_H
@@ -0,0 +1,77 @@
+#ifndef _VERTEXFORMAT_H
+#define _VERTEXFORMAT_H
+
+// Formato compacto de vértices (opção --compact-vertices). Em vez de três
+// buffers separados de floats (posição vec4, normal vec4 e coordenadas de
+// textura vec2, 40 bytes por vértice), cada vértice ocupa 16 bytes em um
+// único buffer intercalado:
+//
+//   - posição: 3 x uint16 normalizados em relação à bounding box do objeto
+//     (mais 16 bits de preenchimento);
+//   - normal: codificação octaédrica em 2 x int16 normalizados (snorm);
+//   - coordenadas de textura: 2 x half float.
+//
+// Os índices de cada objeto usam 16 bits quando o objeto tem no máximo 65536
+// vértices, e são relativos ao primeiro vértice do objeto ("base vertex").
+// A decodificação é feita em "shader_vertex.glsl".
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+
+#include "mesh.h"
+
+// Maior erro aceito nas coordenadas de textura após a conversão para half
+// float. Malhas com coordenadas maiores (por exemplo, texturas repetidas
+// muitas vezes) continuam usando o formato com floats.
+#define VERTEXFORMAT_MAX_TEXCOORD_ERROR (1.0f / 2048.0f)
+
+struct CompactVertex
+{
+    uint16_t position[4]; // X,Y,Z quantizados na bounding box; o quarto valor é sempre zero
+    int16_t  normal[2];   // Normal com codificação octaédrica
+    uint16_t texcoord[2]; // U,V em half float
+};
+
+// Informações de um objeto dentro de uma CompactMesh
+struct CompactShape
+{
+    size_t   index_offset;  // Posição (em bytes) do primeiro índice dentro de CompactMesh::indices
+    bool     indices_16bit; // Índices de 16 bits (GL_UNSIGNED_SHORT) ou 32 bits (GL_UNSIGNED_INT)
+    uint32_t base_vertex;   // Valor somado a cada índice pela GPU (glDrawElementsBaseVertex)
+};
+
+struct CompactMesh
+{
+    std::vector<CompactVertex> vertices;
+    std::vector<uint8_t>       indices; // Índices de 16 ou 32 bits, conforme cada objeto
+    std::vector<CompactShape>  shapes;  // Na mesma ordem de MeshView::shapes
+};
+
+// Converte uma malha para o formato compacto. Retorna false (e não altera
+// "compact") se a malha não puder ser representada sem perda visível de
+// precisão, e neste caso ela deve ser enviada à GPU no formato com floats.
+bool VertexFormat_BuildCompact(const MeshView& mesh, CompactMesh* compact);
+
+// Codificação e decodificação dos atributos, também usadas por
+// VertexFormat_Compare(). As decodificações são idênticas às feitas em
+// "shader_vertex.glsl".
+uint16_t VertexFormat_QuantizeUnorm16(float value, float min, float max);
+float    VertexFormat_DequantizeUnorm16(uint16_t value, float min, float max);
+void      VertexFormat_OctEncode(const glm::vec3& normal, int16_t out[2]);
+glm::vec3 VertexFormat_OctDecode(const int16_t encoded[2]);
+uint16_t VertexFormat_FloatToHalf(float value);
+float    VertexFormat_HalfToFloat(uint16_t value);
+
+// "Diferença visual" entre o formato com floats e o compacto: projeta os
+// vértices das duas versões de "mesh" com uma câmera fixa em uma imagem de
+// 1920x1080 pixels (cada objeto ocupando a tela toda) e imprime o maior
+// deslocamento em pixels, o maior erro angular das normais, o maior erro nas
+// coordenadas de textura e a memória de GPU utilizada por cada formato.
+// Retorna true se o maior deslocamento for menor que meio pixel.
+bool VertexFormat_Compare(const char* name, const MeshView& mesh);
+
+#endif // _VERTEXFORMAT_H
@@ -0,0 +1,925 @@
+// Hierarquia de volumes envolventes sobre a pista. Veja comentários em "bvh.h".
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+
+#include <glm/geometric.hpp>
+
+#include "bvh.h"
+#include "detmath.h"
+#include "threadpool.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define BVH_HAS_SSE 1
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+
+const int      BVH_BINS          = 16;
+const uint32_t BVH_LEAF_SIZE     = 4;  // Nós com até este número de triângulos nunca são divididos
+const uint32_t BVH_MAX_LEAF_SIZE = 16; // ... e nós com mais que este, sempre
+const int      BVH_MAX_DEPTH     = 60; // Cabe na pilha das consultas
+const int      BVH_STACK_SIZE    = 64;
+const uint32_t BVH_OFFSET_MASK   = 0x3FFFFFFF;
+const uint32_t BVH_NO_TRIANGLE   = 0xFFFFFFFF;
+
+// Determinante abaixo do qual o raio é considerado paralelo ao triângulo
+const float BVH_PARALLEL_EPSILON = 1e-12f;
+
+// Componentes da direção menores que isto são trocadas por este valor, para
+// que 1/direção seja finito e o teste das caixas nunca gere NaN
+const float BVH_MIN_DIRECTION = 1e-12f;
+
+float SafeInverse(float d)
+{
+    if ( std::fabs(d) < BVH_MIN_DIRECTION )
+        d = d < 0.0f ? -BVH_MIN_DIRECTION : BVH_MIN_DIRECTION;
+    return 1.0f / d;
+}
+
+// Metade da área da superfície de uma caixa (a constante não altera a SAH)
+float HalfArea(const float* bbox_min, const float* bbox_max)
+{
+    float ex = bbox_max[0] - bbox_min[0];
+    float ey = bbox_max[1] - bbox_min[1];
+    float ez = bbox_max[2] - bbox_min[2];
+    return ex*ey + ey*ez + ez*ex;
+}
+
+struct Bin
+{
+    float    bbox_min[3], bbox_max[3];
+    uint32_t count;
+
+    void clear()
+    {
+        for (int k = 0; k < 3; ++k)
+        {
+            bbox_min[k] =  std::numeric_limits<float>::infinity();
+            bbox_max[k] = -std::numeric_limits<float>::infinity();
+        }
+        count = 0;
+    }
+
+    void grow(const float* other_min, const float* other_max, uint32_t other_count)
+    {
+        for (int k = 0; k < 3; ++k)
+        {
+            bbox_min[k] = std::min(bbox_min[k], other_min[k]);
+            bbox_max[k] = std::max(bbox_max[k], other_max[k]);
+        }
+        count += other_count;
+    }
+};
+
+// Bin de um centróide. A mesma expressão é usada para escolher a divisão e
+// para particionar os triângulos.
+int BinOf(float centroid, float centroid_min, float scale)
+{
+    return std::min((int)((centroid - centroid_min) * scale), BVH_BINS - 1);
+}
+
+glm::vec3 TriangleNormal(const BVHTriangle& triangle)
+{
+    glm::vec3 n = glm::cross(triangle.v1 - triangle.v0, triangle.v2 - triangle.v0);
+    float length = glm::length(n);
+    return length > 0.0f ? n / length : glm::vec3(0.0f, 1.0f, 0.0f);
+}
+
+// v0, e1 = v1 - v0 e e2 = v2 - v0
+void PackTriangle(const BVHTriangle& triangle, float* out)
+{
+    glm::vec3 e1 = triangle.v1 - triangle.v0;
+    glm::vec3 e2 = triangle.v2 - triangle.v0;
+    out[0] = triangle.v0.x; out[1] = triangle.v0.y; out[2] = triangle.v0.z;
+    out[3] = e1.x;          out[4] = e1.y;          out[5] = e1.z;
+    out[6] = e2.x;          out[7] = e2.y;          out[8] = e2.z;
+}
+
+// Teste raio-caixa ("slabs") com a caixa aumentada de "radius" em todas as
+// direções. O teste SSE de BVH::raycastPacket() faz as mesmas operações na
+// mesma ordem (com radius == 0, min - 0 == min), e portanto visita os mesmos
+// nós para cada raio.
+inline bool IntersectBox(const BVHNode& node, const float o[3], const float inv[3], float radius, float max_t)
+{
+    float t1x = (node.bbox_min[0] - radius - o[0]) * inv[0];
+    float t2x = (node.bbox_max[0] + radius - o[0]) * inv[0];
+    float t1y = (node.bbox_min[1] - radius - o[1]) * inv[1];
+    float t2y = (node.bbox_max[1] + radius - o[1]) * inv[1];
+    float t1z = (node.bbox_min[2] - radius - o[2]) * inv[2];
+    float t2z = (node.bbox_max[2] + radius - o[2]) * inv[2];
+    float t_near = std::max(std::max(std::min(t1x, t2x), std::min(t1y, t2y)), std::max(std::min(t1z, t2z), 0.0f));
+    float t_far  = std::min(std::min(std::max(t1x, t2x), std::max(t1y, t2y)), std::min(std::max(t1z, t2z), max_t));
+    return t_near <= t_far;
+}
+
+// Teste de Möller–Trumbore. Retorna o "t" do ponto atingido, ou max_t se o
+// raio não atinge o triângulo antes de max_t.
+inline float IntersectTriangle(const float* tri, const float o[3], const float d[3], float max_t)
+{
+    const float* v0 = tri;
+    const float* e1 = tri + 3;
+    const float* e2 = tri + 6;
+
+    float px = d[1]*e2[2] - d[2]*e2[1];
+    float py = d[2]*e2[0] - d[0]*e2[2];
+    float pz = d[0]*e2[1] - d[1]*e2[0];
+    float det = e1[0]*px + e1[1]*py + e1[2]*pz;
+    if ( !(std::fabs(det) > BVH_PARALLEL_EPSILON) )
+        return max_t;
+    float inv_det = 1.0f / det;
+
+    float sx = o[0] - v0[0];
+    float sy = o[1] - v0[1];
+    float sz = o[2] - v0[2];
+    float u = (sx*px + sy*py + sz*pz) * inv_det;
+    if ( !(u >= 0.0f && u <= 1.0f) )
+        return max_t;
+
+    float qx = sy*e1[2] - sz*e1[1];
+    float qy = sz*e1[0] - sx*e1[2];
+    float qz = sx*e1[1] - sy*e1[0];
+    float v = (d[0]*qx + d[1]*qy + d[2]*qz) * inv_det;
+    if ( !(v >= 0.0f && u + v <= 1.0f) )
+        return max_t;
+
+    float t = (e2[0]*qx + e2[1]*qy + e2[2]*qz) * inv_det;
+    return t >= 0.0f && t < max_t ? t : max_t;
+}
+
+// Ponto do plano do triângulo dentro dele (coordenadas baricêntricas)
+bool InsideTriangle(const glm::vec3& p, const glm::vec3& v0, const glm::vec3& e1, const glm::vec3& e2)
+{
+    glm::vec3 w = p - v0;
+    float d00 = glm::dot(e1, e1);
+    float d01 = glm::dot(e1, e2);
+    float d11 = glm::dot(e2, e2);
+    float d20 = glm::dot(w, e1);
+    float d21 = glm::dot(w, e2);
+    float denom = d00*d11 - d01*d01;
+    float b1 = (d11*d20 - d01*d21) / denom;
+    float b2 = (d00*d21 - d01*d20) / denom;
+    return b1 >= 0.0f && b2 >= 0.0f && b1 + b2 <= 1.0f;
+}
+
+// Normal unitária de "from" para o centro da esfera, ou "fallback" se os
+// pontos coincidem
+glm::vec3 ContactNormal(const glm::vec3& center, const glm::vec3& from, const glm::vec3& fallback)
+{
+    glm::vec3 n = center - from;
+    float length = glm::length(n);
+    return length > 0.0f ? n / length : fallback;
+}
+
+// Primeiro contato da esfera de raio r com centro em s + t*d, t em
+// [0, max_t), com o triângulo de normal unitária "n" (método de Ericson,
+// "Real-Time Collision Detection", 5.5.6): se o ponto em que a esfera toca o
+// plano estiver dentro do triângulo, esse é o primeiro contato; senão a
+// esfera toca antes uma aresta (cilindro) ou um vértice (esfera).
+// Se a esfera já toca o triângulo em "s", só há contato (com t = 0) se ela
+// estiver se aproximando dele: uma esfera encostada em uma parede pode se
+// afastar ou deslizar ao longo dela.
+bool SweepTriangle(const float* tri, const glm::vec3& n, const glm::vec3& s, const glm::vec3& d, float r,
+                   float max_t, float* t, glm::vec3* normal)
+{
+    glm::vec3 v0(tri[0], tri[1], tri[2]);
+    glm::vec3 e1(tri[3], tri[4], tri[5]);
+    glm::vec3 e2(tri[6], tri[7], tri[8]);
+
+    // Face
+    float distance = glm::dot(s - v0, n);
+    glm::vec3 side = distance >= 0.0f ? n : -n;
+    float abs_distance = std::fabs(distance);
+    float speed = glm::dot(d, side);
+    if ( abs_distance <= r )
+    {
+        if ( max_t > 0.0f && speed < 0.0f && InsideTriangle(s - side*abs_distance, v0, e1, e2) )
+        {
+            *t = 0.0f;
+            *normal = side;
+            return true;
+        }
+    }
+    else if ( speed < 0.0f )
+    {
+        float t_plane = (abs_distance - r) / -speed;
+        if ( t_plane < max_t && InsideTriangle(s + d*t_plane - side*r, v0, e1, e2) )
+        {
+            *t = t_plane;
+            *normal = side;
+            return true;
+        }
+    }
+
+    // Vértices e arestas
+    glm::vec3 vertices[3] = { v0, v0 + e1, v0 + e2 };
+    float best_t = max_t;
+    glm::vec3 best_normal;
+    float nn = glm::dot(d, d);
+    for (int k = 0; k < 3; ++k)
+    {
+        glm::vec3 m = s - vertices[k];
+        float c = glm::dot(m, m) - r*r;
+        float b = glm::dot(m, d);
+        if ( c <= 0.0f )
+        {
+            if ( 0.0f < best_t && b < 0.0f )
+            {
+                best_t = 0.0f;
+                best_normal = ContactNormal(s, vertices[k], side);
+            }
+        }
+        else if ( b < 0.0f && nn > 0.0f )
+        {
+            float disc = b*b - nn*c;
+            if ( disc >= 0.0f )
+            {
+                float t_vertex = (-b - std::sqrt(disc)) / nn;
+                if ( t_vertex < best_t )
+                {
+                    best_t = t_vertex;
+                    best_normal = ContactNormal(s + d*t_vertex, vertices[k], side);
+                }
+            }
+        }
+
+        glm::vec3 a = vertices[k];
+        glm::vec3 ab = vertices[(k + 1) % 3] - a;
+        float dd = glm::dot(ab, ab);
+        float md = glm::dot(m, ab);
+        float nd = glm::dot(d, ab);
+        float qa = dd*nn - nd*nd;
+        float qb = dd*glm::dot(m, d) - nd*md;
+        float qc = dd*(glm::dot(m, m) - r*r) - md*md;
+        if ( qc <= 0.0f )
+        {
+            // Já dentro do cilindro infinito da aresta
+            float e = md / dd;
+            glm::vec3 away = ContactNormal(s, a + ab*e, side);
+            if ( e >= 0.0f && e <= 1.0f && 0.0f < best_t && glm::dot(d, away) < 0.0f )
+            {
+                best_t = 0.0f;
+                best_normal = away;
+            }
+        }
+        else if ( qa > 0.0f && qb < 0.0f )
+        {
+            float disc = qb*qb - qa*qc;
+            if ( disc >= 0.0f )
+            {
+                float t_edge = (-qb - std::sqrt(disc)) / qa;
+                float e = (md + t_edge*nd) / dd;
+                if ( t_edge < best_t && e >= 0.0f && e <= 1.0f )
+                {
+                    best_t = t_edge;
+                    best_normal = ContactNormal(s + d*t_edge, a + ab*e, side);
+                }
+            }
+        }
+    }
+
+    if ( !(best_t < max_t) )
+        return false;
+    *t = best_t;
+    *normal = best_normal;
+    return true;
+}
+
+} // namespace
+
+void BVH_AppendMesh(const MeshView& mesh, std::vector<BVHTriangle>* triangles)
+{
+    triangles->reserve(triangles->size() + mesh.num_indices / 3);
+    for (size_t i = 0; i + 2 < mesh.num_indices; i += 3)
+    {
+        BVHTriangle triangle;
+        glm::vec3* corners[3] = { &triangle.v0, &triangle.v1, &triangle.v2 };
+        for (int k = 0; k < 3; ++k)
+        {
+            const float* p = mesh.model_coefficients + 4 * (size_t)mesh.indices[i + k];
+            *corners[k] = glm::vec3(p[0], p[1], p[2]);
+        }
+        triangles->push_back(triangle);
+    }
+}
+
+BVH::BVH()
+    : depth(0)
+    , geometry_hash(0)
+{
+}
+
+void BVH::build(const std::vector<BVHTriangle>& triangles)
+{
+    nodes.clear();
+    tris.clear();
+    triangle_index.clear();
+    normals.clear();
+    depth = 0;
+    geometry_hash = 0;
+    if ( triangles.empty() )
+        return;
+
+    size_t num_triangles = triangles.size();
+    build_bounds.resize(6 * num_triangles);
+    build_centroid.resize(3 * num_triangles);
+    normals.resize(num_triangles);
+    triangle_index.resize(num_triangles);
+    for (size_t i = 0; i < num_triangles; ++i)
+    {
+        const BVHTriangle& triangle = triangles[i];
+        glm::vec3 bbox_min = glm::min(triangle.v0, glm::min(triangle.v1, triangle.v2));
+        glm::vec3 bbox_max = glm::max(triangle.v0, glm::max(triangle.v1, triangle.v2));
+        for (int k = 0; k < 3; ++k)
+        {
+            build_bounds[6*i + k]     = bbox_min[k];
+            build_bounds[6*i + 3 + k] = bbox_max[k];
+            build_centroid[3*i + k]   = 0.5f * (bbox_min[k] + bbox_max[k]);
+        }
+        normals[i] = TriangleNormal(triangle);
+        triangle_index[i] = (uint32_t)i;
+    }
+
+    geometry_hash = DETMATH_HASH_SEED;
+    for (size_t i = 0; i < num_triangles; ++i)
+    {
+        const BVHTriangle& triangle = triangles[i];
+        const float vertices[9] = {
+            triangle.v0.x, triangle.v0.y, triangle.v0.z,
+            triangle.v1.x, triangle.v1.y, triangle.v1.z,
+            triangle.v2.x, triangle.v2.y, triangle.v2.z,
+        };
+        geometry_hash = DetMath_HashFloats(geometry_hash, vertices, 9);
+    }
+
+    nodes.reserve(2 * num_triangles);
+    buildNode(0, (uint32_t)num_triangles, 0);
+
+    tris.resize(9 * num_triangles);
+    for (size_t i = 0; i < num_triangles; ++i)
+        PackTriangle(triangles[triangle_index[i]], &tris[9*i]);
+
+    std::vector<float>().swap(build_bounds);
+    std::vector<float>().swap(build_centroid);
+}
+
+uint32_t BVH::buildNode(uint32_t begin, uint32_t end, int level)
+{
+    uint32_t index = (uint32_t)nodes.size();
+    nodes.push_back(BVHNode());
+    depth = std::max(depth, level + 1);
+
+    Bin bounds, centroids;
+    bounds.clear();
+    centroids.clear();
+    for (uint32_t i = begin; i < end; ++i)
+    {
+        uint32_t t = triangle_index[i];
+        bounds.grow(&build_bounds[6*t], &build_bounds[6*t + 3], 1);
+        centroids.grow(&build_centroid[3*t], &build_centroid[3*t], 0);
+    }
+
+    BVHNode node;
+    for (int k = 0; k < 3; ++k)
+    {
+        node.bbox_min[k] = bounds.bbox_min[k];
+        node.bbox_max[k] = bounds.bbox_max[k];
+    }
+
+    // Melhor divisão pela SAH: em cada eixo, os centróides são distribuídos
+    // em BVH_BINS intervalos iguais, e cada fronteira entre intervalos é
+    // avaliada com as caixas acumuladas dos dois lados
+    uint32_t count = end - begin;
+    int best_axis = -1;
+    int best_split = 0;
+    float best_cost = std::numeric_limits<float>::infinity();
+    if ( count > BVH_LEAF_SIZE && level < BVH_MAX_DEPTH )
+    {
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            float extent = centroids.bbox_max[axis] - centroids.bbox_min[axis];
+            if ( !(extent > 0.0f) )
+                continue;
+            float scale = BVH_BINS / extent;
+
+            Bin bins[BVH_BINS];
+            for (int b = 0; b < BVH_BINS; ++b)
+                bins[b].clear();
+            for (uint32_t i = begin; i < end; ++i)
+            {
+                uint32_t t = triangle_index[i];
+                int b = BinOf(build_centroid[3*t + axis], centroids.bbox_min[axis], scale);
+                bins[b].grow(&build_bounds[6*t], &build_bounds[6*t + 3], 1);
+            }
+
+            // Da direita para a esquerda: área e contagem à direita de cada
+            // fronteira; depois da esquerda para a direita, o custo
+            float right_area[BVH_BINS];
+            uint32_t right_count[BVH_BINS];
+            Bin accumulated;
+            accumulated.clear();
+            for (int b = BVH_BINS - 1; b > 0; --b)
+            {
+                accumulated.grow(bins[b].bbox_min, bins[b].bbox_max, bins[b].count);
+                right_count[b] = accumulated.count;
+                right_area[b] = accumulated.count > 0 ? HalfArea(accumulated.bbox_min, accumulated.bbox_max) : 0.0f;
+            }
+            accumulated.clear();
+            for (int b = 0; b < BVH_BINS - 1; ++b)
+            {
+                accumulated.grow(bins[b].bbox_min, bins[b].bbox_max, bins[b].count);
+                if ( accumulated.count == 0 || right_count[b + 1] == 0 )
+                    continue;
+                float cost = accumulated.count * HalfArea(accumulated.bbox_min, accumulated.bbox_max)
+                           + right_count[b + 1] * right_area[b + 1];
+                if ( cost < best_cost )
+                {
+                    best_cost = cost;
+                    best_axis = axis;
+                    best_split = b + 1;
+                }
+            }
+        }
+    }
+
+    // Folha se dividir não compensa: o custo de percorrer um nó mais o de
+    // testar os triângulos dos filhos (proporcional às áreas), contra o de
+    // testar todos os triângulos daqui (com o custo de um nó igual ao de um
+    // triângulo)
+    float node_area = HalfArea(bounds.bbox_min, bounds.bbox_max);
+    bool leaf = count <= BVH_LEAF_SIZE || level >= BVH_MAX_DEPTH;
+    if ( !leaf && best_axis >= 0 && count <= BVH_MAX_LEAF_SIZE && node_area + best_cost >= count * node_area )
+        leaf = true;
+    if ( !leaf && best_axis < 0 && count <= BVH_MAX_LEAF_SIZE )
+        leaf = true;
+    if ( leaf )
+    {
+        node.offset = begin;
+        node.count = count;
+        nodes[index] = node;
+        return index;
+    }
+
+    uint32_t middle = begin;
+    if ( best_axis >= 0 )
+    {
+        float centroid_min = centroids.bbox_min[best_axis];
+        float scale = BVH_BINS / (centroids.bbox_max[best_axis] - centroid_min);
+        const std::vector<float>& centroid = build_centroid;
+        int axis = best_axis, split = best_split;
+        middle = (uint32_t)(std::partition(triangle_index.begin() + begin, triangle_index.begin() + end,
+            [&centroid, axis, split, centroid_min, scale](uint32_t t)
+            {
+                return BinOf(centroid[3*t + axis], centroid_min, scale) < split;
+            }) - triangle_index.begin());
+    }
+    if ( middle == begin || middle == end )
+    {
+        // Centróides todos iguais: dividimos ao meio, no maior eixo da caixa
+        middle = begin + count / 2;
+        best_axis = 0;
+        for (int k = 1; k < 3; ++k)
+            if ( node.bbox_max[k] - node.bbox_min[k] > node.bbox_max[best_axis] - node.bbox_min[best_axis] )
+                best_axis = k;
+    }
+
+    buildNode(begin, middle, level + 1); // Filho esquerdo: index + 1
+    uint32_t right = buildNode(middle, end, level + 1);
+    node.offset = right | ((uint32_t)best_axis << 30);
+    node.count = 0;
+    nodes[index] = node;
+    return index;
+}
+
+void BVH::getBounds(glm::vec3* bbox_min, glm::vec3* bbox_max) const
+{
+    if ( nodes.empty() )
+    {
+        *bbox_min = *bbox_max = glm::vec3(0.0f);
+        return;
+    }
+    *bbox_min = glm::vec3(nodes[0].bbox_min[0], nodes[0].bbox_min[1], nodes[0].bbox_min[2]);
+    *bbox_max = glm::vec3(nodes[0].bbox_max[0], nodes[0].bbox_max[1], nodes[0].bbox_max[2]);
+}
+
+bool BVH::raycast(const BVHRay& ray, BVHHit* hit) const
+{
+    hit->t = ray.max_t;
+    hit->triangle = -1;
+    hit->normal = glm::vec3(0.0f);
+    if ( nodes.empty() )
+        return false;
+
+    float o[3]   = { ray.origin.x, ray.origin.y, ray.origin.z };
+    float d[3]   = { ray.direction.x, ray.direction.y, ray.direction.z };
+    float inv[3] = { SafeInverse(d[0]), SafeInverse(d[1]), SafeInverse(d[2]) };
+
+    float best_t = ray.max_t;
+    uint32_t best = BVH_NO_TRIANGLE;
+    uint32_t stack[BVH_STACK_SIZE];
+    int top = 0;
+    uint32_t index = 0;
+    for (;;)
+    {
+        const BVHNode& node = nodes[index];
+        if ( IntersectBox(node, o, inv, 0.0f, best_t) )
+        {
+            if ( node.count == 0 )
+            {
+                // Filho mais próximo primeiro, para que os acertos próximos
+                // reduzam best_t antes de visitar o mais distante
+                uint32_t right = node.offset & BVH_OFFSET_MASK;
+                bool negative = d[node.offset >> 30] < 0.0f;
+                stack[top++] = negative ? index + 1 : right;
+                index = negative ? right : index + 1;
+                continue;
+            }
+            for (uint32_t i = node.offset; i < node.offset + node.count; ++i)
+            {
+                float t = IntersectTriangle(&tris[9*i], o, d, best_t);
+                if ( t < best_t )
+                {
+                    best_t = t;
+                    best = i;
+                }
+            }
+        }
+        if ( top == 0 )
+            break;
+        index = stack[--top];
+    }
+
+    if ( best == BVH_NO_TRIANGLE )
+        return false;
+    uint32_t original = triangle_index[best];
+    hit->t = best_t;
+    hit->triangle = (int32_t)original;
+    hit->normal = glm::dot(normals[original], ray.direction) > 0.0f ? -normals[original] : normals[original];
+    return true;
+}
+
+int BVH::raycastPacket(const BVHRay rays[4], BVHHit hits[4]) const
+{
+#ifdef BVH_HAS_SSE
+    for (int r = 0; r < 4; ++r)
+    {
+        hits[r].t = rays[r].max_t;
+        hits[r].triangle = -1;
+        hits[r].normal = glm::vec3(0.0f);
+    }
+    if ( nodes.empty() )
+        return 0;
+
+    // Um raio por elemento dos registradores
+    __m128 ox = _mm_setr_ps(rays[0].origin.x, rays[1].origin.x, rays[2].origin.x, rays[3].origin.x);
+    __m128 oy = _mm_setr_ps(rays[0].origin.y, rays[1].origin.y, rays[2].origin.y, rays[3].origin.y);
+    __m128 oz = _mm_setr_ps(rays[0].origin.z, rays[1].origin.z, rays[2].origin.z, rays[3].origin.z);
+    __m128 dx = _mm_setr_ps(rays[0].direction.x, rays[1].direction.x, rays[2].direction.x, rays[3].direction.x);
+    __m128 dy = _mm_setr_ps(rays[0].direction.y, rays[1].direction.y, rays[2].direction.y, rays[3].direction.y);
+    __m128 dz = _mm_setr_ps(rays[0].direction.z, rays[1].direction.z, rays[2].direction.z, rays[3].direction.z);
+    __m128 ix = _mm_setr_ps(SafeInverse(rays[0].direction.x), SafeInverse(rays[1].direction.x),
+                            SafeInverse(rays[2].direction.x), SafeInverse(rays[3].direction.x));
+    __m128 iy = _mm_setr_ps(SafeInverse(rays[0].direction.y), SafeInverse(rays[1].direction.y),
+                            SafeInverse(rays[2].direction.y), SafeInverse(rays[3].direction.y));
+    __m128 iz = _mm_setr_ps(SafeInverse(rays[0].direction.z), SafeInverse(rays[1].direction.z),
+                            SafeInverse(rays[2].direction.z), SafeInverse(rays[3].direction.z));
+    __m128 best_t = _mm_setr_ps(rays[0].max_t, rays[1].max_t, rays[2].max_t, rays[3].max_t);
+    __m128i best = _mm_set1_epi32(-1);
+
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 epsilon = _mm_set1_ps(BVH_PARALLEL_EPSILON);
+    const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+
+    // A ordem dos filhos segue o primeiro raio; os raios das rodas têm
+    // praticamente a mesma direção
+    const float first_direction[3] = { rays[0].direction.x, rays[0].direction.y, rays[0].direction.z };
+
+    uint32_t stack[BVH_STACK_SIZE];
+    int top = 0;
+    uint32_t index = 0;
+    for (;;)
+    {
+        const BVHNode& node = nodes[index];
+        __m128 t1x = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.bbox_min[0]), ox), ix);
+        __m128 t2x = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.bbox_max[0]), ox), ix);
+        __m128 t1y = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.bbox_min[1]), oy), iy);
+        __m128 t2y = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.bbox_max[1]), oy), iy);
+        __m128 t1z = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.bbox_min[2]), oz), iz);
+        __m128 t2z = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.bbox_max[2]), oz), iz);
+        __m128 t_near = _mm_max_ps(_mm_max_ps(_mm_min_ps(t1x, t2x), _mm_min_ps(t1y, t2y)),
+                                   _mm_max_ps(_mm_min_ps(t1z, t2z), zero));
+        __m128 t_far  = _mm_min_ps(_mm_min_ps(_mm_max_ps(t1x, t2x), _mm_max_ps(t1y, t2y)),
+                                   _mm_min_ps(_mm_max_ps(t1z, t2z), best_t));
+        __m128 active = _mm_cmple_ps(t_near, t_far);
+
+        if ( _mm_movemask_ps(active) != 0 )
+        {
+            if ( node.count == 0 )
+            {
+                uint32_t right = node.offset & BVH_OFFSET_MASK;
+                bool negative = first_direction[node.offset >> 30] < 0.0f;
+                stack[top++] = negative ? index + 1 : right;
+                index = negative ? right : index + 1;
+                continue;
+            }
+
+            // Möller–Trumbore com as mesmas operações de IntersectTriangle(),
+            // em um triângulo e quatro raios; só os raios que atingiram a
+            // caixa da folha são atualizados
+            for (uint32_t i = node.offset; i < node.offset + node.count; ++i)
+            {
+                const float* tri = &tris[9*i];
+                __m128 v0x = _mm_set1_ps(tri[0]), v0y = _mm_set1_ps(tri[1]), v0z = _mm_set1_ps(tri[2]);
+                __m128 e1x = _mm_set1_ps(tri[3]), e1y = _mm_set1_ps(tri[4]), e1z = _mm_set1_ps(tri[5]);
+                __m128 e2x = _mm_set1_ps(tri[6]), e2y = _mm_set1_ps(tri[7]), e2z = _mm_set1_ps(tri[8]);
+
+                __m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+                __m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+                __m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+                __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+                __m128 inv_det = _mm_div_ps(one, det);
+
+                __m128 sx = _mm_sub_ps(ox, v0x);
+                __m128 sy = _mm_sub_ps(oy, v0y);
+                __m128 sz = _mm_sub_ps(oz, v0z);
+                __m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, px), _mm_mul_ps(sy, py)), _mm_mul_ps(sz, pz)), inv_det);
+
+                __m128 qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+                __m128 qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+                __m128 qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+                __m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)), inv_det);
+                __m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), inv_det);
+
+                __m128 mask = _mm_and_ps(active, _mm_cmpgt_ps(_mm_and_ps(det, abs_mask), epsilon));
+                mask = _mm_and_ps(mask, _mm_and_ps(_mm_cmpge_ps(u, zero), _mm_cmple_ps(u, one)));
+                mask = _mm_and_ps(mask, _mm_and_ps(_mm_cmpge_ps(v, zero), _mm_cmple_ps(_mm_add_ps(u, v), one)));
+                mask = _mm_and_ps(mask, _mm_and_ps(_mm_cmpge_ps(t, zero), _mm_cmplt_ps(t, best_t)));
+
+                __m128i imask = _mm_castps_si128(mask);
+                best_t = _mm_or_ps(_mm_and_ps(mask, t), _mm_andnot_ps(mask, best_t));
+                best = _mm_or_si128(_mm_and_si128(imask, _mm_set1_epi32((int)i)), _mm_andnot_si128(imask, best));
+            }
+        }
+        if ( top == 0 )
+            break;
+        index = stack[--top];
+    }
+
+    float t_values[4];
+    int32_t indices[4];
+    _mm_storeu_ps(t_values, best_t);
+    _mm_storeu_si128((__m128i*)indices, best);
+
+    int num_hits = 0;
+    for (int r = 0; r < 4; ++r)
+    {
+        if ( indices[r] < 0 )
+            continue;
+        uint32_t original = triangle_index[indices[r]];
+        hits[r].t = t_values[r];
+        hits[r].triangle = (int32_t)original;
+        hits[r].normal = glm::dot(normals[original], rays[r].direction) > 0.0f ? -normals[original] : normals[original];
+        num_hits++;
+    }
+    return num_hits;
+#else
+    int num_hits = 0;
+    for (int r = 0; r < 4; ++r)
+        num_hits += raycast(rays[r], &hits[r]) ? 1 : 0;
+    return num_hits;
+#endif // BVH_HAS_SSE
+}
+
+size_t BVH::raycastWheels(const BVHRay* rays, size_t num_cars, BVHHit* hits) const
+{
+    std::atomic<size_t> num_hits(0);
+    ParallelFor(num_cars, 256, [&](size_t begin, size_t end)
+    {
+        size_t count = 0;
+        for (size_t car = begin; car < end; ++car)
+            count += raycastPacket(rays + 4*car, hits + 4*car);
+        num_hits += count;
+    });
+    return num_hits;
+}
+
+bool BVH::sweepSphere(const glm::vec3& start, const glm::vec3& end, float radius, float max_normal_y, BVHHit* hit) const
+{
+    hit->t = 1.0f;
+    hit->triangle = -1;
+    hit->normal = glm::vec3(0.0f);
+    if ( nodes.empty() )
+        return false;
+
+    // O segmento do centro contra as caixas aumentadas do raio da esfera
+    glm::vec3 d = end - start;
+    float o[3]   = { start.x, start.y, start.z };
+    float inv[3] = { SafeInverse(d.x), SafeInverse(d.y), SafeInverse(d.z) };
+
+    float best_t = 1.0f;
+    uint32_t best = BVH_NO_TRIANGLE;
+    glm::vec3 best_normal;
+    uint32_t stack[BVH_STACK_SIZE];
+    int top = 0;
+    uint32_t index = 0;
+    for (;;)
+    {
+        const BVHNode& node = nodes[index];
+        if ( IntersectBox(node, o, inv, radius, best_t) )
+        {
+            if ( node.count == 0 )
+            {
+                uint32_t right = node.offset & BVH_OFFSET_MASK;
+                bool negative = d[node.offset >> 30] < 0.0f;
+                stack[top++] = negative ? index + 1 : right;
+                index = negative ? right : index + 1;
+                continue;
+            }
+            for (uint32_t i = node.offset; i < node.offset + node.count; ++i)
+            {
+                const glm::vec3& n = normals[triangle_index[i]];
+                if ( std::fabs(n.y) > max_normal_y )
+                    continue;
+                float t;
+                glm::vec3 normal;
+                if ( SweepTriangle(&tris[9*i], n, start, d, radius, best_t, &t, &normal) )
+                {
+                    best_t = t;
+                    best = i;
+                    best_normal = normal;
+                }
+            }
+        }
+        if ( top == 0 )
+            break;
+        index = stack[--top];
+    }
+
+    if ( best == BVH_NO_TRIANGLE )
+        return false;
+    hit->t = best_t;
+    hit->triangle = (int32_t)triangle_index[best];
+    hit->normal = best_normal;
+    return true;
+}
+
+void BVH_Benchmark(const char* name, const std::vector<BVHTriangle>& triangles)
+{
+    typedef std::chrono::steady_clock clock;
+
+    printf("Benchmark de BVH: %s, %lu triângulos\n", name, (unsigned long)triangles.size());
+
+    BVH bvh;
+    clock::time_point start = clock::now();
+    bvh.build(triangles);
+    double build_ms = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+    printf("  construção %9.2f ms  %lu nós (%.1f MB)  profundidade %d\n", build_ms, (unsigned long)bvh.getNumNodes(),
+           (bvh.getNumNodes() * sizeof(BVHNode) + bvh.getNumTriangles() * 9 * sizeof(float)) / (1024.0 * 1024.0), bvh.getDepth());
+    if ( bvh.isEmpty() )
+        return;
+
+    glm::vec3 bbox_min, bbox_max;
+    bvh.getBounds(&bbox_min, &bbox_max);
+    glm::vec3 extent = bbox_max - bbox_min;
+    float size = std::max(extent.x, extent.z);
+
+    // Carros espalhados sobre a malha, com as rodas nos cantos de um
+    // retângulo de 1% x 1.6% do tamanho da malha e os raios para baixo,
+    // levemente inclinados
+    const size_t num_cars = 1 << 16;
+    std::vector<BVHRay> rays(4 * num_cars);
+    srand(1234);
+    for (size_t car = 0; car < num_cars; ++car)
+    {
+        float x = bbox_min.x + extent.x * (rand() / (float)RAND_MAX);
+        float z = bbox_min.z + extent.z * (rand() / (float)RAND_MAX);
+        for (int wheel = 0; wheel < 4; ++wheel)
+        {
+            BVHRay& ray = rays[4*car + wheel];
+            ray.origin = glm::vec3(x + ((wheel & 1) ? 0.005f : -0.005f) * size,
+                                   bbox_max.y + 0.01f * size,
+                                   z + ((wheel & 2) ? 0.008f : -0.008f) * size);
+            ray.direction = glm::vec3(0.05f * (rand() / (float)RAND_MAX - 0.5f), -1.0f,
+                                      0.05f * (rand() / (float)RAND_MAX - 0.5f));
+            ray.max_t = extent.y + 0.02f * size;
+        }
+    }
+
+    std::vector<BVHHit> scalar(rays.size()), packet(rays.size()), wheels(rays.size());
+    const char* names[3] = { "escalar", "pacotes de 4", "pacotes, threads" };
+    std::vector<BVHHit>* results[3] = { &scalar, &packet, &wheels };
+    for (int mode = 0; mode < 3; ++mode)
+    {
+        std::vector<BVHHit>& hits = *results[mode];
+        double best_ms = 1e30;
+        size_t num_hits = 0;
+        for (int repetition = 0; repetition < 3; ++repetition)
+        {
+            start = clock::now();
+            num_hits = 0;
+            if ( mode == 0 )
+            {
+                for (size_t r = 0; r < rays.size(); ++r)
+                    num_hits += bvh.raycast(rays[r], &hits[r]) ? 1 : 0;
+            }
+            else if ( mode == 1 )
+            {
+                for (size_t car = 0; car < num_cars; ++car)
+                    num_hits += bvh.raycastPacket(&rays[4*car], &hits[4*car]);
+            }
+            else
+                num_hits = bvh.raycastWheels(rays.data(), num_cars, hits.data());
+            best_ms = std::min(best_ms, std::chrono::duration<double, std::milli>(clock::now() - start).count());
+        }
+
+        size_t different = 0;
+        for (size_t r = 0; r < rays.size(); ++r)
+            different += (hits[r].triangle < 0) != (scalar[r].triangle < 0) || hits[r].t != scalar[r].t;
+
+        printf("  raios, %-17s %9.2f ms  %8.2f Mraios/s  %lu atingidos", names[mode], best_ms,
+               rays.size() / (best_ms * 1e3), (unsigned long)num_hits);
+        if ( different > 0 )
+            printf("  ATENÇÃO: %lu diferentes do escalar", (unsigned long)different);
+        printf("\n");
+    }
+
+    // Verificação contra o teste de todos os triângulos em alguns raios
+    std::vector<float> packed(9 * triangles.size());
+    for (size_t i = 0; i < triangles.size(); ++i)
+        PackTriangle(triangles[i], &packed[9*i]);
+    size_t num_checked = std::min((size_t)1024, std::max((size_t)16, (size_t)256000000 / triangles.size()));
+    size_t wrong = 0;
+    for (size_t r = 0; r < num_checked; ++r)
+    {
+        float o[3] = { rays[r].origin.x, rays[r].origin.y, rays[r].origin.z };
+        float d[3] = { rays[r].direction.x, rays[r].direction.y, rays[r].direction.z };
+        float best_t = rays[r].max_t;
+        bool found = false;
+        for (size_t i = 0; i < triangles.size(); ++i)
+        {
+            float t = IntersectTriangle(&packed[9*i], o, d, best_t);
+            if ( t < best_t )
+            {
+                best_t = t;
+                found = true;
+            }
+        }
+        wrong += found != (scalar[r].triangle >= 0) || best_t != scalar[r].t;
+    }
+    printf("  %lu raios verificados contra todos os triângulos: %s\n", (unsigned long)num_checked,
+           wrong == 0 ? "OK" : "ATENÇÃO: resultados diferentes");
+
+    // Esferas varridas com raio de 1% do tamanho da malha, andando 2% em uma
+    // direção horizontal aleatória
+    const size_t num_spheres = 1 << 14;
+    std::vector<glm::vec3> sphere_start(num_spheres), sphere_end(num_spheres);
+    for (size_t i = 0; i < num_spheres; ++i)
+    {
+        sphere_start[i] = bbox_min + extent * glm::vec3(rand() / (float)RAND_MAX, rand() / (float)RAND_MAX, rand() / (float)RAND_MAX);
+        float angle = 6.2831853f * (rand() / (float)RAND_MAX);
+        sphere_end[i] = sphere_start[i] + 0.02f * size * glm::vec3(std::cos(angle), 0.0f, std::sin(angle));
+    }
+    float radius = 0.01f * size;
+    std::vector<BVHHit> sphere_hits(num_spheres);
+    double sweep_ms = 1e30;
+    size_t num_sphere_hits = 0;
+    for (int repetition = 0; repetition < 3; ++repetition)
+    {
+        start = clock::now();
+        num_sphere_hits = 0;
+        for (size_t i = 0; i < num_spheres; ++i)
+            num_sphere_hits += bvh.sweepSphere(sphere_start[i], sphere_end[i], radius, 1.0f, &sphere_hits[i]) ? 1 : 0;
+        sweep_ms = std::min(sweep_ms, std::chrono::duration<double, std::milli>(clock::now() - start).count());
+    }
+
+    size_t sweeps_checked = std::min(num_spheres, num_checked / 4);
+    wrong = 0;
+    for (size_t s = 0; s < sweeps_checked; ++s)
+    {
+        glm::vec3 d = sphere_end[s] - sphere_start[s];
+        float best_t = 1.0f;
+        bool found = false;
+        for (size_t i = 0; i < triangles.size(); ++i)
+        {
+            float t;
+            glm::vec3 normal;
+            if ( SweepTriangle(&packed[9*i], TriangleNormal(triangles[i]), sphere_start[s], d, radius, best_t, &t, &normal) )
+            {
+                best_t = t;
+                found = true;
+            }
+        }
+        wrong += found != (sphere_hits[s].triangle >= 0) || best_t != sphere_hits[s].t;
+    }
+
+    printf("  esferas varridas        %9.2f ms  %8.2f Mesferas/s  %lu colisões  (%lu verificadas: %s)\n",
+           sweep_ms, num_spheres / (sweep_ms * 1e3), (unsigned long)num_sphere_hits,
+           (unsigned long)sweeps_checked, wrong == 0 ? "OK" : "ATENÇÃO: resultados diferentes");
+}
@@ -11,33 +11,16 @@
 #define M_PI   3.14159265358979323846
 #define M_PI_2 1.57079632679489661923
 
-#define MAX_VEL 50.0f
-#define MIN_VEL 2.0f // Velocidade minima para quando estiver freiando, parar
-#define ACCELERATION 10.0f
-#define ACCELERATION_REVERSE 0.0001f
-#define BRAKE_ACCELERATION 0.005f
-
-#define VELOCITY_DECAY_RATIO 0.01f
-#define SIDE_VELOCITY_DECAY_RATIO 0.05f
-#define TURNING_DECAY_RATIO 5.0f
-
-#define ZERO_VELOCITY_THRESHOLD 0.000006f
-#define ZERO_TURNANGLE_THRESHOLD 0.000066f
-#define ZERO_TURNVEL_THRESHOLD 0.000006f
+#include "bvh.h"
+#include "carcollision.h"
+#include "carparams.h"
+#include "detmath.h"
+#include "heightfield.h"
+#include "replay.h"
+#include "tyremodel.h"
 
 #define CAMERA_INITIAL_HEIGHT 8.0f
 
-#define MAX_SIDE_GRIP 0.30f
-#define MIN_CORRELATION_GRIP 0.99f
-#define SLIDING_TURN_COEFICIENT 3.00f
-#define NOT_SLIDING_TURN_COEFICIENT 0.30f
-
-#define TURN_SPEED_COEFICIENT 0.6f
-
-#define ACCELERATE_TYRE_SPEED_COEFICIENT 60.0f
-
-#define SLIDING_DRAG_COEFICIENT 20.0f
-
 
 class Car
 {
@@ -51,7 +34,35 @@ private:
     bool isSliding;
     bool reverse;
     float turnAngle;
-    const float mass = 1.0f;
+
+    // Posição e rotação antes do último passo da simulação. O desenho
+    // interpola entre estas e as atuais (veja "fixedstep.h").
+    glm::vec4 previousPosition;
+    glm::vec3 previousRotation;
+
+    // Parâmetros de dirigibilidade, e o kernel de update() escolhido para
+    // eles (veja "carparams.h")
+    CarParams params;
+    CarPresetKernel kernel;
+
+    // Chão em que o carro se apoia a cada passo (veja setGround()), e a
+    // inclinação do modelo para acompanhá-lo
+    const Heightfield* ground;
+    glm::mat4 groundTilt;
+
+    // Pista com paredes e chão (veja setTrack()), e a caixa do carro usada
+    // para os contatos com ela
+    const BVH* track;
+    CarCollisionShape trackShape;
+
+    // Modo determinístico: seno, cosseno e arcos de "detmath.h" no lugar
+    // dos da biblioteca C (veja setDeterministic())
+    bool deterministic;
+
+    // Modelo de pneus que substitui as regras de derrapagem (veja
+    // setTyreModel())
+    const TyreModel* tyres;
+
     const float verysmallnumber = std::numeric_limits<float>::epsilon();
 
 
@@ -69,8 +80,192 @@ public:
         isSliding = false;
         turnAngle = 0.0f;
         reverse = false;
+        previousPosition = position;
+        previousRotation = rotation;
+        ground = NULL;
+        groundTilt = Matrix_Identity();
+        track = NULL;
+        trackShape = CarCollisionShape();
+        deterministic = false;
+        tyres = NULL;
+        setParams(CarParams_Default());
     };
 
+    void setParams(const CarParams& value){
+        params = value;
+        kernel = CarParams_FindKernel(value);
+    }
+    const CarParams& getParams() const {
+        return params;
+    }
+    CarPresetKernel getKernel() const {
+        return kernel;
+    }
+
+    // Estado gravado nos keyframes dos replays (veja "replay.h"). As teclas
+    // (accelerate, brake, reverse) não fazem parte dele, pois são aplicadas
+    // de novo a cada passo por applyControls().
+    ReplayCarState getReplayState() const {
+        ReplayCarState state;
+        for(int i = 0; i < 3; ++i){
+            state.position[i] = position[i];
+            state.rotation[i] = rotation[i];
+            state.velocity[i] = velocity[i];
+            state.forwards[i] = forwardsVector[i];
+        }
+        state.turn_angle = turnAngle;
+        state.is_sliding = isSliding;
+        return state;
+    }
+    void setReplayState(const ReplayCarState& state){
+        position = glm::vec4(state.position[0], state.position[1], state.position[2], 1.0f);
+        rotation = glm::vec3(state.rotation[0], state.rotation[1], state.rotation[2]);
+        velocity = glm::vec4(state.velocity[0], state.velocity[1], state.velocity[2], 0.0f);
+        forwardsVector = glm::vec4(state.forwards[0], state.forwards[1], state.forwards[2], 0.0f);
+        turnAngle = state.turn_angle;
+        isSliding = state.is_sliding;
+        previousPosition = position;
+        previousRotation = rotation;
+    }
+
+    // Contato com a pista (veja followTrack()): altura do chão sob as rodas,
+    // e batida em uma parede de normal horizontal "normal", que
+    // leva o carro ao ponto de contato e anula a velocidade contra a parede
+    void setHeight(float y){
+        position.y = y;
+    }
+    void hitWall(const glm::vec4& contact_position, const glm::vec4& normal){
+        position = contact_position;
+        float into = dotproduct(velocity, normal);
+        if(into < 0.0f) velocity = velocity - into * normal;
+    }
+
+    // Com um mapa de alturas, updatePosition() coloca o carro na altura do
+    // chão e o modelo é inclinado para a normal do chão. NULL (o padrão)
+    // mantém o movimento no plano.
+    void setGround(const Heightfield* value){
+        ground = value;
+        groundTilt = Matrix_Identity();
+    }
+    void snapToGround(){
+        float height;
+        glm::vec3 normal;
+        ground->sample(position.x, position.z, &height, &normal);
+        position.y = height;
+
+        // Rotação que leva (0,1,0) à normal: eixo (0,1,0) x normal
+        glm::vec4 axis = glm::vec4(normal.z, 0.0f, -normal.x, 0.0f);
+        if(norm(axis) > verysmallnumber) groundTilt = Matrix_Rotate(std::acos(normal.y), axis);
+        else groundTilt = Matrix_Identity();
+    }
+
+    // Com uma pista, cada passo de update() termina com followTrack(), de
+    // modo que o jogo, a reprodução de replays e ReplayPlayer::seek()
+    // executam o mesmo passo. NULL (o padrão) é o chão plano, como em
+    // car_sim e nos benchmarks. "shape" é a caixa do carro.
+    void setTrack(const BVH* value, const CarCollisionShape& shape){
+        track = value;
+        trackShape = shape;
+    }
+
+    // Apoia o carro na pista após um passo da física. Quatro raios para
+    // baixo, um em cada canto da caixa, dão a altura do chão sob as rodas (a
+    // média dos que atingem a pista), e uma esfera com a meia-largura do
+    // carro, varrida da posição anterior à atual, detecta as paredes
+    // (triângulos com normal quase horizontal). Fora da pista o carro mantém
+    // a altura. Com um mapa de alturas (setGround()), updatePosition() já
+    // apoia o carro no chão; aqui restam as paredes, e o carro é apoiado de
+    // novo no ponto em que bateu.
+    void followTrack(){
+        const float wall_max_normal_y = 0.7f; // Paredes: inclinação acima de ~45 graus
+        const float wheel_ray_height  = 2.0f; // Altura acima do carro em que os raios começam
+
+        if(track == NULL || track->isEmpty()) return;
+
+        float radius = trackShape.half_width;
+        glm::vec3 lift(0.0f, radius, 0.0f);
+        BVHHit wall;
+        if(track->sweepSphere(glm::vec3(previousPosition) + lift, glm::vec3(position) + lift, radius, wall_max_normal_y, &wall)){
+            // Contatos com a quina de cima de uma parede podem ter normal
+            // quase vertical; esses não param o carro
+            glm::vec4 normal = glm::vec4(wall.normal.x, 0.0f, wall.normal.z, 0.0f);
+            float length = norm(normal);
+            if(length > 0.1f) hitWall(previousPosition + (position - previousPosition) * wall.t, normal / length);
+        }
+
+        if(ground != NULL){
+            snapToGround();
+            return;
+        }
+
+        // Rodas nos cantos da caixa, giradas pelo "yaw" como em
+        // Matrix_Rotate_Y(). A altura entra no estado do carro: no modo
+        // determinístico o seno e o cosseno são os de "detmath.h", como em
+        // getBodyRotate().
+        float c, s;
+        if(deterministic) DetMath_SinCos(rotation.y, &s, &c);
+        else{
+            c = std::cos(rotation.y);
+            s = std::sin(rotation.y);
+        }
+        BVHRay rays[4];
+        for(int wheel = 0; wheel < 4; ++wheel){
+            float x = trackShape.center_x + ((wheel & 1) ? trackShape.half_width : -trackShape.half_width);
+            float z = trackShape.center_z + ((wheel & 2) ? trackShape.half_length : -trackShape.half_length);
+            rays[wheel].origin = glm::vec3(position.x + c*x + s*z, position.y + wheel_ray_height, position.z - s*x + c*z);
+            rays[wheel].direction = glm::vec3(0.0f, -1.0f, 0.0f);
+            rays[wheel].max_t = 2.0f * wheel_ray_height;
+        }
+
+        BVHHit hits[4];
+        if(track->raycastPacket(rays, hits) == 0) return;
+        float height = 0.0f;
+        int num_hits = 0;
+        for(int wheel = 0; wheel < 4; ++wheel){
+            if(hits[wheel].triangle < 0) continue;
+            height += rays[wheel].origin.y - hits[wheel].t;
+            num_hits++;
+        }
+        setHeight(height / num_hits);
+    }
+
+    // No modo determinístico, com passo fixo, o mesmo estado inicial e as
+    // mesmas teclas dão o mesmo estado bit a bit em qualquer máquina e
+    // compilação (veja "detmath.h"; a thread da simulação deve chamar
+    // DetMath_ResetFloatingPoint()). Os resultados diferem um pouco dos do
+    // modo normal: replays gravados em um modo devem ser reproduzidos no
+    // mesmo modo.
+    void setDeterministic(bool value){
+        deterministic = value;
+    }
+    bool isDeterministic() const {
+        return deterministic;
+    }
+
+    // Com um modelo de pneus (veja "tyremodel.h"), as forças laterais e
+    // longitudinais saem das curvas do modelo, no lugar das regras de
+    // derrapagem de updateRotation() e updateVelocity(); a derrapagem é
+    // passar do pico das curvas. NULL (o padrão) mantém as regras. Como no
+    // modo determinístico, replays devem ser reproduzidos com a mesma opção.
+    void setTyreModel(const TyreModel* value){
+        tyres = value;
+    }
+
+    // Hash de todo o estado que a simulação usa no próximo passo (o estado
+    // anterior, que só serve para interpolar o desenho, fica de fora). Dois
+    // carros com checksums iguais a cada passo estão sincronizados.
+    uint64_t getStateChecksum() const {
+        float state[20] = {
+            position.x, position.y, position.z, position.w,
+            rotation.x, rotation.y, rotation.z,
+            velocity.x, velocity.y, velocity.z, velocity.w,
+            forwardsVector.x, forwardsVector.y, forwardsVector.z, forwardsVector.w,
+            turnAngle,
+            isSliding ? 1.0f : 0.0f, accelerate ? 1.0f : 0.0f, brake ? 1.0f : 0.0f, reverse ? 1.0f : 0.0f
+        };
+        return DetMath_HashFloats(DETMATH_HASH_SEED, state, 20);
+    }
+
     bool getIsSliding(){
     	return isSliding;
     }
@@ -95,21 +290,45 @@ public:
         glm::vec3 cameraPos = glm::vec3(0.0f,CAMERA_INITIAL_HEIGHT,-7.0f);
         return cameraLookAt - cameraPos;
     }
-    float getCameraTheta(){
+    // Os getters abaixo com "alpha" interpolam entre o estado anterior
+    // (alpha = 0) e o atual (alpha = 1, o padrão)
+    float getCameraTheta(float alpha = 1.0f){
         glm::vec3 v = normalize(calculateCameraViewVector());
 
         // When retrieving the theta, consider the car rotation as well
-        return std::atan2(v.x, v.y)+rotation.y;
+        float theta = deterministic ? DetMath_Atan2(v.x, v.y) : std::atan2(v.x, v.y);
+        return theta+getRotation(alpha).y;
     }
     float getCameraPhi(){
         glm::vec3 v = normalize(calculateCameraViewVector());
-        return std::acos(v.z);
+        return deterministic ? DetMath_Acos(v.z) : std::acos(v.z);
+    }
+    glm::mat4 getTranslationMatrix(float alpha = 1.0f){
+        glm::vec4 p = getPosition(alpha);
+        return Matrix_Translate(p.x, p.y, p.z);
+    }
+    // Rotação do modelo, com a inclinação do chão. A física usa somente a
+    // rotação do carro (getBodyRotate()).
+    glm::mat4 getMatrixRotate(float alpha = 1.0f){
+        if(ground != NULL) return groundTilt * getBodyRotate(alpha);
+        return getBodyRotate(alpha);
     }
-    glm::mat4 getTranslationMatrix(){
-        return Matrix_Translate(position.x, position.y, position.z);
+    glm::mat4 getBodyRotate(float alpha = 1.0f){
+        glm::vec3 r = getRotation(alpha);
+        if(deterministic) return deterministicRotate(r);
+        return Matrix_Rotate_Z(r.z) * Matrix_Rotate_Y(r.y) * Matrix_Rotate_X(r.x);
     }
-    glm::mat4 getMatrixRotate(){
-        return Matrix_Rotate_Z(rotation.z) * Matrix_Rotate_Y(rotation.y) * Matrix_Rotate_X(rotation.x);
+    // Matrix_Rotate_Z(r.z) * Matrix_Rotate_Y(r.y) * Matrix_Rotate_X(r.x),
+    // com seno e cosseno de "detmath.h"
+    static glm::mat4 deterministicRotate(const glm::vec3& r){
+        float sx, cx, sy, cy, sz, cz;
+        DetMath_SinCos(r.x, &sx, &cx);
+        DetMath_SinCos(r.y, &sy, &cy);
+        DetMath_SinCos(r.z, &sz, &cz);
+        glm::mat4 rotate_x = Matrix(1.0f, 0.0f, 0.0f, 0.0f,  0.0f, cx, -sx, 0.0f,  0.0f, sx, cx, 0.0f,  0.0f, 0.0f, 0.0f, 1.0f);
+        glm::mat4 rotate_y = Matrix(cy, 0.0f, sy, 0.0f,  0.0f, 1.0f, 0.0f, 0.0f,  -sy, 0.0f, cy, 0.0f,  0.0f, 0.0f, 0.0f, 1.0f);
+        glm::mat4 rotate_z = Matrix(cz, -sz, 0.0f, 0.0f,  sz, cz, 0.0f, 0.0f,  0.0f, 0.0f, 1.0f, 0.0f,  0.0f, 0.0f, 0.0f, 1.0f);
+        return rotate_z * rotate_y * rotate_x;
     }
     glm::vec4 getForwardsVector(){
     	return forwardsVector;
@@ -126,92 +345,179 @@ public:
     glm::vec4 getVelocity(){
         return velocity;
     }
-    glm::vec4 getPosition(){
-        return position;
+    glm::vec4 getPosition(float alpha = 1.0f){
+        return previousPosition * (1.0f - alpha) + position * alpha;
     }
     void turnRight(float elapsed_time){
-        turnAngle -= TURN_SPEED_COEFICIENT * elapsed_time;
+        turnAngle -= params.turn_speed_coeficient * elapsed_time;
     }
     void turnLeft(float elapsed_time){
-        turnAngle += TURN_SPEED_COEFICIENT * elapsed_time;
+        turnAngle += params.turn_speed_coeficient * elapsed_time;
+    }
+
+    // Aplica as teclas de um passo da simulação, como em
+    // updateFromKeyboard() (a ré também acelera)
+    void applyControls(bool forwards, bool brakeHeld, bool left, bool right, bool reverseHeld, float elapsed_time){
+        setAccelerate(forwards || reverseHeld);
+        if(left) turnLeft(elapsed_time);
+        if(right) turnRight(elapsed_time);
+        setBrake(brakeHeld);
+        setReverse(reverseHeld);
     }
 
     void updatePosition(float elapsed_time){
     	position = position + velocity * elapsed_time;
+        if(ground != NULL) snapToGround();
     }
 
-    void updateRotation(float elapsed_time){
-        float forca_centrifuga = powf(turnAngle, 2) * mass * norm(velocity);
+    // "p" é RuntimeCarParams ou um preset (veja "carparams.h")
+    template <class Params>
+    void updateRotation(const Params& p, float elapsed_time){
+        // turnAngle ao quadrado sem powf(), que depende da biblioteca C; o
+        // produto é corretamente arredondado em qualquer máquina
+        float forca_centrifuga = turnAngle * turnAngle * p.mass() * norm(velocity);
 
-        if(forca_centrifuga > MAX_SIDE_GRIP || brake) isSliding = true;
-        else if(dotproduct(velocity, forwardsVector) / (norm(velocity) + 0.000001f) > MIN_CORRELATION_GRIP) isSliding = false;
+        if(forca_centrifuga > p.max_side_grip() || brake) isSliding = true;
+        else if(dotproduct(velocity, forwardsVector) / (norm(velocity) + 0.000001f) > p.min_correlation_grip()) isSliding = false;
 
         if(isSliding)
-            rotation.y += turnAngle * SLIDING_TURN_COEFICIENT * elapsed_time;
+            rotation.y += turnAngle * p.sliding_turn_coeficient() * elapsed_time;
         else
-        rotation.y += turnAngle * NOT_SLIDING_TURN_COEFICIENT * norm(velocity) * elapsed_time;
+        rotation.y += turnAngle * p.not_sliding_turn_coeficient() * norm(velocity) * elapsed_time;
 
 
-        turnAngle *= 1 - TURNING_DECAY_RATIO * elapsed_time; // Decaimento do ângulo de curva
+        turnAngle *= 1 - p.turning_decay_ratio() * elapsed_time; // Decaimento do ângulo de curva
 
         // Threshhold para zerar curva
-        if(std::fabs(turnAngle) < ZERO_TURNANGLE_THRESHOLD) turnAngle = 0.0f;
+        if(std::fabs(turnAngle) < p.zero_turnangle_threshold()) turnAngle = 0.0f;
     }
 
-    void updateVelocity(float elapsed_time){
-        // Calcula sideVelocity e forwardsVelocity
-        // sideVelocity é o vetor da velocidade que aponta para a lateral do carro (esquerda ou direita)
-        glm::vec4 side = normalize(crossproduct(forwardsVector, glm::vec4(0.0f, -1.0f, 0.0f, 0.0f)));
-        glm::vec4 sideVelocity = side * dotproduct(velocity, side); // sideVelocity é o vetor da componente de velocidade perpendicular ao fowards
-
+    template <class Params>
+    void updateVelocity(const Params& p, float elapsed_time){
         float tyreSpeed = dotproduct(forwardsVector, velocity);
 
         if(brake)
             tyreSpeed = 0.0f;
         else if(accelerate)
-            tyreSpeed = ACCELERATE_TYRE_SPEED_COEFICIENT;
+            tyreSpeed = p.accelerate_tyre_speed_coeficient();
         if(isSliding){
             velocity -= forwardsVector * tyreSpeed;
-            velocity -= elapsed_time * (norm(velocity) > mass * SLIDING_DRAG_COEFICIENT? normalize(velocity) * mass * SLIDING_DRAG_COEFICIENT : velocity);
+            velocity -= elapsed_time * (norm(velocity) > p.mass() * p.sliding_drag_coeficient()? normalize(velocity) * p.mass() * p.sliding_drag_coeficient() : velocity);
             velocity += forwardsVector * tyreSpeed;
 
         }else{
             glm::vec4 forwards = forwardsVector * (dotproduct(forwardsVector, velocity) + verysmallnumber);
             forwards = normalize(forwards);
-            velocity = forwards * (norm(velocity) + (accelerate ? ACCELERATION : 0.0f) * elapsed_time);
+            velocity = forwards * (norm(velocity) + (accelerate ? p.acceleration() : 0.0f) * elapsed_time);
 
         }
 
-        if(norm(velocity)>=MAX_VEL){
-            velocity=MAX_VEL * normalize(velocity);
+        limitVelocity(p, elapsed_time);
+    }
+
+    // Velocidade máxima, parada ao frear devagar e desaceleração sem
+    // acelerador nem freio, comuns às regras e ao modelo de pneus
+    template <class Params>
+    void limitVelocity(const Params& p, float elapsed_time){
+        if(norm(velocity)>=p.max_velocity()){
+            velocity=p.max_velocity() * normalize(velocity);
         }
 
-        if((norm(velocity)<=MIN_VEL) && (brake)){
+        if((norm(velocity)<=p.min_velocity()) && (brake)){
             velocity = glm::vec4(0.0f, 0.0f, 0.0f, 0.0f);
         }
         
-        if(!accelerate && !brake) velocity *= 1 - VELOCITY_DECAY_RATIO * elapsed_time;
+        if(!accelerate && !brake) velocity *= 1 - p.velocity_decay_ratio() * elapsed_time;
         
     }
 
+    // Rotação e velocidade pelo modelo de pneus, no lugar de
+    // updateRotation() e updateVelocity(). Não há desvio entre derrapar ou
+    // não: a força lateral puxa a velocidade lateral para zero e a
+    // longitudinal leva a velocidade para a das rodas, cada uma pela sua
+    // curva; cada correção é limitada ao que falta, para não passar do
+    // ponto com passos grandes.
+    template <class Params>
+    void updateTyres(const Params& p, float elapsed_time){
+        glm::vec4 side = normalize(crossproduct(forwardsVector, glm::vec4(0.0f, -1.0f, 0.0f, 0.0f)));
+        float along = dotproduct(velocity, forwardsVector);
+        float across = dotproduct(velocity, side);
+
+        // A curva depende da velocidade na direção das rodas: o carro de
+        // lado para de girar, em vez de rodar sem fim
+        rotation.y += turnAngle * p.not_sliding_turn_coeficient() * along * elapsed_time;
+
+        turnAngle *= 1 - p.turning_decay_ratio() * elapsed_time; // Decaimento do ângulo de curva
+        if(std::fabs(turnAngle) < p.zero_turnangle_threshold()) turnAngle = 0.0f;
+
+        // Rodas livres giram com o carro, sem força longitudinal
+        float tyreSpeed = along;
+        if(brake)
+            tyreSpeed = 0.0f;
+        else if(accelerate)
+            tyreSpeed = p.accelerate_tyre_speed_coeficient();
+
+        float speed = std::fabs(along) + tyres->getParams().min_slip_speed;
+        float lateralSlip = across / speed;
+        float longitudinalSlip = (tyreSpeed - along) / speed;
+        float lateral, longitudinal;
+        tyres->evaluate(lateralSlip, longitudinalSlip, &lateral, &longitudinal);
+
+        float lateralChange = std::copysign(std::min(std::fabs(lateral) * elapsed_time, std::fabs(across)), lateral);
+        float longitudinalChange = std::copysign(std::min(std::fabs(longitudinal) * elapsed_time, std::fabs(tyreSpeed - along)), longitudinal);
+        velocity += forwardsVector * longitudinalChange - side * lateralChange;
+
+        // Derrapagem é a deriva depois do pico da curva lateral; rodas
+        // girando em falso ao acelerar não contam
+        isSliding = std::fabs(lateralSlip) > tyres->getPeakLateralSlip();
+
+        limitVelocity(p, elapsed_time);
+    }
+
     void updateForwardsVector(){
-    	forwardsVector = getMatrixRotate() * glm::vec4(0.0f, 0.0f, 1.0f, 0.0f);
+    	forwardsVector = getBodyRotate() * glm::vec4(0.0f, 0.0f, 1.0f, 0.0f);
     }
 
-    glm::vec3 getRotation(){
-        return rotation;
+    glm::vec3 getRotation(float alpha = 1.0f){
+        return previousRotation * (1.0f - alpha) + rotation * alpha;
     }
 
+    // Um passo da física com o kernel especializado para os parâmetros do
+    // carro, se houver (veja setParams())
     void update(float elapsed_time){
+        switch(kernel){
+            case CAR_KERNEL_DEFAULT: update(DefaultCarPreset(), elapsed_time); break;
+            case CAR_KERNEL_DRIFT:   update(DriftCarPreset(), elapsed_time); break;
+            case CAR_KERNEL_GRIP:    update(GripCarPreset(), elapsed_time); break;
+            default:                 updateRuntime(elapsed_time); break;
+        }
+    }
+
+    // Um passo sempre com o kernel genérico, que lê os parâmetros de
+    // "params" (usado para comparação no benchmark)
+    void updateRuntime(float elapsed_time){
+        update(RuntimeCarParams(params), elapsed_time);
+    }
+
+    template <class Params>
+    void update(const Params& p, float elapsed_time){
         //    +    tecla para curva é pressionada
         //    |__..->+    turnAngle é incrementado
         //           |__..->+    rotation é atualizada com o ângulo de rotação
         //                  |__..->+ vetor fowards é atualizado
         //                         |__..->+ velocity é calculado baseado em fowards e o velocity anterior (o que pode gerar um angulo)
 
+        previousPosition = position;
+        previousRotation = rotation;
+
     	updatePosition(elapsed_time);
-    	updateRotation(elapsed_time);
-    	updateVelocity(elapsed_time);
+        if(tyres != NULL){
+            updateTyres(p, elapsed_time);
+        }else{
+            updateRotation(p, elapsed_time);
+            updateVelocity(p, elapsed_time);
+        }
     	updateForwardsVector();
+        if(track != NULL) followTrack();
     }
 };
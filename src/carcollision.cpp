@@ -0,0 +1,326 @@
+// Colisão entre karts. Veja comentários em "carcollision.h".
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+#include "carcollision.h"
+#include "carpool.h"
+
+CarCollisionShape CarCollision_ShapeFromBox(const glm::vec3& bbox_min, const glm::vec3& bbox_max, float scale)
+{
+    CarCollisionShape shape;
+    shape.center_x    = 0.5f * (bbox_min.x + bbox_max.x) * scale;
+    shape.center_z    = 0.5f * (bbox_min.z + bbox_max.z) * scale;
+    shape.half_width  = 0.5f * (bbox_max.x - bbox_min.x) * scale;
+    shape.half_length = 0.5f * (bbox_max.z - bbox_min.z) * scale;
+    return shape;
+}
+
+CarCollider::CarCollider(const CarCollisionShape& shape)
+    : shape(shape)
+    , restitution(0.3f)
+    , axis(0)
+{
+    stats.pairs = stats.contacts = stats.swaps = 0;
+}
+
+void CarCollider::updateBoxes(const CarPool& pool)
+{
+    size_t num_cars = pool.size();
+    center_x.resize(num_cars); center_z.resize(num_cars);
+    cos_yaw.resize(num_cars); sin_yaw.resize(num_cars);
+    min_x.resize(num_cars); max_x.resize(num_cars);
+    min_z.resize(num_cars); max_z.resize(num_cars);
+
+    double sum_x = 0.0, sum_z = 0.0, sum_xx = 0.0, sum_zz = 0.0;
+    for (size_t i = 0; i < num_cars; ++i)
+    {
+        float yaw = pool.getYaw(i);
+        float c = std::cos(yaw);
+        float s = std::sin(yaw);
+        glm::vec4 position = pool.getPosition(i);
+
+        // Lateral (c, -s) e frente (s, c)
+        float x = position.x + c * shape.center_x + s * shape.center_z;
+        float z = position.z - s * shape.center_x + c * shape.center_z;
+        float extent_x = std::fabs(c) * shape.half_width + std::fabs(s) * shape.half_length;
+        float extent_z = std::fabs(s) * shape.half_width + std::fabs(c) * shape.half_length;
+
+        center_x[i] = x;
+        center_z[i] = z;
+        cos_yaw[i]  = c;
+        sin_yaw[i]  = s;
+        min_x[i] = x - extent_x; max_x[i] = x + extent_x;
+        min_z[i] = z - extent_z; max_z[i] = z + extent_z;
+
+        sum_x += x; sum_xx += (double)x * x;
+        sum_z += z; sum_zz += (double)z * z;
+    }
+
+    // Varremos o eixo em que os karts estão mais espalhados (em uma pista
+    // reta e estreita, o eixo do comprimento), onde cada intervalo cruza
+    // menos outros. Trocar de eixo exige ordenar tudo de novo, então só
+    // trocamos com uma folga de 50%.
+    double variance_x = sum_xx - sum_x * sum_x / std::max<size_t>(num_cars, 1);
+    double variance_z = sum_zz - sum_z * sum_z / std::max<size_t>(num_cars, 1);
+    int best_axis = axis;
+    if ( axis == 0 && variance_z > 1.5 * variance_x )
+        best_axis = 1;
+    else if ( axis == 1 && variance_x > 1.5 * variance_z )
+        best_axis = 0;
+    if ( best_axis != axis )
+    {
+        axis = best_axis;
+        order.clear();
+    }
+}
+
+void CarCollider::sortAxis()
+{
+    const float* key_min = axis == 0 ? min_x.data() : min_z.data();
+    stats.swaps = 0;
+
+    // Ordem nova (primeiro passo, pool menor ou troca de eixo): ordenação
+    // completa
+    size_t num_cars = min_x.size();
+    if ( order.empty() || order.size() > num_cars )
+    {
+        order.resize(num_cars);
+        for (size_t i = 0; i < num_cars; ++i)
+            order[i] = (uint32_t)i;
+        std::sort(order.begin(), order.end(), [key_min](uint32_t a, uint32_t b) { return key_min[a] < key_min[b]; });
+        return;
+    }
+
+    // Karts novos entram no fim da ordem, e a ordenação por inserção os leva
+    // ao lugar certo. Nos outros, quase nenhuma troca se a ordem mudou pouco
+    // desde o último passo.
+    for (size_t i = order.size(); i < num_cars; ++i)
+        order.push_back((uint32_t)i);
+    for (size_t i = 1; i < order.size(); ++i)
+    {
+        uint32_t car = order[i];
+        float key = key_min[car];
+        size_t j = i;
+        while ( j > 0 && key_min[order[j-1]] > key )
+        {
+            order[j] = order[j-1];
+            j--;
+        }
+        stats.swaps += i - j;
+        order[j] = car;
+    }
+}
+
+void CarCollider::sweep()
+{
+    // Copiamos os intervalos (no eixo da varredura e no outro) na ordem da
+    // varredura, para que o laço interno leia memória contígua
+    const float* key_min   = axis == 0 ? min_x.data() : min_z.data();
+    const float* key_max   = axis == 0 ? max_x.data() : max_z.data();
+    const float* other_min = axis == 0 ? min_z.data() : min_x.data();
+    const float* other_max = axis == 0 ? max_z.data() : max_x.data();
+
+    size_t num_cars = order.size();
+    sorted.resize(4 * num_cars);
+    float* sorted_min       = sorted.data();
+    float* sorted_max       = sorted_min + num_cars;
+    float* sorted_other_min = sorted_max + num_cars;
+    float* sorted_other_max = sorted_other_min + num_cars;
+    for (size_t i = 0; i < num_cars; ++i)
+    {
+        uint32_t car = order[i];
+        sorted_min[i]       = key_min[car];
+        sorted_max[i]       = key_max[car];
+        sorted_other_min[i] = other_min[car];
+        sorted_other_max[i] = other_max[car];
+    }
+
+    // Os pares são escritos sempre e contados só se os intervalos no outro
+    // eixo se sobrepõem: sem desvios imprevisíveis no laço interno
+    size_t num_pairs = 0;
+    for (size_t i = 0; i < num_cars; ++i)
+    {
+        float end = sorted_max[i];
+        size_t last = i + 1;
+        while ( last < num_cars && sorted_min[last] <= end )
+            last++;
+        if ( pairs.size() < num_pairs + (last - i) )
+            pairs.resize(2 * (num_pairs + (last - i)));
+
+        uint64_t a = order[i];
+        float begin_other = sorted_other_min[i];
+        float end_other = sorted_other_max[i];
+        for (size_t j = i + 1; j < last; ++j)
+        {
+            uint64_t b = order[j];
+            pairs[num_pairs] = a < b ? (a << 32) | b : (b << 32) | a;
+            num_pairs += (sorted_other_min[j] <= end_other) & (begin_other <= sorted_other_max[j]);
+        }
+    }
+    pairs.resize(num_pairs);
+    stats.pairs = num_pairs;
+}
+
+void CarCollider::narrowphase()
+{
+    contacts.clear();
+    for (size_t p = 0; p < pairs.size(); ++p)
+    {
+        uint32_t a = (uint32_t)(pairs[p] >> 32);
+        uint32_t b = (uint32_t)pairs[p];
+
+        // Eixos candidatos: lateral e frente de cada caixa
+        const float axes[4][2] = {
+            { cos_yaw[a], -sin_yaw[a] }, { sin_yaw[a], cos_yaw[a] },
+            { cos_yaw[b], -sin_yaw[b] }, { sin_yaw[b], cos_yaw[b] },
+        };
+        float dx = center_x[b] - center_x[a];
+        float dz = center_z[b] - center_z[a];
+
+        bool separated = false;
+        CarContact contact;
+        contact.a = a;
+        contact.b = b;
+        contact.depth = 0.0f;
+        for (int k = 0; k < 4 && !separated; ++k)
+        {
+            float lx = axes[k][0], lz = axes[k][1];
+
+            // Raio de cada caixa projetada no eixo
+            float radius_a = shape.half_width  * std::fabs(axes[0][0]*lx + axes[0][1]*lz)
+                           + shape.half_length * std::fabs(axes[1][0]*lx + axes[1][1]*lz);
+            float radius_b = shape.half_width  * std::fabs(axes[2][0]*lx + axes[2][1]*lz)
+                           + shape.half_length * std::fabs(axes[3][0]*lx + axes[3][1]*lz);
+            float distance = dx*lx + dz*lz;
+            float overlap = radius_a + radius_b - std::fabs(distance);
+            if ( overlap <= 0.0f )
+            {
+                separated = true;
+            }
+            else if ( k == 0 || overlap < contact.depth )
+            {
+                float sign = distance < 0.0f ? -1.0f : 1.0f;
+                contact.normal_x = sign * lx;
+                contact.normal_z = sign * lz;
+                contact.depth = overlap;
+            }
+        }
+        if ( !separated )
+            contacts.push_back(contact);
+    }
+    stats.contacts = contacts.size();
+}
+
+void CarCollider::detect(const CarPool& pool)
+{
+    updateBoxes(pool);
+    sortAxis();
+    sweep();
+    narrowphase();
+}
+
+void CarCollider::step(CarPool* pool)
+{
+    detect(*pool);
+
+    for (size_t i = 0; i < contacts.size(); ++i)
+    {
+        const CarContact& c = contacts[i];
+
+        // Velocidade relativa na direção da normal; negativa se os karts se
+        // aproximam. Com massas iguais, cada um recebe metade do impulso.
+        glm::vec4 relative = pool->getVelocity(c.b) - pool->getVelocity(c.a);
+        float approach = relative.x * c.normal_x + relative.z * c.normal_z;
+        if ( approach < 0.0f )
+        {
+            float impulse = -(1.0f + restitution) * approach * 0.5f;
+            pool->applyImpulse(c.a, -impulse * c.normal_x, -impulse * c.normal_z);
+            pool->applyImpulse(c.b,  impulse * c.normal_x,  impulse * c.normal_z);
+        }
+
+        // Separamos os karts, cada um metade da penetração
+        float half_depth = 0.5f * c.depth;
+        pool->translate(c.a, -half_depth * c.normal_x, -half_depth * c.normal_z);
+        pool->translate(c.b,  half_depth * c.normal_x,  half_depth * c.normal_z);
+    }
+}
+
+void CarCollider::findPairsBruteForce(std::vector<uint64_t>* all_pairs) const
+{
+    all_pairs->clear();
+    for (size_t a = 0; a < min_x.size(); ++a)
+    {
+        for (size_t b = a + 1; b < min_x.size(); ++b)
+        {
+            if ( min_x[b] <= max_x[a] && min_x[a] <= max_x[b] && min_z[b] <= max_z[a] && min_z[a] <= max_z[b] )
+                all_pairs->push_back(((uint64_t)a << 32) | b);
+        }
+    }
+}
+
+void CarCollision_Benchmark(const CarCollisionShape& shape, int steps)
+{
+    typedef std::chrono::steady_clock clock;
+    const float dt = 1.0f / 240.0f;
+
+    printf("Benchmark de colisão entre karts: caixa %.2f x %.2f, %d passos de %.4f s\n",
+           2.0f * shape.half_width, 2.0f * shape.half_length, steps, dt);
+    printf("%8s  %12s  %12s  %12s  %14s  %16s  %6s\n", "karts", "pares/passo", "contatos", "física (us)",
+           "colisão (us)", "todos pares (us)", "iguais");
+
+    const size_t sizes[4] = { 10, 100, 1000, 10000 };
+    for (int s = 0; s < 4; ++s)
+    {
+        // Pista cheia: karts em filas de 16, com um kart de folga entre
+        // eles, quase alinhados e com controles aleatórios
+        size_t num_cars = sizes[s];
+        float spacing_x = 3.0f * shape.half_width;
+        float spacing_z = 3.0f * shape.half_length;
+        CarPool pool;
+        srand(1);
+        for (size_t car = 0; car < num_cars; ++car)
+        {
+            float yaw = ((rand() % 61) - 30) / 100.0f;
+            pool.add((float)(car % 16) * spacing_x, (float)(car / 16) * spacing_z, yaw);
+            pool.setControls(car, rand() % 4 != 0, rand() % 16 == 0, (float)(rand() % 3 - 1));
+        }
+
+        CarCollider collider(shape);
+        double physics_ns = 0.0, collision_ns = 0.0;
+        size_t total_pairs = 0, total_contacts = 0;
+        for (int i = 0; i < steps; ++i)
+        {
+            clock::time_point start = clock::now();
+            pool.step(dt);
+            clock::time_point middle = clock::now();
+            collider.step(&pool);
+            clock::time_point end = clock::now();
+
+            physics_ns   += std::chrono::duration<double, std::nano>(middle - start).count();
+            collision_ns += std::chrono::duration<double, std::nano>(end - middle).count();
+            total_pairs    += collider.getStats().pairs;
+            total_contacts += collider.getStats().contacts;
+        }
+
+        // Todos os pares no estado final, comparados com os da varredura
+        collider.detect(pool);
+        std::vector<uint64_t> swept = collider.getPairs();
+        std::vector<uint64_t> all_pairs;
+        int repetitions = num_cars >= 10000 ? 1 : 10;
+        clock::time_point start = clock::now();
+        for (int r = 0; r < repetitions; ++r)
+            collider.findPairsBruteForce(&all_pairs);
+        double brute_ns = std::chrono::duration<double, std::nano>(clock::now() - start).count() / repetitions;
+
+        std::sort(swept.begin(), swept.end());
+        std::sort(all_pairs.begin(), all_pairs.end());
+
+        printf("%8lu  %12.1f  %12.1f  %12.2f  %14.2f  %16.2f  %6s\n", (unsigned long)num_cars,
+               (double)total_pairs / steps, (double)total_contacts / steps,
+               physics_ns / steps / 1000.0, collision_ns / steps / 1000.0, brute_ns / 1000.0,
+               swept == all_pairs ? "sim" : "NÃO");
+    }
+}
@@ -0,0 +1,165 @@
+// Parâmetros de dirigibilidade do carro. Veja comentários em "carparams.h".
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+#include "carparams.h"
+
+CarParams CarParams_Default()
+{
+    return CarParams_FromPreset<DefaultCarPreset>();
+}
+
+bool CarParams_Equal(const CarParams& a, const CarParams& b)
+{
+#define CAR_PARAMS_COMPARE(name, value) if ( a.name != b.name ) return false;
+    CAR_PARAMS_FIELDS(CAR_PARAMS_COMPARE)
+#undef CAR_PARAMS_COMPARE
+    return true;
+}
+
+CarPresetKernel CarParams_FindKernel(const CarParams& params)
+{
+    if ( CarParams_Equal(params, CarParams_FromPreset<DefaultCarPreset>()) )
+        return CAR_KERNEL_DEFAULT;
+    if ( CarParams_Equal(params, CarParams_FromPreset<DriftCarPreset>()) )
+        return CAR_KERNEL_DRIFT;
+    if ( CarParams_Equal(params, CarParams_FromPreset<GripCarPreset>()) )
+        return CAR_KERNEL_GRIP;
+    return CAR_KERNEL_RUNTIME;
+}
+
+const char* CarParams_KernelName(CarPresetKernel kernel)
+{
+    switch ( kernel )
+    {
+    case CAR_KERNEL_DEFAULT: return "default";
+    case CAR_KERNEL_DRIFT:   return "drift";
+    case CAR_KERNEL_GRIP:    return "grip";
+    default:                 return "runtime";
+    }
+}
+
+bool CarParams_Set(CarParams* params, const std::string& key, float value)
+{
+#define CAR_PARAMS_ASSIGN(name, default_value) if ( key == #name ) { params->name = value; return true; }
+    CAR_PARAMS_FIELDS(CAR_PARAMS_ASSIGN)
+#undef CAR_PARAMS_ASSIGN
+    return false;
+}
+
+CarParamsSet::CarParamsSet()
+{
+    presets["default"] = CarParams_FromPreset<DefaultCarPreset>();
+    presets["drift"]   = CarParams_FromPreset<DriftCarPreset>();
+    presets["grip"]    = CarParams_FromPreset<GripCarPreset>();
+}
+
+namespace
+{
+
+std::string Trim(const std::string& s)
+{
+    size_t begin = s.find_first_not_of(" \t\r");
+    if ( begin == std::string::npos )
+        return "";
+    size_t end = s.find_last_not_of(" \t\r");
+    return s.substr(begin, end - begin + 1);
+}
+
+} // namespace
+
+bool CarParamsSet::load(const std::string& filename, std::string* error)
+{
+    std::ifstream file(filename.c_str());
+    if ( !file )
+    {
+        *error = "não foi possível abrir \"" + filename + "\"";
+        return false;
+    }
+
+    std::string section = "default";
+    std::string line;
+    int line_number = 0;
+    while ( std::getline(file, line) )
+    {
+        line_number++;
+        size_t comment = line.find('#');
+        if ( comment != std::string::npos )
+            line.erase(comment);
+        line = Trim(line);
+        if ( line.empty() )
+            continue;
+
+        std::ostringstream where;
+        where << filename << ":" << line_number << ": ";
+
+        if ( line[0] == '[' )
+        {
+            size_t close = line.find(']');
+            if ( close == std::string::npos || close + 1 != line.size() )
+            {
+                *error = where.str() + "esperado \"[preset]\" ou \"[preset : base]\"";
+                return false;
+            }
+
+            // Um preset novo começa com os valores da base, ou de "default"
+            std::string header = line.substr(1, close - 1);
+            size_t colon = header.find(':');
+            section = Trim(header.substr(0, colon));
+            std::string base = colon != std::string::npos ? Trim(header.substr(colon + 1)) : "";
+            if ( section.empty() )
+            {
+                *error = where.str() + "nome de preset vazio";
+                return false;
+            }
+
+            if ( !base.empty() )
+            {
+                const CarParams* params = find(base);
+                if ( params == NULL )
+                {
+                    *error = where.str() + "preset base desconhecido \"" + base + "\"";
+                    return false;
+                }
+                presets[section] = *params;
+            }
+            else if ( find(section) == NULL )
+            {
+                presets[section] = presets["default"];
+            }
+            continue;
+        }
+
+        size_t equals = line.find('=');
+        std::string key = Trim(line.substr(0, equals));
+        std::string value = equals != std::string::npos ? Trim(line.substr(equals + 1)) : "";
+        char* end = NULL;
+        float number = strtof(value.c_str(), &end);
+        if ( equals == std::string::npos || value.empty() || *end != '\0' )
+        {
+            *error = where.str() + "esperado \"parâmetro = valor\"";
+            return false;
+        }
+        if ( !CarParams_Set(&presets[section], key, number) )
+        {
+            *error = where.str() + "parâmetro desconhecido \"" + key + "\"";
+            return false;
+        }
+    }
+    return true;
+}
+
+const CarParams* CarParamsSet::find(const std::string& name) const
+{
+    std::map<std::string, CarParams>::const_iterator it = presets.find(name);
+    return it != presets.end() ? &it->second : NULL;
+}
+
+std::vector<std::string> CarParamsSet::getNames() const
+{
+    std::vector<std::string> names;
+    for (std::map<std::string, CarParams>::const_iterator it = presets.begin(); it != presets.end(); ++it)
+        names.push_back(it->first);
+    return names;
+}
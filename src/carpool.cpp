@@ -0,0 +1,454 @@
+// Simulação em lote de muitos carros. Veja comentários em "carpool.h".
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+
+#include "carconstants.h"
+#include "carpool.h"
+#include "heightfield.h"
+#include "threadpool.h"
+
+// As funções AVX2 são compiladas com o atributo "target", sem mudar as
+// opções do resto do arquivo, e usadas se o processador o suportar
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CARPOOL_HAS_AVX2 1
+#include <immintrin.h>
+#endif
+
+namespace
+{
+
+// Mesmo valor de Car::verysmallnumber
+const float kVerySmallNumber = std::numeric_limits<float>::epsilon();
+
+#ifdef CARPOOL_HAS_AVX2
+// Seno e cosseno de 8 ângulos: redução para [-pi/4, pi/4] pelo múltiplo de
+// pi/2 mais próximo (em três partes, para não perder precisão) e polinômios
+// de "sinf"/"cosf" da biblioteca Cephes. Erro da ordem de 1e-7 para os
+// ângulos acumulados pelos carros.
+__attribute__((target("avx2")))
+inline void SinCos8(__m256 x, __m256* sin_x, __m256* cos_x)
+{
+    __m256i quadrant = _mm256_cvtps_epi32(_mm256_mul_ps(x, _mm256_set1_ps(0.636619772367581343f)));
+    __m256  q = _mm256_cvtepi32_ps(quadrant);
+    __m256  r = _mm256_sub_ps(x, _mm256_mul_ps(q, _mm256_set1_ps(1.5703125f)));
+    r = _mm256_sub_ps(r, _mm256_mul_ps(q, _mm256_set1_ps(4.837512969970703125e-4f)));
+    r = _mm256_sub_ps(r, _mm256_mul_ps(q, _mm256_set1_ps(7.54978995489188216e-8f)));
+
+    __m256 r2 = _mm256_mul_ps(r, r);
+    __m256 s = _mm256_set1_ps(-1.9515295891e-4f);
+    s = _mm256_add_ps(_mm256_mul_ps(s, r2), _mm256_set1_ps(8.3321608736e-3f));
+    s = _mm256_add_ps(_mm256_mul_ps(s, r2), _mm256_set1_ps(-1.6666654611e-1f));
+    s = _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(s, r2), r), r);
+
+    __m256 c = _mm256_set1_ps(2.443315711809948e-5f);
+    c = _mm256_add_ps(_mm256_mul_ps(c, r2), _mm256_set1_ps(-1.388731625493765e-3f));
+    c = _mm256_add_ps(_mm256_mul_ps(c, r2), _mm256_set1_ps(4.166664568298827e-2f));
+    c = _mm256_mul_ps(_mm256_mul_ps(c, r2), r2);
+    c = _mm256_add_ps(_mm256_sub_ps(c, _mm256_mul_ps(_mm256_set1_ps(0.5f), r2)), _mm256_set1_ps(1.0f));
+
+    // Quadrante q: (sen, cos) = (s, c), (c, -s), (-s, -c), (-c, s)
+    __m256 swap = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(quadrant, _mm256_set1_epi32(1)), _mm256_set1_epi32(1)));
+    __m256 sin_sign = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(quadrant, _mm256_set1_epi32(2)), 30));
+    __m256 cos_sign = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(_mm256_add_epi32(quadrant, _mm256_set1_epi32(1)), _mm256_set1_epi32(2)), 30));
+
+    *sin_x = _mm256_xor_ps(_mm256_blendv_ps(s, c, swap), sin_sign);
+    *cos_x = _mm256_xor_ps(_mm256_blendv_ps(c, s, swap), cos_sign);
+}
+
+// Máscara (todos os bits 1) dos carros com o byte de "flags" diferente de zero
+__attribute__((target("avx2")))
+inline __m256 LoadFlags8(const uint8_t* flags)
+{
+    __m256i bytes = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)flags));
+    return _mm256_castsi256_ps(_mm256_cmpgt_epi32(bytes, _mm256_setzero_si256()));
+}
+
+__attribute__((target("avx2")))
+inline void StoreFlags8(uint8_t* flags, __m256 mask)
+{
+    int bits = _mm256_movemask_ps(mask);
+    for (int k = 0; k < 8; ++k)
+        flags[k] = (uint8_t)((bits >> k) & 1);
+}
+#endif // CARPOOL_HAS_AVX2
+
+} // namespace
+
+CarPool::CarPool()
+    : backend(CarPool_BestBackend())
+    , num_cars(0)
+{
+}
+
+void CarPool::clear()
+{
+    num_cars = 0;
+    position_x.clear(); position_z.clear();
+    position_y.clear(); normal_x.clear(); normal_y.clear(); normal_z.clear();
+    velocity_x.clear(); velocity_z.clear();
+    forwards_x.clear(); forwards_z.clear();
+    yaw.clear(); turn_angle.clear(); steer.clear();
+    accelerate.clear(); brake.clear(); sliding.clear();
+}
+
+size_t CarPool::add(float x, float z, float car_yaw)
+{
+    // Os vetores crescem de 8 em 8 carros; os carros extras ficam parados
+    size_t car = num_cars++;
+    if ( car >= position_x.size() )
+    {
+        size_t padded = position_x.size() + 8;
+        position_x.resize(padded, 0.0f); position_z.resize(padded, 0.0f);
+        position_y.resize(padded, 0.0f);
+        normal_x.resize(padded, 0.0f); normal_y.resize(padded, 1.0f); normal_z.resize(padded, 0.0f);
+        velocity_x.resize(padded, 0.0f); velocity_z.resize(padded, 0.0f);
+        forwards_x.resize(padded, 0.0f); forwards_z.resize(padded, 1.0f);
+        yaw.resize(padded, 0.0f); turn_angle.resize(padded, 0.0f); steer.resize(padded, 0.0f);
+        accelerate.resize(padded, 0); brake.resize(padded, 0); sliding.resize(padded, 0);
+    }
+
+    position_x[car] = x;
+    position_z[car] = z;
+    position_y[car] = 0.0f;
+    normal_x[car] = normal_z[car] = 0.0f;
+    normal_y[car] = 1.0f;
+    velocity_x[car] = velocity_z[car] = 0.0f;
+    forwards_x[car] = std::sin(car_yaw);
+    forwards_z[car] = std::cos(car_yaw);
+    yaw[car]        = car_yaw;
+    turn_angle[car] = steer[car] = 0.0f;
+    accelerate[car] = brake[car] = sliding[car] = 0;
+    return car;
+}
+
+void CarPool::setControls(size_t car, bool accelerate_value, bool brake_value, float steer_value)
+{
+    accelerate[car] = accelerate_value ? 1 : 0;
+    brake[car]      = brake_value ? 1 : 0;
+    steer[car]      = steer_value;
+}
+
+void CarPool::step(float dt, CarPoolBackend step_backend)
+{
+    // Os carros são independentes: dividimos os grupos de 8 carros (um
+    // registro AVX2) entre as threads, em trabalhos de 4096 carros
+    ParallelFor(position_x.size() / 8, 512, [&](size_t begin, size_t end) {
+#ifdef CARPOOL_HAS_AVX2
+        if ( step_backend == CARPOOL_AVX2 )
+        {
+            stepAVX2(dt, 8*begin, 8*end);
+            return;
+        }
+#endif
+        stepScalar(dt, 8*begin, std::min(8*end, num_cars));
+    });
+}
+
+void CarPool::followGround(const Heightfield& ground)
+{
+    // Mesma divisão de step(); os carros extras do final também são
+    // consultados, o que mantém os grupos completos para o SIMD
+    ParallelFor(position_x.size() / 8, 512, [&](size_t begin, size_t end) {
+        size_t first = 8*begin;
+        ground.sampleBatch(&position_x[first], &position_z[first], 8*(end - begin),
+                           &position_y[first], &normal_x[first], &normal_y[first], &normal_z[first]);
+    });
+}
+
+// Um passo de Car::update() para cada carro, na mesma ordem: posição,
+// rotação, velocidade e vetor "para frente". Os controles (curva) são
+// aplicados antes, como em updateFromKeyboard().
+void CarPool::stepScalar(float dt, size_t begin, size_t end)
+{
+    for (size_t i = begin; i < end; ++i)
+    {
+        float vx = velocity_x[i];
+        float vz = velocity_z[i];
+        float fx = forwards_x[i];
+        float fz = forwards_z[i];
+        float angle = turn_angle[i] + steer[i] * TURN_SPEED_COEFICIENT * dt;
+        bool  is_accelerating = accelerate[i] != 0;
+        bool  is_braking = brake[i] != 0;
+        bool  is_sliding = sliding[i] != 0;
+
+        // updatePosition()
+        position_x[i] += vx * dt;
+        position_z[i] += vz * dt;
+
+        // updateRotation()
+        float speed = std::sqrt(vx*vx + vz*vz);
+        float centrifugal = angle * angle * CAR_MASS * speed;
+        if ( centrifugal > MAX_SIDE_GRIP || is_braking )
+            is_sliding = true;
+        else if ( (vx*fx + vz*fz) / (speed + 0.000001f) > MIN_CORRELATION_GRIP )
+            is_sliding = false;
+
+        if ( is_sliding )
+            yaw[i] += angle * SLIDING_TURN_COEFICIENT * dt;
+        else
+            yaw[i] += angle * NOT_SLIDING_TURN_COEFICIENT * speed * dt;
+
+        angle *= 1 - TURNING_DECAY_RATIO * dt;
+        if ( std::fabs(angle) < ZERO_TURNANGLE_THRESHOLD )
+            angle = 0.0f;
+
+        // updateVelocity()
+        float tyre_speed = fx*vx + fz*vz;
+        if ( is_braking )
+            tyre_speed = 0.0f;
+        else if ( is_accelerating )
+            tyre_speed = ACCELERATE_TYRE_SPEED_COEFICIENT;
+
+        if ( is_sliding )
+        {
+            vx -= fx * tyre_speed;
+            vz -= fz * tyre_speed;
+            float slide_speed = std::sqrt(vx*vx + vz*vz);
+            float drag = slide_speed > CAR_MASS * SLIDING_DRAG_COEFICIENT ? CAR_MASS * SLIDING_DRAG_COEFICIENT / slide_speed : 1.0f;
+            vx -= dt * (vx * drag);
+            vz -= dt * (vz * drag);
+            vx += fx * tyre_speed;
+            vz += fz * tyre_speed;
+        }
+        else
+        {
+            // Car normaliza forwardsVector * (dot + epsilon): só o sinal importa
+            float direction = (fx*vx + fz*vz) + kVerySmallNumber > 0.0f ? 1.0f : -1.0f;
+            float new_speed = speed + (is_accelerating ? ACCELERATION : 0.0f) * dt;
+            vx = fx * direction * new_speed;
+            vz = fz * direction * new_speed;
+        }
+
+        float final_speed = std::sqrt(vx*vx + vz*vz);
+        if ( final_speed >= MAX_VEL )
+        {
+            vx *= MAX_VEL / final_speed;
+            vz *= MAX_VEL / final_speed;
+        }
+        if ( final_speed <= MIN_VEL && is_braking )
+            vx = vz = 0.0f;
+        if ( !is_accelerating && !is_braking )
+        {
+            vx *= 1 - VELOCITY_DECAY_RATIO * dt;
+            vz *= 1 - VELOCITY_DECAY_RATIO * dt;
+        }
+
+        // updateForwardsVector()
+        forwards_x[i] = std::sin(yaw[i]);
+        forwards_z[i] = std::cos(yaw[i]);
+
+        velocity_x[i] = vx;
+        velocity_z[i] = vz;
+        turn_angle[i] = angle;
+        sliding[i]    = is_sliding ? 1 : 0;
+    }
+}
+
+#ifdef CARPOOL_HAS_AVX2
+// O mesmo que stepScalar(), para 8 carros de cada vez. Cada "if" vira uma
+// máscara, e os dois lados são calculados e selecionados com blendv.
+__attribute__((target("avx2")))
+void CarPool::stepAVX2(float dt, size_t begin, size_t end)
+{
+    const __m256 vdt      = _mm256_set1_ps(dt);
+    const __m256 zero     = _mm256_setzero_ps();
+    const __m256 one      = _mm256_set1_ps(1.0f);
+    const __m256 abs_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+
+    const __m256 steer_rate     = _mm256_set1_ps(TURN_SPEED_COEFICIENT * dt);
+    const __m256 max_grip       = _mm256_set1_ps(MAX_SIDE_GRIP);
+    const __m256 min_corr       = _mm256_set1_ps(MIN_CORRELATION_GRIP);
+    const __m256 sliding_turn   = _mm256_set1_ps(SLIDING_TURN_COEFICIENT);
+    const __m256 gripping_turn  = _mm256_set1_ps(NOT_SLIDING_TURN_COEFICIENT);
+    const __m256 turn_decay     = _mm256_set1_ps(1 - TURNING_DECAY_RATIO * dt);
+    const __m256 turn_threshold = _mm256_set1_ps(ZERO_TURNANGLE_THRESHOLD);
+    const __m256 tyre_accel     = _mm256_set1_ps(ACCELERATE_TYRE_SPEED_COEFICIENT);
+    const __m256 max_drag       = _mm256_set1_ps(CAR_MASS * SLIDING_DRAG_COEFICIENT);
+    const __m256 acceleration   = _mm256_set1_ps(ACCELERATION * dt);
+    const __m256 max_speed      = _mm256_set1_ps(MAX_VEL);
+    const __m256 min_speed      = _mm256_set1_ps(MIN_VEL);
+    const __m256 speed_decay    = _mm256_set1_ps(1 - VELOCITY_DECAY_RATIO * dt);
+
+    for (size_t i = begin; i < end; i += 8)
+    {
+        __m256 px = _mm256_loadu_ps(&position_x[i]);
+        __m256 pz = _mm256_loadu_ps(&position_z[i]);
+        __m256 vx = _mm256_loadu_ps(&velocity_x[i]);
+        __m256 vz = _mm256_loadu_ps(&velocity_z[i]);
+        __m256 fx = _mm256_loadu_ps(&forwards_x[i]);
+        __m256 fz = _mm256_loadu_ps(&forwards_z[i]);
+        __m256 car_yaw = _mm256_loadu_ps(&yaw[i]);
+        __m256 angle = _mm256_add_ps(_mm256_loadu_ps(&turn_angle[i]), _mm256_mul_ps(_mm256_loadu_ps(&steer[i]), steer_rate));
+        __m256 is_accelerating = LoadFlags8(&accelerate[i]);
+        __m256 is_braking = LoadFlags8(&brake[i]);
+        __m256 is_sliding = LoadFlags8(&sliding[i]);
+
+        // updatePosition()
+        px = _mm256_add_ps(px, _mm256_mul_ps(vx, vdt));
+        pz = _mm256_add_ps(pz, _mm256_mul_ps(vz, vdt));
+
+        // updateRotation()
+        __m256 speed = _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(vx, vx), _mm256_mul_ps(vz, vz)));
+        __m256 along = _mm256_add_ps(_mm256_mul_ps(vx, fx), _mm256_mul_ps(vz, fz));
+        __m256 centrifugal = _mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(angle, angle), _mm256_set1_ps(CAR_MASS)), speed);
+        __m256 starts_sliding = _mm256_or_ps(_mm256_cmp_ps(centrifugal, max_grip, _CMP_GT_OQ), is_braking);
+        __m256 regains_grip = _mm256_cmp_ps(_mm256_div_ps(along, _mm256_add_ps(speed, _mm256_set1_ps(0.000001f))), min_corr, _CMP_GT_OQ);
+        is_sliding = _mm256_or_ps(starts_sliding, _mm256_andnot_ps(regains_grip, is_sliding));
+
+        __m256 turn = _mm256_blendv_ps(_mm256_mul_ps(_mm256_mul_ps(angle, gripping_turn), speed),
+                                       _mm256_mul_ps(angle, sliding_turn), is_sliding);
+        car_yaw = _mm256_add_ps(car_yaw, _mm256_mul_ps(turn, vdt));
+
+        angle = _mm256_mul_ps(angle, turn_decay);
+        angle = _mm256_andnot_ps(_mm256_cmp_ps(_mm256_and_ps(angle, abs_mask), turn_threshold, _CMP_LT_OQ), angle);
+
+        // updateVelocity()
+        __m256 tyre_speed = _mm256_blendv_ps(along, tyre_accel, is_accelerating);
+        tyre_speed = _mm256_andnot_ps(is_braking, tyre_speed);
+
+        // Derrapando: arrasto na velocidade relativa aos pneus
+        __m256 sx = _mm256_sub_ps(vx, _mm256_mul_ps(fx, tyre_speed));
+        __m256 sz = _mm256_sub_ps(vz, _mm256_mul_ps(fz, tyre_speed));
+        __m256 slide_speed = _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(sx, sx), _mm256_mul_ps(sz, sz)));
+        __m256 drag = _mm256_blendv_ps(one, _mm256_div_ps(max_drag, slide_speed), _mm256_cmp_ps(slide_speed, max_drag, _CMP_GT_OQ));
+        sx = _mm256_sub_ps(sx, _mm256_mul_ps(vdt, _mm256_mul_ps(sx, drag)));
+        sz = _mm256_sub_ps(sz, _mm256_mul_ps(vdt, _mm256_mul_ps(sz, drag)));
+        sx = _mm256_add_ps(sx, _mm256_mul_ps(fx, tyre_speed));
+        sz = _mm256_add_ps(sz, _mm256_mul_ps(fz, tyre_speed));
+
+        // Com aderência: velocidade na direção do carro
+        __m256 direction = _mm256_blendv_ps(_mm256_set1_ps(-1.0f), one,
+                                            _mm256_cmp_ps(_mm256_add_ps(along, _mm256_set1_ps(kVerySmallNumber)), zero, _CMP_GT_OQ));
+        __m256 new_speed = _mm256_add_ps(speed, _mm256_and_ps(is_accelerating, acceleration));
+        __m256 gx = _mm256_mul_ps(_mm256_mul_ps(fx, direction), new_speed);
+        __m256 gz = _mm256_mul_ps(_mm256_mul_ps(fz, direction), new_speed);
+
+        vx = _mm256_blendv_ps(gx, sx, is_sliding);
+        vz = _mm256_blendv_ps(gz, sz, is_sliding);
+
+        __m256 final_speed = _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(vx, vx), _mm256_mul_ps(vz, vz)));
+        __m256 too_fast = _mm256_cmp_ps(final_speed, max_speed, _CMP_GE_OQ);
+        __m256 clamp = _mm256_blendv_ps(one, _mm256_div_ps(max_speed, final_speed), too_fast);
+        vx = _mm256_mul_ps(vx, clamp);
+        vz = _mm256_mul_ps(vz, clamp);
+
+        __m256 stops = _mm256_and_ps(_mm256_cmp_ps(final_speed, min_speed, _CMP_LE_OQ), is_braking);
+        vx = _mm256_andnot_ps(stops, vx);
+        vz = _mm256_andnot_ps(stops, vz);
+
+        __m256 coasting = _mm256_andnot_ps(_mm256_or_ps(is_accelerating, is_braking), _mm256_castsi256_ps(_mm256_set1_epi32(-1)));
+        __m256 decay = _mm256_blendv_ps(one, speed_decay, coasting);
+        vx = _mm256_mul_ps(vx, decay);
+        vz = _mm256_mul_ps(vz, decay);
+
+        // updateForwardsVector()
+        SinCos8(car_yaw, &fx, &fz);
+
+        _mm256_storeu_ps(&position_x[i], px);
+        _mm256_storeu_ps(&position_z[i], pz);
+        _mm256_storeu_ps(&velocity_x[i], vx);
+        _mm256_storeu_ps(&velocity_z[i], vz);
+        _mm256_storeu_ps(&forwards_x[i], fx);
+        _mm256_storeu_ps(&forwards_z[i], fz);
+        _mm256_storeu_ps(&yaw[i], car_yaw);
+        _mm256_storeu_ps(&turn_angle[i], angle);
+        StoreFlags8(&sliding[i], is_sliding);
+    }
+}
+#else
+void CarPool::stepAVX2(float dt, size_t begin, size_t end)
+{
+    stepScalar(dt, begin, std::min(end, num_cars));
+}
+#endif // CARPOOL_HAS_AVX2
+
+CarPoolBackend CarPool_BestBackend()
+{
+#ifdef CARPOOL_HAS_AVX2
+    if ( __builtin_cpu_supports("avx2") )
+        return CARPOOL_AVX2;
+#endif
+    return CARPOOL_SCALAR;
+}
+
+const char* CarPool_BackendName(CarPoolBackend backend)
+{
+    return backend == CARPOOL_AVX2 ? "avx2" : "escalar";
+}
+
+namespace
+{
+
+// Carros espalhados em uma grade, com controles aleatórios (metade
+// acelerando, alguns freando, curvas para os dois lados)
+void FillRandomPool(CarPool* pool, size_t num_cars)
+{
+    srand(42);
+    pool->clear();
+    for (size_t car = 0; car < num_cars; ++car)
+    {
+        pool->add((float)(car % 100) * 10.0f, (float)(car / 100) * 10.0f, (rand() % 628) / 100.0f);
+        pool->setControls(car, rand() % 2 == 0, rand() % 8 == 0, (float)(rand() % 3 - 1));
+    }
+}
+
+} // namespace
+
+void CarPool_Benchmark(int steps)
+{
+    typedef std::chrono::steady_clock clock;
+    const float dt = 1.0f / 240.0f;
+
+    CarPoolBackend best = CarPool_BestBackend();
+    printf("Benchmark de CarPool: %d passos de %.4f s\n", steps, dt);
+    printf("%8s  %16s  %16s  %8s  %14s\n", "carros", "escalar (ns/car)", "avx2 (ns/car)", "ganho", "max. diferença");
+
+    const size_t sizes[3] = { 1000, 10000, 100000 };
+    for (int s = 0; s < 3; ++s)
+    {
+        size_t num_cars = sizes[s];
+        CarPool pools[2];
+        double ns_per_car[2] = { 0.0, 0.0 };
+        for (int b = 0; b < 2; ++b)
+        {
+            CarPoolBackend backend = b == 0 ? CARPOOL_SCALAR : CARPOOL_AVX2;
+            if ( backend > best )
+                continue;
+
+            FillRandomPool(&pools[b], num_cars);
+            clock::time_point start = clock::now();
+            for (int i = 0; i < steps; ++i)
+            {
+                // Troca os controles no meio da simulação, para passar pelos
+                // dois estados (derrapando e com aderência)
+                if ( i == steps / 2 )
+                {
+                    for (size_t car = 0; car < num_cars; ++car)
+                        pools[b].setControls(car, car % 3 == 0, false, car % 2 == 0 ? 1.0f : -1.0f);
+                }
+                pools[b].step(dt, backend);
+            }
+            double ns = std::chrono::duration<double, std::nano>(clock::now() - start).count();
+            ns_per_car[b] = ns / ((double)steps * num_cars);
+        }
+
+        if ( best < CARPOOL_AVX2 )
+        {
+            printf("%8lu  %16.2f  %16s\n", (unsigned long)num_cars, ns_per_car[0], "-");
+            continue;
+        }
+
+        float max_difference = 0.0f;
+        for (size_t car = 0; car < num_cars; ++car)
+        {
+            glm::vec4 d = pools[0].getPosition(car) - pools[1].getPosition(car);
+            max_difference = std::max(max_difference, std::max(std::fabs(d.x), std::fabs(d.z)));
+        }
+        printf("%8lu  %16.2f  %16.2f  %7.1fx  %14.6f\n", (unsigned long)num_cars,
+               ns_per_car[0], ns_per_car[1], ns_per_car[0] / ns_per_car[1], max_difference);
+    }
+}
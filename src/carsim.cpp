@@ -0,0 +1,1258 @@
+// Simulador da física do carro sem janela nem OpenGL ("car_sim"). Reproduz
+// scripts de comandos (veja "inputscript.h") com a mesma classe Car do jogo
+// ("car.cpp"), no mesmo passo fixo e na mesma ordem de updateFromKeyboard()
+// e Car::update() no laço principal, tão rápido quanto possível. Serve para
+// ajuste dos parâmetros do carro e treinamento em servidores sem GPU.
+//
+// Uso:
+//
+//   car_sim [opções] <script.txt | builtin:nome>[@preset] ...
+//   car_sim [--params=arq] --sweep=varredura.txt --output=resultados.csv
+//   car_sim --replay=arq [--seek=segundos]
+//   car_sim [--params=arq] --benchmark
+//
+//   --hz=N              frequência da física para scripts sem linha "hz"
+//                       (padrão 240)
+//   --trajectory=arq    grava as trajetórias em "arq" ("-" é a saída padrão)
+//   --format=csv|binary formato das trajetórias (padrão csv)
+//   --every=N           grava um a cada N passos da trajetória (padrão 1)
+//   --metrics=arq       grava as métricas de cada script em CSV em "arq"
+//                       (padrão: saída padrão)
+//   --params=arq        lê presets de parâmetros do carro (veja "carparams.h")
+//   --preset=nome       preset dos scripts sem "@preset" (padrão "default")
+//   --checkpoint=x,z,r  adiciona um ponto de controle (círculo de raio r) à
+//                       volta; o primeiro é a linha de chegada. Com pontos
+//                       de controle as métricas incluem o tempo de volta.
+//   --record-replay=arq grava um replay (veja "replay.h") do script, que deve
+//                       ser o único
+//   --replay=arq        reproduz um replay gravado pelo jogo ou por
+//                       --record-replay, verificando cada keyframe, nos
+//                       modos da física com que foi gravado
+//   --seek=segundos     com --replay, vai do fim do replay até o instante
+//                       dado pelo keyframe mais próximo e mostra o estado
+//   --benchmark         compara o tempo por passo dos kernels especializados
+//                       e do genérico para cada preset
+//   --deterministic     física no modo determinístico (Car::setDeterministic())
+//   --tyres             modelo de pneus no lugar das regras de derrapagem
+//                       (Car::setTyreModel())
+//   --checksums=arq     grava o checksum do estado do carro a cada passo de
+//                       cada script (Car::getStateChecksum()) em CSV
+//   --verify-checksums=arq
+//                       compara os checksums de cada passo com os gravados
+//                       por --checksums (em outra máquina ou compilação, por
+//                       exemplo) e mostra o primeiro passo divergente
+//
+// Varredura de parâmetros ("--sweep"): executa todos os scripts com cada
+// configuração de parâmetros de uma grade ou de uma amostra aleatória, em
+// paralelo (veja "threadpool.h"), e grava uma linha por configuração e script
+// em "--output". Os resultados são gravados em lotes, à medida que ficam
+// prontos; se a varredura for interrompida, executá-la de novo com o mesmo
+// arquivo de saída continua de onde parou. Formato do arquivo de varredura:
+//
+//   base default                       # preset inicial (padrão "default")
+//   param max_side_grip 0.1 0.6 6      # nome, mínimo, máximo, valores na grade
+//   param sliding_drag_coeficient 10 30 5
+//   samples 0                          # 0: grade completa; N: N amostras aleatórias
+//   seed 1                             # semente das amostras aleatórias
+//   script builtin:slalom              # um ou mais scripts
+//   script gravacao.txt
+//   checkpoint 0 200 20                # pontos de controle da volta (x z raio)
+//
+// O formato binário é um cabeçalho CarSimTrajectoryHeader seguido de
+// registros CarSimSample, na ordem de bytes da máquina (indicada pelo campo
+// "endianness" do cabeçalho).
+//
+// Este arquivo inclui "car.cpp" (e portanto "matrices.h") diretamente, como
+// "main.cpp", e não pode ser ligado junto com ele.
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <chrono>
+#include <iterator>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "carparams.h"
+#include "detmath.h"
+#include "inputscript.h"
+#include "replay.h"
+#include "threadpool.h"
+#include "tyremodel.h"
+#include "car.cpp"
+
+namespace
+{
+
+const char     CARSIM_MAGIC[8]   = { 'C','A','R','S','I','M','1','\0' };
+const uint32_t CARSIM_ENDIANNESS = 0x01020304;
+
+struct CarSimTrajectoryHeader
+{
+    char     magic[8];
+    uint32_t endianness;
+    uint32_t sample_size; // sizeof(CarSimSample)
+};
+
+// Estado do carro após um passo
+struct CarSimSample
+{
+    uint32_t script;  // Índice do script na linha de comando
+    uint32_t step;
+    float    x, z;    // Posição no plano
+    float    yaw;     // Rotação em torno do eixo Y, em radianos
+    float    vx, vz;  // Velocidade
+    uint8_t  input;   // Teclas do passo (INPUT_*)
+    uint8_t  sliding;
+    uint8_t  reserved[2];
+};
+
+// Métricas agregadas de um script
+struct CarSimMetrics
+{
+    size_t steps;
+    double seconds;          // Tempo simulado
+    double distance;         // Comprimento da trajetória
+    double max_speed;
+    double mean_speed;
+    double sliding_seconds;  // Tempo com Car::getIsSliding()
+    double max_slide_angle;  // Maior ângulo entre velocidade e frente do carro, em graus
+    double lap_seconds;      // Tempo da primeira volta completa; negativo se não houve
+    glm::vec4 final_position;
+    float  final_yaw;
+};
+
+// Ponto de controle da volta: um círculo no plano XZ
+struct Checkpoint
+{
+    float x, z;
+    float radius;
+};
+
+bool InsideCheckpoint(const Checkpoint& checkpoint, const glm::vec4& position)
+{
+    float dx = position.x - checkpoint.x;
+    float dz = position.z - checkpoint.z;
+    return dx*dx + dz*dz <= checkpoint.radius * checkpoint.radius;
+}
+
+enum TrajectoryFormat
+{
+    TRAJECTORY_CSV,
+    TRAJECTORY_BINARY
+};
+
+class TrajectoryWriter
+{
+public:
+    TrajectoryWriter(FILE* file, TrajectoryFormat format, size_t every)
+        : file(file), format(format), every(every)
+    {
+        if ( file == NULL )
+            return;
+
+        if ( format == TRAJECTORY_BINARY )
+        {
+            CarSimTrajectoryHeader header;
+            memcpy(header.magic, CARSIM_MAGIC, sizeof(header.magic));
+            header.endianness  = CARSIM_ENDIANNESS;
+            header.sample_size = sizeof(CarSimSample);
+            fwrite(&header, sizeof(header), 1, file);
+        }
+        else
+        {
+            fprintf(file, "script,step,x,z,yaw,vx,vz,input,sliding\n");
+        }
+    }
+
+    bool isEnabled() const { return file != NULL; }
+
+    void write(const CarSimSample& sample)
+    {
+        if ( file == NULL || sample.step % every != 0 )
+            return;
+
+        if ( format == TRAJECTORY_BINARY )
+            fwrite(&sample, sizeof(sample), 1, file);
+        else
+            fprintf(file, "%u,%u,%.6g,%.6g,%.6g,%.6g,%.6g,%u,%u\n", sample.script, sample.step,
+                    sample.x, sample.z, sample.yaw, sample.vx, sample.vz, sample.input, sample.sliding);
+    }
+
+private:
+    FILE*            file;
+    TrajectoryFormat format;
+    size_t           every;
+};
+
+// Passo em segundos para "hz" passos por segundo, calculado como no jogo
+// (FixedStepScheduler) e nos replays, a partir do passo em nanossegundos
+float StepSeconds(int hz)
+{
+    return (float)Time_ToSeconds(TIME_NS_PER_SECOND / hz);
+}
+
+void ApplyInput(Car* car, uint8_t input, float dt)
+{
+    car->applyControls((input & INPUT_ACCELERATE) != 0, (input & INPUT_BRAKE) != 0,
+                       (input & INPUT_LEFT) != 0, (input & INPUT_RIGHT) != 0,
+                       (input & INPUT_REVERSE) != 0, dt);
+}
+
+// Executa o script com passos de "dt" segundos a partir de um carro parado
+// na origem, como no início do jogo. A volta termina quando o carro passa
+// por todos os pontos de controle, em ordem, e volta ao primeiro depois de
+// ter saído dele. "trajectory" e "tyres" podem ser NULL. Se "checksums" não
+// for NULL, recebe o checksum do estado após cada passo.
+void RunScript(const InputScript& script, const CarParams& params, const std::vector<Checkpoint>& checkpoints,
+               uint32_t script_index, float dt, bool deterministic, const TyreModel* tyres, TrajectoryWriter* trajectory,
+               std::vector<uint64_t>* checksums, CarSimMetrics* metrics)
+{
+    Car car;
+    car.setParams(params);
+    car.setDeterministic(deterministic);
+    car.setTyreModel(tyres);
+    if ( deterministic )
+        DetMath_ResetFloatingPoint();
+    if ( checksums != NULL )
+        checksums->clear();
+    memset(metrics, 0, sizeof(*metrics));
+    metrics->lap_seconds = -1.0;
+
+    size_t next_checkpoint = 1;
+    bool left_start = false;
+
+    double speed_sum = 0.0;
+    glm::vec4 previous = car.getPosition();
+    for (size_t step = 0; step < script.getNumSteps(); ++step)
+    {
+        uint8_t input = script.getFlags(step);
+        ApplyInput(&car, input, dt);
+        car.update(dt);
+        if ( checksums != NULL )
+            checksums->push_back(car.getStateChecksum());
+
+        glm::vec4 position = car.getPosition();
+        glm::vec4 velocity = car.getVelocity();
+        float speed = norm(velocity);
+        metrics->distance += norm(position - previous);
+        previous = position;
+
+        speed_sum += speed;
+        if ( speed > metrics->max_speed )
+            metrics->max_speed = speed;
+
+        bool sliding = car.getIsSliding();
+        if ( sliding )
+            metrics->sliding_seconds += dt;
+
+        // Abaixo de 1 unidade/s a direção da velocidade não é significativa
+        // (no primeiro passo, por exemplo, Car ainda usa o vetor "para
+        // frente" inicial (1,0,0))
+        if ( speed > 1.0f )
+        {
+            glm::vec4 forwards = car.getForwardsVector();
+            float cosine = dotproduct(velocity, forwards) / (speed * norm(forwards));
+            cosine = std::max(-1.0f, std::min(1.0f, cosine));
+            double angle = std::acos(cosine) * 180.0 / M_PI;
+            if ( angle > metrics->max_slide_angle )
+                metrics->max_slide_angle = angle;
+        }
+
+        if ( !checkpoints.empty() && metrics->lap_seconds < 0.0 )
+        {
+            bool at_start = InsideCheckpoint(checkpoints[0], position);
+            left_start = left_start || !at_start;
+            if ( next_checkpoint < checkpoints.size() )
+            {
+                if ( InsideCheckpoint(checkpoints[next_checkpoint], position) )
+                    next_checkpoint++;
+            }
+            else if ( at_start && left_start )
+            {
+                metrics->lap_seconds = (step + 1) * (double)dt;
+            }
+        }
+
+        if ( trajectory != NULL && trajectory->isEnabled() )
+        {
+            CarSimSample sample;
+            memset(&sample, 0, sizeof(sample));
+            sample.script  = script_index;
+            sample.step    = (uint32_t)step;
+            sample.x       = position.x;
+            sample.z       = position.z;
+            sample.yaw     = car.getRotation().y;
+            sample.vx      = velocity.x;
+            sample.vz      = velocity.z;
+            sample.input   = input;
+            sample.sliding = sliding ? 1 : 0;
+            trajectory->write(sample);
+        }
+    }
+
+    metrics->steps          = script.getNumSteps();
+    metrics->seconds        = metrics->steps * (double)dt;
+    metrics->mean_speed     = metrics->steps > 0 ? speed_sum / metrics->steps : 0.0;
+    metrics->final_position = car.getPosition();
+    metrics->final_yaw      = car.getRotation().y;
+}
+
+// Simula 256 carros com os scripts predefinidos (um script diferente a cada
+// carro) com cada preset, usando Car::update() (o kernel especializado, se
+// houver) e Car::updateRuntime(), e compara o tempo por passo e as posições
+// finais (que devem ser idênticas).
+void BenchmarkKernels(const CarParamsSet& presets)
+{
+    typedef std::chrono::steady_clock clock;
+
+    const char* names[] = { "straight", "slalom", "circle", "handbrake" };
+    std::vector<InputScript> scripts(4);
+    size_t num_steps = 0;
+    for (size_t i = 0; i < 4; ++i)
+    {
+        InputScript_BuiltIn(names[i], &scripts[i]);
+        num_steps = std::max(num_steps, scripts[i].getNumSteps());
+    }
+
+    const size_t num_cars = 256;
+    const float dt = 1.0f / 240.0f;
+    const int repetitions = 9;
+
+    printf("Benchmark dos kernels de Car: %lu carros, %lu passos, melhor de %d\n",
+           (unsigned long)num_cars, (unsigned long)num_steps, repetitions);
+    printf("  %-12s %-8s %14s %14s %9s  %s\n", "preset", "kernel", "genérico", "especializado", "ganho", "resultado");
+
+    std::vector<std::string> preset_names = presets.getNames();
+    for (size_t n = 0; n < preset_names.size(); ++n)
+    {
+        const CarParams& params = *presets.find(preset_names[n]);
+        CarPresetKernel kernel = CarParams_FindKernel(params);
+
+        // As duas versões são alternadas a cada repetição, para que
+        // variações do processador afetem as duas igualmente
+        int num_versions = kernel == CAR_KERNEL_RUNTIME ? 1 : 2;
+        double best_ns[2] = { 1e30, 1e30 };
+        std::vector<glm::vec4> final_position[2];
+        for (int r = 0; r < repetitions; ++r)
+        {
+            for (int version = 0; version < num_versions; ++version)
+            {
+                std::vector<Car> cars(num_cars);
+                for (size_t car = 0; car < num_cars; ++car)
+                    cars[car].setParams(params);
+
+                clock::time_point start = clock::now();
+                for (size_t step = 0; step < num_steps; ++step)
+                {
+                    for (size_t car = 0; car < num_cars; ++car)
+                    {
+                        const InputScript& script = scripts[car % 4];
+                        ApplyInput(&cars[car], step < script.getNumSteps() ? script.getFlags(step) : 0, dt);
+                        if ( version == 0 )
+                            cars[car].updateRuntime(dt);
+                        else
+                            cars[car].update(dt);
+                    }
+                }
+                double ns = std::chrono::duration<double, std::nano>(clock::now() - start).count() / (num_cars * num_steps);
+                best_ns[version] = std::min(best_ns[version], ns);
+
+                final_position[version].resize(num_cars);
+                for (size_t car = 0; car < num_cars; ++car)
+                    final_position[version][car] = cars[car].getPosition();
+            }
+        }
+
+        if ( kernel == CAR_KERNEL_RUNTIME )
+        {
+            printf("  %-12s %-8s %11.2f ns %14s %9s  %s\n", preset_names[n].c_str(), CarParams_KernelName(kernel),
+                   best_ns[0], "-", "-", "-");
+            continue;
+        }
+
+        bool identical = true;
+        for (size_t car = 0; car < num_cars; ++car)
+            identical = identical && final_position[0][car] == final_position[1][car];
+        printf("  %-12s %-8s %11.2f ns %11.2f ns %8.2fx  %s\n", preset_names[n].c_str(), CarParams_KernelName(kernel),
+               best_ns[0], best_ns[1], best_ns[0] / best_ns[1], identical ? "idênticos" : "DIFERENTES");
+    }
+}
+
+// Script a partir de um argumento: "builtin:nome" ou um arquivo
+bool LoadScript(const std::string& arg, InputScript* script, std::string* error)
+{
+    if ( arg.compare(0, 8, "builtin:") == 0 )
+    {
+        if ( InputScript_BuiltIn(arg.substr(8), script) )
+            return true;
+        *error = "script predefinido desconhecido \"" + arg.substr(8) + "\" (" + InputScript_BuiltInNames() + ")";
+        return false;
+    }
+    return script->load(arg, error);
+}
+
+struct SweepParam
+{
+    std::string name;
+    float       min, max;
+    int         count;   // Valores na grade
+};
+
+struct SweepSpec
+{
+    std::string              base;
+    std::vector<SweepParam>  params;
+    size_t                   samples; // Zero: grade completa
+    uint32_t                 seed;
+    std::vector<InputScript> scripts;
+    std::vector<Checkpoint>  checkpoints;
+    uint64_t                 hash;    // Identifica a varredura no arquivo de resultados
+
+    size_t numConfigs() const
+    {
+        if ( samples > 0 )
+            return samples;
+        size_t total = 1;
+        for (size_t i = 0; i < params.size(); ++i)
+            total *= (size_t)params[i].count;
+        return total;
+    }
+};
+
+// Hash FNV-1a de 64 bits
+uint64_t HashBytes(uint64_t hash, const void* data, size_t size)
+{
+    const unsigned char* bytes = (const unsigned char*)data;
+    for (size_t i = 0; i < size; ++i)
+        hash = (hash ^ bytes[i]) * 1099511628211ULL;
+    return hash;
+}
+
+bool LoadSweepSpec(const std::string& filename, const CarParamsSet& presets, SweepSpec* spec, std::string* error)
+{
+    std::ifstream file(filename.c_str());
+    if ( !file )
+    {
+        *error = "não foi possível abrir \"" + filename + "\"";
+        return false;
+    }
+
+    spec->base = "default";
+    spec->samples = 0;
+    spec->seed = 1;
+    spec->hash = 14695981039346656037ULL;
+
+    std::string line;
+    int line_number = 0;
+    while ( std::getline(file, line) )
+    {
+        line_number++;
+        spec->hash = HashBytes(spec->hash, line.data(), line.size() + 1);
+        size_t comment = line.find('#');
+        if ( comment != std::string::npos )
+            line.erase(comment);
+
+        std::istringstream fields(line);
+        std::string command;
+        if ( !(fields >> command) )
+            continue;
+
+        std::ostringstream where;
+        where << filename << ":" << line_number << ": ";
+
+        bool ok = true;
+        if ( command == "base" )
+        {
+            ok = (bool)(fields >> spec->base);
+        }
+        else if ( command == "param" )
+        {
+            SweepParam param;
+            CarParams test = CarParams_Default();
+            ok = (bool)(fields >> param.name >> param.min >> param.max >> param.count) && param.count > 0;
+            if ( ok && !CarParams_Set(&test, param.name, param.min) )
+            {
+                *error = where.str() + "parâmetro desconhecido \"" + param.name + "\"";
+                return false;
+            }
+            spec->params.push_back(param);
+        }
+        else if ( command == "samples" )
+        {
+            long samples = -1;
+            ok = (bool)(fields >> samples) && samples >= 0;
+            spec->samples = (size_t)samples;
+        }
+        else if ( command == "seed" )
+        {
+            ok = (bool)(fields >> spec->seed);
+        }
+        else if ( command == "script" )
+        {
+            std::string name;
+            InputScript script;
+            ok = (bool)(fields >> name);
+            if ( ok && !LoadScript(name, &script, error) )
+                return false;
+            spec->scripts.push_back(script);
+        }
+        else if ( command == "checkpoint" )
+        {
+            Checkpoint checkpoint;
+            ok = (bool)(fields >> checkpoint.x >> checkpoint.z >> checkpoint.radius) && checkpoint.radius > 0.0f;
+            spec->checkpoints.push_back(checkpoint);
+        }
+        else
+        {
+            *error = where.str() + "comando desconhecido \"" + command + "\"";
+            return false;
+        }
+
+        if ( !ok )
+        {
+            *error = where.str() + "valores inválidos para \"" + command + "\"";
+            return false;
+        }
+    }
+
+    if ( spec->scripts.empty() )
+    {
+        *error = filename + ": nenhum script";
+        return false;
+    }
+    if ( presets.find(spec->base) == NULL )
+    {
+        *error = filename + ": preset base desconhecido \"" + spec->base + "\"";
+        return false;
+    }
+
+    // Os valores do preset base (que podem vir de --params) e o conteúdo dos
+    // scripts (que podem ser editados sem mudar de nome) também identificam
+    // a varredura
+    const CarParams* base = presets.find(spec->base);
+    spec->hash = HashBytes(spec->hash, base, sizeof(*base));
+    for (size_t s = 0; s < spec->scripts.size(); ++s)
+    {
+        const InputScript& script = spec->scripts[s];
+        int32_t hz = script.getHz();
+        uint64_t num_steps = script.getNumSteps();
+        spec->hash = HashBytes(spec->hash, &hz, sizeof(hz));
+        spec->hash = HashBytes(spec->hash, &num_steps, sizeof(num_steps));
+        for (size_t step = 0; step < script.getNumSteps(); ++step)
+        {
+            uint8_t flags = script.getFlags(step);
+            spec->hash = HashBytes(spec->hash, &flags, 1);
+        }
+    }
+    return true;
+}
+
+// Valores dos parâmetros da configuração "config": a grade é percorrida com
+// o último parâmetro variando mais rápido; as amostras aleatórias dependem
+// só da semente e do índice, e portanto são as mesmas ao continuar uma
+// varredura interrompida
+void SweepConfigValues(const SweepSpec& spec, size_t config, std::vector<float>* values)
+{
+    values->resize(spec.params.size());
+    if ( spec.samples > 0 )
+    {
+        uint64_t state = spec.seed * 0x9E3779B97F4A7C15ULL + config;
+        for (size_t i = 0; i < spec.params.size(); ++i)
+        {
+            // splitmix64
+            state += 0x9E3779B97F4A7C15ULL;
+            uint64_t z = state;
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+            z ^= z >> 31;
+            double u = (double)(z >> 11) / 9007199254740992.0;
+            (*values)[i] = (float)(spec.params[i].min + u * (spec.params[i].max - spec.params[i].min));
+        }
+        return;
+    }
+
+    for (size_t i = spec.params.size(); i-- > 0; )
+    {
+        const SweepParam& param = spec.params[i];
+        int index = (int)(config % (size_t)param.count);
+        config /= (size_t)param.count;
+        (*values)[i] = param.count > 1 ? param.min + (param.max - param.min) * index / (param.count - 1) : param.min;
+    }
+}
+
+// Lê os resultados de uma execução anterior da mesma varredura e mantém
+// somente as configurações completas (com uma linha por script). Retorna
+// false se o arquivo for de outra varredura.
+bool ResumeSweep(const std::string& filename, const std::string& header, size_t num_scripts,
+                 std::vector<uint8_t>* done, std::string* error)
+{
+    std::ifstream file(filename.c_str(), std::ios::binary);
+    if ( !file )
+        return true;
+
+    std::string contents((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    file.close();
+    if ( contents.empty() )
+        return true;
+    if ( contents.compare(0, header.size(), header) != 0 )
+    {
+        *error = "\"" + filename + "\" tem resultados de outra varredura; apague-o ou use outro --output";
+        return false;
+    }
+
+    // Linhas completas (terminadas em '\n') de cada configuração
+    std::vector<size_t> rows(done->size(), 0);
+    std::vector<std::pair<size_t, size_t> > lines; // (início, configuração)
+    size_t begin = header.size();
+    while ( begin < contents.size() )
+    {
+        size_t end = contents.find('\n', begin);
+        if ( end == std::string::npos )
+            break;
+        char* number_end = NULL;
+        unsigned long config = strtoul(contents.c_str() + begin, &number_end, 10);
+        if ( number_end != contents.c_str() + begin && *number_end == ',' && config < rows.size() )
+        {
+            rows[config]++;
+            lines.push_back(std::make_pair(begin, (size_t)config));
+        }
+        begin = end + 1;
+    }
+
+    std::string kept = header;
+    for (size_t i = 0; i < lines.size(); ++i)
+    {
+        if ( rows[lines[i].second] != num_scripts )
+            continue;
+        size_t end = contents.find('\n', lines[i].first);
+        kept.append(contents, lines[i].first, end + 1 - lines[i].first);
+        (*done)[lines[i].second] = 1;
+    }
+
+    // Regravamos sem as linhas de configurações incompletas
+    std::string temp_filename = filename + ".tmp";
+    FILE* out = fopen(temp_filename.c_str(), "wb");
+    if ( out == NULL || fwrite(kept.data(), 1, kept.size(), out) != kept.size() || fclose(out) != 0
+         || rename(temp_filename.c_str(), filename.c_str()) != 0 )
+    {
+        *error = "não foi possível regravar \"" + filename + "\"";
+        return false;
+    }
+    return true;
+}
+
+bool RunSweep(const SweepSpec& spec, const CarParams& base, const std::string& output_filename, int default_hz)
+{
+    typedef std::chrono::steady_clock clock;
+
+    size_t num_configs = spec.numConfigs();
+    size_t num_scripts = spec.scripts.size();
+
+    // A frequência dos scripts sem linha "hz" vem de --hz
+    uint64_t hash = spec.hash;
+    for (size_t s = 0; s < num_scripts; ++s)
+    {
+        int32_t hz = spec.scripts[s].getHz() > 0 ? spec.scripts[s].getHz() : default_hz;
+        hash = HashBytes(hash, &hz, sizeof(hz));
+    }
+
+    char hash_text[32];
+    snprintf(hash_text, sizeof(hash_text), "%016llx", (unsigned long long)hash);
+    std::string header = std::string("# car_sim sweep ") + hash_text + "\nconfig,script";
+    for (size_t i = 0; i < spec.params.size(); ++i)
+        header += "," + spec.params[i].name;
+    header += ",lap_time,max_slide_angle,sliding_seconds,distance,max_speed\n";
+
+    std::vector<uint8_t> done(num_configs, 0);
+    std::string error;
+    if ( !ResumeSweep(output_filename, header, num_scripts, &done, &error) )
+    {
+        fprintf(stderr, "ERROR: %s.\n", error.c_str());
+        return false;
+    }
+
+    std::vector<size_t> pending;
+    for (size_t config = 0; config < num_configs; ++config)
+        if ( !done[config] )
+            pending.push_back(config);
+
+    FILE* output = fopen(output_filename.c_str(), "ab");
+    if ( output == NULL )
+    {
+        fprintf(stderr, "ERROR: Não foi possível abrir \"%s\".\n", output_filename.c_str());
+        return false;
+    }
+    if ( ftell(output) == 0 )
+        fputs(header.c_str(), output);
+
+    fprintf(stderr, "Varredura: %lu configurações x %lu scripts, %lu já concluídas, %u threads\n",
+            (unsigned long)num_configs, (unsigned long)num_scripts,
+            (unsigned long)(num_configs - pending.size()), ThreadPool_NumThreads());
+
+    // Lotes de configurações: cada lote é simulado em paralelo e gravado
+    // (e enviado ao disco) antes do próximo
+    const size_t batch_size = 1024;
+    clock::time_point start = clock::now();
+    for (size_t first = 0; first < pending.size(); first += batch_size)
+    {
+        size_t count = std::min(batch_size, pending.size() - first);
+        std::vector<std::string> rows(count);
+        ParallelFor(count, 1, [&](size_t begin, size_t end) {
+            std::vector<float> values;
+            for (size_t i = begin; i < end; ++i)
+            {
+                size_t config = pending[first + i];
+                SweepConfigValues(spec, config, &values);
+                CarParams params = base;
+                for (size_t p = 0; p < values.size(); ++p)
+                    CarParams_Set(&params, spec.params[p].name, values[p]);
+
+                std::string values_text;
+                for (size_t p = 0; p < values.size(); ++p)
+                {
+                    char value[32];
+                    snprintf(value, sizeof(value), ",%.6g", values[p]);
+                    values_text += value;
+                }
+
+                for (size_t s = 0; s < num_scripts; ++s)
+                {
+                    int hz = spec.scripts[s].getHz() > 0 ? spec.scripts[s].getHz() : default_hz;
+                    CarSimMetrics m;
+                    RunScript(spec.scripts[s], params, spec.checkpoints, (uint32_t)s, StepSeconds(hz), false, NULL, NULL, NULL, &m);
+
+                    char lap[32] = "";
+                    if ( m.lap_seconds >= 0.0 )
+                        snprintf(lap, sizeof(lap), "%.4f", m.lap_seconds);
+                    char row[256];
+                    snprintf(row, sizeof(row), "%lu,%lu", (unsigned long)config, (unsigned long)s);
+                    rows[i] += row + values_text;
+                    snprintf(row, sizeof(row), ",%s,%.3f,%.4f,%.4f,%.4f\n", lap, m.max_slide_angle,
+                             m.sliding_seconds, m.distance, m.max_speed);
+                    rows[i] += row;
+                }
+            }
+        });
+
+        for (size_t i = 0; i < count; ++i)
+            fputs(rows[i].c_str(), output);
+        fflush(output);
+
+        double seconds = std::chrono::duration<double>(clock::now() - start).count();
+        size_t finished = first + count;
+        fprintf(stderr, "\r  %lu/%lu configurações (%.0f configurações/s)", (unsigned long)finished,
+                (unsigned long)pending.size(), finished / std::max(seconds, 1e-9));
+    }
+    if ( !pending.empty() )
+        fprintf(stderr, "\n");
+
+    bool ok = ferror(output) == 0;
+    if ( fclose(output) != 0 || !ok )
+    {
+        fprintf(stderr, "ERROR: Erro ao gravar \"%s\".\n", output_filename.c_str());
+        return false;
+    }
+    return true;
+}
+
+// Executa o script gravando um replay (veja "replay.h") com um keyframe por
+// segundo simulado
+bool RecordReplay(const InputScript& script, const CarParams& params, int hz, bool deterministic, const TyreModel* tyres, const std::string& filename)
+{
+    ReplayRecorder recorder;
+    uint32_t modes = (deterministic ? REPLAY_MODE_DETERMINISTIC : 0) | (tyres != NULL ? REPLAY_MODE_TYRES : 0);
+    if ( !recorder.open(filename, TIME_NS_PER_SECOND / hz, params, (uint32_t)hz, modes, 0) )
+    {
+        fprintf(stderr, "ERROR: Não foi possível criar \"%s\".\n", filename.c_str());
+        return false;
+    }
+
+    Car car;
+    car.setParams(params);
+    car.setDeterministic(deterministic);
+    car.setTyreModel(tyres);
+    float dt = StepSeconds(hz);
+    for (size_t step = 0; step < script.getNumSteps(); ++step)
+    {
+        if ( recorder.wantsKeyframe() )
+            recorder.keyframe(car.getReplayState());
+        ApplyInput(&car, script.getFlags(step), dt);
+        car.update(dt);
+        recorder.input(script.getFlags(step));
+        recorder.advance();
+    }
+
+    if ( !recorder.close() )
+    {
+        fprintf(stderr, "ERROR: Erro ao gravar \"%s\".\n", filename.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool SameState(const ReplayCarState& a, const ReplayCarState& b)
+{
+    return memcmp(a.position, b.position, sizeof(a.position)) == 0
+        && memcmp(a.rotation, b.rotation, sizeof(a.rotation)) == 0
+        && memcmp(a.velocity, b.velocity, sizeof(a.velocity)) == 0
+        && memcmp(a.forwards, b.forwards, sizeof(a.forwards)) == 0
+        && memcmp(&a.turn_angle, &b.turn_angle, sizeof(a.turn_angle)) == 0
+        && a.is_sliding == b.is_sliding;
+}
+
+// Reproduz o replay do início ao fim, comparando o estado do carro com cada
+// keyframe gravado (a física deve ser determinística), e mede o tempo de ir
+// ao instante "seek_seconds" a partir do fim, usando os keyframes. Os modos
+// da física são os da gravação; replays com mapa de alturas ou gravados em
+// uma pista (no jogo) são recusados, pois o simulador anda no chão plano e
+// sem paredes.
+bool PlayReplay(const std::string& filename, double seek_seconds)
+{
+    typedef std::chrono::steady_clock clock;
+
+    ReplayReader replay;
+    std::string error;
+    if ( !replay.load(filename, &error) )
+    {
+        fprintf(stderr, "ERROR: %s.\n", error.c_str());
+        return false;
+    }
+
+    double step_seconds = Time_ToSeconds(replay.getStepNs());
+    printf("%s: %lu passos (%.2f s), %lu transições de teclas, %lu keyframes%s\n", filename.c_str(),
+           (unsigned long)replay.getNumSteps(), replay.getNumSteps() * step_seconds,
+           (unsigned long)replay.getInputs().size(), (unsigned long)replay.getKeyframes().size(),
+           replay.isTruncated() ? " (gravação interrompida)" : "");
+
+    uint32_t modes = replay.getModes();
+    if ( (modes & REPLAY_MODE_HEIGHTFIELD) != 0 )
+    {
+        fprintf(stderr, "ERROR: \"%s\" foi gravado com mapa de alturas, que car_sim não simula.\n", filename.c_str());
+        return false;
+    }
+    if ( replay.getTrackHash() != 0 )
+    {
+        fprintf(stderr, "ERROR: \"%s\" foi gravado em uma pista, que car_sim não simula.\n", filename.c_str());
+        return false;
+    }
+    bool deterministic = (modes & REPLAY_MODE_DETERMINISTIC) != 0;
+    TyreModel tyres;
+    if ( deterministic || (modes & REPLAY_MODE_TYRES) != 0 )
+        printf("Modos:%s%s\n", deterministic ? " determinístico" : "", (modes & REPLAY_MODE_TYRES) != 0 ? " pneus" : "");
+
+    Car car;
+    car.setDeterministic(deterministic);
+    car.setTyreModel((modes & REPLAY_MODE_TYRES) != 0 ? &tyres : NULL);
+    if ( deterministic )
+        DetMath_ResetFloatingPoint();
+    ReplayPlayer<Car> player(replay, &car);
+    const std::vector<ReplayKeyframe>& keyframes = replay.getKeyframes();
+    size_t mismatches = 0;
+    for (size_t k = 0; k < keyframes.size(); ++k)
+    {
+        player.seek(keyframes[k].step);
+        if ( !SameState(car.getReplayState(), keyframes[k].state) )
+        {
+            if ( mismatches == 0 )
+                printf("Primeira divergência no keyframe do passo %lu\n", (unsigned long)keyframes[k].step);
+            mismatches++;
+        }
+    }
+    printf("Keyframes divergentes: %lu de %lu\n", (unsigned long)mismatches, (unsigned long)keyframes.size());
+
+    if ( seek_seconds >= 0.0 )
+    {
+        player.seek(replay.getNumSteps());
+        uint64_t target = (uint64_t)(seek_seconds / step_seconds + 0.5);
+
+        clock::time_point start = clock::now();
+        player.seek(target);
+        double seek_time = std::chrono::duration<double>(clock::now() - start).count();
+
+        glm::vec4 position = car.getPosition();
+        printf("Em %.3f s (passo %lu, %.1f us): x=%.4f z=%.4f yaw=%.5f velocidade=%.4f%s\n",
+               player.getStep() * step_seconds, (unsigned long)player.getStep(), seek_time * 1e6,
+               position.x, position.z, car.getRotation().y, norm(car.getVelocity()),
+               car.getIsSliding() ? " derrapando" : "");
+    }
+    return mismatches == 0;
+}
+
+// Checksums por passo de cada script (veja --checksums), em CSV com o
+// checksum em hexadecimal: "script,step,checksum"
+bool WriteChecksums(const std::string& filename, const std::vector<std::vector<uint64_t> >& checksums)
+{
+    FILE* file = fopen(filename.c_str(), "w");
+    if ( file == NULL )
+    {
+        fprintf(stderr, "ERROR: Não foi possível criar \"%s\".\n", filename.c_str());
+        return false;
+    }
+    setvbuf(file, NULL, _IOFBF, 1 << 20);
+    fprintf(file, "script,step,checksum\n");
+    for (size_t s = 0; s < checksums.size(); ++s)
+        for (size_t step = 0; step < checksums[s].size(); ++step)
+            fprintf(file, "%lu,%lu,%016llx\n", (unsigned long)s, (unsigned long)step, (unsigned long long)checksums[s][step]);
+
+    bool ok = ferror(file) == 0;
+    if ( fclose(file) != 0 || !ok )
+    {
+        fprintf(stderr, "ERROR: Erro ao gravar \"%s\".\n", filename.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool ReadChecksums(const std::string& filename, std::vector<std::vector<uint64_t> >* checksums, std::string* error)
+{
+    std::ifstream file(filename.c_str());
+    if ( !file )
+    {
+        *error = "não foi possível abrir \"" + filename + "\"";
+        return false;
+    }
+
+    std::string line;
+    std::getline(file, line); // Cabeçalho
+    int line_number = 1;
+    while ( std::getline(file, line) )
+    {
+        line_number++;
+        unsigned long script, step;
+        unsigned long long checksum;
+        if ( sscanf(line.c_str(), "%lu,%lu,%llx", &script, &step, &checksum) != 3 )
+        {
+            std::ostringstream where;
+            where << filename << ":" << line_number << ": linha inválida";
+            *error = where.str();
+            return false;
+        }
+        if ( script >= checksums->size() )
+            checksums->resize(script + 1);
+        std::vector<uint64_t>& values = (*checksums)[script];
+        if ( step >= values.size() )
+            values.resize(step + 1, 0);
+        values[step] = checksum;
+    }
+    return true;
+}
+
+// Compara os checksums de cada script com os esperados e mostra o primeiro
+// passo divergente de cada um. Retorna true se todos forem iguais.
+bool VerifyChecksums(const std::vector<std::vector<uint64_t> >& expected, const std::vector<std::vector<uint64_t> >& actual)
+{
+    bool ok = expected.size() == actual.size();
+    if ( !ok )
+        fprintf(stderr, "Checksums: %lu scripts gravados, %lu executados\n", (unsigned long)expected.size(), (unsigned long)actual.size());
+
+    for (size_t s = 0; s < std::min(expected.size(), actual.size()); ++s)
+    {
+        size_t steps = std::min(expected[s].size(), actual[s].size());
+        size_t step = 0;
+        while ( step < steps && expected[s][step] == actual[s][step] )
+            step++;
+
+        if ( step < steps )
+            fprintf(stderr, "Script %lu: primeira divergência no passo %lu (%016llx, esperado %016llx)\n", (unsigned long)s,
+                   (unsigned long)step, (unsigned long long)actual[s][step], (unsigned long long)expected[s][step]);
+        else if ( expected[s].size() != actual[s].size() )
+            fprintf(stderr, "Script %lu: %lu passos iguais, mas %lu gravados e %lu executados\n", (unsigned long)s, (unsigned long)steps,
+                   (unsigned long)expected[s].size(), (unsigned long)actual[s].size());
+        else
+            fprintf(stderr, "Script %lu: %lu passos idênticos\n", (unsigned long)s, (unsigned long)steps);
+        ok = ok && step == steps && expected[s].size() == actual[s].size();
+    }
+    return ok;
+}
+
+void PrintUsage(const char* program)
+{
+    fprintf(stderr, "Uso: %s [--hz=N] [--trajectory=arquivo] [--format=csv|binary] [--every=N]\n"
+                    "       [--metrics=arquivo] [--params=arquivo] [--preset=nome] [--deterministic] [--tyres]\n"
+                    "       [--checksums=arquivo | --verify-checksums=arquivo]\n"
+                    "       <script.txt | builtin:nome>[@preset] ...\n"
+                    "       [--checkpoint=x,z,raio ...] [--record-replay=arquivo]\n"
+                    "     %s [--params=arquivo] --sweep=varredura.txt --output=resultados.csv\n"
+                    "     %s --replay=arquivo [--seek=segundos]\n"
+                    "     %s [--params=arquivo] --benchmark\n"
+                    "Scripts predefinidos: %s\n", program, program, program, program, InputScript_BuiltInNames());
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    int default_hz = 240;
+    std::string trajectory_filename;
+    std::string metrics_filename = "-";
+    TrajectoryFormat format = TRAJECTORY_CSV;
+    size_t every = 1;
+    std::string params_filename;
+    std::string default_preset = "default";
+    bool benchmark = false;
+    std::string sweep_filename;
+    std::string output_filename;
+    std::vector<Checkpoint> checkpoints;
+    std::string record_replay_filename;
+    std::string replay_filename;
+    double seek_seconds = -1.0;
+    bool deterministic = false;
+    bool use_tyres = false;
+    std::string checksums_filename;
+    std::string verify_checksums_filename;
+    std::vector<InputScript> scripts;
+    std::vector<std::string> script_presets; // Vazio: default_preset
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if ( arg.compare(0, 5, "--hz=") == 0 )
+        {
+            default_hz = atoi(arg.c_str() + 5);
+            if ( default_hz <= 0 )
+            {
+                fprintf(stderr, "ERROR: Frequência inválida \"%s\".\n", arg.c_str() + 5);
+                return EXIT_FAILURE;
+            }
+        }
+        else if ( arg.compare(0, 13, "--trajectory=") == 0 )
+        {
+            trajectory_filename = arg.substr(13);
+        }
+        else if ( arg == "--format=csv" || arg == "--format=binary" )
+        {
+            format = arg == "--format=csv" ? TRAJECTORY_CSV : TRAJECTORY_BINARY;
+        }
+        else if ( arg.compare(0, 8, "--every=") == 0 )
+        {
+            every = (size_t)std::max(1, atoi(arg.c_str() + 8));
+        }
+        else if ( arg.compare(0, 10, "--metrics=") == 0 )
+        {
+            metrics_filename = arg.substr(10);
+        }
+        else if ( arg.compare(0, 9, "--params=") == 0 )
+        {
+            params_filename = arg.substr(9);
+        }
+        else if ( arg.compare(0, 9, "--preset=") == 0 )
+        {
+            default_preset = arg.substr(9);
+        }
+        else if ( arg == "--benchmark" )
+        {
+            benchmark = true;
+        }
+        else if ( arg.compare(0, 8, "--sweep=") == 0 )
+        {
+            sweep_filename = arg.substr(8);
+        }
+        else if ( arg.compare(0, 9, "--output=") == 0 )
+        {
+            output_filename = arg.substr(9);
+        }
+        else if ( arg.compare(0, 13, "--checkpoint=") == 0 )
+        {
+            Checkpoint checkpoint;
+            if ( sscanf(arg.c_str() + 13, "%f,%f,%f", &checkpoint.x, &checkpoint.z, &checkpoint.radius) != 3 || checkpoint.radius <= 0.0f )
+            {
+                fprintf(stderr, "ERROR: Ponto de controle inválido \"%s\" (use x,z,raio).\n", arg.c_str() + 13);
+                return EXIT_FAILURE;
+            }
+            checkpoints.push_back(checkpoint);
+        }
+        else if ( arg.compare(0, 16, "--record-replay=") == 0 )
+        {
+            record_replay_filename = arg.substr(16);
+        }
+        else if ( arg.compare(0, 9, "--replay=") == 0 )
+        {
+            replay_filename = arg.substr(9);
+        }
+        else if ( arg.compare(0, 7, "--seek=") == 0 )
+        {
+            seek_seconds = std::max(0.0, atof(arg.c_str() + 7));
+        }
+        else if ( arg == "--deterministic" )
+        {
+            deterministic = true;
+        }
+        else if ( arg == "--tyres" )
+        {
+            use_tyres = true;
+        }
+        else if ( arg.compare(0, 12, "--checksums=") == 0 )
+        {
+            checksums_filename = arg.substr(12);
+        }
+        else if ( arg.compare(0, 19, "--verify-checksums=") == 0 )
+        {
+            verify_checksums_filename = arg.substr(19);
+        }
+        else if ( arg.compare(0, 2, "--") == 0 )
+        {
+            PrintUsage(argv[0]);
+            return EXIT_FAILURE;
+        }
+        else
+        {
+            // "script@preset"
+            std::string preset;
+            size_t at = arg.rfind('@');
+            if ( at != std::string::npos )
+            {
+                preset = arg.substr(at + 1);
+                arg.erase(at);
+            }
+
+            InputScript script;
+            std::string error;
+            if ( !LoadScript(arg, &script, &error) )
+            {
+                fprintf(stderr, "ERROR: %s.\n", error.c_str());
+                return EXIT_FAILURE;
+            }
+            scripts.push_back(script);
+            script_presets.push_back(preset);
+        }
+    }
+
+    CarParamsSet presets;
+    std::string error;
+    if ( !params_filename.empty() && !presets.load(params_filename, &error) )
+    {
+        fprintf(stderr, "ERROR: %s.\n", error.c_str());
+        return EXIT_FAILURE;
+    }
+
+    if ( benchmark )
+    {
+        BenchmarkKernels(presets);
+        return EXIT_SUCCESS;
+    }
+
+    TyreModel tyre_model;
+    const TyreModel* tyres = use_tyres ? &tyre_model : NULL;
+
+    if ( !replay_filename.empty() )
+        return PlayReplay(replay_filename, seek_seconds) ? EXIT_SUCCESS : EXIT_FAILURE;
+
+    if ( !sweep_filename.empty() )
+    {
+        SweepSpec spec;
+        if ( output_filename.empty() )
+        {
+            PrintUsage(argv[0]);
+            return EXIT_FAILURE;
+        }
+        if ( !LoadSweepSpec(sweep_filename, presets, &spec, &error) )
+        {
+            fprintf(stderr, "ERROR: %s.\n", error.c_str());
+            return EXIT_FAILURE;
+        }
+        return RunSweep(spec, *presets.find(spec.base), output_filename, default_hz) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    std::vector<const CarParams*> script_params(scripts.size());
+    for (size_t s = 0; s < scripts.size(); ++s)
+    {
+        if ( script_presets[s].empty() )
+            script_presets[s] = default_preset;
+        script_params[s] = presets.find(script_presets[s]);
+        if ( script_params[s] == NULL )
+        {
+            fprintf(stderr, "ERROR: Preset desconhecido \"%s\".\n", script_presets[s].c_str());
+            return EXIT_FAILURE;
+        }
+    }
+
+    if ( scripts.empty() || (!record_replay_filename.empty() && scripts.size() != 1) )
+    {
+        PrintUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    // As saídas são grandes: usamos buffers de 1 MB
+    FILE* trajectory_file = NULL;
+    if ( trajectory_filename == "-" )
+        trajectory_file = stdout;
+    else if ( !trajectory_filename.empty() )
+        trajectory_file = fopen(trajectory_filename.c_str(), format == TRAJECTORY_BINARY ? "wb" : "w");
+    if ( !trajectory_filename.empty() && trajectory_file == NULL )
+    {
+        fprintf(stderr, "ERROR: Não foi possível criar \"%s\".\n", trajectory_filename.c_str());
+        return EXIT_FAILURE;
+    }
+    if ( trajectory_file != NULL )
+        setvbuf(trajectory_file, NULL, _IOFBF, 1 << 20);
+
+    FILE* metrics_file = metrics_filename == "-" ? stdout : fopen(metrics_filename.c_str(), "w");
+    if ( metrics_file == NULL )
+    {
+        fprintf(stderr, "ERROR: Não foi possível criar \"%s\".\n", metrics_filename.c_str());
+        return EXIT_FAILURE;
+    }
+
+    std::vector<std::vector<uint64_t> > expected_checksums;
+    if ( !verify_checksums_filename.empty() && !ReadChecksums(verify_checksums_filename, &expected_checksums, &error) )
+    {
+        fprintf(stderr, "ERROR: %s.\n", error.c_str());
+        return EXIT_FAILURE;
+    }
+    bool want_checksums = !checksums_filename.empty() || !verify_checksums_filename.empty();
+    std::vector<std::vector<uint64_t> > checksums(scripts.size());
+
+    TrajectoryWriter trajectory(trajectory_file, format, every);
+    std::vector<CarSimMetrics> metrics(scripts.size());
+
+    typedef std::chrono::steady_clock clock;
+    clock::time_point start = clock::now();
+    size_t total_steps = 0;
+    for (size_t s = 0; s < scripts.size(); ++s)
+    {
+        int hz = scripts[s].getHz() > 0 ? scripts[s].getHz() : default_hz;
+        RunScript(scripts[s], *script_params[s], checkpoints, (uint32_t)s, StepSeconds(hz), deterministic, tyres, &trajectory,
+                  want_checksums ? &checksums[s] : NULL, &metrics[s]);
+        total_steps += metrics[s].steps;
+    }
+    double seconds = std::chrono::duration<double>(clock::now() - start).count();
+
+    fprintf(metrics_file, "script,name,preset,steps,seconds,distance,max_speed,mean_speed,sliding_seconds,max_slide_angle,lap_time,final_x,final_z,final_yaw\n");
+    for (size_t s = 0; s < scripts.size(); ++s)
+    {
+        const CarSimMetrics& m = metrics[s];
+        char lap[32] = "";
+        if ( m.lap_seconds >= 0.0 )
+            snprintf(lap, sizeof(lap), "%.4f", m.lap_seconds);
+        fprintf(metrics_file, "%lu,%s,%s,%lu,%.4f,%.4f,%.4f,%.4f,%.4f,%.3f,%s,%.4f,%.4f,%.5f\n",
+                (unsigned long)s, scripts[s].getName().c_str(), script_presets[s].c_str(), (unsigned long)m.steps, m.seconds,
+                m.distance, m.max_speed, m.mean_speed, m.sliding_seconds, m.max_slide_angle, lap,
+                m.final_position.x, m.final_position.z, m.final_yaw);
+    }
+
+    if ( !record_replay_filename.empty() )
+    {
+        int hz = scripts[0].getHz() > 0 ? scripts[0].getHz() : default_hz;
+        if ( !RecordReplay(scripts[0], *script_params[0], hz, deterministic, tyres, record_replay_filename) )
+            return EXIT_FAILURE;
+    }
+
+    if ( !checksums_filename.empty() && !WriteChecksums(checksums_filename, checksums) )
+        return EXIT_FAILURE;
+    bool checksums_ok = verify_checksums_filename.empty() || VerifyChecksums(expected_checksums, checksums);
+
+    if ( trajectory_file != NULL && trajectory_file != stdout )
+        fclose(trajectory_file);
+    if ( metrics_file != stdout )
+        fclose(metrics_file);
+
+    fprintf(stderr, "%lu scripts, %lu passos em %.3f s (%.0f passos/s)\n",
+            (unsigned long)scripts.size(), (unsigned long)total_steps, seconds,
+            seconds > 0.0 ? total_steps / seconds : 0.0);
+    return checksums_ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
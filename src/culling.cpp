@@ -0,0 +1,364 @@
+// Descarte de objetos fora do frustum. Veja comentários em "culling.h".
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "culling.h"
+#include "threadpool.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define CULLING_HAS_SSE 1
+#include <emmintrin.h>
+#endif
+
+// AVX é compilado somente nesta função (atributo "target"), e usado se o
+// processador o suportar
+#if defined(CULLING_HAS_SSE) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CULLING_HAS_AVX 1
+#include <immintrin.h>
+#endif
+
+namespace
+{
+
+// Plano em forma de vetores: coeficientes e valores absolutos das normais
+struct PlaneCoefficients
+{
+    float a, b, c, d;
+    float abs_a, abs_b, abs_c;
+};
+
+void GetPlanes(const Frustum& frustum, PlaneCoefficients planes[6])
+{
+    for (int p = 0; p < 6; ++p)
+    {
+        planes[p].a = frustum.planes[p].x;
+        planes[p].b = frustum.planes[p].y;
+        planes[p].c = frustum.planes[p].z;
+        planes[p].d = frustum.planes[p].w;
+        planes[p].abs_a = std::fabs(planes[p].a);
+        planes[p].abs_b = std::fabs(planes[p].b);
+        planes[p].abs_c = std::fabs(planes[p].c);
+    }
+}
+
+// Todas as implementações calculam, para cada plano, a distância (com sinal
+// e sem normalização) do centro da caixa ao plano e o "raio" da caixa na
+// direção da normal, com as operações na mesma ordem. A caixa está fora do
+// frustum se estiver inteiramente do lado de fora de algum plano.
+size_t TestBoxesScalar(const PlaneCoefficients planes[6],
+                       const float* cx, const float* cy, const float* cz,
+                       const float* ex, const float* ey, const float* ez,
+                       size_t begin, size_t end, uint8_t* visible)
+{
+    size_t num_visible = 0;
+    for (size_t i = begin; i < end; ++i)
+    {
+        bool inside = true;
+        for (int p = 0; p < 6; ++p)
+        {
+            float distance = planes[p].a * cx[i] + planes[p].b * cy[i] + planes[p].c * cz[i] + planes[p].d;
+            float radius   = planes[p].abs_a * ex[i] + planes[p].abs_b * ey[i] + planes[p].abs_c * ez[i];
+            inside = inside && !(distance + radius < 0.0f);
+        }
+        visible[i] = inside ? 1 : 0;
+        num_visible += visible[i];
+    }
+    return num_visible;
+}
+
+#ifdef CULLING_HAS_SSE
+size_t TestBoxesSSE(const PlaneCoefficients planes[6],
+                    const float* cx, const float* cy, const float* cz,
+                    const float* ex, const float* ey, const float* ez,
+                    size_t begin, size_t end, uint8_t* visible)
+{
+    size_t num_visible = 0;
+    const __m128 zero = _mm_setzero_ps();
+    for (size_t i = begin; i < end; i += 4)
+    {
+        __m128 x  = _mm_loadu_ps(cx + i);
+        __m128 y  = _mm_loadu_ps(cy + i);
+        __m128 z  = _mm_loadu_ps(cz + i);
+        __m128 sx = _mm_loadu_ps(ex + i);
+        __m128 sy = _mm_loadu_ps(ey + i);
+        __m128 sz = _mm_loadu_ps(ez + i);
+
+        // Máscara das caixas fora de algum plano
+        __m128 outside = _mm_setzero_ps();
+        for (int p = 0; p < 6; ++p)
+        {
+            __m128 distance = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(planes[p].a), x),
+                                                               _mm_mul_ps(_mm_set1_ps(planes[p].b), y)),
+                                                    _mm_mul_ps(_mm_set1_ps(planes[p].c), z)),
+                                         _mm_set1_ps(planes[p].d));
+            __m128 radius   = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(planes[p].abs_a), sx),
+                                                    _mm_mul_ps(_mm_set1_ps(planes[p].abs_b), sy)),
+                                         _mm_mul_ps(_mm_set1_ps(planes[p].abs_c), sz));
+            outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance, radius), zero));
+        }
+
+        int mask = _mm_movemask_ps(outside);
+        size_t count = end - i < 4 ? end - i : 4;
+        for (size_t k = 0; k < count; ++k)
+        {
+            visible[i + k] = (mask >> k) & 1 ? 0 : 1;
+            num_visible += visible[i + k];
+        }
+    }
+    return num_visible;
+}
+#endif // CULLING_HAS_SSE
+
+#ifdef CULLING_HAS_AVX
+__attribute__((target("avx")))
+size_t TestBoxesAVX(const PlaneCoefficients planes[6],
+                    const float* cx, const float* cy, const float* cz,
+                    const float* ex, const float* ey, const float* ez,
+                    size_t begin, size_t end, uint8_t* visible)
+{
+    size_t num_visible = 0;
+    const __m256 zero = _mm256_setzero_ps();
+    for (size_t i = begin; i < end; i += 8)
+    {
+        __m256 x  = _mm256_loadu_ps(cx + i);
+        __m256 y  = _mm256_loadu_ps(cy + i);
+        __m256 z  = _mm256_loadu_ps(cz + i);
+        __m256 sx = _mm256_loadu_ps(ex + i);
+        __m256 sy = _mm256_loadu_ps(ey + i);
+        __m256 sz = _mm256_loadu_ps(ez + i);
+
+        __m256 outside = _mm256_setzero_ps();
+        for (int p = 0; p < 6; ++p)
+        {
+            __m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(planes[p].a), x),
+                                                                        _mm256_mul_ps(_mm256_set1_ps(planes[p].b), y)),
+                                                          _mm256_mul_ps(_mm256_set1_ps(planes[p].c), z)),
+                                            _mm256_set1_ps(planes[p].d));
+            __m256 radius   = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(planes[p].abs_a), sx),
+                                                          _mm256_mul_ps(_mm256_set1_ps(planes[p].abs_b), sy)),
+                                            _mm256_mul_ps(_mm256_set1_ps(planes[p].abs_c), sz));
+            outside = _mm256_or_ps(outside, _mm256_cmp_ps(_mm256_add_ps(distance, radius), zero, _CMP_LT_OQ));
+        }
+
+        int mask = _mm256_movemask_ps(outside);
+        size_t count = end - i < 8 ? end - i : 8;
+        for (size_t k = 0; k < count; ++k)
+        {
+            visible[i + k] = (mask >> k) & 1 ? 0 : 1;
+            num_visible += visible[i + k];
+        }
+    }
+    return num_visible;
+}
+#endif // CULLING_HAS_AVX
+
+} // namespace
+
+void Culling_ExtractFrustum(const glm::mat4& m, Frustum* frustum)
+{
+    // Linhas da matriz (glm guarda as matrizes por colunas)
+    glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+    glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+    glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+    glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+    // Um ponto está dentro do volume de recorte se -w <= x,y,z <= w
+    frustum->planes[0] = row3 + row0; // Esquerdo
+    frustum->planes[1] = row3 - row0; // Direito
+    frustum->planes[2] = row3 + row1; // Inferior
+    frustum->planes[3] = row3 - row1; // Superior
+    frustum->planes[4] = row3 + row2; // Próximo
+    frustum->planes[5] = row3 - row2; // Distante
+}
+
+void Culling_TransformBox(const glm::mat4& model, const glm::vec3& bbox_min, const glm::vec3& bbox_max,
+                          glm::vec3* center, glm::vec3* extent)
+{
+    glm::vec3 local_center = 0.5f * (bbox_min + bbox_max);
+    glm::vec3 local_extent = 0.5f * (bbox_max - bbox_min);
+
+    *center = glm::vec3(model * glm::vec4(local_center, 1.0f));
+    for (int row = 0; row < 3; ++row)
+    {
+        (*extent)[row] = std::fabs(model[0][row]) * local_extent.x
+                       + std::fabs(model[1][row]) * local_extent.y
+                       + std::fabs(model[2][row]) * local_extent.z;
+    }
+}
+
+size_t Culling_TestBoxes(CullingBackend backend, const Frustum& frustum,
+                         const float* center_x, const float* center_y, const float* center_z,
+                         const float* extent_x, const float* extent_y, const float* extent_z,
+                         size_t begin, size_t end, uint8_t* visible)
+{
+    PlaneCoefficients planes[6];
+    GetPlanes(frustum, planes);
+
+    switch ( backend )
+    {
+#ifdef CULLING_HAS_AVX
+    case CULLING_AVX:
+        return TestBoxesAVX(planes, center_x, center_y, center_z, extent_x, extent_y, extent_z, begin, end, visible);
+#endif
+#ifdef CULLING_HAS_SSE
+    case CULLING_SSE:
+        return TestBoxesSSE(planes, center_x, center_y, center_z, extent_x, extent_y, extent_z, begin, end, visible);
+#endif
+    default:
+        return TestBoxesScalar(planes, center_x, center_y, center_z, extent_x, extent_y, extent_z, begin, end, visible);
+    }
+}
+
+CullingBackend Culling_BestBackend()
+{
+#ifdef CULLING_HAS_AVX
+    if ( __builtin_cpu_supports("avx") )
+        return CULLING_AVX;
+#endif
+#ifdef CULLING_HAS_SSE
+    return CULLING_SSE;
+#else
+    return CULLING_SCALAR;
+#endif
+}
+
+const char* Culling_BackendName(CullingBackend backend)
+{
+    switch ( backend )
+    {
+    case CULLING_SSE: return "sse";
+    case CULLING_AVX: return "avx";
+    default:          return "escalar";
+    }
+}
+
+BoxCuller::BoxCuller()
+    : backend(Culling_BestBackend())
+    , enabled(true)
+    , num_boxes(0)
+{
+    stats.tested = stats.culled = stats.submitted = 0;
+}
+
+void BoxCuller::beginFrame(const glm::mat4& projection_view)
+{
+    Culling_ExtractFrustum(projection_view, &frustum);
+    num_boxes = 0;
+    stats.tested = stats.culled = stats.submitted = 0;
+}
+
+size_t BoxCuller::add(const glm::mat4& model, const glm::vec3& bbox_min, const glm::vec3& bbox_max)
+{
+    // Mantemos os vetores com 7 elementos de preenchimento após a última
+    // caixa, para que os testes SIMD sempre leiam grupos completos
+    size_t index = num_boxes++;
+    size_t padded = num_boxes + 7;
+    if ( center_x.size() < padded )
+    {
+        padded = std::max(padded, 2 * center_x.size());
+        center_x.resize(padded, 0.0f); center_y.resize(padded, 0.0f); center_z.resize(padded, 0.0f);
+        extent_x.resize(padded, 0.0f); extent_y.resize(padded, 0.0f); extent_z.resize(padded, 0.0f);
+        visible.resize(padded, 1);
+    }
+
+    glm::vec3 center, extent;
+    Culling_TransformBox(model, bbox_min, bbox_max, &center, &extent);
+    center_x[index] = center.x; center_y[index] = center.y; center_z[index] = center.z;
+    extent_x[index] = extent.x; extent_y[index] = extent.y; extent_z[index] = extent.z;
+    return index;
+}
+
+void BoxCuller::cull(size_t first)
+{
+    if ( first >= num_boxes )
+        return;
+
+    size_t count = num_boxes - first;
+    size_t num_visible = count;
+    if ( enabled )
+    {
+        // Com muitas caixas, os testes são divididos entre as threads. Os
+        // intervalos começam em múltiplos de 8 a partir de "first", e as
+        // leituras além do fim de um intervalo caem no intervalo seguinte
+        // ou no espaço extra dos vetores.
+        std::atomic<size_t> visible_count(0);
+        ParallelFor(count, 16384, [&](size_t begin, size_t end) {
+            visible_count += Culling_TestBoxes(backend, frustum,
+                                               center_x.data(), center_y.data(), center_z.data(),
+                                               extent_x.data(), extent_y.data(), extent_z.data(),
+                                               first + begin, first + end, visible.data());
+        });
+        num_visible = visible_count;
+    }
+    else
+    {
+        for (size_t i = first; i < num_boxes; ++i)
+            visible[i] = 1;
+    }
+
+    stats.tested    += count;
+    stats.culled    += count - num_visible;
+    stats.submitted += num_visible;
+}
+
+void Culling_Benchmark(size_t num_boxes, int repetitions)
+{
+    typedef std::chrono::steady_clock clock;
+
+    // Caixas aleatórias espalhadas em uma pista de 2 km x 2 km, vistas por
+    // uma câmera no centro
+    glm::mat4 projection = glm::perspective(3.141592f / 3.0f, 16.0f / 9.0f, 0.1f, 500.0f);
+    glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 2.0f, 0.0f), glm::vec3(1.0f, 2.0f, 1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    Frustum frustum;
+    Culling_ExtractFrustum(projection * view, &frustum);
+
+    size_t padded = num_boxes + 7;
+    std::vector<float> cx(padded, 0.0f), cy(padded, 0.0f), cz(padded, 0.0f);
+    std::vector<float> ex(padded, 0.0f), ey(padded, 0.0f), ez(padded, 0.0f);
+    srand(1234);
+    for (size_t i = 0; i < num_boxes; ++i)
+    {
+        glm::mat4 model = glm::translate(glm::mat4(1.0f), glm::vec3(rand() % 2000 - 1000.0f, 0.0f, rand() % 2000 - 1000.0f));
+        model = glm::rotate(model, (rand() % 628) / 100.0f, glm::vec3(0.0f, 1.0f, 0.0f));
+        glm::vec3 center, extent;
+        Culling_TransformBox(model, glm::vec3(-1.0f, 0.0f, -2.0f), glm::vec3(1.0f, 1.5f, 2.0f), &center, &extent);
+        cx[i] = center.x; cy[i] = center.y; cz[i] = center.z;
+        ex[i] = extent.x; ey[i] = extent.y; ez[i] = extent.z;
+    }
+
+    printf("Benchmark de culling: %lu caixas, %d repetições\n", (unsigned long)num_boxes, repetitions);
+
+    std::vector<uint8_t> reference(padded), visible(padded);
+    CullingBackend backends[3] = { CULLING_SCALAR, CULLING_SSE, CULLING_AVX };
+    CullingBackend best = Culling_BestBackend();
+    for (int b = 0; b < 3; ++b)
+    {
+        if ( backends[b] > best )
+            continue;
+
+        double best_ms = 1e30;
+        size_t num_visible = 0;
+        for (int r = 0; r < repetitions; ++r)
+        {
+            clock::time_point start = clock::now();
+            num_visible = Culling_TestBoxes(backends[b], frustum, cx.data(), cy.data(), cz.data(),
+                                            ex.data(), ey.data(), ez.data(), 0, num_boxes, visible.data());
+            double ms = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+            best_ms = std::min(best_ms, ms);
+        }
+
+        if ( b == 0 )
+            reference = visible;
+        bool same = std::equal(reference.begin(), reference.begin() + num_boxes, visible.begin());
+
+        printf("  %-8s %9.3f ms  (%6.2f ns/caixa)  %lu visíveis  %s\n",
+               Culling_BackendName(backends[b]), best_ms, best_ms * 1e6 / num_boxes,
+               (unsigned long)num_visible, same ? "" : "ATENÇÃO: resultado diferente do escalar");
+    }
+}
@@ -0,0 +1,164 @@
+// Funções matemáticas determinísticas. Veja comentários em "detmath.h".
+#include <cfenv>
+#include <cmath>
+#include <cstring>
+
+#include "detmath.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define DETMATH_HAS_SSE 1
+#include <xmmintrin.h>
+#endif
+
+#if defined(__GNUC__) && defined(__FLT_EVAL_METHOD__) && __FLT_EVAL_METHOD__ != 0
+#warning "Floats calculados com precisão estendida (x87): o modo determinístico não será reproduzível entre máquinas; use -msse2 -mfpmath=sse"
+#endif
+
+namespace
+{
+
+const float kPi   = 3.14159265358979323846f;
+const float kPi_2 = 1.57079632679489661923f;
+const float kPi_4 = 0.78539816339744830962f;
+
+} // namespace
+
+void DetMath_SinCos(float x, float* sin_x, float* cos_x)
+{
+    if ( x != x )
+    {
+        *sin_x = *cos_x = x;
+        return;
+    }
+
+    // Ângulos muito grandes perdem precisão de qualquer forma; fmod() é
+    // exata e mantém o quadrante inteiro pequeno
+    if ( std::fabs(x) > 65536.0f )
+        x = std::fmod(x, 6.28318530717958647692f);
+
+    // Redução para [-pi/4, pi/4] pelo múltiplo de pi/2 mais próximo, com
+    // pi/2 em três partes para não perder precisão
+    float q = std::floor(x * 0.636619772367581343f + 0.5f);
+    float r = x - q * 1.5703125f;
+    r = r - q * 4.837512969970703125e-4f;
+    r = r - q * 7.54978995489188216e-8f;
+    float r2 = r * r;
+
+    float s = -1.9515295891e-4f;
+    s = s * r2 + 8.3321608736e-3f;
+    s = s * r2 - 1.6666654611e-1f;
+    s = s * r2 * r + r;
+
+    float c = 2.443315711809948e-5f;
+    c = c * r2 - 1.388731625493765e-3f;
+    c = c * r2 + 4.166664568298827e-2f;
+    c = c * r2 * r2 - 0.5f * r2 + 1.0f;
+
+    // Quadrante q: (sen, cos) = (s, c), (c, -s), (-s, -c), (-c, s)
+    switch ( (int)q & 3 )
+    {
+    case 0:  *sin_x = s;  *cos_x = c;  break;
+    case 1:  *sin_x = c;  *cos_x = -s; break;
+    case 2:  *sin_x = -s; *cos_x = -c; break;
+    default: *sin_x = -c; *cos_x = s;  break;
+    }
+}
+
+float DetMath_Sin(float x)
+{
+    float s, c;
+    DetMath_SinCos(x, &s, &c);
+    return s;
+}
+
+float DetMath_Cos(float x)
+{
+    float s, c;
+    DetMath_SinCos(x, &s, &c);
+    return c;
+}
+
+float DetMath_Atan(float x)
+{
+    bool negative = x < 0.0f;
+    x = std::fabs(x);
+
+    // Redução para [0, tan(pi/8)]
+    float offset = 0.0f;
+    if ( x > 2.414213562373095f )
+    {
+        offset = kPi_2;
+        x = -1.0f / x;
+    }
+    else if ( x > 0.4142135623730950f )
+    {
+        offset = kPi_4;
+        x = (x - 1.0f) / (x + 1.0f);
+    }
+
+    float z = x * x;
+    float y = 8.05374449538e-2f;
+    y = y * z - 1.38776856032e-1f;
+    y = y * z + 1.99777106478e-1f;
+    y = y * z - 3.33329491539e-1f;
+    y = y * z * x + x;
+    y = offset + y;
+    return negative ? -y : y;
+}
+
+float DetMath_Atan2(float y, float x)
+{
+    if ( x == 0.0f )
+    {
+        if ( y > 0.0f ) return kPi_2;
+        if ( y < 0.0f ) return -kPi_2;
+        return 0.0f;
+    }
+
+    float angle = DetMath_Atan(y / x);
+    if ( x < 0.0f )
+        angle = y < 0.0f ? angle - kPi : angle + kPi;
+    return angle;
+}
+
+float DetMath_Acos(float x)
+{
+    // acos(x) = 2 atan(sqrt((1-x)/(1+x))), precisa também perto de +-1
+    x = std::fmax(-1.0f, std::fmin(1.0f, x));
+    return 2.0f * DetMath_Atan2(std::sqrt(1.0f - x), std::sqrt(1.0f + x));
+}
+
+bool DetMath_ResetFloatingPoint()
+{
+    bool ok = true;
+    if ( std::fegetround() != FE_TONEAREST )
+    {
+        std::fesetround(FE_TONEAREST);
+        ok = false;
+    }
+
+#ifdef DETMATH_HAS_SSE
+    // MXCSR: bits 13-14 arredondamento, 15 "flush to zero", 6 "denormals
+    // are zero"
+    const unsigned int mask = 0x6000 | 0x8000 | 0x0040;
+    unsigned int csr = _mm_getcsr();
+    if ( (csr & mask) != 0 )
+    {
+        _mm_setcsr(csr & ~mask);
+        ok = false;
+    }
+#endif
+    return ok;
+}
+
+uint64_t DetMath_HashFloats(uint64_t hash, const float* values, size_t count)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        uint32_t bits;
+        memcpy(&bits, &values[i], sizeof(bits));
+        for (int byte = 0; byte < 4; ++byte)
+            hash = (hash ^ ((bits >> (8*byte)) & 0xFF)) * 1099511628211ULL;
+    }
+    return hash;
+}
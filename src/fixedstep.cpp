@@ -0,0 +1,127 @@
+// Escalonador de passo fixo para a simulação. Veja comentários em "fixedstep.h".
+#include <cstdio>
+
+#include "fixedstep.h"
+
+FixedStepScheduler::FixedStepScheduler(TimeNs step, int max_substeps)
+    : step(step > 0 ? step : 1)
+    , max_substeps(max_substeps > 0 ? max_substeps : 1)
+    , accumulator(0)
+    , dropped_time(0)
+{
+}
+
+void FixedStepScheduler::setStep(TimeNs value)
+{
+    if ( value <= 0 )
+        return;
+
+    // Mantemos a mesma fração de passo acumulada
+    accumulator = (TimeNs)((double)accumulator / step * value);
+    step = value;
+}
+
+int FixedStepScheduler::advance(TimeNs frame_delta)
+{
+    if ( frame_delta > 0 )
+        accumulator += frame_delta;
+
+    TimeNs steps = accumulator / step;
+    if ( steps > max_substeps )
+    {
+        // Descartamos o tempo que não cabe no limite, mantendo a fração de
+        // passo para a interpolação
+        TimeNs excess = (steps - max_substeps) * step;
+        accumulator -= excess;
+        dropped_time += excess;
+        steps = max_substeps;
+    }
+
+    accumulator -= steps * step;
+    return (int)steps;
+}
+
+namespace
+{
+
+// Resultado de uma verificação de FixedStep_Check()
+bool Expect(const char* what, bool ok, bool* all_ok)
+{
+    printf("  %-6s %s\n", ok ? "ok" : "FALHOU", what);
+    *all_ok = *all_ok && ok;
+    return ok;
+}
+
+} // namespace
+
+bool FixedStep_Check()
+{
+    const TimeNs ms = TIME_NS_PER_MILLISECOND;
+    bool ok = true;
+    printf("Verificação do passo fixo com FakeClock\n");
+
+    // TimeBase: os intervalos são exatamente os avanços do relógio
+    FakeClock clock;
+    clock.set(5000 * ms);
+    TimeBase time(&clock);
+    clock.advance(16 * ms);
+    time.beginFrame();
+    clock.advance(20 * ms);
+    time.beginFrame();
+    Expect("TimeBase: duração e início dos quadros", time.getFrameDelta() == 20 * ms && time.getFrameTime() == 36 * ms
+           && time.getFrameIndex() == 2, &ok);
+    time.advanceSimulation(4 * ms);
+    time.setClock(&clock);
+    Expect("TimeBase: setClock() reinicia a contagem", time.getFrameTime() == 0 && time.getFrameIndex() == 0
+           && time.getSimulationTime() == 0, &ok);
+
+    // Passos e fração acumulada
+    FixedStepScheduler scheduler(4 * ms, 8);
+    int steps = scheduler.advance(10 * ms);
+    Expect("advance(10 ms), passo de 4 ms: 2 passos, alpha 0.5", steps == 2 && scheduler.getAlpha() == 0.5f, &ok);
+    steps = scheduler.advance(10 * ms);
+    Expect("advance(10 ms) de novo: 3 passos, alpha 0", steps == 3 && scheduler.getAlpha() == 0.0f, &ok);
+    steps = scheduler.advance(-1 * ms);
+    Expect("advance() com tempo negativo: nenhum passo", steps == 0 && scheduler.getAlpha() == 0.0f, &ok);
+
+    // Limite de passos por quadro: 101 ms são 25 passos, 8 executados, 17
+    // descartados, e 1 ms fica para a interpolação
+    steps = scheduler.advance(101 * ms);
+    Expect("advance(101 ms), no máximo 8: 8 passos, 68 ms descartados", steps == 8 && scheduler.getDroppedTime() == 68 * ms, &ok);
+    Expect("  fração mantida após o descarte: alpha 0.25", scheduler.getAlpha() == 0.25f, &ok);
+
+    // setStep() mantém a fração de passo: 1 ms de 4 vira 2 ms de 8
+    scheduler.setStep(8 * ms);
+    Expect("setStep(8 ms): alpha continua 0.25", scheduler.getStep() == 8 * ms && scheduler.getAlpha() == 0.25f, &ok);
+    steps = scheduler.advance(6 * ms);
+    Expect("  advance(6 ms) completa o passo: 1 passo, alpha 0", steps == 1 && scheduler.getAlpha() == 0.0f, &ok);
+    scheduler.setStep(0);
+    Expect("setStep(0) é ignorado", scheduler.getStep() == 8 * ms, &ok);
+
+    // Quadros irregulares de 1 a 40 ms com travadas de 250 ms a cada 100,
+    // como no laço principal: nenhum tempo se perde nem aparece
+    clock.set(0);
+    time.setClock(&clock);
+    FixedStepScheduler simulation(TIME_NS_PER_SECOND / 240, 8);
+    uint64_t total_steps = 0;
+    bool alpha_in_range = true;
+    for (int frame = 1; frame <= 10000; ++frame)
+    {
+        clock.advance(frame % 100 == 0 ? 250 * ms : (TimeNs)(frame * 7919 % 40 + 1) * ms + frame % 1000);
+        time.beginFrame();
+        steps = simulation.advance(time.getFrameDelta());
+        for (int i = 0; i < steps; ++i)
+            time.advanceSimulation(simulation.getStep());
+        total_steps += steps;
+        alpha_in_range = alpha_in_range && simulation.getAlpha() >= 0.0f && simulation.getAlpha() < 1.0f;
+    }
+    Expect("10000 quadros irregulares: alpha sempre em [0,1)", alpha_in_range, &ok);
+    Expect("  relógio = simulado + descartado + acumulado",
+           time.getFrameTime() == time.getSimulationTime() + simulation.getDroppedTime() + simulation.getAccumulated()
+           && time.getSimulationTime() == (TimeNs)total_steps * simulation.getStep(), &ok);
+    printf("         %.3f s de relógio: %lu passos (%.3f s), %.3f s descartados\n", Time_ToSeconds(time.getFrameTime()),
+           (unsigned long)total_steps, Time_ToSeconds(time.getSimulationTime()), Time_ToSeconds(simulation.getDroppedTime()));
+
+    printf("%s\n", ok ? "Todas as verificações passaram." : "ATENÇÃO: verificações falharam.");
+    return ok;
+}
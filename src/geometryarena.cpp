@@ -0,0 +1,304 @@
+// Arena de geometria compartilhada. Veja comentários em "geometryarena.h".
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <algorithm>
+
+#include "geometryarena.h"
+#include "vertexformat.h"
+
+RangeAllocator::RangeAllocator()
+    : capacity(0)
+    , used(0)
+{
+}
+
+void RangeAllocator::reset(size_t new_capacity)
+{
+    free_blocks.clear();
+    capacity = new_capacity;
+    used = 0;
+    if ( capacity > 0 )
+        free_blocks[0] = capacity;
+}
+
+bool RangeAllocator::allocate(size_t size, size_t* offset)
+{
+    if ( size == 0 )
+    {
+        *offset = 0;
+        return true;
+    }
+
+    // "First fit" em ordem de posição: tende a manter o início do buffer
+    // ocupado e o espaço livre concentrado em poucos blocos grandes no final.
+    for (std::map<size_t, size_t>::iterator it = free_blocks.begin(); it != free_blocks.end(); ++it)
+    {
+        if ( it->second < size )
+            continue;
+
+        *offset = it->first;
+        size_t remaining = it->second - size;
+        free_blocks.erase(it);
+        if ( remaining > 0 )
+            free_blocks[*offset + size] = remaining;
+        used += size;
+        return true;
+    }
+    return false;
+}
+
+void RangeAllocator::release(size_t offset, size_t size)
+{
+    if ( size == 0 )
+        return;
+    used -= size;
+    insertFreeBlock(offset, size);
+}
+
+void RangeAllocator::grow(size_t new_capacity)
+{
+    if ( new_capacity <= capacity )
+        return;
+    size_t old_capacity = capacity;
+    capacity = new_capacity;
+    insertFreeBlock(old_capacity, new_capacity - old_capacity);
+}
+
+size_t RangeAllocator::getLargestFreeBlock() const
+{
+    size_t largest = 0;
+    for (std::map<size_t, size_t>::const_iterator it = free_blocks.begin(); it != free_blocks.end(); ++it)
+        largest = std::max(largest, it->second);
+    return largest;
+}
+
+void RangeAllocator::insertFreeBlock(size_t offset, size_t size)
+{
+    // Unificamos com o bloco livre seguinte, se for vizinho...
+    std::map<size_t, size_t>::iterator next = free_blocks.lower_bound(offset);
+    if ( next != free_blocks.end() && offset + size == next->first )
+    {
+        size += next->second;
+        next = free_blocks.erase(next);
+    }
+
+    // ... e com o anterior
+    if ( next != free_blocks.begin() )
+    {
+        std::map<size_t, size_t>::iterator previous = next;
+        --previous;
+        if ( previous->first + previous->second == offset )
+        {
+            previous->second += size;
+            return;
+        }
+    }
+
+    free_blocks[offset] = size;
+}
+
+GeometryArena::GeometryArena()
+    : layout(GEOMETRY_LAYOUT_FLOAT)
+    , vertex_array_object_id(0)
+    , instanced_vertex_array_object_id(0)
+    , vertex_buffer_id(0)
+    , index_buffer_id(0)
+{
+}
+
+size_t GeometryArena::getVertexSize() const
+{
+    return layout == GEOMETRY_LAYOUT_COMPACT ? sizeof(CompactVertex) : sizeof(FloatVertex);
+}
+
+void GeometryArena::init(GeometryLayout new_layout, size_t vertex_capacity, size_t index_capacity_bytes)
+{
+    layout = new_layout;
+    vertices.reset(vertex_capacity);
+    index_bytes.reset(index_capacity_bytes & ~(size_t)3);
+
+    glGenVertexArrays(1, &vertex_array_object_id);
+    glGenVertexArrays(1, &instanced_vertex_array_object_id);
+
+    glGenBuffers(1, &vertex_buffer_id);
+    glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer_id);
+    glBufferData(GL_ARRAY_BUFFER, vertices.getCapacity() * getVertexSize(), NULL, GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    glGenBuffers(1, &index_buffer_id);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, index_buffer_id);
+    glBufferData(GL_COPY_WRITE_BUFFER, index_bytes.getCapacity(), NULL, GL_STATIC_DRAW);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    setupVertexArrays();
+}
+
+void GeometryArena::setupVertexArrays()
+{
+    GLuint vertex_array_ids[2] = { vertex_array_object_id, instanced_vertex_array_object_id };
+    for (int i = 0; i < 2; ++i)
+    {
+        glBindVertexArray(vertex_array_ids[i]);
+        glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer_id);
+
+        // As localizações correspondem a "(location = N)" em "shader_vertex.glsl"
+        GLsizei stride = (GLsizei)getVertexSize();
+        if ( layout == GEOMETRY_LAYOUT_COMPACT )
+        {
+            glVertexAttribPointer(0, 4, GL_UNSIGNED_SHORT, GL_TRUE, stride, (void*)offsetof(CompactVertex, position));
+            glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, stride, (void*)offsetof(CompactVertex, normal));
+            glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, stride, (void*)offsetof(CompactVertex, texcoord));
+        }
+        else
+        {
+            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(FloatVertex, position));
+            glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(FloatVertex, normal));
+            glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(FloatVertex, texcoord));
+        }
+        glEnableVertexAttribArray(0);
+        glEnableVertexAttribArray(1);
+        glEnableVertexAttribArray(2);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        // O buffer de índices faz parte do estado do VAO
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer_id);
+    }
+
+    glBindVertexArray(0);
+}
+
+void GeometryArena::growBuffer(GLuint* buffer_id, size_t old_bytes, size_t new_bytes)
+{
+    GLuint new_buffer_id;
+    glGenBuffers(1, &new_buffer_id);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, new_buffer_id);
+    glBufferData(GL_COPY_WRITE_BUFFER, new_bytes, NULL, GL_STATIC_DRAW);
+
+    // Cópia feita na própria GPU, sem passar pela memória principal
+    glBindBuffer(GL_COPY_READ_BUFFER, *buffer_id);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, old_bytes);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    glDeleteBuffers(1, buffer_id);
+    *buffer_id = new_buffer_id;
+}
+
+GeometryAllocation GeometryArena::add(const void* vertex_data, size_t num_vertices, const void* index_data, size_t num_index_bytes)
+{
+    GeometryAllocation allocation;
+    allocation.num_vertices = num_vertices;
+    allocation.index_bytes  = (num_index_bytes + 3) & ~(size_t)3;
+
+    bool grown = false;
+    while ( !vertices.allocate(allocation.num_vertices, &allocation.first_vertex) )
+    {
+        size_t old_capacity = vertices.getCapacity();
+        size_t new_capacity = std::max(2*old_capacity, old_capacity + allocation.num_vertices);
+        growBuffer(&vertex_buffer_id, old_capacity * getVertexSize(), new_capacity * getVertexSize());
+        vertices.grow(new_capacity);
+        grown = true;
+    }
+    while ( !index_bytes.allocate(allocation.index_bytes, &allocation.index_offset) )
+    {
+        size_t old_capacity = index_bytes.getCapacity();
+        size_t new_capacity = std::max(2*old_capacity, old_capacity + allocation.index_bytes);
+        growBuffer(&index_buffer_id, old_capacity, new_capacity);
+        index_bytes.grow(new_capacity);
+        grown = true;
+    }
+
+    // O VAO guarda os IDs dos buffers, então precisa ser atualizado se eles
+    // foram recriados
+    if ( grown )
+        setupVertexArrays();
+
+    glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer_id);
+    glBufferSubData(GL_ARRAY_BUFFER, allocation.first_vertex * getVertexSize(), num_vertices * getVertexSize(), vertex_data);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    glBindBuffer(GL_COPY_WRITE_BUFFER, index_buffer_id);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, allocation.index_offset, num_index_bytes, index_data);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    return allocation;
+}
+
+void GeometryArena::remove(const GeometryAllocation& allocation)
+{
+    vertices.release(allocation.first_vertex, allocation.num_vertices);
+    index_bytes.release(allocation.index_offset, allocation.index_bytes);
+}
+
+void GeometryArena::printStats(const char* name) const
+{
+    printf("Arena de geometria '%s': %lu/%lu vértices (%lu blocos livres, maior com %lu), %.1f/%.1f KB de índices (%lu blocos livres)\n",
+           name,
+           (unsigned long)vertices.getUsed(), (unsigned long)vertices.getCapacity(),
+           (unsigned long)vertices.getNumFreeBlocks(), (unsigned long)vertices.getLargestFreeBlock(),
+           index_bytes.getUsed() / 1024.0, index_bytes.getCapacity() / 1024.0,
+           (unsigned long)index_bytes.getNumFreeBlocks());
+}
+
+void GeometryArena_BenchmarkAllocator(int cycles)
+{
+    // Simulamos uma cena com 32 malhas de tamanhos variados, descarregando e
+    // recarregando malhas aleatórias (com um novo tamanho, como acontece ao
+    // editar um modelo) a cada ciclo.
+    const size_t num_meshes = 32;
+    const size_t capacity = 1 << 22;
+
+    RangeAllocator allocator;
+    allocator.reset(capacity);
+
+    srand(1234);
+    std::vector<size_t> offsets(num_meshes);
+    std::vector<size_t> sizes(num_meshes);
+    for (size_t m = 0; m < num_meshes; ++m)
+    {
+        sizes[m] = 1000 + rand() % 60000;
+        allocator.allocate(sizes[m], &offsets[m]);
+    }
+
+    size_t failures = 0;
+    size_t max_free_blocks = 0;
+    for (int c = 0; c < cycles; ++c)
+    {
+        // Descarregamos algumas malhas...
+        std::vector<size_t> unloaded;
+        for (size_t m = 0; m < num_meshes; ++m)
+        {
+            if ( rand() % 4 == 0 )
+            {
+                allocator.release(offsets[m], sizes[m]);
+                unloaded.push_back(m);
+            }
+        }
+        max_free_blocks = std::max(max_free_blocks, allocator.getNumFreeBlocks());
+
+        // ... e as recarregamos com tamanhos ligeiramente diferentes
+        for (size_t i = 0; i < unloaded.size(); ++i)
+        {
+            size_t m = unloaded[i];
+            sizes[m] = std::max((size_t)1000, sizes[m] + rand() % 2001 - 1000);
+            if ( !allocator.allocate(sizes[m], &offsets[m]) )
+            {
+                failures++;
+                sizes[m] = 0;
+            }
+        }
+    }
+
+    printf("Benchmark da arena de geometria: %d ciclos de descarga/recarga de %lu malhas\n", cycles, (unsigned long)num_meshes);
+    printf("  ocupação final: %lu de %lu unidades, %lu blocos livres (máximo %lu), maior bloco livre: %lu\n",
+           (unsigned long)allocator.getUsed(), (unsigned long)capacity,
+           (unsigned long)allocator.getNumFreeBlocks(), (unsigned long)max_free_blocks,
+           (unsigned long)allocator.getLargestFreeBlock());
+    printf("  alocações que falharam por fragmentação: %lu\n", (unsigned long)failures);
+
+    for (size_t m = 0; m < num_meshes; ++m)
+        allocator.release(offsets[m], sizes[m]);
+    printf("  após descarregar tudo: %lu bloco(s) livre(s) com %lu unidades\n",
+           (unsigned long)allocator.getNumFreeBlocks(), (unsigned long)allocator.getLargestFreeBlock());
+}
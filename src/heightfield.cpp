@@ -0,0 +1,579 @@
+// Chão da pista como mapa de alturas. Veja comentários em "heightfield.h".
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+
+#include <glm/common.hpp>
+
+#include "heightfield.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define HEIGHTFIELD_HAS_SSE 1
+#include <emmintrin.h>
+#endif
+
+// AVX2 é compilado somente nesta função (atributo "target"), e usado se o
+// processador o suportar
+#if defined(HEIGHTFIELD_HAS_SSE) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HEIGHTFIELD_HAS_AVX2 1
+#include <immintrin.h>
+#endif
+
+namespace
+{
+
+const size_t TILE_SIZE      = 4;   // Amostras por lado de um tile
+const size_t REGION_SIZE    = 64;  // Amostras por lado de uma região (16x16 tiles)
+const size_t REGION_SAMPLES = REGION_SIZE * REGION_SIZE;
+
+// Intercala os 4 bits de "x" com zeros: abcd -> 0a0b0c0d
+uint32_t SpreadBits4(uint32_t x)
+{
+    x = (x | (x << 2)) & 0x33;
+    x = (x | (x << 1)) & 0x55;
+    return x;
+}
+
+// Parâmetros da grade usados pelas consultas
+struct Grid
+{
+    const float* data;
+    float        origin_x, origin_z;
+    float        inv_cell_size;
+    float        max_x, max_z;      // Última amostra (width - 1, depth - 1)
+    float        max_i, max_j;      // Última célula (width - 2, depth - 2)
+    uint32_t     region_row;        // Amostras de uma linha de regiões
+};
+
+uint32_t OffsetX(uint32_t i)
+{
+    return (i >> 6) * (uint32_t)REGION_SAMPLES + (SpreadBits4((i >> 2) & 15) << 4) + (i & 3);
+}
+
+uint32_t OffsetZ(uint32_t j, uint32_t region_row)
+{
+    return (j >> 6) * region_row + (SpreadBits4((j >> 2) & 15) << 5) + ((j & 3) << 2);
+}
+
+// Interpolação bilinear das quatro amostras de uma célula e normal pelo
+// gradiente da interpolação. Todas as implementações fazem estas operações
+// nesta ordem.
+inline void Bilinear(float h00, float h10, float h01, float h11, float tx, float tz, float inv_cell_size,
+                     float* height, float* nx, float* ny, float* nz)
+{
+    float dx0 = h10 - h00;
+    float dx1 = h11 - h01;
+    float dz0 = h01 - h00;
+    float dz1 = h11 - h10;
+    float hx0 = h00 + dx0 * tx;
+    float hx1 = h01 + dx1 * tx;
+    *height = hx0 + (hx1 - hx0) * tz;
+
+    float slope_x = (dx0 + (dx1 - dx0) * tz) * inv_cell_size;
+    float slope_z = (dz0 + (dz1 - dz0) * tx) * inv_cell_size;
+    float inv_length = 1.0f / std::sqrt(slope_x * slope_x + slope_z * slope_z + 1.0f);
+    *nx = -slope_x * inv_length;
+    *ny = inv_length;
+    *nz = -slope_z * inv_length;
+}
+
+// Posição em amostras, limitada à grade, e a célula que a contém. A célula
+// é limitada à penúltima amostra, para que as quatro amostras existam.
+inline void Locate(const Grid& grid, float x, float z, uint32_t* i, uint32_t* j, float* tx, float* tz)
+{
+    float fx = std::min(std::max((x - grid.origin_x) * grid.inv_cell_size, 0.0f), grid.max_x);
+    float fz = std::min(std::max((z - grid.origin_z) * grid.inv_cell_size, 0.0f), grid.max_z);
+    *i = (uint32_t)std::min(fx, grid.max_i);
+    *j = (uint32_t)std::min(fz, grid.max_j);
+    *tx = fx - (float)*i;
+    *tz = fz - (float)*j;
+}
+
+void SampleScalar(const Grid& grid, const float* x, const float* z, size_t begin, size_t end,
+                  float* height, float* normal_x, float* normal_y, float* normal_z)
+{
+    for (size_t k = begin; k < end; ++k)
+    {
+        uint32_t i, j;
+        float tx, tz;
+        Locate(grid, x[k], z[k], &i, &j, &tx, &tz);
+        uint32_t x0 = OffsetX(i), x1 = OffsetX(i + 1);
+        uint32_t z0 = OffsetZ(j, grid.region_row), z1 = OffsetZ(j + 1, grid.region_row);
+        float h, nx, ny, nz;
+        Bilinear(grid.data[x0 + z0], grid.data[x1 + z0], grid.data[x0 + z1], grid.data[x1 + z1],
+                 tx, tz, grid.inv_cell_size, &h, &nx, &ny, &nz);
+        if ( height )   height[k] = h;
+        if ( normal_x ) normal_x[k] = nx;
+        if ( normal_y ) normal_y[k] = ny;
+        if ( normal_z ) normal_z[k] = nz;
+    }
+}
+
+#ifdef HEIGHTFIELD_HAS_SSE
+// Produto de inteiros de 32 bits (SSE2 só tem _mm_mul_epu32, de 2 em 2)
+inline __m128i MulLo32(__m128i a, __m128i b)
+{
+    __m128i even = _mm_mul_epu32(a, b);
+    __m128i odd  = _mm_mul_epu32(_mm_srli_si128(a, 4), _mm_srli_si128(b, 4));
+    return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+inline __m128i SpreadBits4SSE(__m128i x)
+{
+    x = _mm_and_si128(_mm_or_si128(x, _mm_slli_epi32(x, 2)), _mm_set1_epi32(0x33));
+    x = _mm_and_si128(_mm_or_si128(x, _mm_slli_epi32(x, 1)), _mm_set1_epi32(0x55));
+    return x;
+}
+
+inline __m128i OffsetXSSE(__m128i i)
+{
+    __m128i region = _mm_slli_epi32(_mm_srli_epi32(i, 6), 12);
+    __m128i tile   = _mm_slli_epi32(SpreadBits4SSE(_mm_and_si128(_mm_srli_epi32(i, 2), _mm_set1_epi32(15))), 4);
+    return _mm_add_epi32(_mm_add_epi32(region, tile), _mm_and_si128(i, _mm_set1_epi32(3)));
+}
+
+inline __m128i OffsetZSSE(__m128i j, __m128i region_row)
+{
+    __m128i region = MulLo32(_mm_srli_epi32(j, 6), region_row);
+    __m128i tile   = _mm_slli_epi32(SpreadBits4SSE(_mm_and_si128(_mm_srli_epi32(j, 2), _mm_set1_epi32(15))), 5);
+    return _mm_add_epi32(_mm_add_epi32(region, tile), _mm_slli_epi32(_mm_and_si128(j, _mm_set1_epi32(3)), 2));
+}
+
+// Interpolação de Bilinear() em 4 posições
+inline void BilinearSSE(__m128 h00, __m128 h10, __m128 h01, __m128 h11, __m128 tx, __m128 tz, __m128 inv_cell_size,
+                        __m128* height, __m128* nx, __m128* ny, __m128* nz)
+{
+    __m128 dx0 = _mm_sub_ps(h10, h00);
+    __m128 dx1 = _mm_sub_ps(h11, h01);
+    __m128 dz0 = _mm_sub_ps(h01, h00);
+    __m128 dz1 = _mm_sub_ps(h11, h10);
+    __m128 hx0 = _mm_add_ps(h00, _mm_mul_ps(dx0, tx));
+    __m128 hx1 = _mm_add_ps(h01, _mm_mul_ps(dx1, tx));
+    *height = _mm_add_ps(hx0, _mm_mul_ps(_mm_sub_ps(hx1, hx0), tz));
+
+    __m128 slope_x = _mm_mul_ps(_mm_add_ps(dx0, _mm_mul_ps(_mm_sub_ps(dx1, dx0), tz)), inv_cell_size);
+    __m128 slope_z = _mm_mul_ps(_mm_add_ps(dz0, _mm_mul_ps(_mm_sub_ps(dz1, dz0), tx)), inv_cell_size);
+    __m128 length2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(slope_x, slope_x), _mm_mul_ps(slope_z, slope_z)), _mm_set1_ps(1.0f));
+    __m128 inv_length = _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(length2));
+    __m128 minus = _mm_set1_ps(-0.0f);
+    *nx = _mm_mul_ps(_mm_xor_ps(slope_x, minus), inv_length);
+    *ny = inv_length;
+    *nz = _mm_mul_ps(_mm_xor_ps(slope_z, minus), inv_length);
+}
+
+inline void StoreOutputs(size_t k, __m128 h, __m128 nx, __m128 ny, __m128 nz,
+                         float* height, float* normal_x, float* normal_y, float* normal_z)
+{
+    if ( height )   _mm_storeu_ps(height + k, h);
+    if ( normal_x ) _mm_storeu_ps(normal_x + k, nx);
+    if ( normal_y ) _mm_storeu_ps(normal_y + k, ny);
+    if ( normal_z ) _mm_storeu_ps(normal_z + k, nz);
+}
+
+// Os endereços são calculados com SSE; as 16 leituras são escalares, pois
+// SSE não tem "gather"
+size_t SampleSSE(const Grid& grid, const float* x, const float* z, size_t begin, size_t end,
+                 float* height, float* normal_x, float* normal_y, float* normal_z)
+{
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 origin_x = _mm_set1_ps(grid.origin_x), origin_z = _mm_set1_ps(grid.origin_z);
+    const __m128 inv_cell_size = _mm_set1_ps(grid.inv_cell_size);
+    const __m128 max_x = _mm_set1_ps(grid.max_x), max_z = _mm_set1_ps(grid.max_z);
+    const __m128 max_i = _mm_set1_ps(grid.max_i), max_j = _mm_set1_ps(grid.max_j);
+    const __m128i one = _mm_set1_epi32(1);
+    const __m128i region_row = _mm_set1_epi32((int)grid.region_row);
+
+    size_t k = begin;
+    for (; k + 4 <= end; k += 4)
+    {
+        __m128 fx = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(x + k), origin_x), inv_cell_size), zero), max_x);
+        __m128 fz = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(z + k), origin_z), inv_cell_size), zero), max_z);
+        __m128i i = _mm_cvttps_epi32(_mm_min_ps(fx, max_i));
+        __m128i j = _mm_cvttps_epi32(_mm_min_ps(fz, max_j));
+        __m128 tx = _mm_sub_ps(fx, _mm_cvtepi32_ps(i));
+        __m128 tz = _mm_sub_ps(fz, _mm_cvtepi32_ps(j));
+
+        __m128i x0 = OffsetXSSE(i), x1 = OffsetXSSE(_mm_add_epi32(i, one));
+        __m128i z0 = OffsetZSSE(j, region_row), z1 = OffsetZSSE(_mm_add_epi32(j, one), region_row);
+        int32_t o00[4], o10[4], o01[4], o11[4];
+        _mm_storeu_si128((__m128i*)o00, _mm_add_epi32(x0, z0));
+        _mm_storeu_si128((__m128i*)o10, _mm_add_epi32(x1, z0));
+        _mm_storeu_si128((__m128i*)o01, _mm_add_epi32(x0, z1));
+        _mm_storeu_si128((__m128i*)o11, _mm_add_epi32(x1, z1));
+        const float* d = grid.data;
+        __m128 h00 = _mm_setr_ps(d[o00[0]], d[o00[1]], d[o00[2]], d[o00[3]]);
+        __m128 h10 = _mm_setr_ps(d[o10[0]], d[o10[1]], d[o10[2]], d[o10[3]]);
+        __m128 h01 = _mm_setr_ps(d[o01[0]], d[o01[1]], d[o01[2]], d[o01[3]]);
+        __m128 h11 = _mm_setr_ps(d[o11[0]], d[o11[1]], d[o11[2]], d[o11[3]]);
+
+        __m128 h, nx, ny, nz;
+        BilinearSSE(h00, h10, h01, h11, tx, tz, inv_cell_size, &h, &nx, &ny, &nz);
+        StoreOutputs(k, h, nx, ny, nz, height, normal_x, normal_y, normal_z);
+    }
+    return k;
+}
+#endif // HEIGHTFIELD_HAS_SSE
+
+#ifdef HEIGHTFIELD_HAS_AVX2
+__attribute__((target("avx2")))
+inline __m256i SpreadBits4AVX2(__m256i x)
+{
+    x = _mm256_and_si256(_mm256_or_si256(x, _mm256_slli_epi32(x, 2)), _mm256_set1_epi32(0x33));
+    x = _mm256_and_si256(_mm256_or_si256(x, _mm256_slli_epi32(x, 1)), _mm256_set1_epi32(0x55));
+    return x;
+}
+
+__attribute__((target("avx2")))
+inline __m256i OffsetXAVX2(__m256i i)
+{
+    __m256i region = _mm256_slli_epi32(_mm256_srli_epi32(i, 6), 12);
+    __m256i tile   = _mm256_slli_epi32(SpreadBits4AVX2(_mm256_and_si256(_mm256_srli_epi32(i, 2), _mm256_set1_epi32(15))), 4);
+    return _mm256_add_epi32(_mm256_add_epi32(region, tile), _mm256_and_si256(i, _mm256_set1_epi32(3)));
+}
+
+__attribute__((target("avx2")))
+inline __m256i OffsetZAVX2(__m256i j, __m256i region_row)
+{
+    __m256i region = _mm256_mullo_epi32(_mm256_srli_epi32(j, 6), region_row);
+    __m256i tile   = _mm256_slli_epi32(SpreadBits4AVX2(_mm256_and_si256(_mm256_srli_epi32(j, 2), _mm256_set1_epi32(15))), 5);
+    return _mm256_add_epi32(_mm256_add_epi32(region, tile), _mm256_slli_epi32(_mm256_and_si256(j, _mm256_set1_epi32(3)), 2));
+}
+
+// Como SampleSSE(), com 8 posições e as leituras feitas por "gather"
+__attribute__((target("avx2")))
+size_t SampleAVX2(const Grid& grid, const float* x, const float* z, size_t begin, size_t end,
+                  float* height, float* normal_x, float* normal_y, float* normal_z)
+{
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one_f = _mm256_set1_ps(1.0f);
+    const __m256 minus = _mm256_set1_ps(-0.0f);
+    const __m256 origin_x = _mm256_set1_ps(grid.origin_x), origin_z = _mm256_set1_ps(grid.origin_z);
+    const __m256 inv_cell_size = _mm256_set1_ps(grid.inv_cell_size);
+    const __m256 max_x = _mm256_set1_ps(grid.max_x), max_z = _mm256_set1_ps(grid.max_z);
+    const __m256 max_i = _mm256_set1_ps(grid.max_i), max_j = _mm256_set1_ps(grid.max_j);
+    const __m256i one = _mm256_set1_epi32(1);
+    const __m256i region_row = _mm256_set1_epi32((int)grid.region_row);
+
+    size_t k = begin;
+    for (; k + 8 <= end; k += 8)
+    {
+        __m256 fx = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(x + k), origin_x), inv_cell_size), zero), max_x);
+        __m256 fz = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(z + k), origin_z), inv_cell_size), zero), max_z);
+        __m256i i = _mm256_cvttps_epi32(_mm256_min_ps(fx, max_i));
+        __m256i j = _mm256_cvttps_epi32(_mm256_min_ps(fz, max_j));
+        __m256 tx = _mm256_sub_ps(fx, _mm256_cvtepi32_ps(i));
+        __m256 tz = _mm256_sub_ps(fz, _mm256_cvtepi32_ps(j));
+
+        __m256i x0 = OffsetXAVX2(i), x1 = OffsetXAVX2(_mm256_add_epi32(i, one));
+        __m256i z0 = OffsetZAVX2(j, region_row), z1 = OffsetZAVX2(_mm256_add_epi32(j, one), region_row);
+        __m256 h00 = _mm256_i32gather_ps(grid.data, _mm256_add_epi32(x0, z0), 4);
+        __m256 h10 = _mm256_i32gather_ps(grid.data, _mm256_add_epi32(x1, z0), 4);
+        __m256 h01 = _mm256_i32gather_ps(grid.data, _mm256_add_epi32(x0, z1), 4);
+        __m256 h11 = _mm256_i32gather_ps(grid.data, _mm256_add_epi32(x1, z1), 4);
+
+        __m256 dx0 = _mm256_sub_ps(h10, h00);
+        __m256 dx1 = _mm256_sub_ps(h11, h01);
+        __m256 dz0 = _mm256_sub_ps(h01, h00);
+        __m256 dz1 = _mm256_sub_ps(h11, h10);
+        __m256 hx0 = _mm256_add_ps(h00, _mm256_mul_ps(dx0, tx));
+        __m256 hx1 = _mm256_add_ps(h01, _mm256_mul_ps(dx1, tx));
+        __m256 h = _mm256_add_ps(hx0, _mm256_mul_ps(_mm256_sub_ps(hx1, hx0), tz));
+
+        __m256 slope_x = _mm256_mul_ps(_mm256_add_ps(dx0, _mm256_mul_ps(_mm256_sub_ps(dx1, dx0), tz)), inv_cell_size);
+        __m256 slope_z = _mm256_mul_ps(_mm256_add_ps(dz0, _mm256_mul_ps(_mm256_sub_ps(dz1, dz0), tx)), inv_cell_size);
+        __m256 length2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(slope_x, slope_x), _mm256_mul_ps(slope_z, slope_z)), one_f);
+        __m256 inv_length = _mm256_div_ps(one_f, _mm256_sqrt_ps(length2));
+
+        if ( height )   _mm256_storeu_ps(height + k, h);
+        if ( normal_x ) _mm256_storeu_ps(normal_x + k, _mm256_mul_ps(_mm256_xor_ps(slope_x, minus), inv_length));
+        if ( normal_y ) _mm256_storeu_ps(normal_y + k, inv_length);
+        if ( normal_z ) _mm256_storeu_ps(normal_z + k, _mm256_mul_ps(_mm256_xor_ps(slope_z, minus), inv_length));
+    }
+    return k;
+}
+#endif // HEIGHTFIELD_HAS_AVX2
+
+} // namespace
+
+Heightfield::Heightfield()
+    : backend(Heightfield_BestBackend())
+    , width(0)
+    , depth(0)
+    , regions_x(0)
+    , origin_x(0.0f)
+    , origin_z(0.0f)
+    , cell_size(1.0f)
+    , inv_cell_size(1.0f)
+    , aligned(0)
+{
+}
+
+void Heightfield::clear()
+{
+    width = depth = regions_x = 0;
+    storage.clear();
+    aligned = 0;
+}
+
+uint32_t Heightfield::offsetX(size_t i) const
+{
+    return OffsetX((uint32_t)i);
+}
+
+uint32_t Heightfield::offsetZ(size_t j) const
+{
+    return OffsetZ((uint32_t)j, (uint32_t)(regions_x * REGION_SAMPLES));
+}
+
+void Heightfield::setHeights(size_t new_width, size_t new_depth, float new_origin_x, float new_origin_z,
+                             float new_cell_size, const float* heights)
+{
+    clear();
+    if ( new_width < 2 || new_depth < 2 || !(new_cell_size > 0.0f) )
+        return;
+
+    width = new_width;
+    depth = new_depth;
+    origin_x = new_origin_x;
+    origin_z = new_origin_z;
+    cell_size = new_cell_size;
+    inv_cell_size = 1.0f / new_cell_size;
+
+    // A grade é completada até um número inteiro de regiões; as amostras
+    // extras nunca são lidas. Mais 15 floats para alinhar o início.
+    regions_x = (width + REGION_SIZE - 1) / REGION_SIZE;
+    size_t regions_z = (depth + REGION_SIZE - 1) / REGION_SIZE;
+    storage.assign(regions_x * regions_z * REGION_SAMPLES + 15, 0.0f);
+    aligned = (size_t)((64 - ((uintptr_t)storage.data() & 63)) & 63) / sizeof(float);
+
+    float* tiles = &storage[aligned];
+    for (size_t j = 0; j < depth; ++j)
+    {
+        uint32_t z_offset = offsetZ(j);
+        for (size_t i = 0; i < width; ++i)
+            tiles[offsetX(i) + z_offset] = heights[j*width + i];
+    }
+}
+
+void Heightfield::bake(const std::vector<BVHTriangle>& triangles, float new_cell_size)
+{
+    clear();
+    if ( triangles.empty() || !(new_cell_size > 0.0f) )
+        return;
+
+    const float maxval = std::numeric_limits<float>::max();
+    glm::vec3 bbox_min(maxval, maxval, maxval), bbox_max(-maxval, -maxval, -maxval);
+    for (size_t t = 0; t < triangles.size(); ++t)
+    {
+        bbox_min = glm::min(bbox_min, glm::min(triangles[t].v0, glm::min(triangles[t].v1, triangles[t].v2)));
+        bbox_max = glm::max(bbox_max, glm::max(triangles[t].v0, glm::max(triangles[t].v1, triangles[t].v2)));
+    }
+
+    size_t grid_width = std::max((size_t)2, (size_t)std::ceil((bbox_max.x - bbox_min.x) / new_cell_size) + 1);
+    size_t grid_depth = std::max((size_t)2, (size_t)std::ceil((bbox_max.z - bbox_min.z) / new_cell_size) + 1);
+    const float empty = -std::numeric_limits<float>::infinity();
+    std::vector<float> heights(grid_width * grid_depth, empty);
+
+    // Cada triângulo preenche as amostras dentro da sua projeção no plano
+    // XZ, com a altura do plano do triângulo em cada uma
+    for (size_t t = 0; t < triangles.size(); ++t)
+    {
+        const BVHTriangle& tri = triangles[t];
+        float ax = tri.v0.x, az = tri.v0.z;
+        float e1x = tri.v1.x - ax, e1z = tri.v1.z - az;
+        float e2x = tri.v2.x - ax, e2z = tri.v2.z - az;
+        float area = e1x * e2z - e1z * e2x;
+        if ( std::fabs(area) <= 1e-12f * (std::fabs(e1x * e2z) + std::fabs(e1z * e2x) + 1e-30f) )
+            continue;
+        float inv_area = 1.0f / area;
+
+        float min_x = std::min(tri.v0.x, std::min(tri.v1.x, tri.v2.x));
+        float max_x = std::max(tri.v0.x, std::max(tri.v1.x, tri.v2.x));
+        float min_z = std::min(tri.v0.z, std::min(tri.v1.z, tri.v2.z));
+        float max_z = std::max(tri.v0.z, std::max(tri.v1.z, tri.v2.z));
+        size_t i0 = (size_t)std::max(0.0f, std::ceil((min_x - bbox_min.x) / new_cell_size));
+        size_t i1 = std::min(grid_width - 1, (size_t)std::floor((max_x - bbox_min.x) / new_cell_size));
+        size_t j0 = (size_t)std::max(0.0f, std::ceil((min_z - bbox_min.z) / new_cell_size));
+        size_t j1 = std::min(grid_depth - 1, (size_t)std::floor((max_z - bbox_min.z) / new_cell_size));
+
+        // Tolerância para que amostras sobre as arestas compartilhadas não
+        // fiquem sem nenhum triângulo
+        const float tolerance = -1e-5f;
+        for (size_t j = j0; j <= j1 && j < grid_depth; ++j)
+        {
+            float pz = bbox_min.z + j * new_cell_size - az;
+            for (size_t i = i0; i <= i1 && i < grid_width; ++i)
+            {
+                float px = bbox_min.x + i * new_cell_size - ax;
+                float b1 = (px * e2z - pz * e2x) * inv_area;
+                float b2 = (e1x * pz - e1z * px) * inv_area;
+                if ( b1 < tolerance || b2 < tolerance || b1 + b2 > 1.0f - tolerance )
+                    continue;
+                float y = tri.v0.y + b1 * (tri.v1.y - tri.v0.y) + b2 * (tri.v2.y - tri.v0.y);
+                float& sample = heights[j*grid_width + i];
+                sample = std::max(sample, y);
+            }
+        }
+    }
+
+    for (size_t k = 0; k < heights.size(); ++k)
+        if ( heights[k] == empty )
+            heights[k] = bbox_min.y;
+
+    setHeights(grid_width, grid_depth, bbox_min.x, bbox_min.z, new_cell_size, heights.data());
+}
+
+void Heightfield::sample(float x, float z, float* height, glm::vec3* normal) const
+{
+    if ( isEmpty() )
+    {
+        *height = 0.0f;
+        *normal = glm::vec3(0.0f, 1.0f, 0.0f);
+        return;
+    }
+    sampleBatch(HEIGHTFIELD_SCALAR, &x, &z, 1, height, &normal->x, &normal->y, &normal->z);
+}
+
+void Heightfield::sampleBatch(HeightfieldBackend batch_backend, const float* x, const float* z, size_t count,
+                              float* height, float* normal_x, float* normal_y, float* normal_z) const
+{
+    if ( isEmpty() )
+        return;
+
+    Grid grid;
+    grid.data = data();
+    grid.origin_x = origin_x;
+    grid.origin_z = origin_z;
+    grid.inv_cell_size = inv_cell_size;
+    grid.max_x = (float)(width - 1);
+    grid.max_z = (float)(depth - 1);
+    grid.max_i = (float)(width - 2);
+    grid.max_j = (float)(depth - 2);
+    grid.region_row = (uint32_t)(regions_x * REGION_SAMPLES);
+
+    // As implementações SIMD processam grupos completos; o resto é escalar
+    size_t done = 0;
+    switch ( batch_backend )
+    {
+#ifdef HEIGHTFIELD_HAS_AVX2
+    case HEIGHTFIELD_AVX2:
+        done = SampleAVX2(grid, x, z, 0, count, height, normal_x, normal_y, normal_z);
+        break;
+#endif
+#ifdef HEIGHTFIELD_HAS_SSE
+    case HEIGHTFIELD_SSE:
+        done = SampleSSE(grid, x, z, 0, count, height, normal_x, normal_y, normal_z);
+        break;
+#endif
+    default:
+        break;
+    }
+    SampleScalar(grid, x, z, done, count, height, normal_x, normal_y, normal_z);
+}
+
+HeightfieldBackend Heightfield_BestBackend()
+{
+#ifdef HEIGHTFIELD_HAS_AVX2
+    if ( __builtin_cpu_supports("avx2") )
+        return HEIGHTFIELD_AVX2;
+#endif
+#ifdef HEIGHTFIELD_HAS_SSE
+    return HEIGHTFIELD_SSE;
+#else
+    return HEIGHTFIELD_SCALAR;
+#endif
+}
+
+const char* Heightfield_BackendName(HeightfieldBackend backend)
+{
+    switch ( backend )
+    {
+    case HEIGHTFIELD_SSE:  return "sse";
+    case HEIGHTFIELD_AVX2: return "avx2";
+    default:               return "escalar";
+    }
+}
+
+void Heightfield_Benchmark(size_t size, int repetitions)
+{
+    typedef std::chrono::steady_clock clock;
+
+    // Terreno ondulado de "size" x "size" amostras a cada 0.25 unidades
+    const float cell_size = 0.25f;
+    std::vector<float> heights(size * size);
+    for (size_t j = 0; j < size; ++j)
+        for (size_t i = 0; i < size; ++i)
+            heights[j*size + i] = 3.0f * std::sin(0.05f * i) * std::cos(0.037f * j) + 0.2f * std::sin(0.9f * i + 0.4f * j);
+
+    Heightfield field;
+    clock::time_point start = clock::now();
+    field.setHeights(size, size, 0.0f, 0.0f, cell_size, heights.data());
+    double build_ms = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+
+    Grid row_major;
+    row_major.data = heights.data();
+    row_major.origin_x = row_major.origin_z = 0.0f;
+    row_major.inv_cell_size = 1.0f / cell_size;
+    row_major.max_x = row_major.max_z = (float)(size - 1);
+    row_major.max_i = row_major.max_j = (float)(size - 2);
+
+    printf("Benchmark de mapa de alturas: %lu x %lu amostras (%.1f MB), tiles montados em %.2f ms, %d repetições\n",
+           (unsigned long)size, (unsigned long)size, size * size * sizeof(float) / (1024.0 * 1024.0), build_ms, repetitions);
+    printf("%8s  %12s", "posições", "linhas (ns)");
+    HeightfieldBackend best = Heightfield_BestBackend();
+    for (int b = HEIGHTFIELD_SCALAR; b <= best; ++b)
+        printf("  %12s", Heightfield_BackendName((HeightfieldBackend)b));
+    printf("\n");
+
+    const size_t counts[3] = { 1000, 10000, 100000 };
+    srand(1234);
+    for (int c = 0; c < 3; ++c)
+    {
+        size_t count = counts[c];
+        std::vector<float> x(count), z(count);
+        for (size_t k = 0; k < count; ++k)
+        {
+            x[k] = (size - 1) * cell_size * (rand() / (float)RAND_MAX);
+            z[k] = (size - 1) * cell_size * (rand() / (float)RAND_MAX);
+        }
+
+        // Referência: as mesmas contas com as alturas em ordem de linhas
+        std::vector<float> ref_h(count), ref_nx(count), ref_ny(count), ref_nz(count);
+        double best_ns = 1e30;
+        for (int r = 0; r < repetitions; ++r)
+        {
+            start = clock::now();
+            for (size_t k = 0; k < count; ++k)
+            {
+                uint32_t i, j;
+                float tx, tz;
+                Locate(row_major, x[k], z[k], &i, &j, &tx, &tz);
+                const float* row0 = &heights[j*size];
+                const float* row1 = row0 + size;
+                Bilinear(row0[i], row0[i + 1], row1[i], row1[i + 1], tx, tz, row_major.inv_cell_size,
+                         &ref_h[k], &ref_nx[k], &ref_ny[k], &ref_nz[k]);
+            }
+            best_ns = std::min(best_ns, std::chrono::duration<double, std::nano>(clock::now() - start).count() / count);
+        }
+        printf("%8lu  %12.2f", (unsigned long)count, best_ns);
+
+        bool same = true;
+        std::vector<float> h(count), nx(count), ny(count), nz(count);
+        for (int b = HEIGHTFIELD_SCALAR; b <= best; ++b)
+        {
+            best_ns = 1e30;
+            for (int r = 0; r < repetitions; ++r)
+            {
+                start = clock::now();
+                field.sampleBatch((HeightfieldBackend)b, x.data(), z.data(), count, h.data(), nx.data(), ny.data(), nz.data());
+                best_ns = std::min(best_ns, std::chrono::duration<double, std::nano>(clock::now() - start).count() / count);
+            }
+            printf("  %12.2f", best_ns);
+            same = same && h == ref_h && nx == ref_nx && ny == ref_ny && nz == ref_nz;
+        }
+        printf("  %s\n", same ? "" : "ATENÇÃO: resultados diferentes");
+    }
+}
@@ -0,0 +1,164 @@
+// Sequências de comandos do carro. Veja comentários em "inputscript.h".
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#include "inputscript.h"
+
+namespace
+{
+
+const char INPUT_KEYS[] = "ABLRV";
+
+// Converte "AL" em INPUT_ACCELERATE | INPUT_LEFT. "-" é nenhuma tecla.
+bool ParseKeys(const std::string& keys, uint8_t* flags)
+{
+    *flags = 0;
+    if ( keys == "-" )
+        return true;
+    for (size_t i = 0; i < keys.size(); ++i)
+    {
+        const char* key = strchr(INPUT_KEYS, keys[i]);
+        if ( keys[i] == '\0' || key == NULL )
+            return false;
+        *flags |= (uint8_t)(1 << (key - INPUT_KEYS));
+    }
+    return true;
+}
+
+std::string FormatKeys(uint8_t flags)
+{
+    std::string keys;
+    for (size_t i = 0; INPUT_KEYS[i] != '\0'; ++i)
+        if ( flags & (1 << i) )
+            keys += INPUT_KEYS[i];
+    return keys.empty() ? "-" : keys;
+}
+
+} // namespace
+
+void InputScript::append(uint8_t flags, size_t count)
+{
+    steps.insert(steps.end(), count, flags);
+}
+
+bool InputScript::load(const std::string& filename, std::string* error)
+{
+    std::ifstream file(filename.c_str());
+    if ( !file )
+    {
+        *error = "não foi possível abrir \"" + filename + "\"";
+        return false;
+    }
+
+    name = filename;
+    hz = 0;
+    steps.clear();
+
+    std::string line;
+    int line_number = 0;
+    while ( std::getline(file, line) )
+    {
+        line_number++;
+        size_t comment = line.find('#');
+        if ( comment != std::string::npos )
+            line.erase(comment);
+
+        std::istringstream fields(line);
+        std::string first, keys;
+        if ( !(fields >> first) )
+            continue;
+
+        std::ostringstream where;
+        where << filename << ":" << line_number << ": ";
+
+        if ( first == "hz" )
+        {
+            if ( !(fields >> hz) || hz <= 0 )
+            {
+                *error = where.str() + "frequência inválida";
+                return false;
+            }
+            continue;
+        }
+
+        char* end = NULL;
+        long count = strtol(first.c_str(), &end, 10);
+        uint8_t flags = 0;
+        if ( *end != '\0' || count < 0 || !(fields >> keys) || !ParseKeys(keys, &flags) )
+        {
+            *error = where.str() + "esperado \"<passos> <teclas>\"";
+            return false;
+        }
+        append(flags, (size_t)count);
+    }
+    return true;
+}
+
+bool InputScript::save(const std::string& filename) const
+{
+    FILE* file = fopen(filename.c_str(), "w");
+    if ( file == NULL )
+        return false;
+
+    fprintf(file, "# Comandos do carro: <passos> <teclas> (A acelera, B freio, L esquerda, R direita, V ré)\n");
+    if ( hz > 0 )
+        fprintf(file, "hz %d\n", hz);
+
+    size_t begin = 0;
+    while ( begin < steps.size() )
+    {
+        size_t end = begin + 1;
+        while ( end < steps.size() && steps[end] == steps[begin] )
+            end++;
+        fprintf(file, "%lu %s\n", (unsigned long)(end - begin), FormatKeys(steps[begin]).c_str());
+        begin = end;
+    }
+
+    bool ok = ferror(file) == 0;
+    return fclose(file) == 0 && ok;
+}
+
+bool InputScript_BuiltIn(const std::string& name, InputScript* script)
+{
+    script->clear();
+    script->setName(name);
+    script->setHz(240);
+
+    if ( name == "straight" )
+    {
+        script->append(INPUT_ACCELERATE, 240 * 8);
+        script->append(INPUT_BRAKE, 240 * 4);
+    }
+    else if ( name == "slalom" )
+    {
+        script->append(INPUT_ACCELERATE, 240 * 2);
+        for (int i = 0; i < 8; ++i)
+            script->append(INPUT_ACCELERATE | (i % 2 == 0 ? INPUT_LEFT : INPUT_RIGHT), 240);
+        script->append(0, 240 * 2);
+    }
+    else if ( name == "circle" )
+    {
+        script->append(INPUT_ACCELERATE, 240 * 2);
+        script->append(INPUT_ACCELERATE | INPUT_LEFT, 240 * 10);
+    }
+    else if ( name == "handbrake" )
+    {
+        script->append(INPUT_ACCELERATE, 240 * 4);
+        script->append(INPUT_BRAKE | INPUT_RIGHT, 120);
+        script->append(INPUT_ACCELERATE | INPUT_RIGHT, 240 * 2);
+        script->append(INPUT_ACCELERATE, 240 * 2);
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+const char* InputScript_BuiltInNames()
+{
+    return "straight, slalom, circle, handbrake";
+}
@@ -0,0 +1,105 @@
+// Desenho instanciado. Veja comentários em "instancing.h".
+#include <cstring>
+
+#include <glm/gtc/matrix_inverse.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "instancing.h"
+
+InstanceBatcher::InstanceBatcher()
+    : buffer_id(0)
+    , buffer_capacity(0)
+    , num_instances(0)
+{
+}
+
+void InstanceBatcher::init()
+{
+    glGenBuffers(1, &buffer_id);
+}
+
+void InstanceBatcher::clear()
+{
+    // Os vetores de cada objeto mantêm sua memória entre os quadros
+    for (size_t i = 0; i < used_handles.size(); ++i)
+        instances[used_handles[i]].clear();
+    used_handles.clear();
+    num_instances = 0;
+}
+
+void InstanceBatcher::add(SceneHandle handle, const glm::mat4& model, int32_t object_id)
+{
+    if ( handle == SCENE_INVALID_HANDLE )
+        return;
+    if ( handle >= instances.size() )
+        instances.resize(handle + 1);
+
+    std::vector<InstanceData>& list = instances[handle];
+    if ( list.empty() )
+        used_handles.push_back(handle);
+
+    list.push_back(InstanceData());
+    memcpy(list.back().model, glm::value_ptr(model), sizeof(list.back().model));
+    list.back().object_id = object_id;
+
+    // As normais são transformadas pela inversa transposta, calculada
+    // uma única vez por instância em vez de em cada vértice
+    glm::mat3 normal_matrix = glm::inverseTranspose(glm::mat3(model));
+    memcpy(list.back().normal_matrix, glm::value_ptr(normal_matrix), sizeof(list.back().normal_matrix));
+    num_instances++;
+}
+
+void InstanceBatcher::upload()
+{
+    staging.clear();
+    batches.clear();
+    for (size_t i = 0; i < used_handles.size(); ++i)
+    {
+        const std::vector<InstanceData>& list = instances[used_handles[i]];
+
+        InstanceBatch batch;
+        batch.handle         = used_handles[i];
+        batch.first_instance = staging.size();
+        batch.num_instances  = list.size();
+        batches.push_back(batch);
+
+        staging.insert(staging.end(), list.begin(), list.end());
+    }
+
+    if ( staging.empty() )
+        return;
+
+    glBindBuffer(GL_ARRAY_BUFFER, buffer_id);
+    if ( staging.size() > buffer_capacity )
+        buffer_capacity = staging.size() * 2;
+    glBufferData(GL_ARRAY_BUFFER, buffer_capacity * sizeof(InstanceData), NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, staging.size() * sizeof(InstanceData), staging.data());
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void InstanceBatcher::bindAttributes(const InstanceBatch& batch) const
+{
+    glBindBuffer(GL_ARRAY_BUFFER, buffer_id);
+
+    GLsizei stride = sizeof(InstanceData);
+    size_t  base   = batch.first_instance * sizeof(InstanceData);
+    for (GLuint column = 0; column < 4; ++column)
+    {
+        GLuint location = INSTANCE_MODEL_LOCATION + column;
+        glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, stride, (void*)(base + column * 4 * sizeof(float)));
+        glVertexAttribDivisor(location, 1);
+        glEnableVertexAttribArray(location);
+    }
+    for (GLuint column = 0; column < 3; ++column)
+    {
+        GLuint location = INSTANCE_NORMAL_MATRIX_LOCATION + column;
+        glVertexAttribPointer(location, 3, GL_FLOAT, GL_FALSE, stride, (void*)(base + offsetof(InstanceData, normal_matrix) + column * 3 * sizeof(float)));
+        glVertexAttribDivisor(location, 1);
+        glEnableVertexAttribArray(location);
+    }
+    glVertexAttribIPointer(INSTANCE_OBJECT_ID_LOCATION, 1, GL_INT, stride, (void*)(base + offsetof(InstanceData, object_id)));
+    glVertexAttribDivisor(INSTANCE_OBJECT_ID_LOCATION, 1);
+    glEnableVertexAttribArray(INSTANCE_OBJECT_ID_LOCATION);
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
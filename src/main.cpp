@@ -18,6 +18,7 @@
 #include <cmath>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 
 // Headers abaixo são específicos de C++
 #include <set>
@@ -30,6 +31,7 @@
 #include <sstream>
 #include <stdexcept>
 #include <algorithm>
+#include <chrono>
 
 // Headers das bibliotecas OpenGL
 #include <glad/glad.h>   // Criação de contexto OpenGL 3.3
@@ -39,6 +41,7 @@
 #include <glm/mat4x4.hpp>
 #include <glm/vec4.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include <glm/gtc/matrix_inverse.hpp>
 
 // Headers da biblioteca para carregar modelos obj
 #include <tiny_obj_loader.h>
@@ -48,6 +51,27 @@
 // Headers locais, definidos na pasta "include/"
 #include "utils.h"
 #include "matrices.h"
+#include "mesh.h"
+#include "meshcache.h"
+#include "meshoptimizer.h"
+#include "vertexformat.h"
+#include "geometryarena.h"
+#include "sceneregistry.h"
+#include "instancing.h"
+#include "uniformbuffers.h"
+#include "culling.h"
+#include "fixedstep.h"
+#include "timebase.h"
+#include "carpool.h"
+#include "carcollision.h"
+#include "bvh.h"
+#include "detmath.h"
+#include "heightfield.h"
+#include "inputscript.h"
+#include "replay.h"
+#include "objparser.h"
+#include "threadpool.h"
+#include "tyremodel.h"
 #include "car.cpp"
 #include "keyboard.cpp"
 
@@ -66,7 +90,10 @@ struct ObjModel
 
     // Este construtor lê o modelo de um arquivo utilizando a biblioteca tinyobjloader.
     // Veja: https://github.com/syoyo/tinyobjloader
-    ObjModel(const char* filename, const char* basepath = NULL, bool triangulate = true)
+    // Com backend == OBJPARSER_PARALLEL o arquivo é lido pelo leitor paralelo
+    // de "objparser.h", que ignora materiais.
+    ObjModel(const char* filename, const char* basepath = NULL, bool triangulate = true,
+             ObjParserBackend backend = OBJPARSER_TINYOBJ)
     {
         printf("Carregando objetos do arquivo \"%s\"...\n", filename);
 
@@ -87,7 +114,11 @@ struct ObjModel
 
         std::string warn;
         std::string err;
-        bool ret = tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, filename, basepath, triangulate);
+        bool ret;
+        if ( backend == OBJPARSER_PARALLEL )
+            ret = ObjParser_LoadParallel(&attrib, &shapes, &warn, &err, filename, triangulate);
+        else
+            ret = tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, filename, basepath, triangulate);
 
         if (!err.empty())
             fprintf(stderr, "\n%s\n", err.c_str());
@@ -120,11 +151,41 @@ void PopMatrix(glm::mat4& M);
 
 // Declaração de várias funções utilizadas em main().  Essas estão definidas
 // logo após a definição de main() neste arquivo.
-void BuildTrianglesAndAddToVirtualScene(ObjModel*); // Constrói representação de um ObjModel como malha de triângulos para renderização
+void BuildTrianglesAndAddToVirtualScene(ObjModel*, std::vector<BVHTriangle>* track_triangles = NULL); // Constrói representação de um ObjModel como malha de triângulos para renderização
+void BuildTriangles(ObjModel* model, MeshData* mesh); // Constrói os buffers de uma malha de triângulos a partir de um ObjModel, sem enviá-los para a GPU
+void AddMeshToVirtualScene(const std::string& mesh_name, const MeshView& mesh); // Envia uma malha para a arena de geometria e adiciona seus objetos em g_VirtualScene
+void UnloadMeshFromVirtualScene(const std::string& mesh_name); // Remove uma malha (e seus objetos) da cena, liberando seu espaço na arena
+void ReloadObjModels(); // Recarrega todos os modelos lidos de arquivos ".obj"
+void LoadObjModelAndAddToVirtualScene(const char* filename, bool compute_normals = true, std::vector<BVHTriangle>* track_triangles = NULL); // Carrega um ".obj" utilizando o cache binário de malhas
 void ComputeNormals(ObjModel* model); // Computa normais de um ObjModel, caso não existam.
+void ComputeNormalsReference(ObjModel* model); // Implementação original (e mais lenta) de ComputeNormals()
+void BenchmarkComputeNormals(const char* filename, int repetitions); // Compara ComputeNormals() com ComputeNormalsReference()
 void LoadShadersFromFiles(); // Carrega os shaders de vértice e fragmento, criando um programa de GPU
-void LoadTextureImage(const char* filename); // Função que carrega imagens de textura
-void DrawVirtualObject(const char* object_name); // Desenha um objeto armazenado em g_VirtualScene
+// Imagem lida do disco e decodificada (possivelmente em uma thread de
+// trabalho), aguardando o envio para a GPU na thread principal
+struct DecodedImage
+{
+    std::string    filename;
+    bool           flip;   // Inverter as linhas (texturas 2D; cubemaps não)
+    int            width;
+    int            height;
+    unsigned char* pixels; // RGB, liberado após o envio; NULL se a leitura falhou
+};
+void DecodeImage(DecodedImage* image); // Lê e decodifica uma imagem (pode ser chamada de qualquer thread)
+void LoadTextureImage(DecodedImage* image); // Função que carrega imagens de textura
+void BenchmarkJobScaling(int repetitions); // Mede o tempo dos trabalhos paralelos com 1 a N threads
+void DrawVirtualObject(SceneHandle handle, const glm::mat4& model, int object_id); // Adiciona um objeto de g_VirtualScene na lista de desenho do quadro
+void DrawVirtualObjectInstanced(size_t batch); // Adiciona todas as cópias de um objeto em g_Instances na lista de desenho
+void FlushDrawList(const PerFrameUniforms& frame); // Envia as constantes do quadro para a GPU e executa a lista de desenho
+void ResolveCarParts(); // Preenche g_CarParts com os handles das partes do carro
+std::vector<glm::mat4> CreateCarGrid(size_t num_cars); // Matrizes de modelagem de uma grade de karts parados
+void DrawCars(const std::vector<glm::mat4>& car_models, bool instanced); // Desenha as partes de vários carros
+void BenchmarkCarRendering(size_t max_cars); // Mede o tempo de CPU para submeter o desenho de N carros
+void ValidateCarPool(size_t num_cars, int steps); // Compara a física de CarPool com a da classe Car
+CarCollisionShape LoadCarCollisionShape(const char* filename); // Caixa de colisão dos karts a partir do modelo do carro
+bool LoadHeightfieldImage(const char* filename, const BVH& track, Heightfield* field); // Mapa de alturas de uma imagem em tons de cinza
+void BenchmarkGroundFollowing(size_t num_cars, int steps); // Mede o passo de CarPool com e sem followGround()
+void BenchmarkCarTyres(size_t num_cars, int steps); // Mede o passo de Car com as regras de derrapagem e com o modelo de pneus
 GLuint LoadShader_Vertex(const char* filename);   // Carrega um vertex shader
 GLuint LoadShader_Fragment(const char* filename); // Carrega um fragment shader
 void LoadShader(const char* filename, GLuint shader_id); // Função utilizada pelas duas acima
@@ -135,6 +196,11 @@ void PrintObjModelInfo(ObjModel*); // Função para debugging
 // OpenGL. Estas funções estão definidas no arquivo "textrendering.cpp".
 void TextRendering_Init();
 float TextRendering_LineHeight(GLFWwindow* window);
+void TextRendering_Flush();
+void TextRendering_SetFramebufferSize(int width, int height);
+int TextRendering_CreateHudText();
+void TextRendering_PrintHudString(GLFWwindow* window, int id, const std::string &str, float x, float y, float scale = 1.0f);
+void TextRendering_Benchmark(GLFWwindow* window, size_t num_glyphs);
 float TextRendering_CharWidth(GLFWwindow* window);
 void TextRendering_PrintString(GLFWwindow* window, const std::string &str, float x, float y, float scale = 1.0f);
 void TextRendering_PrintMatrix(GLFWwindow* window, glm::mat4 M, float x, float y, float scale = 1.0f);
@@ -150,6 +216,7 @@ void TextRendering_ShowVelocity(GLFWwindow* window, const glm::vec4 &vel, bool i
 void TextRendering_ShowRotation(GLFWwindow* window, const glm::vec3 &rotation);
 void TextRendering_ShowProjection(GLFWwindow* window);
 void TextRendering_ShowFramesPerSecond(GLFWwindow* window);
+void TextRendering_ShowCullingStats(GLFWwindow* window);
 
 // Funções callback para comunicação com o sistema operacional e interação do
 // usuário. Veja mais comentários nas definições das mesmas, abaixo.
@@ -159,39 +226,46 @@ void KeyCallback(GLFWwindow* window, int key, int scancode, int action, int mode
 void MouseButtonCallback(GLFWwindow* window, int button, int action, int mods);
 void CursorPosCallback(GLFWwindow* window, double xpos, double ypos);
 void ScrollCallback(GLFWwindow* window, double xoffset, double yoffset);
-GLuint LoadCubemap(std::vector<std::string> faces);
+GLuint LoadCubemap(DecodedImage* faces);
 ObjModel CreatePlaneObjModel(const std::string& object_name, float width, float length);
-
-// Funcoes para calculo do tempo de execução
-float getTimeSinceLastFrame();
-void setEndFrameTime();
+ObjModel CreateSmoothingGroupsObjModel(size_t resolution, size_t patch_size);
 
 // Funcao de atualizacao de estado por dados do teclado
-void updateFromKeyboard();
-
-// Definimos uma estrutura que armazenará dados necessários para renderizar
-// cada objeto da cena virtual.
-struct SceneObject
-{
-    std::string  name;        // Nome do objeto
-    size_t       first_index; // Índice do primeiro vértice dentro do vetor indices[] definido em BuildTrianglesAndAddToVirtualScene()
-    size_t       num_indices; // Número de índices do objeto dentro do vetor indices[] definido em BuildTrianglesAndAddToVirtualScene()
-    GLenum       rendering_mode; // Modo de rasterização (GL_TRIANGLES, GL_TRIANGLE_STRIP, etc.)
-    GLuint       vertex_array_object_id; // ID do VAO onde estão armazenados os atributos do modelo
-    glm::vec3    bbox_min; // Axis-Aligned Bounding Box do objeto
-    glm::vec3    bbox_max;
-};
+void updateFromKeyboard(float elapsed_time);
 
 // Constantes
 const float verysmallnumber = std::numeric_limits<float>::epsilon();
 
 // Abaixo definimos variáveis globais utilizadas em várias funções do código.
 
-// A cena virtual é uma lista de objetos nomeados, guardados em um dicionário
-// (map).  Veja dentro da função BuildTrianglesAndAddToVirtualScene() como que são incluídos
-// objetos dentro da variável g_VirtualScene, e veja na função main() como
-// estes são acessados.
-std::map<std::string, SceneObject> g_VirtualScene;
+// A cena virtual é uma lista de objetos nomeados, guardados em um registro
+// onde cada objeto tem um handle (veja "sceneregistry.h"). Veja dentro da
+// função AddMeshToVirtualScene() como que são incluídos objetos dentro da
+// variável g_VirtualScene, e veja na função main() como estes são acessados.
+SceneRegistry g_VirtualScene;
+
+// Arenas de geometria onde estão as malhas de todos os objetos da cena: uma
+// para vértices com floats e outra para o formato compacto. Veja
+// "geometryarena.h".
+GeometryArena g_StaticGeometry;
+GeometryArena g_CompactGeometry;
+
+// Arena cujo VAO está "ligado" no momento; evita trocas de VAO redundantes
+// em DrawVirtualObject().
+const GeometryArena* g_BoundGeometryArena = NULL;
+
+// Malhas carregadas na cena, indexadas pelo nome da malha (nome do arquivo
+// ".obj" ou, para modelos gerados no código, nome do primeiro objeto). Cada
+// malha guarda o espaço ocupado na sua arena e os objetos que a utilizam.
+struct LoadedMesh
+{
+    GeometryArena*           arena;
+    GeometryAllocation       allocation;
+    std::vector<SceneHandle> objects;
+    std::string              filename;        // Arquivo ".obj" de origem (vazio para modelos gerados no código)
+    bool                     compute_normals; // Parâmetro usado em LoadObjModelAndAddToVirtualScene()
+};
+std::map<std::string, LoadedMesh> g_LoadedMeshes;
 
 // Pilha que guardará as matrizes de modelagem.
 std::stack<glm::mat4>  g_MatrixStack;
@@ -245,12 +319,25 @@ glm::vec4 g_CameraUpVector = normalize(glm::vec4(0.0f,1.0f,0.0f,0.0f)); // Vetor
 
 // Variáveis que definem um programa de GPU (shaders). Veja função LoadShadersFromFiles().
 GLuint g_GpuProgramID = 0;
-GLint g_model_uniform;
-GLint g_view_uniform;
-GLint g_projection_uniform;
-GLint g_object_id_uniform;
-GLint g_bbox_min_uniform;
-GLint g_bbox_max_uniform;
+
+// Lista de desenho do quadro atual. DrawVirtualObject() somente adiciona
+// comandos; as constantes de todos eles são enviadas de uma só vez para o
+// buffer circular de UBOs (veja "uniformbuffers.h") em FlushDrawList().
+struct DrawCommand
+{
+    SceneHandle     handle;
+    size_t          instance_batch; // Grupo em g_Instances, ou NO_INSTANCE_BATCH
+    PerDrawUniforms uniforms;
+    size_t          uniform_offset; // Posição do bloco PerDraw no buffer circular
+};
+const size_t NO_INSTANCE_BATCH = (size_t)-1;
+std::vector<DrawCommand> g_DrawList;
+UniformRing g_UniformRing;
+
+// Descarte dos objetos fora do campo de visão da câmera. Os planos do
+// frustum são atualizados no início de cada quadro; os objetos são testados
+// em DrawCars() e em FlushDrawList(). Veja "culling.h".
+BoxCuller g_Culler;
 
 // Número de texturas carregadas pela função LoadTextureImage()
 GLuint g_NumLoadedTextures = 0;
@@ -261,12 +348,377 @@ KEYBOARD keyInfo;
 // Objeto com informacoes fisicas do carro
 Car carInfo = Car();
 
-// Variávels para controle do tempo de execução
-float g_TimeOfLastFrame;
-float g_ElapsedTime;
+// Pista em que o carro anda (veja Car::setTrack()): o modelo passado na linha
+// de comando ou, sem ele, o plano do chão. g_CarShape é a caixa do carro,
+// da bounding box do objeto "corpo".
+BVH g_TrackBVH;
+CarCollisionShape g_CarShape = { 0.0f, 0.0f, 1.0f, 1.6f };
+
+// Chão da pista como mapa de alturas (veja "heightfield.h"), com a opção
+// --heightfield: calculado dos triângulos da pista, com uma amostra a cada
+// HEIGHTFIELD_CELL_SIZE, ou lido de uma imagem com --heightfield=imagem.
+// Vazio sem a opção; o carro então usa os raios das rodas.
+Heightfield g_TrackHeightfield;
+const float HEIGHTFIELD_CELL_SIZE = 0.25f;
+
+// Curvas de pneus do carro com a opção --tyres (veja Car::setTyreModel())
+TyreModel g_TyreModel;
+
+// Altura do branco em um mapa de alturas lido de imagem (o preto é a
+// altura mais baixa da pista)
+const float HEIGHTFIELD_IMAGE_MAX_HEIGHT = 10.0f;
+
+// Teclas aplicadas ao carro no último passo (INPUT_*), e a gravação destas
+// a cada passo quando a opção --record-input=arquivo é usada. A gravação
+// pode ser reproduzida sem janela pelo simulador "car_sim".
+uint8_t g_CarInput = 0;
+InputScript g_RecordedInput;
+std::string g_RecordInputFilename;
+
+// Replay da partida (veja "replay.h"): gravado com a opção
+// --record-replay=arquivo, ou reproduzido no lugar do teclado com
+// --replay=arquivo (as teclas "[" e "]" voltam e avançam 5 segundos)
+ReplayRecorder g_ReplayRecorder;
+ReplayReader g_Replay;
+ReplayPlayer<Car>* g_ReplayPlayer = NULL;
+
+// Controle do tempo de execução: duração dos quadros e tempo simulado, em
+// nanossegundos. Veja "timebase.h".
+TimeBase g_Time;
+
+// A física do carro (e a câmera livre) é atualizada em passos fixos de
+// 1/240 s, independentemente da taxa de quadros, com no máximo 16 passos por
+// quadro (opções --physics-hz e --max-substeps). Veja "fixedstep.h".
+FixedStepScheduler g_Simulation(TIME_NS_PER_SECOND / 240, 16);
+
+// Tempo total (em milissegundos) gasto carregando modelos, separado entre
+// modelos lidos do cache binário ("quente") e lidos do arquivo ".obj" ("frio").
+double g_ModelLoadTimeCold = 0.0;
+double g_ModelLoadTimeWarm = 0.0;
+
+// Implementação utilizada para ler arquivos ".obj" (opção --obj-parser)
+ObjParserBackend g_ObjParserBackend = OBJPARSER_TINYOBJ;
+
+// Envia os modelos para a GPU no formato compacto de "vertexformat.h"
+// (opção --compact-vertices)
+bool g_CompactVertices = false;
+
+// Partes do modelo do carro, com o identificador usado em
+// "shader_fragment.glsl" para cada uma. Veja ResolveCarParts().
+struct CarPart
+{
+    SceneHandle handle;
+    int         object_id;
+};
+std::vector<CarPart> g_CarParts;
+
+// Instâncias das partes dos carros desenhadas no quadro atual
+InstanceBatcher g_Instances;
+
+// Número de karts parados desenhados em uma grade, além do carro do jogador
+// (opção --cars=N)
+size_t g_NumGridCars = 0;
+
+// Maior número de carros do benchmark de desenho instanciado (opção
+// --benchmark cars); zero se o benchmark não foi pedido
+size_t g_BenchmarkCars = 0;
+
+// Número de glifos por quadro do benchmark de texto (opção --benchmark
+// text); zero se o benchmark não foi pedido
+size_t g_BenchmarkTextGlyphs = 0;
 
 int main(int argc, char* argv[])
 {
+    // Argumentos de linha de comando:
+    //   main [modelo.obj] [--obj-parser=tinyobj|parallel] [--compact-vertices] [--cars=N]
+    //        [--physics-hz=N] [--max-substeps=N] [--record-input=arquivo]
+    //        [--car-params=arquivo] [--car-preset=nome]
+    //        [--record-replay=arquivo | --replay=arquivo]
+    //        [--heightfield[=imagem]] [--deterministic] [--tyres]
+    //   main --benchmark objparser <modelo.obj> [repetições]
+    //   main --benchmark normals [modelo.obj] [repetições]
+    //   main --benchmark vertexformat [modelo.obj ...]
+    //   main --benchmark arena [ciclos]
+    //   main --benchmark cars [número máximo de carros]
+    //   main --benchmark culling [número de caixas]
+    //   main --benchmark text [número de glifos]
+    //   main --benchmark carpool [passos]
+    //   main --benchmark collision [passos]
+    //   main --benchmark bvh [modelo.obj ...]
+    //   main --benchmark heightfield [amostras por lado]
+    //   main --benchmark tyres [número de carros]
+    //   main --benchmark timestep
+    //   main --benchmark jobs [repetições]
+    // Os benchmarks são executados sem abrir nenhuma janela (os benchmarks
+    // "cars" e "text" criam uma janela invisível, pois precisam de um
+    // contexto OpenGL).
+    const char* user_model_filename = NULL;
+    std::string car_params_filename;
+    std::string car_preset = "default";
+    std::string record_replay_filename;
+    std::string replay_filename;
+    bool use_heightfield = false;
+    bool deterministic = false;
+    bool use_tyres = false;
+    std::string heightfield_image;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if ( arg.compare(0, 13, "--obj-parser=") == 0 )
+        {
+            if ( !ObjParser_BackendFromName(arg.substr(13), &g_ObjParserBackend) )
+            {
+                fprintf(stderr, "ERROR: Leitor de OBJ desconhecido \"%s\" (use tinyobj ou parallel).\n", arg.c_str() + 13);
+                std::exit(EXIT_FAILURE);
+            }
+        }
+        else if ( arg == "--compact-vertices" )
+        {
+            g_CompactVertices = true;
+        }
+        else if ( arg.compare(0, 7, "--cars=") == 0 )
+        {
+            g_NumGridCars = (size_t)atoi(arg.c_str() + 7);
+        }
+        else if ( arg.compare(0, 13, "--physics-hz=") == 0 )
+        {
+            int hz = atoi(arg.c_str() + 13);
+            if ( hz <= 0 )
+            {
+                fprintf(stderr, "ERROR: Frequência da física inválida \"%s\".\n", arg.c_str() + 13);
+                std::exit(EXIT_FAILURE);
+            }
+            g_Simulation.setStep(TIME_NS_PER_SECOND / hz);
+        }
+        else if ( arg.compare(0, 15, "--max-substeps=") == 0 )
+        {
+            g_Simulation.setMaxSubsteps(atoi(arg.c_str() + 15));
+        }
+        else if ( arg.compare(0, 15, "--record-input=") == 0 )
+        {
+            g_RecordInputFilename = arg.substr(15);
+        }
+        else if ( arg.compare(0, 16, "--record-replay=") == 0 )
+        {
+            record_replay_filename = arg.substr(16);
+        }
+        else if ( arg.compare(0, 9, "--replay=") == 0 )
+        {
+            replay_filename = arg.substr(9);
+        }
+        else if ( arg.compare(0, 13, "--car-params=") == 0 )
+        {
+            car_params_filename = arg.substr(13);
+        }
+        else if ( arg.compare(0, 13, "--car-preset=") == 0 )
+        {
+            car_preset = arg.substr(13);
+        }
+        else if ( arg == "--deterministic" )
+        {
+            deterministic = true;
+        }
+        else if ( arg == "--tyres" )
+        {
+            use_tyres = true;
+        }
+        else if ( arg == "--heightfield" )
+        {
+            use_heightfield = true;
+        }
+        else if ( arg.compare(0, 14, "--heightfield=") == 0 )
+        {
+            use_heightfield = true;
+            heightfield_image = arg.substr(14);
+        }
+        else if ( arg == "--benchmark" )
+        {
+            std::string name = i + 1 < argc ? argv[i+1] : "";
+            if ( name == "objparser" && i + 2 < argc )
+            {
+                int repetitions = i + 3 < argc ? atoi(argv[i+3]) : 5;
+                ObjParser_Benchmark(argv[i+2], repetitions);
+                std::exit(EXIT_SUCCESS);
+            }
+            if ( name == "normals" )
+            {
+                const char* filename = i + 2 < argc ? argv[i+2] : "../../data/bunny.obj";
+                int repetitions = i + 3 < argc ? atoi(argv[i+3]) : 5;
+                BenchmarkComputeNormals(filename, repetitions);
+                std::exit(EXIT_SUCCESS);
+            }
+            if ( name == "vertexformat" )
+            {
+                std::vector<const char*> filenames(argv + i + 2, argv + argc);
+                if ( filenames.empty() )
+                {
+                    filenames.push_back("../../data/sphere.obj");
+                    filenames.push_back("../../data/bunny.obj");
+                    filenames.push_back("../../data/plane.obj");
+                }
+                bool ok = true;
+                for (size_t f = 0; f < filenames.size(); ++f)
+                {
+                    ObjModel model(filenames[f]);
+                    ComputeNormals(&model);
+                    MeshData mesh;
+                    BuildTriangles(&model, &mesh);
+                    ok = VertexFormat_Compare(filenames[f], MeshView_FromData(mesh)) && ok;
+                }
+                std::exit(ok ? EXIT_SUCCESS : EXIT_FAILURE);
+            }
+            if ( name == "arena" )
+            {
+                int cycles = i + 2 < argc ? atoi(argv[i+2]) : 10000;
+                GeometryArena_BenchmarkAllocator(cycles);
+                std::exit(EXIT_SUCCESS);
+            }
+            if ( name == "culling" )
+            {
+                size_t num_boxes = i + 2 < argc ? (size_t)atoi(argv[i+2]) : 100000;
+                Culling_Benchmark(num_boxes, 20);
+                std::exit(EXIT_SUCCESS);
+            }
+            if ( name == "carpool" )
+            {
+                int steps = i + 2 < argc ? atoi(argv[i+2]) : 240;
+                CarPool_Benchmark(steps);
+                ValidateCarPool(256, 2400);
+                std::exit(EXIT_SUCCESS);
+            }
+            if ( name == "collision" )
+            {
+                int steps = i + 2 < argc ? atoi(argv[i+2]) : 240;
+                CarCollision_Benchmark(LoadCarCollisionShape("../../data/carro_agrupado.obj"), steps);
+                std::exit(EXIT_SUCCESS);
+            }
+            if ( name == "bvh" )
+            {
+                // Sem argumentos: o coelho e um terreno sintético com cerca
+                // de um milhão de triângulos, do tamanho de uma pista grande
+                std::vector<const char*> filenames(argv + i + 2, argv + argc);
+                if ( filenames.empty() )
+                {
+                    filenames.push_back("../../data/bunny.obj");
+                    filenames.push_back(NULL);
+                }
+                for (size_t f = 0; f < filenames.size(); ++f)
+                {
+                    ObjModel model = filenames[f] != NULL ? ObjModel(filenames[f]) : CreateSmoothingGroupsObjModel(725, 16);
+                    MeshData mesh;
+                    BuildTriangles(&model, &mesh);
+                    std::vector<BVHTriangle> triangles;
+                    BVH_AppendMesh(MeshView_FromData(mesh), &triangles);
+                    BVH_Benchmark(filenames[f] != NULL ? filenames[f] : "terreno sintético", triangles);
+                }
+                std::exit(EXIT_SUCCESS);
+            }
+            if ( name == "heightfield" )
+            {
+                size_t size = i + 2 < argc ? (size_t)atoi(argv[i+2]) : 2048;
+                Heightfield_Benchmark(size, 5);
+                BenchmarkGroundFollowing(100000, 240);
+                std::exit(EXIT_SUCCESS);
+            }
+            if ( name == "timestep" )
+            {
+                bool ok = FixedStep_Check();
+                std::exit(ok ? EXIT_SUCCESS : EXIT_FAILURE);
+            }
+            if ( name == "tyres" )
+            {
+                size_t num_cars = i + 2 < argc ? (size_t)atoi(argv[i+2]) : 10000;
+                TyreModel_Benchmark(5);
+                BenchmarkCarTyres(num_cars, 1200);
+                std::exit(EXIT_SUCCESS);
+            }
+            if ( name == "jobs" )
+            {
+                int repetitions = i + 2 < argc ? atoi(argv[i+2]) : 5;
+                BenchmarkJobScaling(repetitions);
+                std::exit(EXIT_SUCCESS);
+            }
+            if ( name == "cars" )
+            {
+                // Executado em main() após a criação do contexto OpenGL
+                g_BenchmarkCars = i + 2 < argc ? (size_t)atoi(argv[i+2]) : 1024;
+                break;
+            }
+            if ( name == "text" )
+            {
+                // Executado em main() após a criação do contexto OpenGL
+                g_BenchmarkTextGlyphs = i + 2 < argc ? (size_t)atoi(argv[i+2]) : 10000;
+                break;
+            }
+            fprintf(stderr, "ERROR: Uso: %s --benchmark objparser <modelo.obj> [repetições]\n"
+                            "            %s --benchmark normals [modelo.obj] [repetições]\n"
+                            "            %s --benchmark vertexformat [modelo.obj ...]\n"
+                            "            %s --benchmark arena [ciclos]\n"
+                            "            %s --benchmark cars [número máximo de carros]\n"
+                            "            %s --benchmark culling [número de caixas]\n"
+                            "            %s --benchmark text [número de glifos]\n"
+                            "            %s --benchmark carpool [passos]\n"
+                            "            %s --benchmark collision [passos]\n"
+                            "            %s --benchmark bvh [modelo.obj ...]\n"
+                            "            %s --benchmark heightfield [amostras por lado]\n"
+                            "            %s --benchmark tyres [número de carros]\n"
+                            "            %s --benchmark timestep\n"
+                            "            %s --benchmark jobs [repetições]\n", argv[0], argv[0], argv[0], argv[0], argv[0], argv[0], argv[0], argv[0], argv[0], argv[0], argv[0], argv[0], argv[0], argv[0]);
+            std::exit(EXIT_FAILURE);
+        }
+        else
+            user_model_filename = argv[i];
+    }
+
+    // Parâmetros de dirigibilidade do carro do jogador (veja "carparams.h")
+    CarParamsSet car_presets;
+    std::string car_params_error;
+    if ( !car_params_filename.empty() && !car_presets.load(car_params_filename, &car_params_error) )
+    {
+        fprintf(stderr, "ERROR: %s.\n", car_params_error.c_str());
+        std::exit(EXIT_FAILURE);
+    }
+    if ( car_presets.find(car_preset) == NULL )
+    {
+        fprintf(stderr, "ERROR: Preset de carro desconhecido \"%s\".\n", car_preset.c_str());
+        std::exit(EXIT_FAILURE);
+    }
+    carInfo.setParams(*car_presets.find(car_preset));
+
+    // O replay usa os parâmetros, o passo da simulação e os modos da física
+    // com que foi gravado (veja "replay.h"). O mapa de alturas e a pista não
+    // estão no replay: a opção e o modelo devem ser os mesmos da gravação (a
+    // pista é verificada depois de carregada, e a gravação começa só então).
+    if ( !replay_filename.empty() )
+    {
+        std::string replay_error;
+        if ( !g_Replay.load(replay_filename, &replay_error) )
+        {
+            fprintf(stderr, "ERROR: %s.\n", replay_error.c_str());
+            std::exit(EXIT_FAILURE);
+        }
+        uint32_t modes = g_Replay.getModes();
+        if ( ((modes & REPLAY_MODE_HEIGHTFIELD) != 0) != use_heightfield )
+        {
+            fprintf(stderr, "ERROR: O replay \"%s\" foi gravado %s a opção --heightfield.\n", replay_filename.c_str(),
+                    (modes & REPLAY_MODE_HEIGHTFIELD) != 0 ? "com" : "sem");
+            std::exit(EXIT_FAILURE);
+        }
+        deterministic = (modes & REPLAY_MODE_DETERMINISTIC) != 0;
+        use_tyres = (modes & REPLAY_MODE_TYRES) != 0;
+        g_Simulation.setStep(g_Replay.getStepNs());
+        g_ReplayPlayer = new ReplayPlayer<Car>(g_Replay, &carInfo);
+    }
+
+    // Física determinística (veja Car::setDeterministic()); o estado de
+    // ponto flutuante é verificado a cada quadro, antes dos passos
+    carInfo.setDeterministic(deterministic);
+
+    // Modelo de pneus no lugar das regras de derrapagem (veja
+    // Car::setTyreModel())
+    if ( use_tyres )
+        carInfo.setTyreModel(&g_TyreModel);
+
     // Inicializamos a biblioteca GLFW, utilizada para criar uma janela do
     // sistema operacional, onde poderemos renderizar com OpenGL.
     int success = glfwInit();
@@ -291,6 +743,10 @@ int main(int argc, char* argv[])
     // funções modernas de OpenGL.
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
+    // Os benchmarks de desenho não mostram nada na tela
+    if ( g_BenchmarkCars > 0 || g_BenchmarkTextGlyphs > 0 )
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+
     // Criamos uma janela do sistema operacional, com 800 colunas e 600 linhas
     // de pixels, e com título "INF01047 ...".
     GLFWwindow* window;
@@ -339,37 +795,49 @@ int main(int argc, char* argv[])
     LoadShadersFromFiles();
 
     // ________________________>>_______________________>>>>>>  Load de texturas
-        // Carregamos duas imagens para serem utilizadas como textura
-        LoadTextureImage("../../data/track.jpg");      // TextureImage0
-        LoadTextureImage("../../data/car_texture.jpg");  // TextureImage1
-
-        std::vector<std::string> faces
+        // Duas imagens para serem utilizadas como textura e as seis faces
+        // do cubemap do céu
+        DecodedImage images[8] =
         {
-            "../../data/skybox_px.png", 
-            "../../data/skybox_nx.png", 
-            "../../data/skybox_py.png", 
-            "../../data/skybox_ny.png", 
-            "../../data/skybox_pz.png",
-            "../../data/skybox_nz.png"  
+            { "../../data/track.jpg",       true,  0, 0, NULL }, // TextureImage0
+            { "../../data/car_texture.jpg", true,  0, 0, NULL }, // TextureImage1
+            { "../../data/skybox_px.png",   false, 0, 0, NULL },
+            { "../../data/skybox_nx.png",   false, 0, 0, NULL },
+            { "../../data/skybox_py.png",   false, 0, 0, NULL },
+            { "../../data/skybox_ny.png",   false, 0, 0, NULL },
+            { "../../data/skybox_pz.png",   false, 0, 0, NULL },
+            { "../../data/skybox_nz.png",   false, 0, 0, NULL }
         };
 
-        GLuint cubemapTexture = LoadCubemap(faces);
+        // As imagens são decodificadas em paralelo pelas threads de
+        // trabalho; o envio para a GPU depende de todas e é feito na thread
+        // principal, na ordem das unidades de textura
+        JobCounter decoded;
+        JobCounter uploaded;
+        for (size_t i = 0; i < 8; ++i)
+            ThreadPool_Submit([&images, i]() { DecodeImage(&images[i]); }, &decoded);
+
+        GLuint cubemapTexture = 0;
+        ThreadPool_SubmitMainThread([&images, &cubemapTexture]() {
+            LoadTextureImage(&images[0]);
+            LoadTextureImage(&images[1]);
+            cubemapTexture = LoadCubemap(&images[2]);
+        }, &uploaded, &decoded);
+        ThreadPool_Wait(&uploaded);
 
     // ________________________<<_______________________<<<<<<
 
 
     // _______________________>>_______________________>>>>>>  Load de objetos
 
-        ObjModel sphereModel("../../data/sphere.obj");
-        ComputeNormals(&sphereModel);
-        BuildTrianglesAndAddToVirtualScene(&sphereModel);
-
-        ObjModel planeModel("../../data/plane.obj");
-        ComputeNormals(&planeModel);
-        BuildTrianglesAndAddToVirtualScene(&planeModel);
+        // Modelos lidos de arquivos ".obj" passam pelo cache binário de
+        // malhas: somente a primeira execução faz o parsing do arquivo.
+        LoadObjModelAndAddToVirtualScene("../../data/sphere.obj");
+        LoadObjModelAndAddToVirtualScene("../../data/plane.obj");
 
+        std::vector<BVHTriangle> track_triangles;
         ObjModel planemodel = CreatePlaneObjModel("plane", 100, 30);
-        BuildTrianglesAndAddToVirtualScene(&planemodel);
+        BuildTrianglesAndAddToVirtualScene(&planemodel, user_model_filename == NULL ? &track_triangles : NULL);
 
         // Carregamos partes do carro
         // Grupos pertencentes ao objeto:
@@ -383,19 +851,85 @@ int main(int argc, char* argv[])
         - Objeto 'corpo'
         - Objeto 'vidros'
         */
-        ObjModel carmodel("../../data/carro_agrupado.obj");
-        ComputeNormals(&carmodel);
-        BuildTrianglesAndAddToVirtualScene(&carmodel);
+        LoadObjModelAndAddToVirtualScene("../../data/carro_agrupado.obj");
 
 
     // _______________________<<_______________________<<<<<<
 
-    if ( argc > 1 )
+    if ( user_model_filename != NULL )
+    {
+        LoadObjModelAndAddToVirtualScene(user_model_filename, false, &track_triangles);
+    }
+
+    TimeNs bvh_start_time = g_Time.now();
+    g_TrackBVH.build(track_triangles);
+    printf("BVH da pista: %lu triângulos, %lu nós, em %.2f ms.\n", (unsigned long)g_TrackBVH.getNumTriangles(),
+           (unsigned long)g_TrackBVH.getNumNodes(), Time_ToMilliseconds(g_Time.now() - bvh_start_time));
+
+    if ( use_heightfield )
+    {
+        TimeNs heightfield_start_time = g_Time.now();
+        if ( heightfield_image.empty() )
+            g_TrackHeightfield.bake(track_triangles, HEIGHTFIELD_CELL_SIZE);
+        else if ( !LoadHeightfieldImage(heightfield_image.c_str(), g_TrackBVH, &g_TrackHeightfield) )
+            std::exit(EXIT_FAILURE);
+        printf("Mapa de alturas da pista: %lu x %lu amostras (%s), em %.2f ms.\n", (unsigned long)g_TrackHeightfield.getWidth(),
+               (unsigned long)g_TrackHeightfield.getDepth(), Heightfield_BackendName(g_TrackHeightfield.getBackend()),
+               Time_ToMilliseconds(g_Time.now() - heightfield_start_time));
+        if ( !g_TrackHeightfield.isEmpty() )
+            carInfo.setGround(&g_TrackHeightfield);
+    }
+
+    SceneHandle car_body = g_VirtualScene.find("corpo");
+    if ( g_VirtualScene.isLoaded(car_body) )
+        g_CarShape = CarCollision_ShapeFromBox(g_VirtualScene.get(car_body).bbox_min, g_VirtualScene.get(car_body).bbox_max, 0.03f);
+    if ( !g_TrackBVH.isEmpty() )
+        carInfo.setTrack(&g_TrackBVH, g_CarShape);
+
+    // As colisões com as paredes dependem da pista: o replay deve ter sido
+    // gravado nela (veja "replay.h")
+    if ( g_ReplayPlayer != NULL && g_Replay.getTrackHash() != g_TrackBVH.getGeometryHash() )
     {
-        ObjModel model(argv[1]);
-        BuildTrianglesAndAddToVirtualScene(&model);
+        fprintf(stderr, "ERROR: O replay \"%s\" foi gravado em outra pista.\n", replay_filename.c_str());
+        std::exit(EXIT_FAILURE);
+    }
+    if ( g_ReplayPlayer == NULL && !record_replay_filename.empty() )
+    {
+        // Um keyframe por segundo simulado
+        uint32_t keyframe_interval = (uint32_t)(TIME_NS_PER_SECOND / g_Simulation.getStep());
+        uint32_t modes = (deterministic ? REPLAY_MODE_DETERMINISTIC : 0) | (use_tyres ? REPLAY_MODE_TYRES : 0)
+                       | (use_heightfield ? REPLAY_MODE_HEIGHTFIELD : 0);
+        if ( !g_ReplayRecorder.open(record_replay_filename, g_Simulation.getStep(), carInfo.getParams(), keyframe_interval,
+                                    modes, g_TrackBVH.getGeometryHash()) )
+        {
+            fprintf(stderr, "ERROR: Não foi possível criar \"%s\".\n", record_replay_filename.c_str());
+            std::exit(EXIT_FAILURE);
+        }
     }
 
+    printf("Modelos carregados em %.2f ms (%.2f ms sem cache, %.2f ms com cache).\n",
+           g_ModelLoadTimeCold + g_ModelLoadTimeWarm, g_ModelLoadTimeCold, g_ModelLoadTimeWarm);
+
+    // Buscamos os objetos desenhados a cada quadro pelo nome uma única vez;
+    // o laço de renderização usa somente os handles. Os handles continuam
+    // válidos se os modelos forem recarregados (tecla M).
+    SceneHandle skybox_handle = g_VirtualScene.reserve("the_sphere");
+    SceneHandle plane_handle  = g_VirtualScene.reserve("plane");
+    ResolveCarParts();
+
+    // Todas as partes dos carros são desenhadas de forma instanciada
+    g_Instances.init();
+
+    // Constantes dos shaders (veja "uniformbuffers.h")
+    g_UniformRing.init(64 * 1024);
+
+    // O cubemap do skybox fica sempre ligado na unidade de textura 3 (veja
+    // "SkyboxCube" em LoadShadersFromFiles())
+    glActiveTexture(GL_TEXTURE3);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
+    std::vector<glm::mat4> grid_car_models = CreateCarGrid(g_NumGridCars);
+    std::vector<glm::mat4> car_models;
+
     // Inicializamos o código para renderização de texto.
     TextRendering_Init();
 
@@ -407,6 +941,24 @@ int main(int argc, char* argv[])
     glCullFace(GL_BACK);
     glFrontFace(GL_CCW);
 
+    if ( g_BenchmarkCars > 0 )
+    {
+        BenchmarkCarRendering(g_BenchmarkCars);
+        glfwTerminate();
+        return 0;
+    }
+
+    if ( g_BenchmarkTextGlyphs > 0 )
+    {
+        TextRendering_Benchmark(window, g_BenchmarkTextGlyphs);
+        glfwTerminate();
+        return 0;
+    }
+
+    // O primeiro quadro é medido a partir daqui, e não desde o início do
+    // carregamento
+    g_Time.reset();
+
     // Ficamos em um loop infinito, renderizando, até que o usuário feche a janela
     while (!glfwWindowShouldClose(window))
     {
@@ -429,6 +981,10 @@ int main(int argc, char* argv[])
         // os shaders de vértice e fragmentos).
         glUseProgram(g_GpuProgramID);
 
+        // O carro é desenhado interpolado entre os dois últimos passos da
+        // simulação, de acordo com a fração de passo que sobrou no acumulador
+        float alpha = g_Simulation.getAlpha();
+
         // _______________________>>_____________________>>>>  Camera settings
 
             if (g_UseFreeCamera){
@@ -437,7 +993,7 @@ int main(int argc, char* argv[])
                     g_JustToggledFreeCamera=false;
                     // Translada 2 unidades no vetor da posição da câmera
                     g_CameraPosition += glm::vec4(0.0f, 3.0f, 0.0f, 0.0f);
-                    g_CameraViewVector = normalize(carInfo.getPosition() - g_CameraPosition);
+                    g_CameraViewVector = normalize(carInfo.getPosition(alpha) - g_CameraPosition);
 
                     // Calcula valores iniciais de phi e theta para câmera livre
                     float vx = g_CameraViewVector.x;
@@ -462,13 +1018,13 @@ int main(int argc, char* argv[])
                 case lockedLookAt:
                 case slidingLookAt:
                     g_CameraPhi = carInfo.getCameraPhi();
-                    g_CameraTheta = carInfo.getCameraTheta();
+                    g_CameraTheta = carInfo.getCameraTheta(alpha);
                     r = g_CameraDistance;
                     y = r*sin(g_CameraPhi);
                     z = r*cos(g_CameraPhi)*cos(g_CameraTheta);
                     x = r*cos(g_CameraPhi)*sin(g_CameraTheta);
-                    g_CameraPosition  = carInfo.getPosition() + glm::vec4(x,y,z,0.0f); // Ponto "c", centro da câmera
-                    camera_lookat_l    = carInfo.getPosition() + glm::vec4(0.0f, 3.0f, 0.0f, 0.0f); // Ponto "l", para onde a câmera (look-at) estará sempre olhando
+                    g_CameraPosition  = carInfo.getPosition(alpha) + glm::vec4(x,y,z,0.0f); // Ponto "c", centro da câmera
+                    camera_lookat_l    = carInfo.getPosition(alpha) + glm::vec4(0.0f, 3.0f, 0.0f, 0.0f); // Ponto "l", para onde a câmera (look-at) estará sempre olhando
                     g_CameraViewVector= normalize(camera_lookat_l - g_CameraPosition); // Vetor "view", sentido para onde a câmera está virada
 
                     break;
@@ -517,13 +1073,11 @@ int main(int argc, char* argv[])
             projection = Matrix_Orthographic(l, r, b, t, nearplane, farplane);
         }
 
-        glm::mat4 model = Matrix_Identity(); // Transformação identidade de modelagem
+        // Planos do frustum usados para descartar os objetos que não
+        // aparecem na tela neste quadro
+        g_Culler.beginFrame(projection * view);
 
-        // Enviamos as matrizes "view" e "projection" para a placa de vídeo
-        // (GPU). Veja o arquivo "shader_vertex.glsl", onde estas são
-        // efetivamente aplicadas em todos os pontos.
-        glUniformMatrix4fv(g_view_uniform       , 1 , GL_FALSE , glm::value_ptr(view));
-        glUniformMatrix4fv(g_projection_uniform , 1 , GL_FALSE , glm::value_ptr(projection));
+        glm::mat4 model = Matrix_Identity(); // Transformação identidade de modelagem
 
         #define PLANE 0
         #define SKYBOX 1
@@ -535,54 +1089,36 @@ int main(int argc, char* argv[])
         // _______________________>>_____________________>>>>  desenho dos objetos
 
             // Skybox primeiro, pois fica atrás de tudo
-            model =  carInfo.getTranslationMatrix()
+            model =  carInfo.getTranslationMatrix(alpha)
                 * Matrix_Scale(-150.0f, 150.0f, 150.0f);  // esfera gigante
-            glUniformMatrix4fv(g_model_uniform, 1 , GL_FALSE , glm::value_ptr(model));
-            glUniform1i(g_object_id_uniform, SKYBOX);
-            DrawVirtualObject("the_sphere");
-            
-            glActiveTexture(GL_TEXTURE3);
-            glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
-            glUniform1i(glGetUniformLocation(g_GpuProgramID, "SkyboxCube"), 3);
+            DrawVirtualObject(skybox_handle, model, SKYBOX);
 
             model = Matrix_Identity();
             // model = Matrix_Scale(200.0f, 1.0f, 200.0f);
-            glUniformMatrix4fv(g_model_uniform, 1 , GL_FALSE , glm::value_ptr(model));
-            glUniform1i(g_object_id_uniform, CAR_TYRES);
-            DrawVirtualObject("plane");
-
-
-            // Desenhamos as partes do carro
-            PushMatrix(model);
-                model = carInfo.getTranslationMatrix()*
-                Matrix_Scale(0.03f, 0.03f, 0.03f)*
-                carInfo.getMatrixRotate();
-                
-                glUniformMatrix4fv(g_model_uniform, 1 , GL_FALSE , glm::value_ptr(model));
-                glUniform1i(g_object_id_uniform, CAR_BODY);
-                DrawVirtualObject("the_car");
-
-                // Desenha rodas com rotação a partir da velocidade
-                PushMatrix(model);
-                    //TODO : fazer roda rodar em torno do vetor ortogonal ao fowards do carro
-                    // model*Matrix_Rotate();
-                    glUniformMatrix4fv(g_model_uniform, 1 , GL_FALSE , glm::value_ptr(model));
-                    glUniform1i(g_object_id_uniform, CAR_TYRES);
-                    DrawVirtualObject("roda_anterior_esquerda");
-                    DrawVirtualObject("roda_dianteira_esquerda");
-                    DrawVirtualObject("roda_anterior_direita");
-                    DrawVirtualObject("roda_dianteira_direita");
-                PopMatrix(model);
-                glUniformMatrix4fv(g_model_uniform, 1 , GL_FALSE , glm::value_ptr(model));
-                glUniform1i(g_object_id_uniform, CAR_BODY);
-                DrawVirtualObject("corpo");
-                glUniform1i(g_object_id_uniform, CAR_GLASSES);
-                DrawVirtualObject("vidros");
-                glUniform1i(g_object_id_uniform, CAR_PLAQUES);
-                DrawVirtualObject("placas");
-                DrawVirtualObject("logo");
-
-            PopMatrix(model);
+            DrawVirtualObject(plane_handle, model, CAR_TYRES);
+
+
+            // Desenhamos as partes dos carros: o carro do jogador e os
+            // karts da grade (opção --cars). Cada parte é desenhada uma única
+            // vez para todos os carros; veja DrawCars().
+            car_models.clear();
+            car_models.push_back(carInfo.getTranslationMatrix(alpha)*
+                                 Matrix_Scale(0.03f, 0.03f, 0.03f)*
+                                 carInfo.getMatrixRotate(alpha));
+            car_models.insert(car_models.end(), grid_car_models.begin(), grid_car_models.end());
+            DrawCars(car_models, true);
+
+            // Enviamos as matrizes "view" e "projection", a posição da câmera
+            // e a direção da luz para a placa de vídeo (GPU), junto com as
+            // constantes de todos os objetos acima, e os desenhamos. Veja o
+            // arquivo "shader_vertex.glsl", onde estas são efetivamente
+            // aplicadas em todos os pontos.
+            PerFrameUniforms frame;
+            frame.view            = view;
+            frame.projection      = projection;
+            frame.camera_position = glm::inverse(view) * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+            frame.light_direction = normalize(glm::vec4(1.0f, 1.0f, 0.0f, 0.0f));
+            FlushDrawList(frame);
         // ________________________<<______________________<<<<<<
         TextRendering_ShowVelocity(window, carInfo.getVelocity(), carInfo.getIsSliding());
         TextRendering_ShowRotation(window, carInfo.getRotation());
@@ -594,6 +1130,13 @@ int main(int argc, char* argv[])
         // por segundo (frames per second).
         TextRendering_ShowFramesPerSecond(window);
 
+        // Imprimimos na tela quantos objetos foram testados, descartados e
+        // desenhados neste quadro.
+        TextRendering_ShowCullingStats(window);
+
+        // Desenhamos de uma só vez todos os textos escritos acima.
+        TextRendering_Flush();
+
         // O framebuffer onde OpenGL executa as operações de renderização não
         // é o mesmo que está sendo mostrado para o usuário, caso contrário
         // seria possível ver artefatos conhecidos como "screen tearing". A
@@ -608,15 +1151,66 @@ int main(int argc, char* argv[])
         // pela biblioteca GLFW.
         glfwPollEvents();
 
-        // Atualiza as variaveis de movimentaçao com base no teclado.
-        updateFromKeyboard();
+        // Executamos os trabalhos enviados para a thread principal (os que
+        // fazem chamadas OpenGL, veja "threadpool.h")
+        ThreadPool_RunMainThreadJobs();
+
+        // Início do próximo quadro: o tempo real gasto neste quadro é
+        // acumulado pelo escalonador de passo fixo
+        g_Time.beginFrame();
+
+        // Executamos os passos da simulação que couberem no tempo acumulado:
+        // as variaveis de movimentaçao com base no teclado e os valores pro
+        // carro são atualizados sempre com o mesmo intervalo de tempo.
+        int num_steps = g_Simulation.advance(g_Time.getFrameDelta());
+        float step = (float)g_Simulation.getStepSeconds();
+        if ( carInfo.isDeterministic() && !DetMath_ResetFloatingPoint() )
+            fprintf(stderr, "Estado de ponto flutuante alterado (arredondamento ou denormais); restaurado.\n");
+        for (int i = 0; i < num_steps; ++i)
+        {
+            if ( g_ReplayPlayer != NULL )
+            {
+                // O carro segue o replay; o teclado só move a câmera livre
+                if ( g_CameraType == freeCamera )
+                    updateFromKeyboard(step);
+                g_ReplayPlayer->advance();
+            }
+            else
+            {
+                if ( g_ReplayRecorder.isOpen() && g_ReplayRecorder.wantsKeyframe() )
+                    g_ReplayRecorder.keyframe(carInfo.getReplayState());
+                updateFromKeyboard(step);
+                carInfo.update(step);
+                if ( g_ReplayRecorder.isOpen() )
+                {
+                    g_ReplayRecorder.input(g_CarInput);
+                    g_ReplayRecorder.advance();
+                }
+            }
+            g_Time.advanceSimulation(g_Simulation.getStep());
+        }
+    }
 
-        // Atuliza valores pro carro (para o tempo passado)
-        carInfo.update(getTimeSinceLastFrame());
+    // Gravamos os comandos do carro, se pedido
+    if ( !g_RecordInputFilename.empty() )
+    {
+        g_RecordedInput.setHz((int)(TIME_NS_PER_SECOND / g_Simulation.getStep()));
+        if ( g_RecordedInput.save(g_RecordInputFilename) )
+            printf("Comandos gravados em \"%s\" (%lu passos).\n", g_RecordInputFilename.c_str(), (unsigned long)g_RecordedInput.getNumSteps());
+        else
+            fprintf(stderr, "ERROR: Não foi possível gravar \"%s\".\n", g_RecordInputFilename.c_str());
+    }
 
-        // Atualiza o tempo do ultimo frame
-        setEndFrameTime();
+    if ( g_ReplayRecorder.isOpen() )
+    {
+        uint64_t replay_steps = g_ReplayRecorder.getStep();
+        if ( g_ReplayRecorder.close() )
+            printf("Replay gravado em \"%s\" (%lu passos).\n", record_replay_filename.c_str(), (unsigned long)replay_steps);
+        else
+            fprintf(stderr, "ERROR: Não foi possível gravar \"%s\".\n", record_replay_filename.c_str());
     }
+    delete g_ReplayPlayer;
+    g_ReplayPlayer = NULL;
 
     // Finalizamos o uso dos recursos do sistema operacional
     glfwTerminate();
@@ -625,89 +1219,721 @@ int main(int argc, char* argv[])
     return 0;
 }
 
-// Função que carrega uma imagem para ser utilizada como textura
-void LoadTextureImage(const char* filename)
+// Lê a imagem do disco e a decodifica para RGB. Não usa OpenGL, então pode
+// ser executada em uma thread de trabalho. A inversão das linhas é feita
+// aqui, e não com stbi_set_flip_vertically_on_load(), que é um estado global
+// de stb_image compartilhado por todas as threads.
+void DecodeImage(DecodedImage* image)
 {
-    printf("Carregando imagem \"%s\"... ", filename);
-
-    // Primeiro fazemos a leitura da imagem do disco
-    stbi_set_flip_vertically_on_load(true);
-    int width;
-    int height;
     int channels;
-    unsigned char *data = stbi_load(filename, &width, &height, &channels, 3);
+    image->pixels = stbi_load(image->filename.c_str(), &image->width, &image->height, &channels, 3);
+    if ( image->pixels == NULL )
+    {
+        fprintf(stderr, "ERROR: Cannot open image file \"%s\".\n", image->filename.c_str());
+        return;
+    }
 
-    if ( data == NULL )
+    if ( image->flip )
     {
-        fprintf(stderr, "ERROR: Cannot open image file \"%s\".\n", filename);
+        size_t row_size = 3 * (size_t)image->width;
+        std::vector<unsigned char> row(row_size);
+        for (int y = 0; y < image->height / 2; ++y)
+        {
+            unsigned char* top    = image->pixels + row_size * y;
+            unsigned char* bottom = image->pixels + row_size * (image->height - 1 - y);
+            memcpy(row.data(), top, row_size);
+            memcpy(top, bottom, row_size);
+            memcpy(bottom, row.data(), row_size);
+        }
+    }
+}
+
+// Função que carrega uma imagem decodificada por DecodeImage() para ser
+// utilizada como textura
+void LoadTextureImage(DecodedImage* image)
+{
+    printf("Carregando imagem \"%s\"... ", image->filename.c_str());
+    if ( image->pixels == NULL )
         std::exit(EXIT_FAILURE);
+
+    printf("OK (%dx%d).\n", image->width, image->height);
+
+    int width = image->width;
+    int height = image->height;
+    unsigned char *data = image->pixels;
+
+    // Agora criamos objetos na GPU com OpenGL para armazenar a textura
+    GLuint texture_id;
+    GLuint sampler_id;
+    glGenTextures(1, &texture_id);
+    glGenSamplers(1, &sampler_id);
+
+    // Veja slides 95-96 do documento Aula_20_Mapeamento_de_Texturas.pdf
+    glSamplerParameteri(sampler_id, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glSamplerParameteri(sampler_id, GL_TEXTURE_WRAP_T, GL_REPEAT);
+
+    // Parâmetros de amostragem da textura.
+    glSamplerParameteri(sampler_id, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glSamplerParameteri(sampler_id, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    // Agora enviamos a imagem lida do disco para a GPU
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glPixelStorei(GL_UNPACK_SKIP_PIXELS, 0);
+    glPixelStorei(GL_UNPACK_SKIP_ROWS, 0);
+
+    GLuint textureunit = g_NumLoadedTextures;
+    glActiveTexture(GL_TEXTURE0 + textureunit);
+    glBindTexture(GL_TEXTURE_2D, texture_id);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_SRGB8, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
+    glGenerateMipmap(GL_TEXTURE_2D);
+    glBindSampler(textureunit, sampler_id);
+
+    stbi_image_free(data);
+    image->pixels = NULL;
+
+    g_NumLoadedTextures ++;
+}
+
+// Função que desenha um objeto armazenado em g_VirtualScene. Veja definição
+// dos objetos na função AddMeshToVirtualScene(). O handle é obtido no
+// carregamento com g_VirtualScene.reserve() (ou find()). O objeto é somente
+// adicionado na lista de desenho do quadro, com sua matriz de modelagem e
+// seu identificador; o desenho acontece em FlushDrawList().
+void DrawVirtualObject(SceneHandle handle, const glm::mat4& model, int object_id)
+{
+    // Objetos removidos ou ainda não carregados não têm arena, e não há nada
+    // para desenhar
+    if ( !g_VirtualScene.isLoaded(handle) )
+        return;
+    const SceneObject& object = g_VirtualScene.get(handle);
+
+    DrawCommand command;
+    command.handle         = handle;
+    command.instance_batch = NO_INSTANCE_BATCH;
+    command.uniforms.model = model;
+
+    // As normais são transformadas pela inversa transposta da matriz de
+    // modelagem, calculada aqui uma única vez por objeto (e não em cada
+    // vértice). Veja "shader_vertex.glsl".
+    command.uniforms.normal_matrix = glm::mat4(glm::inverseTranspose(glm::mat3(model)));
+
+    // A axis-aligned bounding box (AABB) do modelo é usada pelo fragment
+    // shader e, no formato compacto, para decodificar as posições.
+    command.uniforms.bbox_min = glm::vec4(object.bbox_min, 1.0f);
+    command.uniforms.bbox_max = glm::vec4(object.bbox_max, 1.0f);
+    command.uniforms.params   = glm::ivec4(object_id, object.compact_vertices ? 1 : 0, 0, 0);
+
+    g_DrawList.push_back(command);
+}
+
+// Adiciona na lista de desenho todas as cópias de um objeto adicionadas em
+// g_Instances (grupo "batch"), desenhadas com uma única chamada. A matriz
+// "model", a matriz das normais e o identificador de cada cópia vêm do
+// buffer de instâncias (veja "instancing.h").
+void DrawVirtualObjectInstanced(size_t batch)
+{
+    SceneHandle handle = g_Instances.getBatch(batch).handle;
+    if ( !g_VirtualScene.isLoaded(handle) || g_Instances.getBatch(batch).num_instances == 0 )
+        return;
+    const SceneObject& object = g_VirtualScene.get(handle);
+
+    DrawCommand command;
+    command.handle                 = handle;
+    command.instance_batch         = batch;
+    command.uniforms.model         = glm::mat4(1.0f);
+    command.uniforms.normal_matrix = glm::mat4(1.0f);
+    command.uniforms.bbox_min      = glm::vec4(object.bbox_min, 1.0f);
+    command.uniforms.bbox_max      = glm::vec4(object.bbox_max, 1.0f);
+    command.uniforms.params        = glm::ivec4(0, object.compact_vertices ? 1 : 0, 1, 0);
+
+    g_DrawList.push_back(command);
+}
+
+// Executa a lista de desenho do quadro. As constantes do quadro e de todos os
+// objetos são copiadas de uma só vez para o buffer circular de UBOs, e cada
+// desenho somente seleciona o seu bloco PerDraw com glBindBufferRange().
+void FlushDrawList(const PerFrameUniforms& frame)
+{
+    // Descartamos os objetos não instanciados fora do frustum (as instâncias
+    // já foram testadas em DrawCars()). A bounding box é transformada pela
+    // mesma matriz de modelagem usada no desenho.
+    size_t first_box = g_Culler.getNumBoxes();
+    for (size_t i = 0; i < g_DrawList.size(); ++i)
+    {
+        const DrawCommand& command = g_DrawList[i];
+        if ( command.instance_batch == NO_INSTANCE_BATCH )
+            g_Culler.add(command.uniforms.model, glm::vec3(command.uniforms.bbox_min), glm::vec3(command.uniforms.bbox_max));
+    }
+    g_Culler.cull(first_box);
+
+    size_t num_kept = 0;
+    size_t box = first_box;
+    for (size_t i = 0; i < g_DrawList.size(); ++i)
+    {
+        if ( g_DrawList[i].instance_batch == NO_INSTANCE_BATCH && !g_Culler.isVisible(box++) )
+            continue;
+        g_DrawList[num_kept++] = g_DrawList[i];
+    }
+    g_DrawList.resize(num_kept);
+
+    g_UniformRing.beginFrame();
+    size_t frame_offset = g_UniformRing.append(&frame, sizeof(frame));
+    for (size_t i = 0; i < g_DrawList.size(); ++i)
+        g_DrawList[i].uniform_offset = g_UniformRing.append(&g_DrawList[i].uniforms, sizeof(PerDrawUniforms));
+    g_UniformRing.upload();
+
+    g_UniformRing.bindRange(UNIFORM_BINDING_PER_FRAME, frame_offset, sizeof(PerFrameUniforms));
+
+    // Outras partes do código (por exemplo, a renderização de texto) usam
+    // seus próprios VAOs; o VAO da arena é ligado novamente no primeiro
+    // objeto de cada quadro.
+    g_BoundGeometryArena = NULL;
+
+    for (size_t i = 0; i < g_DrawList.size(); ++i)
+    {
+        const DrawCommand& command = g_DrawList[i];
+        const SceneObject& object = g_VirtualScene.get(command.handle);
+
+        g_UniformRing.bindRange(UNIFORM_BINDING_PER_DRAW, command.uniform_offset, sizeof(PerDrawUniforms));
+
+        if ( command.instance_batch != NO_INSTANCE_BATCH )
+        {
+            // O VAO instanciado da arena tem os atributos de instância
+            // apontados para este grupo; o próximo objeto não instanciado
+            // volta ao VAO normal.
+            const InstanceBatch& batch = g_Instances.getBatch(command.instance_batch);
+            object.arena->bindInstanced();
+            g_Instances.bindAttributes(batch);
+            g_BoundGeometryArena = NULL;
+
+            glDrawElementsInstancedBaseVertex(
+                object.rendering_mode,
+                object.num_indices,
+                object.index_type,
+                (void*)object.index_offset,
+                (GLsizei)batch.num_instances,
+                object.base_vertex
+            );
+            continue;
+        }
+
+        // "Ligamos" o VAO da arena onde está o objeto. Todos os objetos de
+        // uma arena compartilham o mesmo VAO, então a troca só acontece
+        // quando o objeto anterior estava em outra arena. Veja
+        // "geometryarena.h".
+        if ( object.arena != g_BoundGeometryArena )
+        {
+            object.arena->bind();
+            g_BoundGeometryArena = object.arena;
+        }
+
+        // Pedimos para a GPU rasterizar os vértices do objeto. Veja a
+        // documentação da função glDrawElementsBaseVertex() em
+        // http://docs.gl/gl3/glDrawElementsBaseVertex.
+        glDrawElementsBaseVertex(
+            object.rendering_mode,
+            object.num_indices,
+            object.index_type,
+            (void*)object.index_offset,
+            object.base_vertex
+        );
+    }
+
+    g_UniformRing.endFrame();
+    g_DrawList.clear();
+}
+
+// Busca os handles das partes do modelo do carro (veja
+// "carro_agrupado.obj"). O objeto "the_car" não existe no modelo atual, e
+// seu handle simplesmente não desenha nada.
+void ResolveCarParts()
+{
+    const struct { const char* name; int object_id; } parts[] = {
+        { "the_car",                 CAR_BODY    },
+        { "roda_anterior_esquerda",  CAR_TYRES   },
+        { "roda_dianteira_esquerda", CAR_TYRES   },
+        { "roda_anterior_direita",   CAR_TYRES   },
+        { "roda_dianteira_direita",  CAR_TYRES   },
+        { "corpo",                   CAR_BODY    },
+        { "vidros",                  CAR_GLASSES },
+        { "placas",                  CAR_PLAQUES },
+        { "logo",                    CAR_PLAQUES },
+    };
+
+    g_CarParts.clear();
+    for (size_t i = 0; i < sizeof(parts)/sizeof(parts[0]); ++i)
+    {
+        CarPart part;
+        part.handle    = g_VirtualScene.reserve(parts[i].name);
+        part.object_id = parts[i].object_id;
+        g_CarParts.push_back(part);
+    }
+}
+
+// Matrizes de modelagem de "num_cars" karts parados em uma grade de largada,
+// com quatro karts por fila, atrás da posição inicial do jogador. O
+// espaçamento é calculado a partir da bounding box da carroceria.
+std::vector<glm::mat4> CreateCarGrid(size_t num_cars)
+{
+    const float scale = 0.03f;
+    float spacing = 5.0f;
+    SceneHandle body = g_VirtualScene.find("corpo");
+    if ( g_VirtualScene.isLoaded(body) )
+    {
+        glm::vec3 size = g_VirtualScene.get(body).bbox_max - g_VirtualScene.get(body).bbox_min;
+        spacing = 1.5f * scale * std::max(size.x, std::max(size.y, size.z));
+    }
+
+    std::vector<glm::mat4> models;
+    for (size_t i = 0; i < num_cars; ++i)
+    {
+        float x = ((float)(i % 4) - 1.5f) * spacing;
+        float z = (float)(i / 4 + 1) * spacing;
+        models.push_back(Matrix_Translate(x, 0.0f, z) * Matrix_Scale(scale, scale, scale));
+    }
+    return models;
+}
+
+// Desenha todas as partes de cada carro em "car_models". No modo instanciado
+// cada parte é desenhada uma única vez para todos os carros; caso contrário,
+// cada parte de cada carro é uma chamada de desenho (como era feito antes,
+// mantido para comparação no benchmark).
+void DrawCars(const std::vector<glm::mat4>& car_models, bool instanced)
+{
+    //TODO : fazer roda rodar em torno do vetor ortogonal ao fowards do carro
+    if ( instanced )
+    {
+        // Cada parte de cada carro é testada contra o frustum, e somente as
+        // cópias visíveis vão para o buffer de instâncias
+        size_t first_box = g_Culler.getNumBoxes();
+        for (size_t car = 0; car < car_models.size(); ++car)
+        {
+            for (size_t part = 0; part < g_CarParts.size(); ++part)
+            {
+                SceneHandle handle = g_CarParts[part].handle;
+                if ( g_VirtualScene.isLoaded(handle) )
+                    g_Culler.add(car_models[car], g_VirtualScene.get(handle).bbox_min, g_VirtualScene.get(handle).bbox_max);
+            }
+        }
+        g_Culler.cull(first_box);
+
+        g_Instances.clear();
+        size_t box = first_box;
+        for (size_t car = 0; car < car_models.size(); ++car)
+        {
+            for (size_t part = 0; part < g_CarParts.size(); ++part)
+            {
+                if ( !g_VirtualScene.isLoaded(g_CarParts[part].handle) || !g_Culler.isVisible(box++) )
+                    continue;
+                g_Instances.add(g_CarParts[part].handle, car_models[car], g_CarParts[part].object_id);
+            }
+        }
+        g_Instances.upload();
+
+        for (size_t batch = 0; batch < g_Instances.getNumBatches(); ++batch)
+            DrawVirtualObjectInstanced(batch);
+        return;
+    }
+
+    for (size_t car = 0; car < car_models.size(); ++car)
+    {
+        for (size_t part = 0; part < g_CarParts.size(); ++part)
+            DrawVirtualObject(g_CarParts[part].handle, car_models[car], g_CarParts[part].object_id);
+    }
+}
+
+// Mede o tempo de CPU gasto para submeter o desenho de N carros (de 1 até
+// "max_cars", dobrando a cada passo), com uma chamada de desenho por parte
+// de cada carro e com o desenho instanciado. O tempo medido inclui somente
+// DrawCars() e FlushDrawList(); a GPU é sincronizada com glFinish() fora
+// da medição, entre os quadros.
+void BenchmarkCarRendering(size_t max_cars)
+{
+    typedef std::chrono::steady_clock clock;
+    const int warmup_frames = 5;
+    const int frames = 50;
+
+    glUseProgram(g_GpuProgramID);
+    glm::mat4 view = Matrix_Camera_View(glm::vec4(0.0f, 20.0f, -20.0f, 1.0f), glm::vec4(0.0f, -1.0f, 1.0f, 0.0f), glm::vec4(0.0f, 1.0f, 0.0f, 0.0f));
+    PerFrameUniforms frame_uniforms;
+    frame_uniforms.view            = view;
+    frame_uniforms.projection      = Matrix_Perspective(3.141592f / 3.0f, g_ScreenRatio, -0.1f, -500.0f);
+    frame_uniforms.camera_position = glm::inverse(view) * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+    frame_uniforms.light_direction = normalize(glm::vec4(1.0f, 1.0f, 0.0f, 0.0f));
+
+    size_t num_parts = 0;
+    for (size_t part = 0; part < g_CarParts.size(); ++part)
+        num_parts += g_VirtualScene.isLoaded(g_CarParts[part].handle) ? 1 : 0;
+
+    printf("Benchmark de desenho de carros (%lu partes por carro, %d quadros por medição)\n",
+           (unsigned long)num_parts, frames);
+    printf("%8s  %22s  %22s\n", "carros", "um desenho por parte", "instanciado");
+    for (size_t num_cars = 1; num_cars <= max_cars; num_cars *= 2)
+    {
+        std::vector<glm::mat4> car_models = CreateCarGrid(num_cars);
+
+        double ms[2];
+        for (int instanced = 0; instanced < 2; ++instanced)
+        {
+            double total_ms = 0.0;
+            for (int frame = 0; frame < warmup_frames + frames; ++frame)
+            {
+                glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+                clock::time_point start = clock::now();
+                g_Culler.beginFrame(frame_uniforms.projection * frame_uniforms.view);
+                DrawCars(car_models, instanced != 0);
+                FlushDrawList(frame_uniforms);
+                double elapsed = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+
+                glFinish();
+                if ( frame >= warmup_frames )
+                    total_ms += elapsed;
+            }
+            ms[instanced] = total_ms / frames;
+        }
+
+        printf("%8lu  %9.3f ms (%5lu draws)  %9.3f ms (%5lu draws)\n",
+               (unsigned long)num_cars, ms[0], (unsigned long)(num_cars * num_parts), ms[1], (unsigned long)num_parts);
+    }
+}
+
+// Caixa de colisão dos karts (veja "carcollision.h"): bounding box de todos
+// os vértices do modelo do carro, na escala de desenho de DrawCars(). Sem o
+// arquivo, usa uma caixa de 2 x 3.2 unidades, próxima à do modelo.
+CarCollisionShape LoadCarCollisionShape(const char* filename)
+{
+    FileInfo info;
+    if ( !GetFileInfo(filename, &info) )
+    {
+        fprintf(stderr, "Modelo \"%s\" não encontrado; usando uma caixa padrão.\n", filename);
+        CarCollisionShape shape = { 0.0f, 0.0f, 1.0f, 1.6f };
+        return shape;
+    }
+
+    ObjModel model(filename);
+    const std::vector<tinyobj::real_t>& vertices = model.attrib.vertices;
+    const float maxval = std::numeric_limits<float>::max();
+    glm::vec3 bbox_min = glm::vec3(maxval, maxval, maxval);
+    glm::vec3 bbox_max = glm::vec3(-maxval, -maxval, -maxval);
+    for (size_t v = 0; v + 2 < vertices.size(); v += 3)
+    {
+        for (int k = 0; k < 3; ++k)
+        {
+            bbox_min[k] = std::min(bbox_min[k], (float)vertices[v+k]);
+            bbox_max[k] = std::max(bbox_max[k], (float)vertices[v+k]);
+        }
+    }
+    return CarCollision_ShapeFromBox(bbox_min, bbox_max, 0.03f);
+}
+
+// Lê um mapa de alturas de uma imagem em tons de cinza (8 ou 16 bits),
+// esticada sobre a extensão da pista em X e Z: a coluna da imagem é o X e a
+// linha é o Z. O preto fica na altura mais baixa da pista e o branco
+// HEIGHTFIELD_IMAGE_MAX_HEIGHT acima dela. As células são quadradas: no eixo
+// em que a imagem tem menos pixels por unidade, ela cobre um pouco mais que
+// a pista.
+bool LoadHeightfieldImage(const char* filename, const BVH& track, Heightfield* field)
+{
+    int width, depth, channels;
+    stbi_us* pixels = stbi_load_16(filename, &width, &depth, &channels, 1);
+    if ( pixels == NULL )
+    {
+        fprintf(stderr, "ERROR: Cannot open image file \"%s\".\n", filename);
+        return false;
+    }
+    if ( width < 2 || depth < 2 || track.isEmpty() )
+    {
+        fprintf(stderr, "ERROR: Mapa de alturas \"%s\" precisa de ao menos 2x2 pixels e de uma pista.\n", filename);
+        stbi_image_free(pixels);
+        return false;
+    }
+
+    glm::vec3 bbox_min, bbox_max;
+    track.getBounds(&bbox_min, &bbox_max);
+    float cell_size = std::max((bbox_max.x - bbox_min.x) / (width - 1), (bbox_max.z - bbox_min.z) / (depth - 1));
+    if ( !(cell_size > 0.0f) )
+        cell_size = 1.0f;
+
+    std::vector<float> heights((size_t)width * depth);
+    for (size_t k = 0; k < heights.size(); ++k)
+        heights[k] = bbox_min.y + HEIGHTFIELD_IMAGE_MAX_HEIGHT * (pixels[k] / 65535.0f);
+    stbi_image_free(pixels);
+
+    field->setHeights(width, depth, bbox_min.x, bbox_min.z, cell_size, heights.data());
+    return true;
+}
+
+// Tempo por carro de um passo de CarPool com "num_cars" carros espalhados
+// por um terreno ondulado, sem e com followGround() depois do passo
+void BenchmarkGroundFollowing(size_t num_cars, int steps)
+{
+    typedef std::chrono::steady_clock clock;
+    const float dt = 1.0f / 240.0f;
+
+    const size_t size = 1024;
+    std::vector<float> heights(size * size);
+    for (size_t j = 0; j < size; ++j)
+        for (size_t i = 0; i < size; ++i)
+            heights[j*size + i] = 3.0f * sinf(0.05f * i) * cosf(0.037f * j);
+    Heightfield ground;
+    ground.setHeights(size, size, 0.0f, 0.0f, HEIGHTFIELD_CELL_SIZE, heights.data());
+    float extent = (size - 1) * HEIGHTFIELD_CELL_SIZE;
+
+    printf("Benchmark de CarPool sobre o mapa de alturas: %lu carros, %d passos (%s)\n",
+           (unsigned long)num_cars, steps, Heightfield_BackendName(ground.getBackend()));
+    for (int follow = 0; follow < 2; ++follow)
+    {
+        CarPool pool;
+        srand(42);
+        for (size_t car = 0; car < num_cars; ++car)
+        {
+            pool.add(extent * (rand() / (float)RAND_MAX), extent * (rand() / (float)RAND_MAX), (rand() % 628) / 100.0f);
+            pool.setControls(car, rand() % 2 == 0, rand() % 8 == 0, (float)(rand() % 3 - 1));
+        }
+
+        clock::time_point start = clock::now();
+        for (int i = 0; i < steps; ++i)
+        {
+            pool.step(dt);
+            if ( follow )
+                pool.followGround(ground);
+        }
+        double ns = std::chrono::duration<double, std::nano>(clock::now() - start).count();
+        printf("  %-22s %8.2f ns/carro\n", follow ? "passo + followGround()" : "passo", ns / ((double)steps * num_cars));
+
+        // A consulta em lote deve dar o mesmo resultado que uma a uma
+        if ( follow )
+        {
+            size_t different = 0;
+            for (size_t car = 0; car < num_cars; ++car)
+            {
+                glm::vec4 p = pool.getPosition(car);
+                float height;
+                glm::vec3 normal;
+                ground.sample(p.x, p.z, &height, &normal);
+                if ( height != p.y || normal != pool.getGroundNormal(car) )
+                    different++;
+            }
+            printf("  %lu carros com altura diferente de Heightfield::sample()\n", (unsigned long)different);
+        }
+    }
+}
+
+// Simula "num_cars" carros com a classe Car, com as regras de derrapagem e
+// com o modelo de pneus, com as mesmas teclas aleatórias trocadas a cada
+// segundo, e imprime o tempo por passo de cada carro e a fração dos passos
+// em que os carros estão derrapando.
+void BenchmarkCarTyres(size_t num_cars, int steps)
+{
+    typedef std::chrono::steady_clock clock;
+    const float dt = 1.0f / 240.0f;
+
+    TyreModel tyres;
+    printf("Benchmark de Car com o modelo de pneus: %lu carros, %d passos\n", (unsigned long)num_cars, steps);
+    for (int use_tyres = 0; use_tyres < 2; ++use_tyres)
+    {
+        std::vector<Car> cars(num_cars);
+        for (size_t car = 0; car < num_cars; ++car)
+            cars[car].setTyreModel(use_tyres ? &tyres : NULL);
+
+        srand(42);
+        std::vector<uint8_t> controls(num_cars);
+        size_t sliding = 0;
+        double ns = 0.0;
+        for (int i = 0; i < steps; ++i)
+        {
+            // Teclas sorteadas a cada segundo e mantidas a cada passo, como
+            // em updateFromKeyboard(), fora da medição
+            for (size_t car = 0; car < num_cars; ++car)
+            {
+                if ( i % 240 == 0 )
+                    controls[car] = (rand() % 4 != 0 ? INPUT_ACCELERATE : 0) | (rand() % 8 == 0 ? INPUT_BRAKE : 0)
+                                  | (rand() % 2 == 0 ? (rand() % 2 == 0 ? INPUT_LEFT : INPUT_RIGHT) : 0);
+                uint8_t input = controls[car];
+                cars[car].applyControls((input & INPUT_ACCELERATE) != 0, (input & INPUT_BRAKE) != 0, (input & INPUT_LEFT) != 0,
+                                        (input & INPUT_RIGHT) != 0, false, dt);
+            }
+
+            clock::time_point start = clock::now();
+            for (size_t car = 0; car < num_cars; ++car)
+                cars[car].update(dt);
+            ns += std::chrono::duration<double, std::nano>(clock::now() - start).count();
+
+            for (size_t car = 0; car < num_cars; ++car)
+                sliding += cars[car].getIsSliding() ? 1 : 0;
+        }
+        printf("  %-18s %8.2f ns/carro, derrapando em %5.1f%% dos passos\n", use_tyres ? "modelo de pneus" : "regras",
+               ns / ((double)steps * num_cars), 100.0 * sliding / ((double)steps * num_cars));
+    }
+}
+
+// Simula "num_cars" carros com a classe Car e com CarPool (com cada uma das
+// implementações), com os mesmos controles aleatórios trocados a cada
+// segundo, e imprime a maior diferença de posição e de rotação entre eles.
+void ValidateCarPool(size_t num_cars, int steps)
+{
+    const float dt = 1.0f / 240.0f;
+
+    std::vector<Car> cars(num_cars);
+    CarPool pools[2];
+    for (size_t car = 0; car < num_cars; ++car)
+    {
+        // Car começa com forwardsVector = (1,0,0); um passo de duração zero
+        // o alinha com a rotação, como em CarPool::add()
+        cars[car].update(0.0f);
+        pools[0].add(0.0f, 0.0f, 0.0f);
+        pools[1].add(0.0f, 0.0f, 0.0f);
+    }
+
+    srand(7);
+    std::vector<float> steer(num_cars);
+    for (int i = 0; i < steps; ++i)
+    {
+        if ( i % 240 == 0 )
+        {
+            for (size_t car = 0; car < num_cars; ++car)
+            {
+                bool accelerate = rand() % 3 != 0;
+                bool brake = !accelerate && rand() % 4 == 0;
+                steer[car] = (float)(rand() % 3 - 1);
+                cars[car].setAccelerate(accelerate);
+                cars[car].setBrake(brake);
+                pools[0].setControls(car, accelerate, brake, steer[car]);
+                pools[1].setControls(car, accelerate, brake, steer[car]);
+            }
+        }
+
+        for (size_t car = 0; car < num_cars; ++car)
+        {
+            if ( steer[car] > 0.0f )
+                cars[car].turnLeft(dt);
+            else if ( steer[car] < 0.0f )
+                cars[car].turnRight(dt);
+            cars[car].update(dt);
+        }
+        pools[0].step(dt, CARPOOL_SCALAR);
+        pools[1].step(dt, CarPool_BestBackend());
+    }
+
+    printf("Validação de CarPool contra Car: %lu carros, %d passos\n", (unsigned long)num_cars, steps);
+    for (int b = 0; b < 2; ++b)
+    {
+        float max_position = 0.0f;
+        float max_yaw = 0.0f;
+        for (size_t car = 0; car < num_cars; ++car)
+        {
+            max_position = std::max(max_position, norm(cars[car].getPosition() - pools[b].getPosition(car)));
+            max_yaw = std::max(max_yaw, std::fabs(cars[car].getRotation().y - pools[b].getYaw(car)));
+        }
+        printf("  %-8s posição: %.6f  rotação: %.6f\n",
+               CarPool_BackendName(b == 0 ? CARPOOL_SCALAR : CarPool_BestBackend()), max_position, max_yaw);
+    }
+}
+
+// Mede o tempo dos trabalhos distribuídos pelo sistema de trabalhos (veja
+// "threadpool.h") com 1, 2, ..., N threads: um passo de CarPool com 100 mil
+// carros, o culling de 1 milhão de caixas, ComputeNormals() na malha
+// sintética e a decodificação de 8 imagens de textura. Imprime o melhor
+// tempo de "repetitions" execuções e o ganho em relação a uma thread.
+void BenchmarkJobScaling(int repetitions)
+{
+    typedef std::chrono::steady_clock clock;
+
+    if ( repetitions < 1 )
+        repetitions = 1;
+
+    const size_t num_cars = 100000;
+    CarPool pool;
+    srand(42);
+    for (size_t car = 0; car < num_cars; ++car)
+    {
+        pool.add((float)(car % 300) * 4.0f, (float)(car / 300) * 6.0f, (rand() % 628) / 100.0f);
+        pool.setControls(car, rand() % 2 == 0, rand() % 8 == 0, (float)(rand() % 3 - 1));
+    }
+
+    const size_t num_boxes = 1000000;
+    glm::mat4 projection = Matrix_Perspective(3.141592f / 3.0f, 16.0f / 9.0f, -0.1f, -500.0f);
+    glm::mat4 view = Matrix_Camera_View(glm::vec4(0.0f, 2.0f, 0.0f, 1.0f), glm::vec4(1.0f, 0.0f, 1.0f, 0.0f), glm::vec4(0.0f, 1.0f, 0.0f, 0.0f));
+    BoxCuller culler;
+    culler.beginFrame(projection * view);
+    for (size_t i = 0; i < num_boxes; ++i)
+    {
+        glm::mat4 model = Matrix_Translate(rand() % 2000 - 1000.0f, 0.0f, rand() % 2000 - 1000.0f)
+                        * Matrix_Rotate_Y((rand() % 628) / 100.0f);
+        culler.add(model, glm::vec3(-1.0f, 0.0f, -2.0f), glm::vec3(1.0f, 1.5f, 2.0f));
     }
 
-    printf("OK (%dx%d).\n", width, height);
+    ObjModel normals_model = CreateSmoothingGroupsObjModel(128, 4);
 
-    // Agora criamos objetos na GPU com OpenGL para armazenar a textura
-    GLuint texture_id;
-    GLuint sampler_id;
-    glGenTextures(1, &texture_id);
-    glGenSamplers(1, &sampler_id);
+    // Somente imagens que existem (as faces do céu são opcionais)
+    std::vector<std::string> image_files;
+    const char* candidates[] = { "../../data/track.jpg", "../../data/car_texture.jpg" };
+    for (size_t i = 0; i < 2; ++i)
+        if ( std::ifstream(candidates[i]).good() )
+            image_files.push_back(candidates[i]);
 
-    // Veja slides 95-96 do documento Aula_20_Mapeamento_de_Texturas.pdf
-    glSamplerParameteri(sampler_id, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glSamplerParameteri(sampler_id, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    unsigned int max_threads = ThreadPool_NumThreads();
+    printf("Benchmark de escalabilidade do sistema de trabalhos: %d repetições, 1 a %u threads\n", repetitions, max_threads);
+    printf("  %-7s  %-18s  %-18s  %-18s  %-18s\n", "threads", "carpool", "culling", "normais", "texturas");
 
-    // Parâmetros de amostragem da textura.
-    glSamplerParameteri(sampler_id, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glSamplerParameteri(sampler_id, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    double base_ms[4] = { 0.0, 0.0, 0.0, 0.0 };
+    for (unsigned int threads = 1; threads <= max_threads; ++threads)
+    {
+        ThreadPool_SetMaxThreads(threads);
 
-    // Agora enviamos a imagem lida do disco para a GPU
-    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
-    glPixelStorei(GL_UNPACK_SKIP_PIXELS, 0);
-    glPixelStorei(GL_UNPACK_SKIP_ROWS, 0);
+        double best_ms[4] = { 1e30, 1e30, 1e30, 1e30 };
+        for (int r = 0; r < repetitions; ++r)
+        {
+            clock::time_point start = clock::now();
+            pool.step(1.0f / 240.0f);
+            best_ms[0] = std::min(best_ms[0], std::chrono::duration<double, std::milli>(clock::now() - start).count());
 
-    GLuint textureunit = g_NumLoadedTextures;
-    glActiveTexture(GL_TEXTURE0 + textureunit);
-    glBindTexture(GL_TEXTURE_2D, texture_id);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_SRGB8, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-    glGenerateMipmap(GL_TEXTURE_2D);
-    glBindSampler(textureunit, sampler_id);
+            start = clock::now();
+            culler.cull(0);
+            best_ms[1] = std::min(best_ms[1], std::chrono::duration<double, std::milli>(clock::now() - start).count());
 
-    stbi_image_free(data);
+            ObjModel model = normals_model;
+            start = clock::now();
+            ComputeNormals(&model);
+            best_ms[2] = std::min(best_ms[2], std::chrono::duration<double, std::milli>(clock::now() - start).count());
 
-    g_NumLoadedTextures ++;
-}
+            if ( !image_files.empty() )
+            {
+                DecodedImage images[8];
+                JobCounter decoded;
+                start = clock::now();
+                for (size_t i = 0; i < 8; ++i)
+                {
+                    images[i].filename = image_files[i % image_files.size()];
+                    images[i].flip = true;
+                    images[i].pixels = NULL;
+                    ThreadPool_Submit([&images, i]() { DecodeImage(&images[i]); }, &decoded);
+                }
+                ThreadPool_Wait(&decoded);
+                best_ms[3] = std::min(best_ms[3], std::chrono::duration<double, std::milli>(clock::now() - start).count());
+                for (size_t i = 0; i < 8; ++i)
+                    stbi_image_free(images[i].pixels);
+            }
+        }
 
-// Função que desenha um objeto armazenado em g_VirtualScene. Veja definição
-// dos objetos na função BuildTrianglesAndAddToVirtualScene().
-void DrawVirtualObject(const char* object_name)
-{
-    // "Ligamos" o VAO. Informamos que queremos utilizar os atributos de
-    // vértices apontados pelo VAO criado pela função BuildTrianglesAndAddToVirtualScene(). Veja
-    // comentários detalhados dentro da definição de BuildTrianglesAndAddToVirtualScene().
-    glBindVertexArray(g_VirtualScene[object_name].vertex_array_object_id);
-
-    // Setamos as variáveis "bbox_min" e "bbox_max" do fragment shader
-    // com os parâmetros da axis-aligned bounding box (AABB) do modelo.
-    glm::vec3 bbox_min = g_VirtualScene[object_name].bbox_min;
-    glm::vec3 bbox_max = g_VirtualScene[object_name].bbox_max;
-    glUniform4f(g_bbox_min_uniform, bbox_min.x, bbox_min.y, bbox_min.z, 1.0f);
-    glUniform4f(g_bbox_max_uniform, bbox_max.x, bbox_max.y, bbox_max.z, 1.0f);
-
-    // Pedimos para a GPU rasterizar os vértices dos eixos XYZ
-    // apontados pelo VAO como linhas. Veja a definição de
-    // g_VirtualScene[""] dentro da função BuildTrianglesAndAddToVirtualScene(), e veja
-    // a documentação da função glDrawElements() em
-    // http://docs.gl/gl3/glDrawElements.
-    glDrawElements(
-        g_VirtualScene[object_name].rendering_mode,
-        g_VirtualScene[object_name].num_indices,
-        GL_UNSIGNED_INT,
-        (void*)(g_VirtualScene[object_name].first_index * sizeof(GLuint))
-    );
+        printf("  %7u", threads);
+        for (int test = 0; test < 4; ++test)
+        {
+            if ( test == 3 && image_files.empty() )
+            {
+                printf("  %-18s", "-");
+                continue;
+            }
+            if ( threads == 1 )
+                base_ms[test] = best_ms[test];
+            printf("  %8.2f ms %5.2fx", best_ms[test], base_ms[test] / best_ms[test]);
+        }
+        printf("\n");
+    }
 
-    // "Desligamos" o VAO, evitando assim que operações posteriores venham a
-    // alterar o mesmo. Isso evita bugs.
-    glBindVertexArray(0);
+    ThreadPool_SetMaxThreads(0);
 }
 
 // Função que carrega os shaders de vértices e de fragmentos que serão
@@ -743,20 +1969,17 @@ void LoadShadersFromFiles()
     // Criamos um programa de GPU utilizando os shaders carregados acima.
     g_GpuProgramID = CreateGpuProgram(vertex_shader_id, fragment_shader_id);
 
-    // Buscamos o endereço das variáveis definidas dentro do Vertex Shader.
-    // Utilizaremos estas variáveis para enviar dados para a placa de vídeo
-    // (GPU)! Veja arquivo "shader_vertex.glsl" e "shader_fragment.glsl".
-    g_model_uniform      = glGetUniformLocation(g_GpuProgramID, "model"); // Variável da matriz "model"
-    g_view_uniform       = glGetUniformLocation(g_GpuProgramID, "view"); // Variável da matriz "view" em shader_vertex.glsl
-    g_projection_uniform = glGetUniformLocation(g_GpuProgramID, "projection"); // Variável da matriz "projection" em shader_vertex.glsl
-    g_object_id_uniform  = glGetUniformLocation(g_GpuProgramID, "object_id"); // Variável "object_id" em shader_fragment.glsl
-    g_bbox_min_uniform   = glGetUniformLocation(g_GpuProgramID, "bbox_min");
-    g_bbox_max_uniform   = glGetUniformLocation(g_GpuProgramID, "bbox_max");
+    // Associamos os blocos de constantes ("uniform blocks") definidos em
+    // "shader_vertex.glsl" e "shader_fragment.glsl" aos pontos de ligação
+    // usados em FlushDrawList(). Veja "uniformbuffers.h".
+    glUniformBlockBinding(g_GpuProgramID, glGetUniformBlockIndex(g_GpuProgramID, "PerFrame"), UNIFORM_BINDING_PER_FRAME);
+    glUniformBlockBinding(g_GpuProgramID, glGetUniformBlockIndex(g_GpuProgramID, "PerDraw"), UNIFORM_BINDING_PER_DRAW);
 
     // Variáveis em "shader_fragment.glsl" para acesso das imagens de textura
     glUseProgram(g_GpuProgramID);
     glUniform1i(glGetUniformLocation(g_GpuProgramID, "TextureImage0"), 0);
     glUniform1i(glGetUniformLocation(g_GpuProgramID, "TextureImage1"), 1);
+    glUniform1i(glGetUniformLocation(g_GpuProgramID, "SkyboxCube"), 3);
     glUseProgram(0);
 }
 
@@ -783,6 +2006,267 @@ void PopMatrix(glm::mat4& M)
 // Função que computa as normais de um ObjModel, caso elas não tenham sido
 // especificadas dentro do arquivo ".obj"
 void ComputeNormals(ObjModel* model)
+{
+    if ( !model->attrib.normals.empty() )
+        return;
+
+    // Primeiro computamos as normais para todos os TRIÂNGULOS.
+    // Segundo, computamos as normais dos VÉRTICES através do método proposto
+    // por Gouraud, onde a normal de cada vértice vai ser a média das normais de
+    // todas as faces que compartilham este vértice e que pertencem ao mesmo "smoothing group".
+    //
+    // Cada vértice de cada triângulo (um "canto") recebe a chave (smoothing
+    // group, índice do vértice). Ordenando os cantos por esta chave, os cantos
+    // que compartilham uma normal ficam contíguos, e cada sequência de chaves
+    // iguais vira uma normal. A ordem das chaves é exatamente a ordem em que
+    // ComputeNormalsReference() cria as normais, e como a ordenação é estável
+    // as somas são feitas na mesma ordem: o resultado é idêntico, bit a bit,
+    // ao da implementação original, mas com um único passo sobre a malha em
+    // vez de um passo por smoothing group.
+
+    // Índice do primeiro triângulo de cada shape
+    std::vector<size_t> first_triangle(model->shapes.size() + 1, 0);
+    for (size_t shape = 0; shape < model->shapes.size(); ++shape)
+    {
+        assert(model->shapes[shape].mesh.smoothing_group_ids.size() == model->shapes[shape].mesh.num_face_vertices.size());
+        first_triangle[shape+1] = first_triangle[shape] + model->shapes[shape].mesh.num_face_vertices.size();
+    }
+
+    const size_t num_triangles = first_triangle.back();
+    const size_t num_corners = 3*num_triangles;
+    const size_t num_vertices = model->attrib.vertices.size() / 3;
+
+    // Lista ordenada dos smoothing groups que existem no objeto. A chave de
+    // cada canto usa a posição do smoothing group nesta lista, de forma que
+    // ela tenha o menor número possível de bits.
+    std::vector<unsigned int> sgroup_ids;
+    for (size_t shape = 0; shape < model->shapes.size(); ++shape)
+    {
+        const std::vector<unsigned int>& ids = model->shapes[shape].mesh.smoothing_group_ids;
+        for (size_t triangle = 0; triangle < ids.size(); ++triangle)
+            if ( sgroup_ids.empty() || sgroup_ids.back() != ids[triangle] )
+                sgroup_ids.push_back(ids[triangle]);
+    }
+    std::sort(sgroup_ids.begin(), sgroup_ids.end());
+    sgroup_ids.erase(std::unique(sgroup_ids.begin(), sgroup_ids.end()), sgroup_ids.end());
+
+    unsigned int vertex_bits = 0;
+    while ( vertex_bits < 32 && ((uint64_t)1 << vertex_bits) < num_vertices )
+        vertex_bits++;
+    unsigned int key_bits = vertex_bits;
+    while ( key_bits < 64 && ((uint64_t)1 << (key_bits - vertex_bits)) < sgroup_ids.size() )
+        key_bits++;
+
+    // Bits do smoothing group na chave dos cantos de um triângulo (a posição
+    // do smoothing group em "sgroup_ids", acima dos bits do vértice)
+    const bool single_sgroup = (sgroup_ids.size() == 1);
+    auto sgroup_key = [&sgroup_ids, single_sgroup, vertex_bits](const tinyobj::mesh_t& mesh, size_t triangle) -> uint64_t {
+        assert(mesh.num_face_vertices[triangle] == 3);
+        if ( single_sgroup )
+            return 0;
+        uint64_t sgroup = std::lower_bound(sgroup_ids.begin(), sgroup_ids.end(), mesh.smoothing_group_ids[triangle]) - sgroup_ids.begin();
+        return sgroup << vertex_bits;
+    };
+
+    // Normal (não normalizada) de um triângulo
+    const float* positions = model->attrib.vertices.data();
+    auto triangle_normal = [positions](const tinyobj::mesh_t& mesh, size_t triangle) -> glm::vec4 {
+        glm::vec4  vertices[3];
+        for (size_t vertex = 0; vertex < 3; ++vertex)
+        {
+            const float* v = &positions[3*mesh.indices[3*triangle + vertex].vertex_index];
+            vertices[vertex] = glm::vec4(v[0],v[1],v[2],1.0);
+        }
+
+        const glm::vec4  a = vertices[0];
+        const glm::vec4  b = vertices[1];
+        const glm::vec4  c = vertices[2];
+
+        return crossproduct(b-a,c-a);
+    };
+
+    // Média das normais acumuladas em uma chave
+    auto store_normal = [&](size_t normal_index, const glm::vec4& sum, size_t count) {
+        glm::vec4 n = sum / (float)count;
+        n /= norm(n);
+
+        model->attrib.normals[3*normal_index + 0] = n.x;
+        model->attrib.normals[3*normal_index + 1] = n.y;
+        model->attrib.normals[3*normal_index + 2] = n.z;
+    };
+
+    const uint64_t num_keys = ((uint64_t)(sgroup_ids.size() - 1) << vertex_bits) + num_vertices;
+    if ( num_keys <= 2*num_corners )
+    {
+        // Poucas chaves possíveis (caso comum: um ou poucos smoothing
+        // groups): acumulamos diretamente em uma tabela indexada pela chave,
+        // sem vetores por canto. Cada thread fica com um intervalo de chaves
+        // e percorre os triângulos na ordem em que aparecem na malha, somando
+        // somente os cantos do seu intervalo; assim cada soma é feita na
+        // mesma ordem que na implementação original.
+        std::vector<glm::vec4> sums((size_t)num_keys, glm::vec4(0.0f,0.0f,0.0f,0.0f));
+        std::vector<uint32_t> counts((size_t)num_keys, 0);
+
+        const size_t num_parts = std::min((size_t)ThreadPool_NumThreads(), (size_t)(num_keys / 4096) + 1);
+        ParallelFor(num_parts, 1, [&](size_t begin, size_t end) {
+            const uint64_t first_key = num_keys * begin / num_parts;
+            const uint64_t part_keys = num_keys * end / num_parts - first_key;
+            glm::vec4* const key_sums = sums.data();
+            uint32_t* const key_counts = counts.data();
+
+            for (size_t shape = 0; shape < model->shapes.size(); ++shape)
+            {
+                const tinyobj::mesh_t& mesh = model->shapes[shape].mesh;
+
+                for (size_t triangle = 0; triangle < mesh.num_face_vertices.size(); ++triangle)
+                {
+                    const uint64_t sgroup = sgroup_key(mesh, triangle);
+
+                    uint64_t corner_keys[3];
+                    bool in_range[3];
+                    for (size_t vertex = 0; vertex < 3; ++vertex)
+                    {
+                        corner_keys[vertex] = sgroup | (uint64_t)mesh.indices[3*triangle + vertex].vertex_index;
+                        in_range[vertex] = corner_keys[vertex] - first_key < part_keys;
+                    }
+                    if ( !in_range[0] && !in_range[1] && !in_range[2] )
+                        continue;
+
+                    const glm::vec4  n = triangle_normal(mesh, triangle);
+                    for (size_t vertex = 0; vertex < 3; ++vertex)
+                    {
+                        if ( !in_range[vertex] )
+                            continue;
+                        key_sums[corner_keys[vertex]] += n;
+                        key_counts[corner_keys[vertex]] += 1;
+                    }
+                }
+            }
+        });
+
+        std::vector<int> normal_of_key((size_t)num_keys, -1);
+        size_t num_normals = 0;
+        for (size_t key = 0; key < num_keys; ++key)
+            if ( counts[key] > 0 )
+                normal_of_key[key] = (int)num_normals++;
+
+        // Computamos a média das normais acumuladas e escrevemos os índices
+        // das normais para os vértices dos triângulos, em paralelo
+        model->attrib.normals.resize(3*num_normals);
+        ParallelFor((size_t)num_keys, 4096, [&](size_t begin, size_t end) {
+            for (size_t key = begin; key < end; ++key)
+                if ( counts[key] > 0 )
+                    store_normal(normal_of_key[key], sums[key], counts[key]);
+        });
+        for (size_t shape = 0; shape < model->shapes.size(); ++shape)
+        {
+            tinyobj::mesh_t& mesh = model->shapes[shape].mesh;
+
+            ParallelFor(mesh.num_face_vertices.size(), 4096, [&](size_t begin, size_t end) {
+                for (size_t triangle = begin; triangle < end; ++triangle)
+                {
+                    const uint64_t sgroup = sgroup_key(mesh, triangle);
+                    for (size_t vertex = 0; vertex < 3; ++vertex)
+                    {
+                        tinyobj::index_t& idx = mesh.indices[3*triangle + vertex];
+                        idx.normal_index = normal_of_key[sgroup | (uint64_t)idx.vertex_index];
+                    }
+                }
+            });
+        }
+        return;
+    }
+
+    // Normais dos triângulos e chaves dos cantos, em paralelo
+    std::vector<glm::vec4> triangle_normals(num_triangles);
+    std::vector<tinyobj::index_t*> corner_indices(num_corners);
+    std::vector<uint64_t> keys(num_corners);
+    for (size_t shape = 0; shape < model->shapes.size(); ++shape)
+    {
+        tinyobj::mesh_t& mesh = model->shapes[shape].mesh;
+        const size_t base = first_triangle[shape];
+
+        ParallelFor(mesh.num_face_vertices.size(), 4096, [&](size_t begin, size_t end) {
+            for (size_t triangle = begin; triangle < end; ++triangle)
+            {
+                const uint64_t sgroup = sgroup_key(mesh, triangle);
+                for (size_t vertex = 0; vertex < 3; ++vertex)
+                {
+                    tinyobj::index_t& idx = mesh.indices[3*triangle + vertex];
+                    size_t corner = 3*(base + triangle) + vertex;
+                    keys[corner] = sgroup | (uint64_t)idx.vertex_index;
+                    corner_indices[corner] = &idx;
+                }
+                triangle_normals[base + triangle] = triangle_normal(mesh, triangle);
+            }
+        });
+    }
+
+    // Muitas chaves possíveis: ordenação estável dos cantos pela chave (radix
+    // sort LSD, 11 bits por passo). Cantos com a mesma chave permanecem na
+    // ordem em que aparecem na malha.
+    const unsigned int digit_bits = 11;
+    std::vector<uint64_t> sorted_keys(keys);
+    std::vector<uint32_t> sorted(num_corners);
+    {
+        std::vector<uint64_t> temp_keys(num_corners);
+        std::vector<uint32_t> temp(num_corners);
+
+        for (size_t corner = 0; corner < num_corners; ++corner)
+            sorted[corner] = (uint32_t)corner;
+
+        for (unsigned int shift = 0; shift < key_bits; shift += digit_bits)
+        {
+            size_t offsets[(1 << digit_bits) + 1] = { 0 };
+            for (size_t i = 0; i < num_corners; ++i)
+                offsets[((sorted_keys[i] >> shift) & ((1 << digit_bits) - 1)) + 1]++;
+            for (size_t digit = 1; digit <= (1 << digit_bits); ++digit)
+                offsets[digit] += offsets[digit-1];
+            for (size_t i = 0; i < num_corners; ++i)
+            {
+                size_t position = offsets[(sorted_keys[i] >> shift) & ((1 << digit_bits) - 1)]++;
+                temp_keys[position] = sorted_keys[i];
+                temp[position] = sorted[i];
+            }
+            sorted_keys.swap(temp_keys);
+            sorted.swap(temp);
+        }
+    }
+
+    // Início de cada sequência de cantos com a mesma chave; a i-ésima
+    // sequência corresponde à i-ésima normal.
+    std::vector<size_t> first_of_normal;
+    first_of_normal.reserve(num_vertices + 1);
+    for (size_t i = 0; i < num_corners; ++i)
+        if ( i == 0 || sorted_keys[i] != sorted_keys[i-1] )
+            first_of_normal.push_back(i);
+    const size_t num_normals = first_of_normal.size();
+    first_of_normal.push_back(num_corners);
+
+    // Computamos a média das normais acumuladas e escrevemos os índices das
+    // normais para os vértices dos triângulos, em paralelo
+    model->attrib.normals.resize(3*num_normals);
+    ParallelFor(num_normals, 1024, [&](size_t begin, size_t end) {
+        for (size_t normal_index = begin; normal_index < end; ++normal_index)
+        {
+            const size_t first = first_of_normal[normal_index];
+            const size_t last  = first_of_normal[normal_index + 1];
+
+            glm::vec4 sum = glm::vec4(0.0f,0.0f,0.0f,0.0f);
+            for (size_t i = first; i < last; ++i)
+                sum += triangle_normals[sorted[i] / 3];
+            store_normal(normal_index, sum, last - first);
+
+            for (size_t i = first; i < last; ++i)
+                corner_indices[sorted[i]]->normal_index = (int)normal_index;
+        }
+    });
+}
+
+// Implementação original de ComputeNormals(), que percorre a malha inteira uma
+// vez para cada smoothing group. Mantida somente como referência para
+// BenchmarkComputeNormals(), que verifica se as duas produzem o mesmo resultado.
+void ComputeNormalsReference(ObjModel* model)
 {
     if ( !model->attrib.normals.empty() )
         return;
@@ -898,17 +2382,166 @@ void ComputeNormals(ObjModel* model)
     }
 }
 
+// Executa ComputeNormals() e ComputeNormalsReference() "repetitions" vezes em
+// "filename" (ignorando as normais do arquivo) e em uma malha sintética com
+// muitos smoothing groups, imprime os tempos e verifica se os resultados são
+// idênticos.
+void BenchmarkComputeNormals(const char* filename, int repetitions)
+{
+    typedef std::chrono::steady_clock clock;
+
+    if ( repetitions < 1 )
+        repetitions = 1;
+
+    std::vector<ObjModel> models;
+    models.push_back(ObjModel(filename));
+    models.push_back(CreateSmoothingGroupsObjModel(128, 4));
+
+    for (size_t m = 0; m < models.size(); ++m)
+    {
+        ObjModel& model = models[m];
+        model.attrib.normals.clear();
+        for (size_t shape = 0; shape < model.shapes.size(); ++shape)
+            for (size_t i = 0; i < model.shapes[shape].mesh.indices.size(); ++i)
+                model.shapes[shape].mesh.indices[i].normal_index = -1;
+
+        std::set<unsigned int> sgroup_ids;
+        size_t num_triangles = 0;
+        for (size_t shape = 0; shape < model.shapes.size(); ++shape)
+        {
+            const std::vector<unsigned int>& ids = model.shapes[shape].mesh.smoothing_group_ids;
+            sgroup_ids.insert(ids.begin(), ids.end());
+            num_triangles += ids.size();
+        }
+
+        printf("Benchmark de ComputeNormals(): %s (%lu triângulos, %lu smoothing groups), %d repetições, %u threads\n",
+               m == 0 ? filename : "malha sintética", (unsigned long)num_triangles,
+               (unsigned long)sgroup_ids.size(), repetitions, ThreadPool_NumThreads());
+
+        ObjModel result[2];
+        for (int version = 0; version < 2; ++version)
+        {
+            double best_ms = 1e30;
+            double total_ms = 0.0;
+            for (int r = 0; r < repetitions; ++r)
+            {
+                result[version] = model;
+
+                clock::time_point start = clock::now();
+                if ( version == 0 )
+                    ComputeNormalsReference(&result[version]);
+                else
+                    ComputeNormals(&result[version]);
+                double ms = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+
+                best_ms = std::min(best_ms, ms);
+                total_ms += ms;
+            }
+            printf("  %-10s melhor %9.2f ms   média %9.2f ms\n",
+                   version == 0 ? "original" : "nova", best_ms, total_ms / repetitions);
+        }
+
+        bool same = result[0].attrib.normals.size() == result[1].attrib.normals.size()
+                 && memcmp(result[0].attrib.normals.data(), result[1].attrib.normals.data(),
+                           result[0].attrib.normals.size() * sizeof(float)) == 0;
+        for (size_t shape = 0; same && shape < model.shapes.size(); ++shape)
+        {
+            const std::vector<tinyobj::index_t>& a = result[0].shapes[shape].mesh.indices;
+            const std::vector<tinyobj::index_t>& b = result[1].shapes[shape].mesh.indices;
+            for (size_t i = 0; same && i < a.size(); ++i)
+                same = a[i].normal_index == b[i].normal_index;
+        }
+        printf("  %s\n", same ? "resultados idênticos" : "ATENÇÃO: resultados diferentes");
+    }
+}
+
 // Constrói triângulos para futura renderização a partir de um ObjModel.
-void BuildTrianglesAndAddToVirtualScene(ObjModel* model)
+void BuildTrianglesAndAddToVirtualScene(ObjModel* model, std::vector<BVHTriangle>* track_triangles)
+{
+    MeshData mesh;
+    BuildTriangles(model, &mesh);
+    if ( !mesh.shapes.empty() )
+        AddMeshToVirtualScene(mesh.shapes[0].name, MeshView_FromData(mesh));
+    if ( track_triangles != NULL )
+        BVH_AppendMesh(MeshView_FromData(mesh), track_triangles);
+}
+
+// Carrega um modelo de um arquivo ".obj" e o adiciona na cena virtual. Se
+// existir um cache binário válido para o arquivo (veja "meshcache.h"), o
+// mesmo é mapeado em memória e enviado diretamente para a GPU. Caso
+// contrário, o arquivo é lido com o leitor escolhido em g_ObjParserBackend e
+// o cache é (re)criado. Se "track_triangles" não for NULL, os triângulos do
+// modelo também são adicionados a ele (veja "bvh.h").
+void LoadObjModelAndAddToVirtualScene(const char* filename, bool compute_normals, std::vector<BVHTriangle>* track_triangles)
+{
+    TimeNs start_time = g_Time.now();
+    uint32_t flags = compute_normals ? MESHCACHE_FLAG_COMPUTED_NORMALS : 0;
+    if ( g_ObjParserBackend == OBJPARSER_PARALLEL )
+        flags |= MESHCACHE_FLAG_PARALLEL_PARSER;
+
+    MappedFile cache_file;
+    MeshView cached_mesh;
+    if ( MeshCache_Load(filename, flags, &cache_file, &cached_mesh) )
+    {
+        AddMeshToVirtualScene(filename, cached_mesh);
+        if ( track_triangles != NULL )
+            BVH_AppendMesh(cached_mesh, track_triangles);
+        g_LoadedMeshes[filename].filename = filename;
+        g_LoadedMeshes[filename].compute_normals = compute_normals;
+
+        double elapsed_ms = Time_ToMilliseconds(g_Time.now() - start_time);
+        g_ModelLoadTimeWarm += elapsed_ms;
+
+        printf("Carregando objetos do cache \"%s\"...\n", MeshCache_PathFor(filename).c_str());
+        for (size_t shape = 0; shape < cached_mesh.shapes.size(); ++shape)
+            printf("- Objeto '%s'\n", cached_mesh.shapes[shape].name.c_str());
+        printf("OK (cache quente, %.2f ms).\n", elapsed_ms);
+        return;
+    }
+
+    ObjModel model(filename, NULL, true, g_ObjParserBackend);
+    if ( compute_normals )
+        ComputeNormals(&model);
+
+    MeshData mesh;
+    BuildTriangles(&model, &mesh);
+    AddMeshToVirtualScene(filename, MeshView_FromData(mesh));
+    if ( track_triangles != NULL )
+        BVH_AppendMesh(MeshView_FromData(mesh), track_triangles);
+    g_LoadedMeshes[filename].filename = filename;
+    g_LoadedMeshes[filename].compute_normals = compute_normals;
+
+    double elapsed_ms = Time_ToMilliseconds(g_Time.now() - start_time);
+    g_ModelLoadTimeCold += elapsed_ms;
+
+    printf("Modelo \"%s\" carregado sem cache em %.2f ms (cache frio).\n", filename, elapsed_ms);
+
+    if ( !MeshCache_Store(filename, flags, mesh) )
+        fprintf(stderr, "WARNING: Não foi possível gravar o cache \"%s\".\n", MeshCache_PathFor(filename).c_str());
+}
+
+// Constrói os buffers de uma malha de triângulos a partir de um ObjModel.
+// Estes buffers são enviados para a GPU por AddMeshToVirtualScene() e
+// também são o conteúdo gravado no cache binário de malhas. Os triângulos são
+// primeiro gerados com um vértice por índice e então otimizados por
+// MeshOptimizer_Optimize().
+void BuildTriangles(ObjModel* model, MeshData* mesh)
 {
-    GLuint vertex_array_object_id;
-    glGenVertexArrays(1, &vertex_array_object_id);
-    glBindVertexArray(vertex_array_object_id);
+    std::vector<uint32_t>& indices              = mesh->indices;
+    std::vector<float>&    model_coefficients   = mesh->model_coefficients;
+    std::vector<float>&    normal_coefficients  = mesh->normal_coefficients;
+    std::vector<float>&    texture_coefficients = mesh->texture_coefficients;
+
+    size_t total_indices = 0;
+    for (size_t shape = 0; shape < model->shapes.size(); ++shape)
+        total_indices += model->shapes[shape].mesh.indices.size();
 
-    std::vector<GLuint> indices;
-    std::vector<float>  model_coefficients;
-    std::vector<float>  normal_coefficients;
-    std::vector<float>  texture_coefficients;
+    indices.reserve(total_indices);
+    model_coefficients.reserve(4*total_indices);
+    if ( !model->attrib.normals.empty() )
+        normal_coefficients.reserve(4*total_indices);
+    if ( !model->attrib.texcoords.empty() )
+        texture_coefficients.reserve(2*total_indices);
 
     for (size_t shape = 0; shape < model->shapes.size(); ++shape)
     {
@@ -975,71 +2608,173 @@ void BuildTrianglesAndAddToVirtualScene(ObjModel* model)
 
         size_t last_index = indices.size() - 1;
 
+        MeshShape theshape;
+        theshape.name        = model->shapes[shape].name;
+        theshape.first_index = first_index; // Primeiro índice
+        theshape.num_indices = last_index - first_index + 1; // Número de indices
+        theshape.first_vertex = first_index; // Por enquanto um vértice para cada índice
+        theshape.num_vertices = theshape.num_indices;
+        theshape.bbox_min    = bbox_min;
+        theshape.bbox_max    = bbox_max;
+
+        mesh->shapes.push_back(theshape);
+    }
+
+    // Unificamos os vértices repetidos e reordenamos triângulos e vértices
+    // para aproveitar as caches da GPU (veja "meshoptimizer.h").
+    std::vector<MeshOptimizerStats> stats;
+    MeshOptimizer_Optimize(mesh, &stats);
+    for (size_t shape = 0; shape < mesh->shapes.size(); ++shape)
+    {
+        printf("- Objeto '%s': %lu -> %lu vértices, ACMR %.2f -> %.2f\n",
+               mesh->shapes[shape].name.c_str(),
+               (unsigned long)stats[shape].vertices_before, (unsigned long)stats[shape].vertices_after,
+               stats[shape].acmr_before, stats[shape].acmr_after);
+    }
+}
+
+// Envia os buffers de uma malha para a arena de geometria (veja
+// "geometryarena.h") e adiciona cada um de seus objetos na cena virtual
+// g_VirtualScene. Com g_CompactVertices a malha é convertida para o formato
+// compacto de "vertexformat.h", se possível, e vai para a arena compacta.
+// Se já existir uma malha com o mesmo nome, ela é descarregada antes.
+void AddMeshToVirtualScene(const std::string& mesh_name, const MeshView& mesh)
+{
+    UnloadMeshFromVirtualScene(mesh_name);
+
+    CompactMesh compact;
+    bool use_compact = g_CompactVertices && VertexFormat_BuildCompact(mesh, &compact);
+
+    // As arenas são criadas na primeira malha, com espaço suficiente para a
+    // cena padrão; se necessário, elas crescem automaticamente.
+    GeometryArena* arena = use_compact ? &g_CompactGeometry : &g_StaticGeometry;
+    if ( !arena->isInitialized() )
+        arena->init(use_compact ? GEOMETRY_LAYOUT_COMPACT : GEOMETRY_LAYOUT_FLOAT, 256*1024, 4*1024*1024);
+
+    GeometryAllocation allocation;
+    if ( use_compact )
+    {
+        allocation = arena->add(compact.vertices.data(), compact.vertices.size(),
+                                compact.indices.data(), compact.indices.size());
+    }
+    else
+    {
+        // Intercalamos os atributos em um único buffer. A coordenada W da
+        // posição e da normal é preenchida pelo vertex shader.
+        size_t num_vertices = mesh.num_model_coefficients / 4;
+        std::vector<FloatVertex> vertices(num_vertices);
+        for (size_t v = 0; v < num_vertices; ++v)
+        {
+            FloatVertex& vertex = vertices[v];
+            for (int i = 0; i < 3; ++i)
+            {
+                vertex.position[i] = mesh.model_coefficients[4*v + i];
+                vertex.normal[i]   = mesh.num_normal_coefficients > 0 ? mesh.normal_coefficients[4*v + i] : 0.0f;
+            }
+            for (int i = 0; i < 2; ++i)
+                vertex.texcoord[i] = mesh.num_texture_coefficients > 0 ? mesh.texture_coefficients[2*v + i] : 0.0f;
+        }
+
+        // Os índices são enviados diretamente da MeshView, que pode apontar
+        // para um arquivo de cache mapeado em memória.
+        allocation = arena->add(vertices.data(), num_vertices, mesh.indices, mesh.num_indices * sizeof(GLuint));
+    }
+
+    LoadedMesh& loaded = g_LoadedMeshes[mesh_name];
+    loaded.arena = arena;
+    loaded.allocation = allocation;
+
+    for (size_t shape = 0; shape < mesh.shapes.size(); ++shape)
+    {
         SceneObject theobject;
-        theobject.name           = model->shapes[shape].name;
-        theobject.first_index    = first_index; // Primeiro índice
-        theobject.num_indices    = last_index - first_index + 1; // Número de indices
+        theobject.name           = mesh.shapes[shape].name;
+        theobject.first_index    = mesh.shapes[shape].first_index; // Primeiro índice
+        theobject.num_indices    = mesh.shapes[shape].num_indices; // Número de indices
         theobject.rendering_mode = GL_TRIANGLES;       // Índices correspondem ao tipo de rasterização GL_TRIANGLES.
-        theobject.vertex_array_object_id = vertex_array_object_id;
-
-        theobject.bbox_min = bbox_min;
-        theobject.bbox_max = bbox_max;
-
-        g_VirtualScene[model->shapes[shape].name] = theobject;
-    }
-
-    GLuint VBO_model_coefficients_id;
-    glGenBuffers(1, &VBO_model_coefficients_id);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO_model_coefficients_id);
-    glBufferData(GL_ARRAY_BUFFER, model_coefficients.size() * sizeof(float), NULL, GL_STATIC_DRAW);
-    glBufferSubData(GL_ARRAY_BUFFER, 0, model_coefficients.size() * sizeof(float), model_coefficients.data());
-    GLuint location = 0; // "(location = 0)" em "shader_vertex.glsl"
-    GLint  number_of_dimensions = 4; // vec4 em "shader_vertex.glsl"
-    glVertexAttribPointer(location, number_of_dimensions, GL_FLOAT, GL_FALSE, 0, 0);
-    glEnableVertexAttribArray(location);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-    if ( !normal_coefficients.empty() )
-    {
-        GLuint VBO_normal_coefficients_id;
-        glGenBuffers(1, &VBO_normal_coefficients_id);
-        glBindBuffer(GL_ARRAY_BUFFER, VBO_normal_coefficients_id);
-        glBufferData(GL_ARRAY_BUFFER, normal_coefficients.size() * sizeof(float), NULL, GL_STATIC_DRAW);
-        glBufferSubData(GL_ARRAY_BUFFER, 0, normal_coefficients.size() * sizeof(float), normal_coefficients.data());
-        location = 1; // "(location = 1)" em "shader_vertex.glsl"
-        number_of_dimensions = 4; // vec4 em "shader_vertex.glsl"
-        glVertexAttribPointer(location, number_of_dimensions, GL_FLOAT, GL_FALSE, 0, 0);
-        glEnableVertexAttribArray(location);
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
-    }
-
-    if ( !texture_coefficients.empty() )
-    {
-        GLuint VBO_texture_coefficients_id;
-        glGenBuffers(1, &VBO_texture_coefficients_id);
-        glBindBuffer(GL_ARRAY_BUFFER, VBO_texture_coefficients_id);
-        glBufferData(GL_ARRAY_BUFFER, texture_coefficients.size() * sizeof(float), NULL, GL_STATIC_DRAW);
-        glBufferSubData(GL_ARRAY_BUFFER, 0, texture_coefficients.size() * sizeof(float), texture_coefficients.data());
-        location = 2; // "(location = 1)" em "shader_vertex.glsl"
-        number_of_dimensions = 2; // vec2 em "shader_vertex.glsl"
-        glVertexAttribPointer(location, number_of_dimensions, GL_FLOAT, GL_FALSE, 0, 0);
-        glEnableVertexAttribArray(location);
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
-    }
-
-    GLuint indices_id;
-    glGenBuffers(1, &indices_id);
-
-    // "Ligamos" o buffer. Note que o tipo agora é GL_ELEMENT_ARRAY_BUFFER.
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indices_id);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), NULL, GL_STATIC_DRAW);
-    glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, indices.size() * sizeof(GLuint), indices.data());
-    // glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0); // XXX Errado!
-    //
+        theobject.arena          = arena;
+
+        // As posições dentro da malha são deslocadas pela posição da malha
+        // dentro da arena.
+        theobject.compact_vertices = use_compact;
+        if ( use_compact )
+        {
+            theobject.index_type   = compact.shapes[shape].indices_16bit ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+            theobject.index_offset = allocation.index_offset + compact.shapes[shape].index_offset;
+            theobject.base_vertex  = (GLint)(allocation.first_vertex + compact.shapes[shape].base_vertex);
+        }
+        else
+        {
+            theobject.index_type   = GL_UNSIGNED_INT;
+            theobject.index_offset = allocation.index_offset + theobject.first_index * sizeof(GLuint);
+            theobject.base_vertex  = (GLint)allocation.first_vertex;
+        }
+
+        theobject.bbox_min = mesh.shapes[shape].bbox_min;
+        theobject.bbox_max = mesh.shapes[shape].bbox_max;
+
+        // Um objeto com o mesmo nome vindo de outra malha é substituído; a
+        // malha antiga é descarregada se não tiver mais nenhum objeto.
+        SceneHandle handle = g_VirtualScene.find(theobject.name);
+        if ( g_VirtualScene.isLoaded(handle) )
+        {
+            for (std::map<std::string, LoadedMesh>::iterator it = g_LoadedMeshes.begin(); it != g_LoadedMeshes.end(); ++it)
+            {
+                std::vector<SceneHandle>& objects = it->second.objects;
+                std::vector<SceneHandle>::iterator object = std::find(objects.begin(), objects.end(), handle);
+                if ( it->first == mesh_name || object == objects.end() )
+                    continue;
+                objects.erase(object);
+                if ( objects.empty() )
+                {
+                    UnloadMeshFromVirtualScene(it->first);
+                    break;
+                }
+            }
+        }
+
+        handle = g_VirtualScene.add(theobject);
+        loaded.objects.push_back(handle);
+    }
+}
+
+// Remove da cena virtual os objetos de uma malha adicionada com
+// AddMeshToVirtualScene() e libera o espaço ocupado por ela na sua arena.
+void UnloadMeshFromVirtualScene(const std::string& mesh_name)
+{
+    std::map<std::string, LoadedMesh>::iterator it = g_LoadedMeshes.find(mesh_name);
+    if ( it == g_LoadedMeshes.end() )
+        return;
+
+    LoadedMesh& loaded = it->second;
+    for (size_t i = 0; i < loaded.objects.size(); ++i)
+        g_VirtualScene.remove(loaded.objects[i]);
+    loaded.arena->remove(loaded.allocation);
 
-    // "Desligamos" o VAO, evitando assim que operações posteriores venham a
-    // alterar o mesmo. Isso evita bugs.
-    glBindVertexArray(0);
+    g_LoadedMeshes.erase(it);
+}
+
+// Recarrega todos os modelos lidos de arquivos ".obj" (tecla M). Cada malha
+// é descarregada e enviada novamente para a arena, reaproveitando o espaço
+// liberado; as estatísticas impressas mostram a fragmentação resultante.
+void ReloadObjModels()
+{
+    std::vector<std::pair<std::string, bool> > files;
+    for (std::map<std::string, LoadedMesh>::iterator it = g_LoadedMeshes.begin(); it != g_LoadedMeshes.end(); ++it)
+    {
+        if ( !it->second.filename.empty() )
+            files.push_back(std::make_pair(it->second.filename, it->second.compute_normals));
+    }
+
+    for (size_t i = 0; i < files.size(); ++i)
+    {
+        UnloadMeshFromVirtualScene(files[i].first);
+        LoadObjModelAndAddToVirtualScene(files[i].first.c_str(), files[i].second);
+    }
+
+    if ( g_StaticGeometry.isInitialized() )
+        g_StaticGeometry.printStats("float");
+    if ( g_CompactGeometry.isInitialized() )
+        g_CompactGeometry.printStats("compacta");
 }
 
 // Carrega um Vertex Shader de um arquivo GLSL. Veja definição de LoadShader() abaixo.
@@ -1210,6 +2945,10 @@ void FramebufferSizeCallback(GLFWwindow* window, int width, int height)
     // O cast para float é necessário pois números inteiros são arredondados ao
     // serem divididos!
     g_ScreenRatio = (float)width / height;
+
+    // O layout dos textos usa o tamanho do framebuffer guardado aqui, e os
+    // textos do HUD são refeitos quando ele muda.
+    TextRendering_SetFramebufferSize(width, height);
 }
 
 // Variáveis globais que armazenam a última posição do cursor do mouse, para
@@ -1287,7 +3026,7 @@ void CursorPosCallback(GLFWwindow* window, double xpos, double ypos)
         float dx = xpos - g_LastCursorPosX;
         float dy = ypos - g_LastCursorPosY;
         float phimin, phimax;
-        float elapsedTime = getTimeSinceLastFrame();
+        float elapsedTime = (float)Time_ToSeconds(g_Time.getFrameDelta());
         // Define os limites do angulo da camera dependendo do tipoe de camera
         // (camera livre tem o theta )
         if(g_CameraType==freeCamera){
@@ -1432,6 +3171,19 @@ void KeyCallback(GLFWwindow* window, int key, int scancode, int action, int mod)
         keyInfo.reverse_held = false;
     }
 
+    // Com um replay, as teclas "[" e "]" voltam e avançam 5 segundos
+    if ((key == GLFW_KEY_LEFT_BRACKET || key == GLFW_KEY_RIGHT_BRACKET) && action == GLFW_PRESS && g_ReplayPlayer != NULL)
+    {
+        uint64_t jump = (uint64_t)(5 * TIME_NS_PER_SECOND / g_Replay.getStepNs());
+        uint64_t current = g_ReplayPlayer->getStep();
+        if ( key == GLFW_KEY_LEFT_BRACKET )
+            g_ReplayPlayer->seek(current > jump ? current - jump : 0);
+        else
+            g_ReplayPlayer->seek(current + jump);
+        fprintf(stdout, "Replay: %.1f s\n", g_ReplayPlayer->getStep() * Time_ToSeconds(g_Replay.getStepNs()));
+        fflush(stdout);
+    }
+
     // Se o usuário apertar a tecla P, utilizamos projeção perspectiva.
     if (key == GLFW_KEY_P && action == GLFW_PRESS)
     {
@@ -1457,6 +3209,14 @@ void KeyCallback(GLFWwindow* window, int key, int scancode, int action, int mod)
         fprintf(stdout,"Shaders recarregados!\n");
         fflush(stdout);
     }
+
+    // Se o usuário apertar a tecla M, recarregamos os modelos dos arquivos ".obj".
+    if (key == GLFW_KEY_M && action == GLFW_PRESS)
+    {
+        ReloadObjModels();
+        fprintf(stdout,"Modelos recarregados!\n");
+        fflush(stdout);
+    }
 }
 
 // Definimos o callback para impressão de erros da GLFW no terminal
@@ -1538,7 +3298,9 @@ void TextRendering_ShowVelocity(GLFWwindow* window, const glm::vec4 &vel, bool i
     char buffer[100];
     snprintf(buffer, 100, "Velocity: (X = %f) (Y = %f) (Z = %f) (Norm = %f) (isSliding? %s)\n", vel.x, vel.y, vel.z, norm(vel), isSliding ? "True" : "False");
 
-    TextRendering_PrintString(window, buffer, -1.0f+pad/10, -1.0f+2*pad/10, 1.0f);
+    // Texto retido: o layout só é refeito quando o texto muda
+    static int hud = TextRendering_CreateHudText();
+    TextRendering_PrintHudString(window, hud, buffer, -1.0f+pad/10, -1.0f+2*pad/10, 1.0f);
 }
 
 // Debug da Rotação do modelo do carro
@@ -1552,7 +3314,8 @@ void TextRendering_ShowRotation(GLFWwindow* window, const glm::vec3 &rotation)
     char buffer[80];
     snprintf(buffer, 80, "Rotation Matrix: (X = %f) (Y = %f) (Z = %f)\n", rotation.x, rotation.y, rotation.z);
 
-    TextRendering_PrintString(window, buffer, -1.0f+pad/10, -1.0f+12*pad/10, 1.0f);
+    static int hud = TextRendering_CreateHudText();
+    TextRendering_PrintHudString(window, hud, buffer, -1.0f+pad/10, -1.0f+12*pad/10, 1.0f);
 }
 
 // Escrevemos na tela qual matriz de projeção está sendo utilizada.
@@ -1564,20 +3327,11 @@ void TextRendering_ShowProjection(GLFWwindow* window)
     float lineheight = TextRendering_LineHeight(window);
     float charwidth = TextRendering_CharWidth(window);
 
+    static int hud = TextRendering_CreateHudText();
     if ( g_UsePerspectiveProjection )
-        TextRendering_PrintString(window, "Perspective", 1.0f-13*charwidth, -1.0f+2*lineheight/10, 1.0f);
+        TextRendering_PrintHudString(window, hud, "Perspective", 1.0f-13*charwidth, -1.0f+2*lineheight/10, 1.0f);
     else
-        TextRendering_PrintString(window, "Orthographic", 1.0f-13*charwidth, -1.0f+2*lineheight/10, 1.0f);
-}
-
-float getTimeSinceLastFrame(){
-    return ((float)glfwGetTime() - g_TimeOfLastFrame) + verysmallnumber;
-}
-
-void setEndFrameTime(){
-
-    g_TimeOfLastFrame = (float)glfwGetTime();
-
+        TextRendering_PrintHudString(window, hud, "Orthographic", 1.0f-13*charwidth, -1.0f+2*lineheight/10, 1.0f);
 }
 
 
@@ -1590,31 +3344,54 @@ void TextRendering_ShowFramesPerSecond(GLFWwindow* window)
 
     // Variáveis estáticas (static) mantém seus valores entre chamadas
     // subsequentes da função!
-    static float old_seconds = (float)glfwGetTime();
-    static int   ellapsed_frames = 0;
-    static char  buffer[20] = "?? fps";
-    static int   numchars = 7;
+    static TimeNs old_time = g_Time.getFrameTime();
+    static int    ellapsed_frames = 0;
+    static char   buffer[20] = "?? fps";
+    static int    numchars = 7;
 
     ellapsed_frames += 1;
 
-    // Recuperamos o número de segundos que passou desde a execução do programa
-    float seconds = (float)glfwGetTime();
+    // Instante do início deste quadro (veja "timebase.h")
+    TimeNs time = g_Time.getFrameTime();
 
-    // Número de segundos desde o último cálculo do fps
-    float ellapsed_seconds = seconds - old_seconds;
+    // Tempo desde o último cálculo do fps
+    TimeNs ellapsed_time = time - old_time;
 
-    if ( ellapsed_seconds > 1.0f )
+    if ( ellapsed_time > TIME_NS_PER_SECOND )
     {
-        numchars = snprintf(buffer, 20, "%.2f fps", ellapsed_frames / ellapsed_seconds);
+        numchars = snprintf(buffer, 20, "%.2f fps", ellapsed_frames / Time_ToSeconds(ellapsed_time));
 
-        old_seconds = seconds;
+        old_time = time;
         ellapsed_frames = 0;
     }
 
     float lineheight = TextRendering_LineHeight(window);
     float charwidth = TextRendering_CharWidth(window);
 
-    TextRendering_PrintString(window, buffer, 1.0f-(numchars + 1)*charwidth, 1.0f-lineheight, 1.0f);
+    // O texto só muda uma vez por segundo; nos outros quadros o layout
+    // anterior é reaproveitado
+    static int hud = TextRendering_CreateHudText();
+    TextRendering_PrintHudString(window, hud, buffer, 1.0f-(numchars + 1)*charwidth, 1.0f-lineheight, 1.0f);
+}
+
+// Escrevemos na tela, abaixo do fps, quantos objetos foram testados contra o
+// frustum, quantos foram descartados e quantos foram enviados para desenho.
+void TextRendering_ShowCullingStats(GLFWwindow* window)
+{
+    if ( !g_ShowInfoText )
+        return;
+
+    const CullingStats& stats = g_Culler.getStats();
+
+    char buffer[80];
+    int numchars = snprintf(buffer, 80, "culling: %lu testados, %lu descartados, %lu desenhados",
+                            (unsigned long)stats.tested, (unsigned long)stats.culled, (unsigned long)stats.submitted);
+
+    float lineheight = TextRendering_LineHeight(window);
+    float charwidth = TextRendering_CharWidth(window);
+
+    static int hud = TextRendering_CreateHudText();
+    TextRendering_PrintHudString(window, hud, buffer, 1.0f-(numchars + 1)*charwidth, 1.0f-2*lineheight, 1.0f);
 }
 
 // Função para debugging: imprime no terminal todas informações de um modelo
@@ -1788,86 +3565,80 @@ void PrintObjModelInfo(ObjModel* model)
 
 // set makeprg=cd\ ..\ &&\ make\ run\ >/dev/null
 // vim: set spell spelllang=pt_br :
-void updateFromKeyboard(){
+void updateFromKeyboard(float elapsed_time){
     if(g_CameraType==freeCamera){
         // Controls camera if free camera
         float cameraVel=FREE_CAM_VEL;
         if(g_FreeCameraDoubleSpeed) cameraVel*=2;
 
-        float elapsedTime = getTimeSinceLastFrame();
-        
         if(keyInfo.forwards_held){
-            g_CameraPosition+=cameraVel*elapsedTime*g_CameraViewVector;
+            g_CameraPosition+=cameraVel*elapsed_time*g_CameraViewVector;
         }
         if(keyInfo.left_held){
             glm::vec4 u = crossproduct(g_CameraUpVector, -g_CameraViewVector);
             u/=norm(u);
-            g_CameraPosition-=cameraVel*elapsedTime*u;
+            g_CameraPosition-=cameraVel*elapsed_time*u;
         }
         if(keyInfo.right_held){
             glm::vec4 u = crossproduct(g_CameraUpVector, -g_CameraViewVector);
             u/=norm(u);
-            g_CameraPosition+=cameraVel*elapsedTime*u;
+            g_CameraPosition+=cameraVel*elapsed_time*u;
         }
         if(keyInfo.reverse_held){
-            g_CameraPosition-=cameraVel*elapsedTime*g_CameraViewVector;            
+            g_CameraPosition-=cameraVel*elapsed_time*g_CameraViewVector;            
         }
     }else{
         // Controls car if camera is lookat
-        if(keyInfo.forwards_held) carInfo.setAccelerate(true);
-        else carInfo.setAccelerate(false);
-
-        float elapsed_time = getTimeSinceLastFrame();
-
-        if(keyInfo.left_held) carInfo.turnLeft(elapsed_time);
-
-        if(keyInfo.right_held) carInfo.turnRight(elapsed_time);
-
-        if(keyInfo.brake_held) carInfo.setBrake(true);
-        else carInfo.setBrake(false);
-
-        if(keyInfo.reverse_held){
-            carInfo.setReverse(true);
-            carInfo.setAccelerate(true);
-        }else{
-            carInfo.setReverse(false);
-        };
+        carInfo.applyControls(keyInfo.forwards_held, keyInfo.brake_held, keyInfo.left_held,
+                              keyInfo.right_held, keyInfo.reverse_held, elapsed_time);
+
+        g_CarInput = (keyInfo.forwards_held ? INPUT_ACCELERATE : 0)
+                   | (keyInfo.brake_held    ? INPUT_BRAKE      : 0)
+                   | (keyInfo.left_held     ? INPUT_LEFT       : 0)
+                   | (keyInfo.right_held    ? INPUT_RIGHT      : 0)
+                   | (keyInfo.reverse_held  ? INPUT_REVERSE    : 0);
     }
+
+    // Com a câmera livre o carro não recebe comandos: acelerador, freio e ré
+    // continuam como estavam, sem curva
+    if(g_CameraType==freeCamera)
+        g_CarInput &= ~(INPUT_LEFT | INPUT_RIGHT);
+    if(!g_RecordInputFilename.empty())
+        g_RecordedInput.append(g_CarInput);
 }
 
 
 // Código pronto para fazer load do cubemap, usado para projeção da esfera
-GLuint LoadCubemap(std::vector<std::string> faces)
+// Cria um cubemap com as seis faces (+X, -X, +Y, -Y, +Z, -Z) decodificadas
+// por DecodeImage(), sem inverter as linhas
+GLuint LoadCubemap(DecodedImage* faces)
 {
     GLuint textureID;
     glGenTextures(1, &textureID);
     glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
 
-    int width, height, nrChannels;
-    stbi_set_flip_vertically_on_load(false); // VERY IMPORTANT for cubemaps
-
-    for (GLuint i = 0; i < faces.size(); i++)
+    for (GLuint i = 0; i < 6; i++)
     {
-        unsigned char* data = stbi_load(faces[i].c_str(), &width, &height, &nrChannels, 3);
+        unsigned char* data = faces[i].pixels;
         if (data)
         {
             glTexImage2D(
                 GL_TEXTURE_CUBE_MAP_POSITIVE_X + i,
                 0,
                 GL_RGB,
-                width,
-                height,
+                faces[i].width,
+                faces[i].height,
                 0,
                 GL_RGB,
                 GL_UNSIGNED_BYTE,
                 data
             );
             stbi_image_free(data);
+            faces[i].pixels = NULL;
         }
         else
         {
-            std::cout << "Failed to load cubemap face: " << faces[i] << std::endl;
-            stbi_image_free(data);
+            std::cout << "Failed to load cubemap face: " << faces[i].filename << std::endl;
         }
     }
 
@@ -1957,4 +3728,49 @@ ObjModel CreatePlaneObjModel(const std::string& object_name, float width, float
     printf("OK. Modelo gerado com 4 vertices e 2 faces.\n");
 
     return plane_model;
+}
+
+// Gera uma malha sintética para benchmarks: um terreno ondulado com
+// resolution x resolution quadrados, dividido em regiões de patch_size x
+// patch_size quadrados, cada uma com o seu smoothing group.
+ObjModel CreateSmoothingGroupsObjModel(size_t resolution, size_t patch_size)
+{
+    ObjModel model;
+
+    for (size_t i = 0; i <= resolution; ++i)
+    {
+        for (size_t j = 0; j <= resolution; ++j)
+        {
+            float x = (float)j / resolution;
+            float z = (float)i / resolution;
+            model.attrib.vertices.push_back(x);
+            model.attrib.vertices.push_back(0.1f * sinf(20.0f*x) * cosf(15.0f*z));
+            model.attrib.vertices.push_back(z);
+        }
+    }
+
+    tinyobj::shape_t shape;
+    shape.name = "synthetic";
+    size_t patches_per_row = (resolution + patch_size - 1) / patch_size;
+    for (size_t i = 0; i < resolution; ++i)
+    {
+        for (size_t j = 0; j < resolution; ++j)
+        {
+            int v00 = (int)(i*(resolution+1) + j);
+            int v01 = v00 + 1;
+            int v10 = v00 + (int)(resolution+1);
+            int v11 = v10 + 1;
+            unsigned int sgroup = (unsigned int)((i/patch_size)*patches_per_row + j/patch_size + 1);
+
+            tinyobj::index_t corners[6] = { {v00,-1,-1}, {v10,-1,-1}, {v11,-1,-1},
+                                            {v00,-1,-1}, {v11,-1,-1}, {v01,-1,-1} };
+            shape.mesh.indices.insert(shape.mesh.indices.end(), corners, corners + 6);
+            shape.mesh.num_face_vertices.insert(shape.mesh.num_face_vertices.end(), {3, 3});
+            shape.mesh.smoothing_group_ids.insert(shape.mesh.smoothing_group_ids.end(), {sgroup, sgroup});
+            shape.mesh.material_ids.insert(shape.mesh.material_ids.end(), {-1, -1});
+        }
+    }
+    model.shapes.push_back(shape);
+
+    return model;
 }
\ No newline at end of file
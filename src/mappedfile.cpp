@@ -0,0 +1,130 @@
+// Mapeamento de arquivos em memória (POSIX mmap() ou Win32 MapViewOfFile()).
+#include "mappedfile.h"
+
+#ifdef _WIN32
+    #define WIN32_LEAN_AND_MEAN
+    #include <windows.h>
+    #include <sys/types.h>
+    #include <sys/stat.h>
+#else
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+#endif
+
+bool GetFileInfo(const char* filename, FileInfo* info)
+{
+#ifdef _WIN32
+    struct _stat64 st;
+    if ( _stat64(filename, &st) != 0 )
+        return false;
+#else
+    struct stat st;
+    if ( stat(filename, &st) != 0 )
+        return false;
+#endif
+    info->size  = (uint64_t)st.st_size;
+    info->mtime = (int64_t)st.st_mtime;
+    return true;
+}
+
+MappedFile::MappedFile()
+    : data(NULL)
+    , size(0)
+#ifdef _WIN32
+    , file_handle(NULL)
+    , mapping_handle(NULL)
+#else
+    , fd(-1)
+#endif
+{
+}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+bool MappedFile::open(const char* filename)
+{
+    close();
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if ( file == INVALID_HANDLE_VALUE )
+        return false;
+
+    LARGE_INTEGER file_size;
+    if ( !GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0 )
+    {
+        CloseHandle(file);
+        return false;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if ( mapping == NULL )
+    {
+        CloseHandle(file);
+        return false;
+    }
+
+    void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if ( view == NULL )
+    {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+
+    file_handle    = file;
+    mapping_handle = mapping;
+    data = (const unsigned char*)view;
+    size = (size_t)file_size.QuadPart;
+#else
+    int file = ::open(filename, O_RDONLY);
+    if ( file < 0 )
+        return false;
+
+    struct stat st;
+    if ( fstat(file, &st) != 0 || st.st_size == 0 )
+    {
+        ::close(file);
+        return false;
+    }
+
+    void* view = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+    if ( view == MAP_FAILED )
+    {
+        ::close(file);
+        return false;
+    }
+
+    fd   = file;
+    data = (const unsigned char*)view;
+    size = (size_t)st.st_size;
+#endif
+
+    return true;
+}
+
+void MappedFile::close()
+{
+    if ( data == NULL )
+        return;
+
+#ifdef _WIN32
+    UnmapViewOfFile(data);
+    CloseHandle((HANDLE)mapping_handle);
+    CloseHandle((HANDLE)file_handle);
+    file_handle    = NULL;
+    mapping_handle = NULL;
+#else
+    munmap((void*)data, size);
+    ::close(fd);
+    fd = -1;
+#endif
+
+    data = NULL;
+    size = 0;
+}
@@ -0,0 +1,312 @@
+// Cache binário de malhas. Veja comentários em "meshcache.h".
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "meshcache.h"
+
+namespace
+{
+
+const char     MESHCACHE_MAGIC[8]   = { 'F','C','G','M','E','S','H','\0' };
+const uint32_t MESHCACHE_ENDIANNESS = 0x01020304;
+const uint64_t MESHCACHE_ALIGNMENT  = 16;
+
+// Cabeçalho do arquivo de cache. Todos os "offsets" são em bytes a partir do
+// início do arquivo, e todos os streams são alinhados em MESHCACHE_ALIGNMENT
+// bytes, de forma que podem ser lidos diretamente do arquivo mapeado.
+struct MeshCacheHeader
+{
+    char     magic[8];
+    uint32_t version;
+    uint32_t endianness;
+    uint32_t flags;
+    uint32_t reserved;
+    uint64_t source_size;
+    int64_t  source_mtime;
+    uint64_t source_hash;
+    uint64_t path_offset;
+    uint64_t path_length;
+    uint64_t shapes_offset;
+    uint64_t num_shapes;
+    uint64_t model_offset;
+    uint64_t num_model_coefficients;
+    uint64_t normal_offset;
+    uint64_t num_normal_coefficients;
+    uint64_t texture_offset;
+    uint64_t num_texture_coefficients;
+    uint64_t indices_offset;
+    uint64_t num_indices;
+};
+
+// Registro de cada objeto (SceneObject) dentro do cache. Os nomes ficam em
+// uma região de strings logo após estes registros.
+struct MeshCacheShape
+{
+    uint64_t name_offset;
+    uint64_t name_length;
+    uint64_t first_index;
+    uint64_t num_indices;
+    uint64_t first_vertex;
+    uint64_t num_vertices;
+    float    bbox_min[3];
+    float    bbox_max[3];
+};
+
+uint64_t AlignUp(uint64_t value)
+{
+    return (value + MESHCACHE_ALIGNMENT - 1) & ~(MESHCACHE_ALIGNMENT - 1);
+}
+
+// Verifica se a região [offset, offset+size) está dentro do arquivo
+bool InsideFile(uint64_t offset, uint64_t size, uint64_t file_size)
+{
+    return offset <= file_size && size <= file_size - offset;
+}
+
+// Escreve "size" bytes no arquivo, completando com zeros até "offset"
+bool WriteAt(FILE* f, uint64_t* position, uint64_t offset, const void* data, uint64_t size)
+{
+    static const unsigned char zeros[MESHCACHE_ALIGNMENT] = { 0 };
+    while ( *position < offset )
+    {
+        uint64_t n = offset - *position;
+        if ( n > MESHCACHE_ALIGNMENT )
+            n = MESHCACHE_ALIGNMENT;
+        if ( fwrite(zeros, 1, (size_t)n, f) != n )
+            return false;
+        *position += n;
+    }
+    if ( size > 0 && fwrite(data, 1, (size_t)size, f) != size )
+        return false;
+    *position += size;
+    return true;
+}
+
+// Hash do conteúdo atual do arquivo fonte
+bool HashSourceFile(const char* source_filename, uint64_t* hash)
+{
+    MappedFile source;
+    if ( !source.open(source_filename) )
+        return false;
+    *hash = MeshCache_Hash(source.getData(), source.getSize());
+    return true;
+}
+
+} // namespace
+
+std::string MeshCache_PathFor(const char* source_filename)
+{
+    return std::string(source_filename) + ".meshcache";
+}
+
+uint64_t MeshCache_Hash(const void* data, size_t size)
+{
+    // FNV-1a processando 8 bytes por vez, seguido de uma etapa final de
+    // mistura ("finalizer" do MurmurHash3) para espalhar os bits.
+    const uint64_t prime = 0x100000001b3ULL;
+    uint64_t h = 0xcbf29ce484222325ULL ^ (uint64_t)size;
+
+    const unsigned char* bytes = (const unsigned char*)data;
+    size_t i = 0;
+    for ( ; i + 8 <= size; i += 8 )
+    {
+        uint64_t word;
+        memcpy(&word, bytes + i, 8);
+        h = (h ^ word) * prime;
+    }
+    for ( ; i < size; ++i )
+        h = (h ^ bytes[i]) * prime;
+
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+bool MeshCache_Load(const char* source_filename, uint32_t flags, MappedFile* file, MeshView* view)
+{
+    FileInfo source_info;
+    if ( !GetFileInfo(source_filename, &source_info) )
+        return false;
+
+    std::string cache_filename = MeshCache_PathFor(source_filename);
+    if ( !file->open(cache_filename.c_str()) )
+        return false;
+
+    const unsigned char* base = file->getData();
+    const uint64_t file_size = file->getSize();
+
+    // Validamos a chave do cache: versão, opções, caminho, data de
+    // modificação, tamanho e, por último (pois é a única verificação que lê
+    // o arquivo fonte), o hash do conteúdo.
+    MeshCacheHeader header;
+    bool valid = file_size >= sizeof(header);
+    if ( valid )
+    {
+        memcpy(&header, base, sizeof(header));
+        valid = memcmp(header.magic, MESHCACHE_MAGIC, sizeof(MESHCACHE_MAGIC)) == 0
+             && header.version == MESHCACHE_VERSION
+             && header.endianness == MESHCACHE_ENDIANNESS
+             && header.flags == flags
+             && header.source_size == source_info.size
+             && header.source_mtime == source_info.mtime;
+    }
+
+    valid = valid
+         && InsideFile(header.path_offset, header.path_length, file_size)
+         && InsideFile(header.shapes_offset, header.num_shapes * sizeof(MeshCacheShape), file_size)
+         && InsideFile(header.model_offset, header.num_model_coefficients * sizeof(float), file_size)
+         && InsideFile(header.normal_offset, header.num_normal_coefficients * sizeof(float), file_size)
+         && InsideFile(header.texture_offset, header.num_texture_coefficients * sizeof(float), file_size)
+         && InsideFile(header.indices_offset, header.num_indices * sizeof(uint32_t), file_size);
+
+    valid = valid
+         && header.path_length == strlen(source_filename)
+         && memcmp(base + header.path_offset, source_filename, (size_t)header.path_length) == 0;
+
+    uint64_t source_hash = 0;
+    valid = valid
+         && HashSourceFile(source_filename, &source_hash)
+         && source_hash == header.source_hash;
+
+    if ( !valid )
+    {
+        file->close();
+        return false;
+    }
+
+    view->model_coefficients       = (const float*)(base + header.model_offset);
+    view->num_model_coefficients   = (size_t)header.num_model_coefficients;
+    view->normal_coefficients      = (const float*)(base + header.normal_offset);
+    view->num_normal_coefficients  = (size_t)header.num_normal_coefficients;
+    view->texture_coefficients     = (const float*)(base + header.texture_offset);
+    view->num_texture_coefficients = (size_t)header.num_texture_coefficients;
+    view->indices                  = (const uint32_t*)(base + header.indices_offset);
+    view->num_indices              = (size_t)header.num_indices;
+
+    view->shapes.resize((size_t)header.num_shapes);
+    for (size_t i = 0; i < view->shapes.size(); ++i)
+    {
+        MeshCacheShape record;
+        memcpy(&record, base + header.shapes_offset + i*sizeof(record), sizeof(record));
+
+        if ( !InsideFile(record.name_offset, record.name_length, file_size)
+          || record.first_index + record.num_indices > header.num_indices
+          || 4*(record.first_vertex + record.num_vertices) > header.num_model_coefficients )
+        {
+            file->close();
+            return false;
+        }
+
+        MeshShape& shape = view->shapes[i];
+        shape.name.assign((const char*)(base + record.name_offset), (size_t)record.name_length);
+        shape.first_index = (size_t)record.first_index;
+        shape.num_indices = (size_t)record.num_indices;
+        shape.first_vertex = (size_t)record.first_vertex;
+        shape.num_vertices = (size_t)record.num_vertices;
+        shape.bbox_min = glm::vec3(record.bbox_min[0], record.bbox_min[1], record.bbox_min[2]);
+        shape.bbox_max = glm::vec3(record.bbox_max[0], record.bbox_max[1], record.bbox_max[2]);
+    }
+
+    return true;
+}
+
+bool MeshCache_Store(const char* source_filename, uint32_t flags, const MeshData& data)
+{
+    FileInfo source_info;
+    uint64_t source_hash;
+    if ( !GetFileInfo(source_filename, &source_info) || !HashSourceFile(source_filename, &source_hash) )
+        return false;
+
+    // Registros dos objetos e região de strings com seus nomes
+    std::vector<MeshCacheShape> records(data.shapes.size());
+    uint64_t names_length = 0;
+    for (size_t i = 0; i < data.shapes.size(); ++i)
+        names_length += data.shapes[i].name.size();
+
+    MeshCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MESHCACHE_MAGIC, sizeof(MESHCACHE_MAGIC));
+    header.version      = MESHCACHE_VERSION;
+    header.endianness   = MESHCACHE_ENDIANNESS;
+    header.flags        = flags;
+    header.source_size  = source_info.size;
+    header.source_mtime = source_info.mtime;
+    header.source_hash  = source_hash;
+
+    header.path_offset = sizeof(header);
+    header.path_length = strlen(source_filename);
+
+    header.shapes_offset = AlignUp(header.path_offset + header.path_length);
+    header.num_shapes    = records.size();
+
+    uint64_t names_offset = header.shapes_offset + records.size() * sizeof(MeshCacheShape);
+    uint64_t name_offset  = names_offset;
+    for (size_t i = 0; i < data.shapes.size(); ++i)
+    {
+        const MeshShape& shape = data.shapes[i];
+        records[i].name_offset = name_offset;
+        records[i].name_length = shape.name.size();
+        records[i].first_index = shape.first_index;
+        records[i].num_indices = shape.num_indices;
+        records[i].first_vertex = shape.first_vertex;
+        records[i].num_vertices = shape.num_vertices;
+        records[i].bbox_min[0] = shape.bbox_min.x;
+        records[i].bbox_min[1] = shape.bbox_min.y;
+        records[i].bbox_min[2] = shape.bbox_min.z;
+        records[i].bbox_max[0] = shape.bbox_max.x;
+        records[i].bbox_max[1] = shape.bbox_max.y;
+        records[i].bbox_max[2] = shape.bbox_max.z;
+        name_offset += shape.name.size();
+    }
+
+    header.model_offset             = AlignUp(names_offset + names_length);
+    header.num_model_coefficients   = data.model_coefficients.size();
+    header.normal_offset            = AlignUp(header.model_offset + data.model_coefficients.size() * sizeof(float));
+    header.num_normal_coefficients  = data.normal_coefficients.size();
+    header.texture_offset           = AlignUp(header.normal_offset + data.normal_coefficients.size() * sizeof(float));
+    header.num_texture_coefficients = data.texture_coefficients.size();
+    header.indices_offset           = AlignUp(header.texture_offset + data.texture_coefficients.size() * sizeof(float));
+    header.num_indices              = data.indices.size();
+
+    // Escrevemos primeiro em um arquivo temporário e depois o renomeamos,
+    // para que uma execução interrompida nunca deixe um cache incompleto.
+    std::string cache_filename = MeshCache_PathFor(source_filename);
+    std::string temp_filename = cache_filename + ".tmp";
+
+    FILE* f = fopen(temp_filename.c_str(), "wb");
+    if ( f == NULL )
+        return false;
+
+    uint64_t position = 0;
+    bool ok = WriteAt(f, &position, 0, &header, sizeof(header))
+           && WriteAt(f, &position, header.path_offset, source_filename, header.path_length)
+           && WriteAt(f, &position, header.shapes_offset, records.data(), records.size() * sizeof(MeshCacheShape));
+
+    for (size_t i = 0; ok && i < data.shapes.size(); ++i)
+        ok = WriteAt(f, &position, records[i].name_offset, data.shapes[i].name.data(), records[i].name_length);
+
+    ok = ok
+      && WriteAt(f, &position, header.model_offset, data.model_coefficients.data(), data.model_coefficients.size() * sizeof(float))
+      && WriteAt(f, &position, header.normal_offset, data.normal_coefficients.data(), data.normal_coefficients.size() * sizeof(float))
+      && WriteAt(f, &position, header.texture_offset, data.texture_coefficients.data(), data.texture_coefficients.size() * sizeof(float))
+      && WriteAt(f, &position, header.indices_offset, data.indices.data(), data.indices.size() * sizeof(uint32_t));
+
+    ok = (fclose(f) == 0) && ok;
+
+    if ( ok )
+    {
+        // No Windows rename() falha se o destino já existe
+        remove(cache_filename.c_str());
+        ok = rename(temp_filename.c_str(), cache_filename.c_str()) == 0;
+    }
+
+    if ( !ok )
+        remove(temp_filename.c_str());
+
+    return ok;
+}
@@ -0,0 +1,424 @@
+// Otimização de malhas para a GPU. Veja comentários em "meshoptimizer.h".
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+#include "meshoptimizer.h"
+#include "threadpool.h"
+
+namespace
+{
+
+// Parâmetros do algoritmo de Forsyth (valores sugeridos no artigo original)
+const int   FORSYTH_CACHE_SIZE          = 32;
+const float FORSYTH_CACHE_DECAY_POWER   = 1.5f;
+const float FORSYTH_LAST_TRIANGLE_SCORE = 0.75f;
+const float FORSYTH_VALENCE_BOOST_SCALE = 2.0f;
+const float FORSYTH_VALENCE_BOOST_POWER = 0.5f;
+const int   FORSYTH_MAX_VALENCE         = 64; // Valências maiores usam o valor deste índice na tabela
+
+// Número máximo de floats de um vértice: posição (4) + normal (4) + textura (2)
+const size_t MAX_VERTEX_FLOATS = 10;
+
+// Pontuações pré-calculadas de um vértice, em função da sua posição na cache
+// e do número de triângulos ainda não emitidos que o utilizam.
+struct ForsythScoreTables
+{
+    float cache[FORSYTH_CACHE_SIZE];
+    float valence[FORSYTH_MAX_VALENCE + 1];
+
+    ForsythScoreTables()
+    {
+        for (int i = 0; i < FORSYTH_CACHE_SIZE; ++i)
+        {
+            // Os três vértices do último triângulo emitido têm uma pontuação
+            // fixa, para não favorecer nenhuma direção em particular.
+            if ( i < 3 )
+                cache[i] = FORSYTH_LAST_TRIANGLE_SCORE;
+            else
+                cache[i] = powf(1.0f - (float)(i - 3) / (FORSYTH_CACHE_SIZE - 3), FORSYTH_CACHE_DECAY_POWER);
+        }
+
+        // Vértices com poucos triângulos restantes são priorizados, para que
+        // não fiquem "órfãos" (exigindo uma nova transformação mais tarde).
+        valence[0] = 0.0f;
+        for (int i = 1; i <= FORSYTH_MAX_VALENCE; ++i)
+            valence[i] = FORSYTH_VALENCE_BOOST_SCALE * powf((float)i, -FORSYTH_VALENCE_BOOST_POWER);
+    }
+};
+
+float VertexScore(const ForsythScoreTables& tables, int cache_position, unsigned int remaining_valence)
+{
+    if ( remaining_valence == 0 )
+        return -1.0f; // Vértice não é mais utilizado
+
+    float score = cache_position >= 0 ? tables.cache[cache_position] : 0.0f;
+    return score + tables.valence[std::min(remaining_valence, (unsigned int)FORSYTH_MAX_VALENCE)];
+}
+
+// Tabela hash (endereçamento aberto) utilizada para encontrar vértices
+// idênticos. Guarda o índice do vértice já inserido em "vertices".
+class VertexWelder
+{
+public:
+    VertexWelder(size_t max_vertices, size_t vertex_floats)
+        : vertex_floats(vertex_floats)
+    {
+        size_t capacity = 16;
+        while ( capacity < 2*max_vertices )
+            capacity *= 2;
+        table.assign(capacity, EMPTY);
+        vertices.reserve(max_vertices * vertex_floats);
+    }
+
+    // Retorna o índice de "vertex", inserindo-o se ainda não existir
+    uint32_t insert(const float* vertex)
+    {
+        size_t mask = table.size() - 1;
+        size_t slot = hash(vertex) & mask;
+        for (;;)
+        {
+            uint32_t index = table[slot];
+            if ( index == EMPTY )
+            {
+                index = (uint32_t)(vertices.size() / vertex_floats);
+                vertices.insert(vertices.end(), vertex, vertex + vertex_floats);
+                table[slot] = index;
+                return index;
+            }
+            if ( memcmp(&vertices[index * vertex_floats], vertex, vertex_floats * sizeof(float)) == 0 )
+                return index;
+            slot = (slot + 1) & mask;
+        }
+    }
+
+    const std::vector<float>& getVertices() const { return vertices; }
+
+private:
+    static const uint32_t EMPTY = 0xFFFFFFFFu;
+
+    size_t hash(const float* vertex) const
+    {
+        // FNV-1a sobre a representação binária dos floats
+        uint64_t h = 0xcbf29ce484222325ULL;
+        for (size_t i = 0; i < vertex_floats; ++i)
+        {
+            uint32_t bits;
+            memcpy(&bits, &vertex[i], sizeof(bits));
+            h = (h ^ bits) * 0x100000001b3ULL;
+        }
+        return (size_t)(h ^ (h >> 32));
+    }
+
+    size_t                vertex_floats;
+    std::vector<uint32_t> table;
+    std::vector<float>    vertices;
+};
+
+// Definição exigida pelo uso de EMPTY por referência em table.assign()
+const uint32_t VertexWelder::EMPTY;
+
+// Resultado da otimização de um objeto, antes de ser concatenado na malha final
+struct OptimizedShape
+{
+    std::vector<float>    vertices; // Vértices intercalados com "vertex_floats" floats cada
+    std::vector<uint32_t> indices;  // Índices locais ao objeto
+    MeshOptimizerStats    stats;
+};
+
+void OptimizeShape(const MeshData& mesh, const MeshShape& shape, bool has_normals, bool has_texcoords, OptimizedShape* result)
+{
+    const size_t vertex_floats = 4 + (has_normals ? 4 : 0) + (has_texcoords ? 2 : 0);
+    const uint32_t* indices = mesh.indices.data() + shape.first_index;
+
+    // Estatísticas da malha original
+    std::vector<uint32_t> distinct(indices, indices + shape.num_indices);
+    std::sort(distinct.begin(), distinct.end());
+    result->stats.vertices_before = std::unique(distinct.begin(), distinct.end()) - distinct.begin();
+    result->stats.acmr_before = MeshOptimizer_ACMR(indices, shape.num_indices);
+
+    // 1. Welding
+    VertexWelder welder(result->stats.vertices_before, vertex_floats);
+    result->indices.resize(shape.num_indices);
+    float vertex[MAX_VERTEX_FLOATS];
+    for (size_t i = 0; i < shape.num_indices; ++i)
+    {
+        size_t v = indices[i];
+        float* p = vertex;
+        memcpy(p, &mesh.model_coefficients[4*v], 4*sizeof(float));
+        p += 4;
+        if ( has_normals )
+        {
+            memcpy(p, &mesh.normal_coefficients[4*v], 4*sizeof(float));
+            p += 4;
+        }
+        if ( has_texcoords )
+            memcpy(p, &mesh.texture_coefficients[2*v], 2*sizeof(float));
+        result->indices[i] = welder.insert(vertex);
+    }
+    const std::vector<float>& welded = welder.getVertices();
+    const size_t num_vertices = welded.size() / vertex_floats;
+
+    // 2. Ordem dos triângulos
+    MeshOptimizer_OptimizeVertexCache(result->indices.data(), result->indices.size(), num_vertices);
+
+    // 3. Ordem dos vértices: ordem do primeiro uso pelos triângulos
+    std::vector<uint32_t> remap(num_vertices, 0xFFFFFFFFu);
+    uint32_t next_vertex = 0;
+    result->vertices.resize(welded.size());
+    for (size_t i = 0; i < result->indices.size(); ++i)
+    {
+        uint32_t v = result->indices[i];
+        if ( remap[v] == 0xFFFFFFFFu )
+        {
+            remap[v] = next_vertex;
+            memcpy(&result->vertices[next_vertex * vertex_floats], &welded[v * vertex_floats], vertex_floats * sizeof(float));
+            next_vertex++;
+        }
+        result->indices[i] = remap[v];
+    }
+
+    result->stats.vertices_after = num_vertices;
+    result->stats.acmr_after = MeshOptimizer_ACMR(result->indices.data(), result->indices.size());
+}
+
+} // namespace
+
+void MeshOptimizer_Optimize(MeshData* mesh, std::vector<MeshOptimizerStats>* stats)
+{
+    const size_t num_vertices = mesh->model_coefficients.size() / 4;
+    const bool has_normals   = !mesh->normal_coefficients.empty();
+    const bool has_texcoords = !mesh->texture_coefficients.empty();
+
+    // Os atributos precisam estar alinhados (um por vértice) para que possamos
+    // comparar vértices; caso contrário deixamos a malha como está.
+    bool valid = (!has_normals   || mesh->normal_coefficients.size()  == 4*num_vertices)
+              && (!has_texcoords || mesh->texture_coefficients.size() == 2*num_vertices);
+    for (size_t i = 0; valid && i < mesh->indices.size(); ++i)
+        valid = mesh->indices[i] < num_vertices;
+    for (size_t s = 0; valid && s < mesh->shapes.size(); ++s)
+        valid = mesh->shapes[s].num_indices % 3 == 0;
+
+    if ( !valid )
+    {
+        if ( stats )
+        {
+            stats->resize(mesh->shapes.size());
+            for (size_t s = 0; s < mesh->shapes.size(); ++s)
+            {
+                const MeshShape& shape = mesh->shapes[s];
+                MeshOptimizerStats& st = (*stats)[s];
+                st.vertices_before = st.vertices_after = shape.num_vertices;
+                st.acmr_before = st.acmr_after = MeshOptimizer_ACMR(&mesh->indices[shape.first_index], shape.num_indices);
+            }
+        }
+        return;
+    }
+
+    // Cada objeto é otimizado de forma independente, em paralelo
+    std::vector<OptimizedShape> optimized(mesh->shapes.size());
+    ParallelFor(mesh->shapes.size(), 1, [&](size_t begin, size_t end) {
+        for (size_t s = begin; s < end; ++s)
+            OptimizeShape(*mesh, mesh->shapes[s], has_normals, has_texcoords, &optimized[s]);
+    });
+
+    // Concatenação dos objetos otimizados
+    size_t total_vertices = 0;
+    for (size_t s = 0; s < optimized.size(); ++s)
+        total_vertices += optimized[s].stats.vertices_after;
+
+    const size_t vertex_floats = 4 + (has_normals ? 4 : 0) + (has_texcoords ? 2 : 0);
+    std::vector<float> model_coefficients;
+    std::vector<float> normal_coefficients;
+    std::vector<float> texture_coefficients;
+    model_coefficients.reserve(4*total_vertices);
+    if ( has_normals )
+        normal_coefficients.reserve(4*total_vertices);
+    if ( has_texcoords )
+        texture_coefficients.reserve(2*total_vertices);
+
+    if ( stats )
+        stats->resize(mesh->shapes.size());
+
+    for (size_t s = 0; s < optimized.size(); ++s)
+    {
+        const OptimizedShape& shape = optimized[s];
+        const size_t first_vertex = model_coefficients.size() / 4;
+
+        for (size_t v = 0; v < shape.stats.vertices_after; ++v)
+        {
+            const float* vertex = &shape.vertices[v * vertex_floats];
+            model_coefficients.insert(model_coefficients.end(), vertex, vertex + 4);
+            vertex += 4;
+            if ( has_normals )
+            {
+                normal_coefficients.insert(normal_coefficients.end(), vertex, vertex + 4);
+                vertex += 4;
+            }
+            if ( has_texcoords )
+                texture_coefficients.insert(texture_coefficients.end(), vertex, vertex + 2);
+        }
+
+        MeshShape& mesh_shape = mesh->shapes[s];
+        for (size_t i = 0; i < shape.indices.size(); ++i)
+            mesh->indices[mesh_shape.first_index + i] = (uint32_t)(first_vertex + shape.indices[i]);
+        mesh_shape.first_vertex = first_vertex;
+        mesh_shape.num_vertices = shape.stats.vertices_after;
+
+        if ( stats )
+            (*stats)[s] = shape.stats;
+    }
+
+    mesh->model_coefficients.swap(model_coefficients);
+    mesh->normal_coefficients.swap(normal_coefficients);
+    mesh->texture_coefficients.swap(texture_coefficients);
+}
+
+void MeshOptimizer_OptimizeVertexCache(uint32_t* indices, size_t num_indices, size_t num_vertices)
+{
+    static const ForsythScoreTables tables;
+
+    const size_t num_triangles = num_indices / 3;
+    if ( num_triangles == 0 )
+        return;
+
+    // Lista de triângulos que utilizam cada vértice
+    std::vector<uint32_t> first_triangle(num_vertices + 1, 0);
+    for (size_t i = 0; i < 3*num_triangles; ++i)
+        first_triangle[indices[i] + 1]++;
+    for (size_t v = 0; v < num_vertices; ++v)
+        first_triangle[v+1] += first_triangle[v];
+
+    std::vector<uint32_t> remaining(num_vertices, 0); // Triângulos ainda não emitidos de cada vértice
+    std::vector<uint32_t> vertex_triangles(3*num_triangles);
+    for (size_t t = 0; t < num_triangles; ++t)
+    {
+        for (size_t k = 0; k < 3; ++k)
+        {
+            uint32_t v = indices[3*t + k];
+            vertex_triangles[first_triangle[v] + remaining[v]++] = (uint32_t)t;
+        }
+    }
+
+    std::vector<int>   cache_position(num_vertices, -1);
+    std::vector<float> vertex_score(num_vertices);
+    for (size_t v = 0; v < num_vertices; ++v)
+        vertex_score[v] = VertexScore(tables, -1, remaining[v]);
+
+    std::vector<float> triangle_score(num_triangles);
+    std::vector<char>  emitted(num_triangles, 0);
+    for (size_t t = 0; t < num_triangles; ++t)
+        triangle_score[t] = vertex_score[indices[3*t+0]] + vertex_score[indices[3*t+1]] + vertex_score[indices[3*t+2]];
+
+    std::vector<uint32_t> output(3*num_triangles);
+    std::vector<uint32_t> cache;
+    std::vector<uint32_t> new_cache;
+    cache.reserve(FORSYTH_CACHE_SIZE + 3);
+    new_cache.reserve(FORSYTH_CACHE_SIZE + 3);
+
+    size_t best_triangle = 0;
+    for (size_t t = 1; t < num_triangles; ++t)
+        if ( triangle_score[t] > triangle_score[best_triangle] )
+            best_triangle = t;
+
+    size_t next_unemitted = 0; // Para quando nenhum triângulo da cache tem vértices restantes
+    for (size_t n = 0; n < num_triangles; ++n)
+    {
+        if ( best_triangle == (size_t)-1 )
+        {
+            while ( emitted[next_unemitted] )
+                next_unemitted++;
+            best_triangle = next_unemitted;
+        }
+
+        const uint32_t* tri = &indices[3*best_triangle];
+        output[3*n+0] = tri[0];
+        output[3*n+1] = tri[1];
+        output[3*n+2] = tri[2];
+        emitted[best_triangle] = 1;
+
+        // Removemos o triângulo das listas dos seus vértices
+        for (size_t k = 0; k < 3; ++k)
+        {
+            uint32_t v = tri[k];
+            uint32_t* list = &vertex_triangles[first_triangle[v]];
+            for (uint32_t i = 0; i < remaining[v]; ++i)
+            {
+                if ( list[i] == best_triangle )
+                {
+                    list[i] = list[remaining[v] - 1];
+                    break;
+                }
+            }
+            remaining[v]--;
+        }
+
+        // Os vértices do triângulo emitido vão para o início da cache (LRU)
+        new_cache.assign(tri, tri + 3);
+        for (size_t i = 0; i < cache.size(); ++i)
+            if ( cache[i] != tri[0] && cache[i] != tri[1] && cache[i] != tri[2] )
+                new_cache.push_back(cache[i]);
+        cache.swap(new_cache);
+
+        // Atualizamos as pontuações dos vértices da cache (e dos que saíram
+        // dela) e escolhemos o melhor triângulo entre os que os utilizam.
+        for (size_t i = 0; i < cache.size(); ++i)
+        {
+            uint32_t v = cache[i];
+            cache_position[v] = i < (size_t)FORSYTH_CACHE_SIZE ? (int)i : -1;
+            vertex_score[v] = VertexScore(tables, cache_position[v], remaining[v]);
+        }
+
+        best_triangle = (size_t)-1;
+        float best_score = -1.0f;
+        for (size_t i = 0; i < cache.size(); ++i)
+        {
+            uint32_t v = cache[i];
+            const uint32_t* list = &vertex_triangles[first_triangle[v]];
+            for (uint32_t j = 0; j < remaining[v]; ++j)
+            {
+                uint32_t t = list[j];
+                float score = vertex_score[indices[3*t+0]] + vertex_score[indices[3*t+1]] + vertex_score[indices[3*t+2]];
+                triangle_score[t] = score;
+                if ( score > best_score )
+                {
+                    best_score = score;
+                    best_triangle = t;
+                }
+            }
+        }
+
+        if ( cache.size() > (size_t)FORSYTH_CACHE_SIZE )
+            cache.resize(FORSYTH_CACHE_SIZE);
+    }
+
+    std::copy(output.begin(), output.end(), indices);
+}
+
+float MeshOptimizer_ACMR(const uint32_t* indices, size_t num_indices, unsigned int cache_size)
+{
+    if ( num_indices < 3 )
+        return 0.0f;
+
+    uint32_t max_index = 0;
+    for (size_t i = 0; i < num_indices; ++i)
+        max_index = std::max(max_index, indices[i]);
+
+    // Cache FIFO simulada guardando, para cada vértice, o "instante" em que
+    // ele entrou na cache: ele ainda está na cache se entrou há menos de
+    // "cache_size" faltas.
+    std::vector<size_t> time_loaded((size_t)max_index + 1, 0);
+    size_t time = cache_size + 1;
+    size_t misses = 0;
+    for (size_t i = 0; i < num_indices; ++i)
+    {
+        uint32_t v = indices[i];
+        if ( time - time_loaded[v] > cache_size )
+        {
+            time_loaded[v] = time++;
+            misses++;
+        }
+    }
+
+    return (float)misses / (float)(num_indices / 3);
+}
@@ -0,0 +1,779 @@
+// Leitor paralelo de arquivos OBJ. Veja comentários em "objparser.h".
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+
+#include "objparser.h"
+#include "mappedfile.h"
+#include "threadpool.h"
+
+namespace
+{
+
+// Valor especial de smoothing group: a face usa o smoothing group herdado do
+// bloco anterior (o comando "s" correspondente está em outro bloco).
+const unsigned int SGROUP_INHERIT = 0xFFFFFFFFu;
+
+// Bits de ObjCorner::relative: o índice correspondente é relativo ao número
+// de elementos lidos até então DENTRO do bloco (índices negativos no OBJ), e
+// precisa ser somado à base do bloco durante a junção.
+const unsigned char RELATIVE_V  = 0x1;
+const unsigned char RELATIVE_VT = 0x2;
+const unsigned char RELATIVE_VN = 0x4;
+
+// Tamanho mínimo de um bloco; arquivos pequenos não são divididos.
+const size_t MIN_CHUNK_SIZE = 256 * 1024;
+
+// Um vértice de uma face, como lido do arquivo (já convertido para índices
+// começando em zero; -1 indica ausência de normal ou coordenada de textura).
+struct ObjCorner
+{
+    int v;
+    int vt;
+    int vn;
+    unsigned char relative;
+};
+
+struct ObjFace
+{
+    size_t       first_corner;
+    size_t       num_corners;
+    unsigned int smoothing_group;
+};
+
+// Início de um novo objeto (comandos "g" ou "o") antes da face "face" do bloco
+struct ObjShapeEvent
+{
+    size_t      face;
+    std::string name;
+};
+
+// Resultado da leitura de um bloco do arquivo
+struct ObjChunk
+{
+    const char* begin;
+    const char* end;
+
+    std::vector<float>         v;
+    std::vector<float>         vn;
+    std::vector<float>         vt;
+    std::vector<ObjCorner>     corners;
+    std::vector<ObjFace>       faces;
+    std::vector<ObjShapeEvent> events;
+    unsigned int               final_smoothing_group; // SGROUP_INHERIT se não há comando "s"
+    size_t                     degenerate_faces;
+    const char*                error_position;        // NULL se não houve erro
+
+    // Preenchidos durante a junção dos blocos
+    size_t       v_base;
+    size_t       vn_base;
+    size_t       vt_base;
+    unsigned int initial_smoothing_group;
+    std::vector<tinyobj::index_t> out_indices;
+    std::vector<unsigned char>    out_num_face_vertices;
+    std::vector<unsigned int>     out_smoothing_group_ids;
+    std::vector<size_t>           face_first_output;        // Primeira face de saída de cada face lida (+1 sentinela)
+    std::vector<size_t>           face_first_output_corner; // Idem, para out_indices
+};
+
+// Trecho contínuo de faces de saída de um bloco que pertencem a um objeto
+struct ObjSegment
+{
+    const ObjChunk* chunk;
+    size_t          first_face;
+    size_t          end_face;
+    size_t          first_corner;
+    size_t          end_corner;
+};
+
+inline bool IsSpace(char c)
+{
+    return c == ' ' || c == '\t';
+}
+
+inline bool IsDigit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+inline const char* SkipSpaces(const char* p, const char* end)
+{
+    while ( p < end && IsSpace(*p) )
+        ++p;
+    return p;
+}
+
+inline double Pow10(int exponent)
+{
+    // Potências de 10 exatamente representáveis em double
+    static const double table[] = {
+        1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+    if ( exponent >= 0 && exponent <= 22 )
+        return table[exponent];
+    return std::pow(10.0, (double)exponent);
+}
+
+// Leitura rápida de um número real. Acumulamos até 19 dígitos significativos
+// em um inteiro de 64 bits e aplicamos o expoente com uma única multiplicação
+// ou divisão por uma potência de 10 exata, evitando strtod() (que depende do
+// locale e é bem mais lento). Retorna false se não há número em "p".
+inline bool ParseFloat(const char** p_inout, const char* end, float* out)
+{
+    const char* p = SkipSpaces(*p_inout, end);
+
+    bool negative = false;
+    if ( p < end && (*p == '-' || *p == '+') )
+    {
+        negative = (*p == '-');
+        ++p;
+    }
+
+    unsigned long long mantissa = 0;
+    int exponent = 0;
+    int significant_digits = 0;
+    bool any_digit = false;
+
+    for ( ; p < end && IsDigit(*p); ++p )
+    {
+        any_digit = true;
+        if ( significant_digits < 19 )
+        {
+            mantissa = mantissa*10 + (unsigned)(*p - '0');
+            if ( mantissa != 0 )
+                significant_digits++;
+        }
+        else
+            exponent++;
+    }
+
+    if ( p < end && *p == '.' )
+    {
+        ++p;
+        for ( ; p < end && IsDigit(*p); ++p )
+        {
+            any_digit = true;
+            if ( significant_digits < 19 )
+            {
+                mantissa = mantissa*10 + (unsigned)(*p - '0');
+                if ( mantissa != 0 )
+                    significant_digits++;
+                exponent--;
+            }
+        }
+    }
+
+    if ( !any_digit )
+        return false;
+
+    if ( p < end && (*p == 'e' || *p == 'E') )
+    {
+        const char* q = p + 1;
+        bool negative_exponent = false;
+        if ( q < end && (*q == '-' || *q == '+') )
+        {
+            negative_exponent = (*q == '-');
+            ++q;
+        }
+        if ( q < end && IsDigit(*q) )
+        {
+            int e = 0;
+            for ( ; q < end && IsDigit(*q); ++q )
+                if ( e < 10000 )
+                    e = e*10 + (*q - '0');
+            exponent += negative_exponent ? -e : e;
+            p = q;
+        }
+    }
+
+    double value = (double)mantissa;
+    if ( exponent < 0 )
+        value /= Pow10(-exponent);
+    else if ( exponent > 0 )
+        value *= Pow10(exponent);
+
+    *out = (float)(negative ? -value : value);
+    *p_inout = p;
+    return true;
+}
+
+// Assim como a tinyobjloader, componentes ausentes valem zero
+inline float ParseFloatOrZero(const char** p, const char* end)
+{
+    float value = 0.0f;
+    if ( !ParseFloat(p, end, &value) )
+        return 0.0f;
+    return value;
+}
+
+inline int ParseInt(const char** p_inout, const char* end)
+{
+    const char* p = *p_inout;
+    bool negative = false;
+    if ( p < end && (*p == '-' || *p == '+') )
+    {
+        negative = (*p == '-');
+        ++p;
+    }
+    int value = 0;
+    for ( ; p < end && IsDigit(*p); ++p )
+        value = value*10 + (*p - '0');
+    *p_inout = p;
+    return negative ? -value : value;
+}
+
+// Converte um índice do arquivo OBJ (começando em 1, ou negativo para índices
+// relativos) para um índice começando em zero. Índices relativos são
+// convertidos para um índice relativo ao início do bloco e marcados em
+// "relative"; eles serão corrigidos na junção dos blocos.
+inline void ConvertIndex(int raw, size_t local_count, int* out, unsigned char* relative, unsigned char relative_bit)
+{
+    if ( raw > 0 )
+        *out = raw - 1;
+    else if ( raw < 0 )
+    {
+        *out = (int)local_count + raw;
+        *relative |= relative_bit;
+    }
+    else
+        *out = -1; // Zero é inválido; tratado pelo chamador
+}
+
+// Lê um bloco [chunk->begin, chunk->end) do arquivo, que sempre começa no
+// início de uma linha e termina no fim de uma linha.
+void ParseChunk(ObjChunk* chunk)
+{
+    const char* p = chunk->begin;
+    const char* end = chunk->end;
+    unsigned int smoothing_group = SGROUP_INHERIT;
+
+    chunk->final_smoothing_group = SGROUP_INHERIT;
+    chunk->degenerate_faces = 0;
+    chunk->error_position = NULL;
+
+    // Estimativa grosseira para evitar realocações: ~30 bytes por linha
+    size_t estimated_lines = (size_t)(end - p) / 30;
+    chunk->v.reserve(estimated_lines * 3 / 2);
+    chunk->corners.reserve(estimated_lines * 2);
+    chunk->faces.reserve(estimated_lines / 2);
+
+    while ( p < end )
+    {
+        const char* line_end = (const char*)memchr(p, '\n', (size_t)(end - p));
+        if ( line_end == NULL )
+            line_end = end;
+        const char* next_line = line_end < end ? line_end + 1 : end;
+
+        // Removemos '\r' do final da linha (arquivos do Windows)
+        while ( line_end > p && (line_end[-1] == '\r') )
+            --line_end;
+
+        const char* t = SkipSpaces(p, line_end);
+        p = next_line;
+
+        if ( t + 1 >= line_end || *t == '#' )
+            continue;
+
+        if ( t[0] == 'v' && IsSpace(t[1]) )
+        {
+            t += 2;
+            chunk->v.push_back(ParseFloatOrZero(&t, line_end));
+            chunk->v.push_back(ParseFloatOrZero(&t, line_end));
+            chunk->v.push_back(ParseFloatOrZero(&t, line_end));
+        }
+        else if ( t[0] == 'v' && t[1] == 'n' && t + 2 < line_end && IsSpace(t[2]) )
+        {
+            t += 3;
+            chunk->vn.push_back(ParseFloatOrZero(&t, line_end));
+            chunk->vn.push_back(ParseFloatOrZero(&t, line_end));
+            chunk->vn.push_back(ParseFloatOrZero(&t, line_end));
+        }
+        else if ( t[0] == 'v' && t[1] == 't' && t + 2 < line_end && IsSpace(t[2]) )
+        {
+            t += 3;
+            chunk->vt.push_back(ParseFloatOrZero(&t, line_end));
+            chunk->vt.push_back(ParseFloatOrZero(&t, line_end));
+        }
+        else if ( t[0] == 'f' && IsSpace(t[1]) )
+        {
+            t += 2;
+            ObjFace face;
+            face.first_corner = chunk->corners.size();
+            face.smoothing_group = smoothing_group;
+
+            for (;;)
+            {
+                t = SkipSpaces(t, line_end);
+                if ( t >= line_end )
+                    break;
+
+                ObjCorner corner;
+                corner.relative = 0;
+                corner.vt = -1;
+                corner.vn = -1;
+
+                int raw_v = ParseInt(&t, line_end);
+                if ( raw_v == 0 )
+                {
+                    chunk->error_position = t;
+                    return;
+                }
+                ConvertIndex(raw_v, chunk->v.size() / 3, &corner.v, &corner.relative, RELATIVE_V);
+
+                if ( t < line_end && *t == '/' )
+                {
+                    ++t;
+                    if ( t < line_end && *t != '/' && !IsSpace(*t) )
+                        ConvertIndex(ParseInt(&t, line_end), chunk->vt.size() / 2, &corner.vt, &corner.relative, RELATIVE_VT);
+                    if ( t < line_end && *t == '/' )
+                    {
+                        ++t;
+                        ConvertIndex(ParseInt(&t, line_end), chunk->vn.size() / 3, &corner.vn, &corner.relative, RELATIVE_VN);
+                    }
+                }
+
+                // Qualquer outro caractere no meio de um índice é um erro
+                if ( t < line_end && !IsSpace(*t) )
+                {
+                    chunk->error_position = t;
+                    return;
+                }
+
+                chunk->corners.push_back(corner);
+            }
+
+            face.num_corners = chunk->corners.size() - face.first_corner;
+            if ( face.num_corners < 3 )
+            {
+                chunk->corners.resize(face.first_corner);
+                chunk->degenerate_faces++;
+                continue;
+            }
+            chunk->faces.push_back(face);
+        }
+        else if ( t[0] == 'g' && IsSpace(t[1]) )
+        {
+            // Múltiplos nomes de grupo são concatenados com espaços, assim
+            // como na tinyobjloader.
+            ObjShapeEvent event;
+            event.face = chunk->faces.size();
+            t += 2;
+            for (;;)
+            {
+                t = SkipSpaces(t, line_end);
+                if ( t >= line_end )
+                    break;
+                const char* name_begin = t;
+                while ( t < line_end && !IsSpace(*t) )
+                    ++t;
+                if ( !event.name.empty() )
+                    event.name += ' ';
+                event.name.append(name_begin, t);
+            }
+            chunk->events.push_back(event);
+        }
+        else if ( t[0] == 'o' && IsSpace(t[1]) )
+        {
+            // Assim como na tinyobjloader, o nome é o resto da linha
+            ObjShapeEvent event;
+            event.face = chunk->faces.size();
+            event.name.assign(t + 2, line_end);
+            chunk->events.push_back(event);
+        }
+        else if ( t[0] == 's' && IsSpace(t[1]) )
+        {
+            t = SkipSpaces(t + 2, line_end);
+            if ( t >= line_end )
+                continue;
+            if ( line_end - t >= 3 && t[0] == 'o' && t[1] == 'f' && t[2] == 'f' )
+                smoothing_group = 0;
+            else
+            {
+                int id = ParseInt(&t, line_end);
+                smoothing_group = id < 0 ? 0u : (unsigned int)id;
+            }
+            chunk->final_smoothing_group = smoothing_group;
+        }
+        // Outros comandos (mtllib, usemtl, l, p, ...) são ignorados
+    }
+}
+
+// Corrige os índices relativos e os smoothing groups herdados de um bloco e
+// triangula suas faces, gerando os vetores "out_*" do bloco.
+bool ResolveChunk(ObjChunk* chunk, const tinyobj::attrib_t& attrib, bool triangulate)
+{
+    const int num_v  = (int)(attrib.vertices.size() / 3);
+    const int num_vt = (int)(attrib.texcoords.size() / 2);
+    const int num_vn = (int)(attrib.normals.size() / 3);
+
+    chunk->out_indices.reserve(chunk->corners.size() + chunk->corners.size() / 2);
+    chunk->face_first_output.resize(chunk->faces.size() + 1);
+    chunk->face_first_output_corner.resize(chunk->faces.size() + 1);
+
+    std::vector<tinyobj::index_t> polygon;
+
+    for (size_t f = 0; f < chunk->faces.size(); ++f)
+    {
+        const ObjFace& face = chunk->faces[f];
+        chunk->face_first_output[f] = chunk->out_num_face_vertices.size();
+        chunk->face_first_output_corner[f] = chunk->out_indices.size();
+
+        unsigned int smoothing_group = face.smoothing_group;
+        if ( smoothing_group == SGROUP_INHERIT )
+            smoothing_group = chunk->initial_smoothing_group;
+
+        polygon.resize(face.num_corners);
+        for (size_t c = 0; c < face.num_corners; ++c)
+        {
+            const ObjCorner& corner = chunk->corners[face.first_corner + c];
+            tinyobj::index_t& idx = polygon[c];
+            idx.vertex_index   = corner.v  + ((corner.relative & RELATIVE_V)  ? (int)chunk->v_base  : 0);
+            idx.texcoord_index = corner.vt + ((corner.relative & RELATIVE_VT) ? (int)chunk->vt_base : 0);
+            idx.normal_index   = corner.vn + ((corner.relative & RELATIVE_VN) ? (int)chunk->vn_base : 0);
+
+            if ( idx.vertex_index < 0 || idx.vertex_index >= num_v
+              || idx.texcoord_index < -1 || idx.texcoord_index >= num_vt
+              || idx.normal_index < -1 || idx.normal_index >= num_vn )
+                return false;
+        }
+
+        size_t n = polygon.size();
+        if ( !triangulate || n == 3 )
+        {
+            chunk->out_indices.insert(chunk->out_indices.end(), polygon.begin(), polygon.end());
+            chunk->out_num_face_vertices.push_back((unsigned char)std::min(n, (size_t)255));
+            chunk->out_smoothing_group_ids.push_back(smoothing_group);
+        }
+        else if ( n == 4 )
+        {
+            // Dividimos o quadrilátero pela menor diagonal (igual à tinyobjloader)
+            const float* v = attrib.vertices.data();
+            const float* p0 = v + 3*polygon[0].vertex_index;
+            const float* p1 = v + 3*polygon[1].vertex_index;
+            const float* p2 = v + 3*polygon[2].vertex_index;
+            const float* p3 = v + 3*polygon[3].vertex_index;
+            float e02x = p2[0] - p0[0], e02y = p2[1] - p0[1], e02z = p2[2] - p0[2];
+            float e13x = p3[0] - p1[0], e13y = p3[1] - p1[1], e13z = p3[2] - p1[2];
+            float sqr02 = e02x*e02x + e02y*e02y + e02z*e02z;
+            float sqr13 = e13x*e13x + e13y*e13y + e13z*e13z;
+
+            static const int split02[6] = { 0, 1, 2, 0, 2, 3 };
+            static const int split13[6] = { 0, 1, 3, 1, 2, 3 };
+            const int* order = sqr02 < sqr13 ? split02 : split13;
+            for (int i = 0; i < 6; ++i)
+                chunk->out_indices.push_back(polygon[order[i]]);
+            for (int i = 0; i < 2; ++i)
+            {
+                chunk->out_num_face_vertices.push_back(3);
+                chunk->out_smoothing_group_ids.push_back(smoothing_group);
+            }
+        }
+        else
+        {
+            // Triangulação em leque
+            for (size_t i = 1; i + 1 < n; ++i)
+            {
+                chunk->out_indices.push_back(polygon[0]);
+                chunk->out_indices.push_back(polygon[i]);
+                chunk->out_indices.push_back(polygon[i+1]);
+                chunk->out_num_face_vertices.push_back(3);
+                chunk->out_smoothing_group_ids.push_back(smoothing_group);
+            }
+        }
+    }
+
+    chunk->face_first_output[chunk->faces.size()] = chunk->out_num_face_vertices.size();
+    chunk->face_first_output_corner[chunk->faces.size()] = chunk->out_indices.size();
+    return true;
+}
+
+// Cria um shape_t a partir dos trechos de faces que pertencem a ele
+void ExportShape(const std::string& name, const std::vector<ObjSegment>& segments, std::vector<tinyobj::shape_t>* shapes)
+{
+    size_t num_faces = 0;
+    for (size_t i = 0; i < segments.size(); ++i)
+        num_faces += segments[i].end_face - segments[i].first_face;
+    if ( num_faces == 0 )
+        return;
+
+    shapes->push_back(tinyobj::shape_t());
+    tinyobj::shape_t& shape = shapes->back();
+    shape.name = name;
+    shape.mesh.num_face_vertices.reserve(num_faces);
+    shape.mesh.smoothing_group_ids.reserve(num_faces);
+    shape.mesh.material_ids.assign(num_faces, -1);
+
+    for (size_t i = 0; i < segments.size(); ++i)
+    {
+        const ObjSegment& s = segments[i];
+        const ObjChunk* chunk = s.chunk;
+
+        shape.mesh.indices.insert(shape.mesh.indices.end(),
+            chunk->out_indices.begin() + s.first_corner, chunk->out_indices.begin() + s.end_corner);
+        shape.mesh.num_face_vertices.insert(shape.mesh.num_face_vertices.end(),
+            chunk->out_num_face_vertices.begin() + s.first_face, chunk->out_num_face_vertices.begin() + s.end_face);
+        shape.mesh.smoothing_group_ids.insert(shape.mesh.smoothing_group_ids.end(),
+            chunk->out_smoothing_group_ids.begin() + s.first_face, chunk->out_smoothing_group_ids.begin() + s.end_face);
+    }
+}
+
+// Número da linha (começando em 1) correspondente a uma posição do arquivo
+size_t LineNumber(const char* begin, const char* position)
+{
+    return 1 + (size_t)std::count(begin, position, '\n');
+}
+
+} // namespace
+
+bool ObjParser_BackendFromName(const std::string& name, ObjParserBackend* backend)
+{
+    if ( name == "tinyobj" )
+        *backend = OBJPARSER_TINYOBJ;
+    else if ( name == "parallel" )
+        *backend = OBJPARSER_PARALLEL;
+    else
+        return false;
+    return true;
+}
+
+const char* ObjParser_BackendName(ObjParserBackend backend)
+{
+    return backend == OBJPARSER_PARALLEL ? "parallel" : "tinyobj";
+}
+
+bool ObjParser_LoadParallel(tinyobj::attrib_t* attrib, std::vector<tinyobj::shape_t>* shapes,
+                            std::string* warn, std::string* err,
+                            const char* filename, bool triangulate)
+{
+    MappedFile file;
+    if ( !file.open(filename) )
+    {
+        if ( err )
+            *err += "Cannot open file \"" + std::string(filename) + "\".\n";
+        return false;
+    }
+
+    const char* data = (const char*)file.getData();
+    const char* data_end = data + file.getSize();
+
+    // Dividimos o arquivo em blocos que terminam sempre em um '\n'. Criamos
+    // mais blocos do que threads para balancear a carga.
+    size_t num_chunks = 4 * ThreadPool_NumThreads();
+    size_t chunk_size = std::max(MIN_CHUNK_SIZE, file.getSize() / num_chunks + 1);
+
+    std::vector<ObjChunk> chunks;
+    const char* p = data;
+    while ( p < data_end )
+    {
+        const char* end = p + std::min(chunk_size, (size_t)(data_end - p));
+        if ( end < data_end )
+        {
+            const char* newline = (const char*)memchr(end, '\n', (size_t)(data_end - end));
+            end = newline ? newline + 1 : data_end;
+        }
+        chunks.push_back(ObjChunk());
+        chunks.back().begin = p;
+        chunks.back().end = end;
+        p = end;
+    }
+
+    // 1) Leitura em paralelo de cada bloco
+    ParallelFor(chunks.size(), 1, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i)
+            ParseChunk(&chunks[i]);
+    });
+
+    // 2) Bases de cada bloco e smoothing group herdado (sequencial, O(blocos))
+    size_t total_v = 0, total_vn = 0, total_vt = 0, degenerate_faces = 0;
+    unsigned int smoothing_group = 0;
+    for (size_t i = 0; i < chunks.size(); ++i)
+    {
+        ObjChunk& chunk = chunks[i];
+        if ( chunk.error_position != NULL )
+        {
+            if ( err )
+            {
+                char buffer[64];
+                snprintf(buffer, sizeof(buffer), "%lu", (unsigned long)LineNumber(data, chunk.error_position));
+                *err += "Failed to parse `f' line (e.g. a zero value for vertex index). Line " + std::string(buffer) + ".\n";
+            }
+            return false;
+        }
+        chunk.v_base  = total_v;
+        chunk.vn_base = total_vn;
+        chunk.vt_base = total_vt;
+        chunk.initial_smoothing_group = smoothing_group;
+        if ( chunk.final_smoothing_group != SGROUP_INHERIT )
+            smoothing_group = chunk.final_smoothing_group;
+        total_v  += chunk.v.size() / 3;
+        total_vn += chunk.vn.size() / 3;
+        total_vt += chunk.vt.size() / 2;
+        degenerate_faces += chunk.degenerate_faces;
+    }
+
+    if ( degenerate_faces > 0 && warn )
+        *warn += "Degenerated face found.\n";
+
+    // 3) Concatenação dos atributos, em paralelo
+    attrib->vertices.resize(3 * total_v);
+    attrib->normals.resize(3 * total_vn);
+    attrib->texcoords.resize(2 * total_vt);
+    attrib->vertex_weights.clear();
+    attrib->texcoord_ws.clear();
+    attrib->colors.clear();
+
+    ParallelFor(chunks.size(), 1, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i)
+        {
+            const ObjChunk& chunk = chunks[i];
+            std::copy(chunk.v.begin(),  chunk.v.end(),  attrib->vertices.begin()  + 3*chunk.v_base);
+            std::copy(chunk.vn.begin(), chunk.vn.end(), attrib->normals.begin()   + 3*chunk.vn_base);
+            std::copy(chunk.vt.begin(), chunk.vt.end(), attrib->texcoords.begin() + 2*chunk.vt_base);
+        }
+    });
+
+    // 4) Correção de índices e triangulação, em paralelo
+    std::vector<char> resolved(chunks.size(), 0);
+    ParallelFor(chunks.size(), 1, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i)
+            resolved[i] = ResolveChunk(&chunks[i], *attrib, triangulate) ? 1 : 0;
+    });
+
+    for (size_t i = 0; i < chunks.size(); ++i)
+    {
+        if ( !resolved[i] )
+        {
+            if ( err )
+                *err += "Face with invalid vertex, normal or texcoord index found.\n";
+            return false;
+        }
+    }
+
+    // 5) Montagem dos objetos. Um novo objeto começa a cada comando "g" ou
+    // "o"; objetos sem faces são descartados, como na tinyobjloader.
+    shapes->clear();
+    std::string name;
+    std::vector<ObjSegment> segments;
+    for (size_t i = 0; i < chunks.size(); ++i)
+    {
+        const ObjChunk& chunk = chunks[i];
+        size_t face = 0;
+        for (size_t e = 0; e <= chunk.events.size(); ++e)
+        {
+            size_t event_face = e < chunk.events.size() ? chunk.events[e].face : chunk.faces.size();
+
+            ObjSegment segment;
+            segment.chunk      = &chunk;
+            segment.first_face = chunk.face_first_output[face];
+            segment.end_face   = chunk.face_first_output[event_face];
+            segment.first_corner = chunk.face_first_output_corner[face];
+            segment.end_corner   = chunk.face_first_output_corner[event_face];
+            if ( segment.end_face > segment.first_face )
+                segments.push_back(segment);
+            face = event_face;
+
+            if ( e < chunk.events.size() )
+            {
+                ExportShape(name, segments, shapes);
+                segments.clear();
+                name = chunk.events[e].name;
+            }
+        }
+    }
+    ExportShape(name, segments, shapes);
+
+    return true;
+}
+
+void ObjParser_Benchmark(const char* filename, int repetitions)
+{
+    typedef std::chrono::steady_clock clock;
+
+    if ( repetitions < 1 )
+        repetitions = 1;
+
+    FileInfo info;
+    if ( !GetFileInfo(filename, &info) )
+    {
+        fprintf(stderr, "ERROR: Cannot open file \"%s\".\n", filename);
+        return;
+    }
+
+    printf("Benchmark do leitor de OBJ: \"%s\" (%.2f MB), %d repetições, %u threads\n",
+           filename, info.size / (1024.0*1024.0), repetitions, ThreadPool_NumThreads());
+
+    tinyobj::attrib_t attrib[2];
+    std::vector<tinyobj::shape_t> shapes[2];
+    double best_ms[2] = { 1e30, 1e30 };
+    double total_ms[2] = { 0.0, 0.0 };
+
+    for (int backend = 0; backend < 2; ++backend)
+    {
+        for (int r = 0; r < repetitions; ++r)
+        {
+            attrib[backend] = tinyobj::attrib_t();
+            shapes[backend].clear();
+            std::vector<tinyobj::material_t> materials;
+            std::string warn, err;
+
+            clock::time_point start = clock::now();
+            bool ok;
+            if ( backend == OBJPARSER_TINYOBJ )
+                ok = tinyobj::LoadObj(&attrib[backend], &shapes[backend], &materials, &warn, &err, filename, NULL, true);
+            else
+                ok = ObjParser_LoadParallel(&attrib[backend], &shapes[backend], &warn, &err, filename, true);
+            double ms = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+
+            if ( !ok )
+            {
+                fprintf(stderr, "ERROR: %s falhou: %s\n", ObjParser_BackendName((ObjParserBackend)backend), err.c_str());
+                return;
+            }
+            best_ms[backend] = std::min(best_ms[backend], ms);
+            total_ms[backend] += ms;
+        }
+
+        printf("  %-8s melhor %9.2f ms   média %9.2f ms   %8.1f MB/s\n",
+               ObjParser_BackendName((ObjParserBackend)backend),
+               best_ms[backend], total_ms[backend] / repetitions,
+               info.size / (1024.0*1024.0) / (best_ms[backend] / 1000.0));
+    }
+
+    printf("  speedup: %.2fx\n", best_ms[OBJPARSER_TINYOBJ] / best_ms[OBJPARSER_PARALLEL]);
+
+    // Verificamos se os dois backends produziram o mesmo resultado
+    float max_error = 0.0f;
+    bool same = attrib[0].vertices.size() == attrib[1].vertices.size()
+             && attrib[0].normals.size() == attrib[1].normals.size()
+             && attrib[0].texcoords.size() == attrib[1].texcoords.size()
+             && shapes[0].size() == shapes[1].size();
+
+    for (size_t i = 0; same && i < attrib[0].vertices.size(); ++i)
+        max_error = std::max(max_error, std::fabs(attrib[0].vertices[i] - attrib[1].vertices[i]));
+    for (size_t i = 0; same && i < attrib[0].normals.size(); ++i)
+        max_error = std::max(max_error, std::fabs(attrib[0].normals[i] - attrib[1].normals[i]));
+    for (size_t i = 0; same && i < attrib[0].texcoords.size(); ++i)
+        max_error = std::max(max_error, std::fabs(attrib[0].texcoords[i] - attrib[1].texcoords[i]));
+
+    for (size_t s = 0; same && s < shapes[0].size(); ++s)
+    {
+        const tinyobj::mesh_t& a = shapes[0][s].mesh;
+        const tinyobj::mesh_t& b = shapes[1][s].mesh;
+        same = shapes[0][s].name == shapes[1][s].name
+            && a.indices.size() == b.indices.size()
+            && a.num_face_vertices == b.num_face_vertices
+            && a.smoothing_group_ids == b.smoothing_group_ids;
+        for (size_t i = 0; same && i < a.indices.size(); ++i)
+            same = a.indices[i].vertex_index == b.indices[i].vertex_index
+                && a.indices[i].normal_index == b.indices[i].normal_index
+                && a.indices[i].texcoord_index == b.indices[i].texcoord_index;
+    }
+
+    if ( same )
+        printf("  resultados equivalentes (erro máximo nos atributos: %g)\n", max_error);
+    else
+        printf("  ATENÇÃO: resultados diferentes (polígonos com mais de 4 vértices são triangulados de forma diferente)\n");
+}
@@ -0,0 +1,409 @@
+// Gravação e reprodução de partidas. Veja comentários em "replay.h".
+#include <algorithm>
+#include <cstring>
+
+#include "mappedfile.h"
+#include "replay.h"
+
+namespace
+{
+
+const char REPLAY_MAGIC[8] = { 'K','A','R','T','R','P','L','3' };
+
+// Versões anteriores: sem os modos e sem o hash da pista (1) e somente sem o
+// hash da pista (2)
+const char REPLAY_MAGIC_V1[8] = { 'K','A','R','T','R','P','L','1' };
+const char REPLAY_MAGIC_V2[8] = { 'K','A','R','T','R','P','L','2' };
+
+// Os registros são entregues à thread de escrita a cada keyframe, ou antes
+// se o buffer passar deste tamanho
+const size_t REPLAY_BUFFER_SIZE = 64 * 1024;
+
+void PutVarint(std::vector<uint8_t>* out, uint64_t value)
+{
+    while ( value >= 0x80 )
+    {
+        out->push_back((uint8_t)(value | 0x80));
+        value >>= 7;
+    }
+    out->push_back((uint8_t)value);
+}
+
+void PutFloat(std::vector<uint8_t>* out, float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    for (int i = 0; i < 4; ++i)
+        out->push_back((uint8_t)(bits >> (8 * i)));
+}
+
+// Leitura sequencial de um buffer; "ok" fica false ao passar do fim
+struct ByteReader
+{
+    const uint8_t* data;
+    size_t         size;
+    size_t         offset;
+    bool           ok;
+
+    uint8_t byte()
+    {
+        if ( offset >= size )
+        {
+            ok = false;
+            return 0;
+        }
+        return data[offset++];
+    }
+
+    uint64_t varint()
+    {
+        uint64_t value = 0;
+        for (int shift = 0; shift < 64; shift += 7)
+        {
+            uint8_t b = byte();
+            value |= (uint64_t)(b & 0x7F) << shift;
+            if ( !(b & 0x80) )
+                return value;
+        }
+        ok = false;
+        return 0;
+    }
+
+    float float32()
+    {
+        uint32_t bits = 0;
+        for (int i = 0; i < 4; ++i)
+            bits |= (uint32_t)byte() << (8 * i);
+        float value;
+        memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+};
+
+// Os floats do estado na ordem em que são gravados
+void StateToFloats(const ReplayCarState& state, float* values)
+{
+    memcpy(values + 0, state.position, sizeof(state.position));
+    memcpy(values + 3, state.rotation, sizeof(state.rotation));
+    memcpy(values + 6, state.velocity, sizeof(state.velocity));
+    memcpy(values + 9, state.forwards, sizeof(state.forwards));
+    values[12] = state.turn_angle;
+}
+
+void FloatsToState(const float* values, ReplayCarState* state)
+{
+    memcpy(state->position, values + 0, sizeof(state->position));
+    memcpy(state->rotation, values + 3, sizeof(state->rotation));
+    memcpy(state->velocity, values + 6, sizeof(state->velocity));
+    memcpy(state->forwards, values + 9, sizeof(state->forwards));
+    state->turn_angle = values[12];
+}
+
+} // namespace
+
+ReplayRecorder::ReplayRecorder()
+    : file(NULL)
+    , keyframe_interval(1)
+    , step(0)
+    , last_record_step(0)
+    , last_input(-1)
+    , stopping(false)
+    , failed(false)
+{
+}
+
+ReplayRecorder::~ReplayRecorder()
+{
+    close();
+}
+
+bool ReplayRecorder::open(const std::string& filename, TimeNs step_ns, const CarParams& params, uint32_t interval, uint32_t modes, uint64_t track_hash)
+{
+    close();
+
+    file = fopen(filename.c_str(), "wb");
+    if ( file == NULL )
+        return false;
+
+    keyframe_interval = interval > 0 ? interval : 1;
+    step = 0;
+    last_record_step = 0;
+    last_input = -1;
+    memset(last_bits, 0, sizeof(last_bits));
+    stopping = false;
+    failed = false;
+
+    buffer.assign(REPLAY_MAGIC, REPLAY_MAGIC + sizeof(REPLAY_MAGIC));
+    PutVarint(&buffer, (uint64_t)step_ns);
+    PutVarint(&buffer, keyframe_interval);
+    PutVarint(&buffer, modes);
+    PutVarint(&buffer, track_hash);
+
+    float values[] = {
+#define REPLAY_PARAMS_VALUE(name, value) params.name,
+        CAR_PARAMS_FIELDS(REPLAY_PARAMS_VALUE)
+#undef REPLAY_PARAMS_VALUE
+    };
+    PutVarint(&buffer, sizeof(values) / sizeof(values[0]));
+    for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); ++i)
+        PutFloat(&buffer, values[i]);
+
+    writer = std::thread(&ReplayRecorder::writerLoop, this);
+    return true;
+}
+
+void ReplayRecorder::writeRecord(uint8_t tag)
+{
+    buffer.push_back(tag);
+    PutVarint(&buffer, step - last_record_step);
+    last_record_step = step;
+}
+
+void ReplayRecorder::keyframe(const ReplayCarState& state)
+{
+    if ( !isOpen() )
+        return;
+
+    float values[REPLAY_STATE_FLOATS];
+    StateToFloats(state, values);
+
+    writeRecord(REPLAY_TAG_KEYFRAME);
+    for (int i = 0; i < REPLAY_STATE_FLOATS; ++i)
+    {
+        uint32_t bits;
+        memcpy(&bits, &values[i], sizeof(bits));
+        PutVarint(&buffer, bits ^ last_bits[i]);
+        last_bits[i] = bits;
+    }
+    buffer.push_back(state.is_sliding ? 1 : 0);
+
+    // Gravamos a cada keyframe, para que uma partida interrompida perca no
+    // máximo um intervalo
+    submit();
+}
+
+void ReplayRecorder::input(uint8_t flags)
+{
+    if ( !isOpen() || last_input == flags )
+        return;
+
+    writeRecord(REPLAY_TAG_INPUT);
+    buffer.push_back(flags);
+    last_input = flags;
+}
+
+void ReplayRecorder::advance()
+{
+    step++;
+    if ( buffer.size() >= REPLAY_BUFFER_SIZE )
+        submit();
+}
+
+void ReplayRecorder::submit()
+{
+    if ( buffer.empty() )
+        return;
+
+    std::vector<uint8_t> full;
+    full.reserve(REPLAY_BUFFER_SIZE + 256);
+    full.swap(buffer);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        queue.push_back(std::vector<uint8_t>());
+        queue.back().swap(full);
+    }
+    wakeup.notify_one();
+}
+
+void ReplayRecorder::writerLoop()
+{
+    std::vector<std::vector<uint8_t> > pending;
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;)
+    {
+        wakeup.wait(lock, [this] { return stopping || !queue.empty(); });
+        if ( queue.empty() )
+            return;
+
+        pending.swap(queue);
+        lock.unlock();
+
+        // Escrevemos sem segurar o mutex, para que submit() não espere
+        bool ok = true;
+        for (size_t i = 0; i < pending.size(); ++i)
+            ok = ok && fwrite(pending[i].data(), 1, pending[i].size(), file) == pending[i].size();
+        ok = ok && fflush(file) == 0;
+        pending.clear();
+
+        lock.lock();
+        failed = failed || !ok;
+    }
+}
+
+bool ReplayRecorder::close()
+{
+    if ( !isOpen() )
+        return true;
+
+    writeRecord(REPLAY_TAG_END);
+    submit();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wakeup.notify_one();
+    writer.join();
+
+    bool ok = !failed && ferror(file) == 0;
+    ok = fclose(file) == 0 && ok;
+    file = NULL;
+    return ok;
+}
+
+bool ReplayReader::load(const std::string& filename, std::string* error)
+{
+    MappedFile file;
+    if ( !file.open(filename.c_str()) )
+    {
+        *error = "não foi possível abrir \"" + filename + "\"";
+        return false;
+    }
+
+    ByteReader in = { file.getData(), file.getSize(), 0, true };
+    bool version1 = in.size >= sizeof(REPLAY_MAGIC_V1) && memcmp(in.data, REPLAY_MAGIC_V1, sizeof(REPLAY_MAGIC_V1)) == 0;
+    bool version2 = in.size >= sizeof(REPLAY_MAGIC_V2) && memcmp(in.data, REPLAY_MAGIC_V2, sizeof(REPLAY_MAGIC_V2)) == 0;
+    if ( !version1 && !version2 && (in.size < sizeof(REPLAY_MAGIC) || memcmp(in.data, REPLAY_MAGIC, sizeof(REPLAY_MAGIC)) != 0) )
+    {
+        *error = "\"" + filename + "\" não é um replay";
+        return false;
+    }
+    in.offset = sizeof(REPLAY_MAGIC);
+
+    step_ns = (TimeNs)in.varint();
+    keyframe_interval = (uint32_t)in.varint();
+    modes = version1 ? 0 : (uint32_t)in.varint();
+    track_hash = (version1 || version2) ? 0 : in.varint();
+
+    // Parâmetros a mais (de uma versão mais nova) são ignorados, e os que
+    // faltam ficam com o valor padrão
+    float values[] = {
+#define REPLAY_PARAMS_VALUE(name, value) value,
+        CAR_PARAMS_FIELDS(REPLAY_PARAMS_VALUE)
+#undef REPLAY_PARAMS_VALUE
+    };
+    uint64_t num_params = in.varint();
+    for (uint64_t i = 0; i < num_params && in.ok; ++i)
+    {
+        float value = in.float32();
+        if ( i < sizeof(values) / sizeof(values[0]) )
+            values[i] = value;
+    }
+    size_t index = 0;
+#define REPLAY_PARAMS_READ(name, value) params.name = values[index++];
+    CAR_PARAMS_FIELDS(REPLAY_PARAMS_READ)
+#undef REPLAY_PARAMS_READ
+
+    if ( !in.ok || step_ns <= 0 || keyframe_interval == 0 )
+    {
+        *error = "cabeçalho inválido em \"" + filename + "\"";
+        return false;
+    }
+
+    inputs.clear();
+    keyframes.clear();
+    truncated = true;
+    num_steps = 0;
+
+    uint32_t bits[REPLAY_STATE_FLOATS];
+    memset(bits, 0, sizeof(bits));
+
+    // Um registro incompleto no fim (gravação interrompida) é descartado, e
+    // o replay vai até o último registro lido
+    uint64_t step = 0;
+    while ( in.offset < in.size )
+    {
+        uint8_t tag = in.byte();
+        uint64_t record_step = step + in.varint();
+        if ( tag == REPLAY_TAG_INPUT )
+        {
+            ReplayInput input;
+            input.step = record_step;
+            input.flags = in.byte();
+            if ( !in.ok )
+                break;
+            inputs.push_back(input);
+            num_steps = std::max(num_steps, record_step + 1); // O passo da transição foi executado
+        }
+        else if ( tag == REPLAY_TAG_KEYFRAME )
+        {
+            uint32_t next[REPLAY_STATE_FLOATS];
+            float state[REPLAY_STATE_FLOATS];
+            for (int i = 0; i < REPLAY_STATE_FLOATS; ++i)
+            {
+                next[i] = bits[i] ^ (uint32_t)in.varint();
+                memcpy(&state[i], &next[i], sizeof(state[i]));
+            }
+            uint8_t sliding = in.byte();
+            if ( !in.ok )
+                break;
+
+            ReplayKeyframe keyframe;
+            keyframe.step = record_step;
+            FloatsToState(state, &keyframe.state);
+            keyframe.state.is_sliding = sliding != 0;
+            keyframes.push_back(keyframe);
+            memcpy(bits, next, sizeof(bits));
+            num_steps = std::max(num_steps, record_step);
+        }
+        else if ( tag == REPLAY_TAG_END )
+        {
+            if ( !in.ok )
+                break;
+            truncated = false;
+            num_steps = record_step;
+            break;
+        }
+        else
+        {
+            *error = "registro inválido em \"" + filename + "\"";
+            return false;
+        }
+        step = record_step;
+    }
+
+    if ( keyframes.empty() || keyframes[0].step != 0 )
+    {
+        *error = "\"" + filename + "\" não tem o keyframe inicial";
+        return false;
+    }
+    return true;
+}
+
+long ReplayReader::findInput(uint64_t step) const
+{
+    // Primeira transição depois de "step"
+    size_t begin = 0, end = inputs.size();
+    while ( begin < end )
+    {
+        size_t middle = (begin + end) / 2;
+        if ( inputs[middle].step <= step )
+            begin = middle + 1;
+        else
+            end = middle;
+    }
+    return (long)begin - 1;
+}
+
+size_t ReplayReader::findKeyframe(uint64_t step) const
+{
+    size_t begin = 0, end = keyframes.size();
+    while ( begin < end )
+    {
+        size_t middle = (begin + end) / 2;
+        if ( keyframes[middle].step <= step )
+            begin = middle + 1;
+        else
+            end = middle;
+    }
+    return begin > 0 ? begin - 1 : 0;
+}
@@ -0,0 +1,40 @@
+// Registro dos objetos da cena virtual. Veja comentários em "sceneregistry.h".
+#include "sceneregistry.h"
+
+SceneHandle SceneRegistry::add(const SceneObject& object)
+{
+    SceneHandle handle = reserve(object.name);
+    objects[handle] = object;
+    return handle;
+}
+
+void SceneRegistry::remove(SceneHandle handle)
+{
+    if ( handle >= objects.size() )
+        return;
+
+    // Mantemos somente o nome, para que o mesmo handle seja reutilizado se o
+    // objeto for carregado novamente.
+    std::string name = objects[handle].name;
+    objects[handle] = SceneObject();
+    objects[handle].name = name;
+}
+
+SceneHandle SceneRegistry::find(const std::string& name) const
+{
+    std::map<std::string, SceneHandle>::const_iterator it = handles.find(name);
+    return it != handles.end() ? it->second : SCENE_INVALID_HANDLE;
+}
+
+SceneHandle SceneRegistry::reserve(const std::string& name)
+{
+    std::map<std::string, SceneHandle>::iterator it = handles.find(name);
+    if ( it != handles.end() )
+        return it->second;
+
+    SceneHandle handle = (SceneHandle)objects.size();
+    objects.push_back(SceneObject());
+    objects.back().name = name;
+    handles[name] = handle;
+    return handle;
+}
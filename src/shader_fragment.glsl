@@ -17,10 +17,24 @@ in vec4 normal_modelspace;
 // Coordenadas de textura obtidas do arquivo OBJ (se existirem!)
 in vec2 texcoords;
 
-// Matrizes computadas no código C++ e enviadas para a GPU
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+// Constantes computadas no código C++ e enviadas para a GPU em "uniform
+// buffers". Estes blocos devem ser idênticos aos de "shader_vertex.glsl".
+layout (std140) uniform PerFrame
+{
+    mat4 view;
+    mat4 projection;
+    vec4 camera_position; // Posição da câmera em coordenadas globais
+    vec4 light_direction; // Sentido (normalizado) da fonte de luz
+};
+
+layout (std140) uniform PerDraw
+{
+    mat4  model;
+    mat4  normal_matrix;
+    vec4  bbox_min;       // Parâmetros da axis-aligned bounding box (AABB) do modelo
+    vec4  bbox_max;
+    ivec4 draw_params;
+};
 
 // Identificador que define qual objeto está sendo desenhado no momento
 #define PLANE 0
@@ -30,11 +44,9 @@ uniform mat4 projection;
 #define CAR_TYRES 4
 #define CAR_GLASSES 5
 
-uniform int object_id;
-
-// Parâmetros da axis-aligned bounding box (AABB) do modelo
-uniform vec4 bbox_min;
-uniform vec4 bbox_max;
+// O identificador vem do vertex shader, pois no desenho instanciado ele é um
+// atributo de cada instância (veja "shader_vertex.glsl")
+flat in int fragment_object_id;
 
 uniform sampler2D TextureImage0;
 uniform samplerCube SkyboxCube;
@@ -51,10 +63,7 @@ int light_model;
 
 void main()
 {
-    // Obtemos a posição da câmera utilizando a inversa da matriz que define o
-    // sistema de coordenadas da câmera.
-    vec4 origin = vec4(0.0, 0.0, 0.0, 1.0);
-    vec4 camera_position = inverse(view) * origin;
+    int object_id = fragment_object_id;
 
     // O fragmento atual é coberto por um ponto que percente à superfície de um
     // dos objetos virtuais da cena. Este ponto, p, possui uma posição no
@@ -68,7 +77,7 @@ void main()
     vec4 n = normalize(normal);
     
    // Vetor que define o sentido da fonte de luz em relação ao ponto atual.
-    vec4 l = normalize(vec4(1.0,1.0,0.0,0.0));
+    vec4 l = light_direction;
 
     // Vetor que define o sentido da câmera em relação ao ponto atual.
     vec4 v = normalize(camera_position - p);
@@ -2,14 +2,43 @@
 
 // Atributos de vértice recebidos como entrada ("in") pelo Vertex Shader.
 // Veja a função BuildTrianglesAndAddToVirtualScene() em "main.cpp".
-layout (location = 0) in vec4 model_coefficients;
-layout (location = 1) in vec4 normal_model;
+// No formato compacto (veja "vertexformat.h"), model_coefficients.xyz é a
+// posição normalizada dentro da bounding box do objeto e normal_model.xy é a
+// normal com codificação octaédrica; ambos são decodificados abaixo.
+layout (location = 0) in vec4 model_coefficients_in;
+layout (location = 1) in vec4 normal_model_in;
 layout (location = 2) in vec2 texture_coefficients;
 
-// Matrizes computadas no código C++ e enviadas para a GPU
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+// Atributos de instância, usados somente no desenho instanciado (veja
+// "instancing.h"): matriz de modelagem, identificador do objeto e matriz das
+// normais de cada cópia. A mat4 ocupa as localizações 3 a 6, e a mat3 as
+// localizações 8 a 10.
+layout (location = 3) in mat4 instance_model;
+layout (location = 7) in int instance_object_id;
+layout (location = 8) in mat3 instance_normal_matrix;
+
+// Constantes computadas no código C++ e enviadas para a GPU em "uniform
+// buffers" (veja "uniformbuffers.h"). Estes blocos devem ser idênticos aos
+// de "shader_fragment.glsl".
+layout (std140) uniform PerFrame
+{
+    mat4 view;
+    mat4 projection;
+    vec4 camera_position;
+    vec4 light_direction;
+};
+
+// No desenho instanciado, "model", "normal_matrix" e o identificador do
+// objeto são substituídos pelos atributos de instância. A bounding box
+// também é usada para decodificar as posições no formato compacto.
+layout (std140) uniform PerDraw
+{
+    mat4  model;
+    mat4  normal_matrix;   // Inversa transposta de "model"
+    vec4  bbox_min;
+    vec4  bbox_max;
+    ivec4 draw_params;     // x: object_id, y: vértices compactos, z: desenho instanciado
+};
 
 // Atributos de vértice que serão gerados como saída ("out") pelo Vertex Shader.
 // ** Estes serão interpolados pelo rasterizador! ** gerando, assim, valores
@@ -20,9 +49,42 @@ out vec4 position_model;
 out vec4 normal;
 out vec2 texcoords;
 out vec4 normal_modelspace;
+flat out int fragment_object_id;
+
+// Decodificação octaédrica, idêntica a VertexFormat_OctDecode()
+vec3 oct_decode(vec2 e)
+{
+    vec3 n = vec3(e.x, e.y, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0)
+    {
+        vec2 s = vec2(e.x >= 0.0 ? 1.0 : -1.0, e.y >= 0.0 ? 1.0 : -1.0);
+        n.xy = (1.0 - abs(e.yx)) * s;
+    }
+    return normalize(n);
+}
 
 void main()
 {
+    // No formato com floats somente X,Y,Z são armazenados (veja FloatVertex
+    // em "geometryarena.h")
+    vec4 model_coefficients = vec4(model_coefficients_in.xyz, 1.0);
+    vec4 normal_model = vec4(normal_model_in.xyz, 0.0);
+    if (draw_params.y != 0)
+    {
+        model_coefficients = vec4(bbox_min.xyz + (bbox_max.xyz - bbox_min.xyz) * model_coefficients_in.xyz, 1.0);
+        normal_model = vec4(oct_decode(normal_model_in.xy), 0.0);
+    }
+
+    mat4 model_matrix = model;
+    mat3 normal_model_matrix = mat3(normal_matrix);
+    fragment_object_id = draw_params.x;
+    if (draw_params.z != 0)
+    {
+        model_matrix = instance_model;
+        normal_model_matrix = instance_normal_matrix;
+        fragment_object_id = instance_object_id;
+    }
+
     // A variável gl_Position define a posição final de cada vértice
     // OBRIGATORIAMENTE em "normalized device coordinates" (NDC), onde cada
     // coeficiente estará entre -1 e 1 após divisão por w.
@@ -35,7 +97,7 @@ void main()
     // deste Vertex Shader, a placa de vídeo (GPU) fará a divisão por W. Veja
     // slides 41-67 e 69-86 do documento Aula_09_Projecoes.pdf.
 
-    gl_Position = projection * view * model * model_coefficients;
+    gl_Position = projection * view * model_matrix * model_coefficients;
 
     // Como as variáveis acima  (tipo vec4) são vetores com 4 coeficientes,
     // também é possível acessar e modificar cada coeficiente de maneira
@@ -52,15 +114,15 @@ void main()
     // rasterizador para gerar atributos únicos para cada fragmento gerado.
 
     // Posição do vértice atual no sistema de coordenadas global (World).
-    position_world = model * model_coefficients;
+    position_world = model_matrix * model_coefficients;
 
     // Posição do vértice atual no sistema de coordenadas local do modelo.
     position_model = model_coefficients;
 
     // Normal do vértice atual no sistema de coordenadas global (World).
     // Veja slides 123-151 do documento Aula_07_Transformacoes_Geometricas_3D.pdf.
-    normal = inverse(transpose(model)) * normal_model;
-    normal.w = 0.0;
+    // A inversa transposta da matriz de modelagem é calculada na CPU.
+    normal = vec4(normal_model_matrix * normal_model.xyz, 0.0);
 
     // Coordenadas de textura obtidas do arquivo OBJ (se existirem!)
     texcoords = texture_coefficients;
@@ -1,6 +1,8 @@
 // Based on http://hamelot.io/visualization/opengl-text-without-any-external-libraries/
 //   and on https://github.com/rougier/freetype-gl
 #include <string>
+#include <vector>
+#include <chrono>
 
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
@@ -87,12 +89,49 @@ GLuint textVBO;
 GLuint textprogram_id;
 GLuint texttexture_id;
 
+// Glifo de cada codepoint, construída uma única vez em TextRendering_Init()
+// (NULL para caracteres que a fonte não tem)
+std::vector<const texture_glyph_t*> textglyphs;
+
+// Vértices (x, y, s, t) de todos os glifos escritos desde o último
+// TextRendering_Flush(), desenhados com uma única chamada
+std::vector<float> textvertices;
+size_t textbuffer_capacity = 0; // Em floats
+
+// Tamanho do framebuffer usado no layout dos textos, atualizado por
+// TextRendering_SetFramebufferSize() (em vez de consultar a GLFW em cada
+// chamada)
+int textwidth = 800;
+int textheight = 600;
+
+// Textos retidos do HUD. Cada um guarda o último texto, posição e escala
+// escritos e os vértices resultantes; o layout só é refeito quando algum
+// deles ou o tamanho do framebuffer muda. Os vértices dos textos mostrados
+// ficam em um buffer próprio (hudVBO), enviado para a GPU somente quando
+// algum texto muda ou deixa de ser mostrado.
+struct HudText
+{
+    std::string        text;
+    float              x, y, scale;
+    int                layout_width, layout_height; // Tamanho do framebuffer no último layout
+    std::vector<float> vertices;
+    bool               shown;                       // Escrito no quadro atual
+    bool               was_shown;                   // Desenhado no quadro anterior
+};
+std::vector<HudText> hudtexts;
+std::vector<float> hudvertices; // Vértices dos textos mostrados, em sequência
+bool huddirty = false;
+GLuint hudVAO;
+GLuint hudVBO;
+
 void TextRendering_Init()
 {
     GLuint sampler;
 
     glGenBuffers(1, &textVBO);
     glGenVertexArrays(1, &textVAO);
+    glGenBuffers(1, &hudVBO);
+    glGenVertexArrays(1, &hudVAO);
     glGenTextures(1, &texttexture_id);
     glGenSamplers(1, &sampler);
     glSamplerParameteri(sampler, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
@@ -126,8 +165,15 @@ void TextRendering_Init()
 
     glBindVertexArray(textVAO);
 
+    textbuffer_capacity = 1024 * 24;
     glBindBuffer(GL_ARRAY_BUFFER, textVBO);
-    glBufferData(GL_ARRAY_BUFFER, 24 * sizeof(float), NULL, GL_DYNAMIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, textbuffer_capacity * sizeof(float), NULL, GL_STREAM_DRAW);
+    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, 0);
+    glEnableVertexAttribArray(0);
+    glCheckError();
+
+    glBindVertexArray(hudVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, hudVBO);
     glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, 0);
     glEnableVertexAttribArray(0);
     glCheckError();
@@ -140,30 +186,46 @@ void TextRendering_Init()
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     glBindVertexArray(0);
     glCheckError();
+
+    // Tabela codepoint -> glifo, para não procurar o glifo de cada caractere
+    // em dejavufont.glyphs. O glifo de codepoint -1 (caractere desconhecido)
+    // não é usado.
+    textglyphs.clear();
+    for (size_t j = 0; j < dejavufont.glyphs_count; ++j)
+    {
+        uint32_t codepoint = dejavufont.glyphs[j].codepoint;
+        if ( codepoint == (uint32_t)-1 )
+            continue;
+        if ( codepoint >= textglyphs.size() )
+            textglyphs.resize(codepoint + 1, NULL);
+        if ( textglyphs[codepoint] == NULL )
+            textglyphs[codepoint] = &dejavufont.glyphs[j];
+    }
 }
 
 float textscale = 1.5f;
 
-void TextRendering_PrintString(GLFWwindow* window, const std::string &str, float x, float y, float scale = 1.0f)
+void TextRendering_SetFramebufferSize(int width, int height)
+{
+    // Janela minimizada: mantemos o último tamanho
+    if ( width <= 0 || height <= 0 )
+        return;
+    textwidth = width;
+    textheight = height;
+}
+
+// Calcula os vértices dos glifos de "str" e os adiciona em "vertices"
+void TextRendering_LayoutString(const std::string &str, float x, float y, float scale, std::vector<float>* vertices)
 {
     scale *= textscale;
-    int width, height;
-    glfwGetWindowSize(window, &width, &height);
-    float sx = scale / width;
-    float sy = scale / height;
+    float sx = scale / textwidth;
+    float sy = scale / textheight;
 
     for (size_t i = 0; i < str.size(); i++)
     {
         // Find the glyph for the character we are looking for
-        texture_glyph_t *glyph = 0;
-        for (size_t j = 0; j < dejavufont.glyphs_count; ++j)
-        {
-            if (dejavufont.glyphs[j].codepoint == (uint32_t)str[i])
-            {
-                glyph = &dejavufont.glyphs[j];
-                break;
-            }
-        }
+        uint32_t codepoint = (unsigned char)str[i];
+        const texture_glyph_t *glyph = codepoint < textglyphs.size() ? textglyphs[codepoint] : 0;
         if (!glyph) {
             continue;
         }
@@ -178,51 +240,146 @@ void TextRendering_PrintString(GLFWwindow* window, const std::string &str, float
         float s1 = glyph->s1 - 0.5f/dejavufont.tex_width;
         float t1 = glyph->t1 - 0.5f/dejavufont.tex_height;
 
-        struct {float x, y, s, t;} data[6] = {
-            { x0, y0, s0, t0 },
-            { x0, y1, s0, t1 },
-            { x1, y1, s1, t1 },
-            { x0, y0, s0, t0 },
-            { x1, y1, s1, t1 },
-            { x1, y0, s1, t0 }
+        const float data[24] = {
+            x0, y0, s0, t0,
+            x0, y1, s0, t1,
+            x1, y1, s1, t1,
+            x0, y0, s0, t0,
+            x1, y1, s1, t1,
+            x1, y0, s1, t0
         };
+        vertices->insert(vertices->end(), data, data + 24);
 
-        glEnable(GL_BLEND);
-        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        x += (glyph->advance_x * sx);
+    }
+}
 
-        glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-        glDepthFunc(GL_ALWAYS);
-        glBindBuffer(GL_ARRAY_BUFFER, textVBO);
-        glBufferSubData(GL_ARRAY_BUFFER, 0, 24 * sizeof(float), data);
+// Os glifos só são desenhados em TextRendering_Flush(), junto com todos os
+// outros textos do quadro
+void TextRendering_PrintString(GLFWwindow* window, const std::string &str, float x, float y, float scale = 1.0f)
+{
+    TextRendering_LayoutString(str, x, y, scale, &textvertices);
+}
+
+// Cria um texto retido do HUD, escrito com TextRendering_PrintHudString()
+int TextRendering_CreateHudText()
+{
+    HudText hud;
+    hud.x = hud.y = hud.scale = 0.0f;
+    hud.layout_width = hud.layout_height = 0;
+    hud.shown = hud.was_shown = false;
+    hudtexts.push_back(hud);
+    return (int)hudtexts.size() - 1;
+}
+
+// Mostra o texto retido "id" neste quadro. Textos que não são escritos em um
+// quadro não são desenhados.
+void TextRendering_PrintHudString(GLFWwindow* window, int id, const std::string &str, float x, float y, float scale = 1.0f)
+{
+    HudText& hud = hudtexts[id];
+    if ( hud.text != str || hud.x != x || hud.y != y || hud.scale != scale
+      || hud.layout_width != textwidth || hud.layout_height != textheight )
+    {
+        hud.text  = str;
+        hud.x     = x;
+        hud.y     = y;
+        hud.scale = scale;
+        hud.layout_width  = textwidth;
+        hud.layout_height = textheight;
+        hud.vertices.clear();
+        TextRendering_LayoutString(str, x, y, scale, &hud.vertices);
+        huddirty = true;
+    }
+
+    if ( !hud.was_shown )
+        huddirty = true;
+    hud.shown = true;
+}
+
+// Desenha todos os textos escritos desde a última chamada, com uma única
+// configuração de estado e uma chamada glDrawArrays() para os textos do HUD
+// e outra para os demais. Deve ser chamada uma vez por quadro, depois de
+// todos os TextRendering_Print*() e antes de glfwSwapBuffers().
+void TextRendering_Flush()
+{
+    // Os textos do HUD são juntados novamente somente se algum mudou,
+    // apareceu ou deixou de ser mostrado
+    for (size_t i = 0; i < hudtexts.size(); ++i)
+    {
+        if ( hudtexts[i].was_shown && !hudtexts[i].shown )
+            huddirty = true;
+    }
+    if ( huddirty )
+    {
+        hudvertices.clear();
+        for (size_t i = 0; i < hudtexts.size(); ++i)
+        {
+            if ( hudtexts[i].shown )
+                hudvertices.insert(hudvertices.end(), hudtexts[i].vertices.begin(), hudtexts[i].vertices.end());
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, hudVBO);
+        glBufferData(GL_ARRAY_BUFFER, hudvertices.size() * sizeof(float), hudvertices.data(), GL_DYNAMIC_DRAW);
         glBindBuffer(GL_ARRAY_BUFFER, 0);
+        huddirty = false;
+    }
+    for (size_t i = 0; i < hudtexts.size(); ++i)
+    {
+        hudtexts[i].was_shown = hudtexts[i].shown;
+        hudtexts[i].shown = false;
+    }
 
-        glUseProgram(textprogram_id);
-        glBindVertexArray(textVAO);
+    if ( textvertices.empty() && hudvertices.empty() )
+        return;
 
-        glDrawArrays(GL_TRIANGLES, 0, 6);
+    if ( !textvertices.empty() )
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, textVBO);
 
-        glBindVertexArray(0);
-        glUseProgram(0);
-        glDepthFunc(GL_LESS);
+        // O buffer é realocado ("orphaned") a cada quadro, para não esperar a
+        // GPU terminar de usar os vértices do quadro anterior
+        if ( textvertices.size() > textbuffer_capacity )
+            textbuffer_capacity = textvertices.size() * 2;
+        glBufferData(GL_ARRAY_BUFFER, textbuffer_capacity * sizeof(float), NULL, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, textvertices.size() * sizeof(float), textvertices.data());
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
 
-        glDisable(GL_BLEND);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-        x += (glyph->advance_x * sx);
+    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+    glDepthFunc(GL_ALWAYS);
+
+    glUseProgram(textprogram_id);
+
+    if ( !hudvertices.empty() )
+    {
+        glBindVertexArray(hudVAO);
+        glDrawArrays(GL_TRIANGLES, 0, (GLsizei)(hudvertices.size() / 4));
     }
+    if ( !textvertices.empty() )
+    {
+        glBindVertexArray(textVAO);
+        glDrawArrays(GL_TRIANGLES, 0, (GLsizei)(textvertices.size() / 4));
+    }
+
+    glBindVertexArray(0);
+    glUseProgram(0);
+    glDepthFunc(GL_LESS);
+
+    glDisable(GL_BLEND);
+
+    textvertices.clear();
 }
 
 float TextRendering_LineHeight(GLFWwindow* window)
 {
-    int width, height;
-    glfwGetWindowSize(window, &width, &height);
-    return dejavufont.height / height * textscale;
+    return dejavufont.height / textheight * textscale;
 }
 
 float TextRendering_CharWidth(GLFWwindow* window)
 {
-    int width, height;
-    glfwGetWindowSize(window, &width, &height);
-    return dejavufont.glyphs[32].advance_x / width * textscale;
+    return dejavufont.glyphs[32].advance_x / textwidth * textscale;
 }
 
 void TextRendering_PrintMatrix(GLFWwindow* window, glm::mat4 M, float x, float y, float scale = 1.0f)
@@ -304,3 +461,64 @@ void TextRendering_PrintMatrixVectorProductDivW(GLFWwindow* window, glm::mat4 M,
     snprintf(buffer, 90, "[%+0.2f %+0.2f %+0.2f %+0.2f][%+0.2f]     [%+0.2f]        [%+0.2f]\n", M[0][3], M[1][3], M[2][3], M[3][3], v[3], r[3], r[3]/w);
     TextRendering_PrintString(window, buffer, x, y - 3*lineheight, scale);
 }
+
+// Mede o tempo de CPU para escrever e desenhar "num_glyphs" glifos por
+// quadro, desenhando cada glifo separadamente (como antes da renderização em
+// lote) e todos de uma só vez. A GPU é sincronizada com glFinish() fora da
+// medição, entre os quadros.
+void TextRendering_Benchmark(GLFWwindow* window, size_t num_glyphs)
+{
+    typedef std::chrono::steady_clock clock;
+    const int warmup_frames = 5;
+    const int frames = 50;
+    const size_t line_length = 80;
+
+    // Linhas de 80 caracteres ASCII visíveis, cobrindo a janela
+    std::vector<std::string> lines;
+    for (size_t glyph = 0; glyph < num_glyphs; glyph += line_length)
+    {
+        std::string line;
+        for (size_t c = 0; c < line_length && glyph + c < num_glyphs; ++c)
+            line += (char)('!' + (glyph + c) % 94);
+        lines.push_back(line);
+    }
+
+    float lineheight = TextRendering_LineHeight(window);
+    float charwidth = TextRendering_CharWidth(window);
+
+    printf("Benchmark de texto: %lu glifos por quadro, %d quadros por medição\n", (unsigned long)num_glyphs, frames);
+    double ms[2];
+    for (int batched = 0; batched < 2; ++batched)
+    {
+        double total_ms = 0.0;
+        for (int frame = 0; frame < warmup_frames + frames; ++frame)
+        {
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+            clock::time_point start = clock::now();
+            for (size_t l = 0; l < lines.size(); ++l)
+            {
+                float y = 1.0f - (l % 40 + 1) * lineheight;
+                if ( batched )
+                {
+                    TextRendering_PrintString(window, lines[l], -1.0f, y, 1.0f);
+                    continue;
+                }
+                for (size_t c = 0; c < lines[l].size(); ++c)
+                {
+                    TextRendering_PrintString(window, lines[l].substr(c, 1), -1.0f + c * charwidth, y, 1.0f);
+                    TextRendering_Flush();
+                }
+            }
+            TextRendering_Flush();
+            double elapsed = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+
+            glFinish();
+            if ( frame >= warmup_frames )
+                total_ms += elapsed;
+        }
+        ms[batched] = total_ms / frames;
+    }
+    printf("  um desenho por glifo: %8.3f ms/quadro\n", ms[0]);
+    printf("  em lote:              %8.3f ms/quadro  (%.1fx)\n", ms[1], ms[0] / ms[1]);
+}
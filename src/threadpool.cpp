@@ -0,0 +1,389 @@
+// Sistema de trabalhos com roubo de trabalho. Veja comentários em "threadpool.h".
+#include <condition_variable>
+#include <deque>
+#include <thread>
+
+#include "threadpool.h"
+
+struct Job
+{
+    std::function<void()> function;
+    JobCounter*           counter;
+    bool                  main_thread;
+};
+
+namespace
+{
+
+// Fila dupla de uma thread: a dona usa o fim (o trabalho mais recente, cujos
+// dados provavelmente ainda estão na cache), e as outras roubam do início.
+struct WorkerQueue
+{
+    std::mutex        mutex;
+    std::deque<Job*>  jobs;
+};
+
+// Índice da fila da thread atual. As threads de trabalho usam as filas
+// 1..N; a thread principal (e qualquer outra thread fora do sistema) usa a
+// fila 0.
+thread_local unsigned int t_WorkerIndex = 0;
+
+// Estado do gerador de números pseudo-aleatórios que escolhe de quem roubar
+thread_local unsigned int t_StealSeed = 0;
+
+class JobScheduler
+{
+public:
+    JobScheduler()
+        : num_queued(0)
+        , max_threads(0)
+        , quit(false)
+        , main_thread(std::this_thread::get_id())
+    {
+        unsigned int num_cores = std::thread::hardware_concurrency();
+        if ( num_cores == 0 )
+            num_cores = 1;
+
+        // A thread que espera pelos trabalhos também os executa, então
+        // criamos uma thread a menos que o número de núcleos.
+        queues = std::vector<WorkerQueue>(num_cores);
+        for (unsigned int i = 1; i < num_cores; ++i)
+            workers.push_back(std::thread(&JobScheduler::workerLoop, this, i));
+    }
+
+    ~JobScheduler()
+    {
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex);
+            quit = true;
+        }
+        wake.notify_all();
+        for (size_t i = 0; i < workers.size(); ++i)
+            workers[i].join();
+
+        for (size_t i = 0; i < queues.size(); ++i)
+            for (size_t j = 0; j < queues[i].jobs.size(); ++j)
+                delete queues[i].jobs[j];
+        for (size_t i = 0; i < main_jobs.size(); ++i)
+            delete main_jobs[i];
+    }
+
+    unsigned int numThreads() const
+    {
+        unsigned int total = (unsigned int)queues.size();
+        unsigned int limit = max_threads.load(std::memory_order_relaxed);
+        if ( limit != 0 && limit < total )
+            return limit;
+        return total;
+    }
+
+    void setMaxThreads(unsigned int value)
+    {
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex);
+            max_threads = value;
+        }
+        wake.notify_all();
+    }
+
+    bool isMainThread() const
+    {
+        return std::this_thread::get_id() == main_thread;
+    }
+
+    void submit(const std::function<void()>& function, JobCounter* counter, JobCounter* after, bool on_main_thread)
+    {
+        Job* job = new Job;
+        job->function    = function;
+        job->counter     = counter;
+        job->main_thread = on_main_thread;
+
+        if ( counter != NULL )
+            counter->pending.fetch_add(1, std::memory_order_relaxed);
+
+        if ( after != NULL )
+        {
+            // O último trabalho de "after" decrementa o contador com o mutex
+            // travado (veja finish()), então aqui ou ele já terminou, ou vai
+            // encontrar este trabalho na lista de dependentes.
+            std::lock_guard<std::mutex> lock(after->mutex);
+            if ( !after->isDone() )
+            {
+                after->dependents.push_back(job);
+                return;
+            }
+        }
+
+        enqueue(job);
+    }
+
+    void wait(JobCounter* counter)
+    {
+        while ( !counter->isDone() )
+        {
+            Job* job = findJob(t_WorkerIndex, isMainThread());
+            if ( job != NULL )
+                execute(job);
+            else
+                std::this_thread::yield();
+        }
+
+        // O último trabalho ainda pode estar com o mutex do contador
+        // travado; esperamos que ele o solte antes que o contador possa ser
+        // destruído.
+        std::lock_guard<std::mutex> lock(counter->mutex);
+    }
+
+    size_t runMainThreadJobs()
+    {
+        size_t num_jobs = 0;
+        while ( Job* job = popMainThreadJob() )
+        {
+            execute(job);
+            num_jobs++;
+        }
+        return num_jobs;
+    }
+
+private:
+    void enqueue(Job* job)
+    {
+        if ( job->main_thread )
+        {
+            std::lock_guard<std::mutex> lock(main_mutex);
+            main_jobs.push_back(job);
+            return;
+        }
+
+        {
+            WorkerQueue& queue = queues[t_WorkerIndex];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.jobs.push_back(job);
+        }
+
+        // Travamos sleep_mutex para que uma thread que acabou de verificar
+        // que não há trabalho não perca o aviso
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex);
+            num_queued++;
+        }
+        // Com menos threads que o padrão, notify_one() poderia acordar
+        // somente uma thread inativa
+        if ( max_threads.load(std::memory_order_relaxed) != 0 )
+            wake.notify_all();
+        else
+            wake.notify_one();
+    }
+
+    Job* popMainThreadJob()
+    {
+        std::lock_guard<std::mutex> lock(main_mutex);
+        if ( main_jobs.empty() )
+            return NULL;
+        Job* job = main_jobs.front();
+        main_jobs.pop_front();
+        return job;
+    }
+
+    // Trabalho mais recente da própria fila ou, se ela estiver vazia, o mais
+    // antigo da fila de outra thread (começando por uma escolhida ao acaso)
+    Job* findJob(unsigned int index, bool main_thread)
+    {
+        if ( main_thread )
+        {
+            if ( Job* job = popMainThreadJob() )
+                return job;
+        }
+
+        if ( num_queued.load(std::memory_order_relaxed) == 0 )
+            return NULL;
+
+        {
+            WorkerQueue& queue = queues[index];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if ( !queue.jobs.empty() )
+            {
+                Job* job = queue.jobs.back();
+                queue.jobs.pop_back();
+                num_queued--;
+                return job;
+            }
+        }
+
+        unsigned int num_queues = (unsigned int)queues.size();
+        t_StealSeed = t_StealSeed * 1664525u + 1013904223u;
+        unsigned int first = (t_StealSeed >> 16) % num_queues;
+        for (unsigned int i = 0; i < num_queues; ++i)
+        {
+            unsigned int victim = (first + i) % num_queues;
+            if ( victim == index )
+                continue;
+
+            WorkerQueue& queue = queues[victim];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if ( !queue.jobs.empty() )
+            {
+                Job* job = queue.jobs.front();
+                queue.jobs.pop_front();
+                num_queued--;
+                return job;
+            }
+        }
+        return NULL;
+    }
+
+    void execute(Job* job)
+    {
+        job->function();
+        if ( job->counter != NULL )
+            finish(job->counter);
+        delete job;
+    }
+
+    // Decrementa o contador e, se ele chegou a zero, libera os trabalhos que
+    // dependiam dele
+    void finish(JobCounter* counter)
+    {
+        std::vector<Job*> ready;
+        {
+            std::lock_guard<std::mutex> lock(counter->mutex);
+            if ( counter->pending.fetch_sub(1, std::memory_order_acq_rel) == 1 )
+                ready.swap(counter->dependents);
+        }
+        for (size_t i = 0; i < ready.size(); ++i)
+            enqueue(ready[i]);
+    }
+
+    void workerLoop(unsigned int index)
+    {
+        t_WorkerIndex = index;
+        t_StealSeed = index;
+        for (;;)
+        {
+            if ( index < numThreads() )
+            {
+                Job* job = findJob(index, false);
+                if ( job != NULL )
+                {
+                    execute(job);
+                    continue;
+                }
+            }
+
+            std::unique_lock<std::mutex> lock(sleep_mutex);
+            while ( !quit && (num_queued == 0 || index >= numThreads()) )
+                wake.wait(lock);
+            if ( quit )
+                return;
+        }
+    }
+
+    std::vector<std::thread>  workers;
+    std::vector<WorkerQueue>  queues;
+    std::atomic<size_t>       num_queued;  // Trabalhos nas filas das threads (não conta main_jobs)
+    std::atomic<unsigned int> max_threads;
+    std::mutex                sleep_mutex;
+    std::condition_variable   wake;
+    bool                      quit;
+
+    std::thread::id           main_thread;
+    std::mutex                main_mutex;
+    std::deque<Job*>          main_jobs;
+};
+
+JobScheduler& GetJobScheduler()
+{
+    static JobScheduler scheduler;
+    return scheduler;
+}
+
+// Trabalho sendo executado por um ParallelFor(). As threads pegam
+// intervalos de "grain" elementos incrementando "next" atomicamente, até que
+// todos os elementos tenham sido processados.
+struct ParallelJob
+{
+    const std::function<void(size_t, size_t)>* body;
+    size_t count;
+    size_t grain;
+    std::atomic<size_t> next;
+};
+
+void RunParallelJob(ParallelJob* job)
+{
+    for (;;)
+    {
+        size_t begin = job->next.fetch_add(job->grain);
+        if ( begin >= job->count )
+            break;
+        size_t end = begin + job->grain < job->count ? begin + job->grain : job->count;
+        (*job->body)(begin, end);
+    }
+}
+
+} // namespace
+
+unsigned int ThreadPool_NumThreads()
+{
+    return GetJobScheduler().numThreads();
+}
+
+void ThreadPool_SetMaxThreads(unsigned int max_threads)
+{
+    GetJobScheduler().setMaxThreads(max_threads);
+}
+
+void ThreadPool_Submit(const std::function<void()>& job, JobCounter* counter, JobCounter* after)
+{
+    GetJobScheduler().submit(job, counter, after, false);
+}
+
+void ThreadPool_SubmitMainThread(const std::function<void()>& job, JobCounter* counter, JobCounter* after)
+{
+    GetJobScheduler().submit(job, counter, after, true);
+}
+
+void ThreadPool_Wait(JobCounter* counter)
+{
+    GetJobScheduler().wait(counter);
+}
+
+size_t ThreadPool_RunMainThreadJobs()
+{
+    return GetJobScheduler().runMainThreadJobs();
+}
+
+void ParallelFor(size_t count, size_t grain, const std::function<void(size_t begin, size_t end)>& body)
+{
+    if ( count == 0 )
+        return;
+    if ( grain == 0 )
+        grain = 1;
+
+    // Trabalho pequeno demais: executamos diretamente
+    if ( count <= grain )
+    {
+        body(0, count);
+        return;
+    }
+
+    ParallelJob job;
+    job.body  = &body;
+    job.count = count;
+    job.grain = grain;
+    job.next  = 0;
+
+    // Um trabalho auxiliar por thread (no máximo um por intervalo). Os
+    // intervalos são distribuídos dinamicamente por "next", então um
+    // auxiliar roubado tarde simplesmente não encontra mais nada a fazer.
+    size_t num_chunks = (count + grain - 1) / grain;
+    size_t num_helpers = ThreadPool_NumThreads() - 1;
+    if ( num_helpers > num_chunks - 1 )
+        num_helpers = num_chunks - 1;
+
+    JobCounter helpers;
+    for (size_t i = 0; i < num_helpers; ++i)
+        ThreadPool_Submit([&job]() { RunParallelJob(&job); }, &helpers);
+
+    RunParallelJob(&job);
+    ThreadPool_Wait(&helpers);
+}
@@ -0,0 +1,39 @@
+// Base de tempo do jogo. Veja comentários em "timebase.h".
+#include <chrono>
+
+#include "timebase.h"
+
+TimeNs SteadyClock::now() const
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+TimeBase::TimeBase(const Clock* clock)
+    : clock(clock != NULL ? clock : &steady_clock)
+{
+    reset();
+}
+
+void TimeBase::setClock(const Clock* new_clock)
+{
+    clock = new_clock != NULL ? new_clock : &steady_clock;
+    reset();
+}
+
+void TimeBase::reset()
+{
+    start           = clock->now();
+    frame_start     = start;
+    frame_delta     = 0;
+    frame_index     = 0;
+    simulation_time = 0;
+}
+
+void TimeBase::beginFrame()
+{
+    TimeNs t = clock->now();
+    frame_delta = t - frame_start;
+    frame_start = t;
+    frame_index++;
+}
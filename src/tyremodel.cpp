@@ -0,0 +1,288 @@
+// Modelo de pneus por curvas de escorregamento. Veja comentários em "tyremodel.h".
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "carconstants.h"
+#include "detmath.h"
+#include "tyremodel.h"
+
+// As funções AVX2 são compiladas com o atributo "target", sem mudar as
+// opções do resto do arquivo, e usadas se o processador o suportar
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define TYREMODEL_HAS_AVX2 1
+#include <immintrin.h>
+#endif
+
+namespace
+{
+
+// Valor da tabela na posição de "slip", com o sinal de "slip"
+inline float Lookup(const float* table, float scale, float slip)
+{
+    float position = std::min((float)TYRE_TABLE_SIZE, std::fabs(slip) * scale);
+    int index = (int)position;
+    float t = position - (float)index;
+    float value = table[index] + (table[index + 1] - table[index]) * t;
+    return std::copysign(value, slip);
+}
+
+// Elipse de atrito: reduz as duas forças na mesma proporção se juntas
+// passam da aderência
+inline void LimitToEllipse(float inv_lateral_grip, float inv_longitudinal_grip, float* lateral, float* longitudinal)
+{
+    float u = *lateral * inv_lateral_grip;
+    float v = *longitudinal * inv_longitudinal_grip;
+    float scale = 1.0f / std::max(1.0f, std::sqrt(u * u + v * v));
+    *lateral *= scale;
+    *longitudinal *= scale;
+}
+
+// A fórmula com o escorregamento limitado ao fim da tabela, como Lookup()
+inline float ClampedPacejka(const TyreCurve& curve, float slip)
+{
+    return std::copysign(TyreModel_Pacejka(curve, std::min(curve.max_slip, std::fabs(slip))), slip);
+}
+
+void BakeCurve(const TyreCurve& curve, float* table, float* scale, float* peak_slip)
+{
+    for (int i = 0; i <= TYRE_TABLE_SIZE; ++i)
+        table[i] = TyreModel_Pacejka(curve, curve.max_slip * i / TYRE_TABLE_SIZE);
+    table[TYRE_TABLE_SIZE + 1] = table[TYRE_TABLE_SIZE];
+    *scale = TYRE_TABLE_SIZE / curve.max_slip;
+
+    // Pico procurado com resolução bem maior que a da tabela
+    const int samples = 4096;
+    float best = -1.0f;
+    *peak_slip = curve.max_slip;
+    for (int i = 0; i <= samples; ++i)
+    {
+        float slip = curve.max_slip * i / samples;
+        float value = TyreModel_Pacejka(curve, slip);
+        if ( value > best )
+        {
+            best = value;
+            *peak_slip = slip;
+        }
+    }
+}
+
+#ifdef TYREMODEL_HAS_AVX2
+__attribute__((target("avx2")))
+inline __m256 Lookup8(const float* table, __m256 scale, __m256 slip)
+{
+    const __m256 sign = _mm256_set1_ps(-0.0f);
+    __m256 position = _mm256_min_ps(_mm256_mul_ps(_mm256_andnot_ps(sign, slip), scale), _mm256_set1_ps((float)TYRE_TABLE_SIZE));
+    __m256i index = _mm256_cvttps_epi32(position);
+    __m256 t = _mm256_sub_ps(position, _mm256_cvtepi32_ps(index));
+    __m256 v0 = _mm256_i32gather_ps(table, index, 4);
+    __m256 v1 = _mm256_i32gather_ps(table, _mm256_add_epi32(index, _mm256_set1_epi32(1)), 4);
+    __m256 value = _mm256_add_ps(v0, _mm256_mul_ps(_mm256_sub_ps(v1, v0), t));
+    return _mm256_or_ps(_mm256_andnot_ps(sign, value), _mm256_and_ps(sign, slip));
+}
+#endif // TYREMODEL_HAS_AVX2
+
+} // namespace
+
+TyreModelParams TyreModel_DefaultParams()
+{
+    TyreModelParams params;
+    params.lateral.b = TYRE_LATERAL_B;
+    params.lateral.c = TYRE_LATERAL_C;
+    params.lateral.d = TYRE_LATERAL_GRIP;
+    params.lateral.e = TYRE_LATERAL_E;
+    params.lateral.max_slip = TYRE_LATERAL_MAX_SLIP;
+    params.longitudinal.b = TYRE_LONGITUDINAL_B;
+    params.longitudinal.c = TYRE_LONGITUDINAL_C;
+    params.longitudinal.d = TYRE_LONGITUDINAL_GRIP;
+    params.longitudinal.e = TYRE_LONGITUDINAL_E;
+    params.longitudinal.max_slip = TYRE_LONGITUDINAL_MAX_SLIP;
+    params.min_slip_speed = TYRE_MIN_SLIP_SPEED;
+    return params;
+}
+
+float TyreModel_Pacejka(const TyreCurve& curve, float slip)
+{
+    // Com as funções de DetMath as tabelas são iguais em qualquer máquina, e
+    // o modo determinístico continua reproduzível com os pneus
+    float bx = curve.b * slip;
+    return curve.d * DetMath_Sin(curve.c * DetMath_Atan(bx - curve.e * (bx - DetMath_Atan(bx))));
+}
+
+TyreModel::TyreModel()
+    : backend(TyreModel_BestBackend())
+{
+    setParams(TyreModel_DefaultParams());
+}
+
+void TyreModel::setParams(const TyreModelParams& value)
+{
+    params = value;
+    BakeCurve(params.lateral, lateral_table, &lateral_scale, &peak_lateral_slip);
+    BakeCurve(params.longitudinal, longitudinal_table, &longitudinal_scale, &peak_longitudinal_slip);
+    inv_lateral_grip = 1.0f / params.lateral.d;
+    inv_longitudinal_grip = 1.0f / params.longitudinal.d;
+}
+
+void TyreModel::evaluate(float lateral_slip, float longitudinal_slip, float* lateral, float* longitudinal) const
+{
+    *lateral = Lookup(lateral_table, lateral_scale, lateral_slip);
+    *longitudinal = Lookup(longitudinal_table, longitudinal_scale, longitudinal_slip);
+    LimitToEllipse(inv_lateral_grip, inv_longitudinal_grip, lateral, longitudinal);
+}
+
+void TyreModel::evaluateExact(float lateral_slip, float longitudinal_slip, float* lateral, float* longitudinal) const
+{
+    *lateral = ClampedPacejka(params.lateral, lateral_slip);
+    *longitudinal = ClampedPacejka(params.longitudinal, longitudinal_slip);
+    LimitToEllipse(inv_lateral_grip, inv_longitudinal_grip, lateral, longitudinal);
+}
+
+void TyreModel::evaluateBatchExact(const float* lateral_slip, const float* longitudinal_slip, size_t count,
+                                   float* lateral, float* longitudinal) const
+{
+    for (size_t i = 0; i < count; ++i)
+        evaluateExact(lateral_slip[i], longitudinal_slip[i], &lateral[i], &longitudinal[i]);
+}
+
+#ifdef TYREMODEL_HAS_AVX2
+__attribute__((target("avx2")))
+static size_t EvaluateAVX2(const float* lateral_table, float lateral_scale, const float* longitudinal_table, float longitudinal_scale,
+                           float inv_lateral_grip, float inv_longitudinal_grip,
+                           const float* lateral_slip, const float* longitudinal_slip, size_t count,
+                           float* lateral, float* longitudinal)
+{
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 lat_scale = _mm256_set1_ps(lateral_scale);
+    const __m256 lon_scale = _mm256_set1_ps(longitudinal_scale);
+    const __m256 inv_lat_grip = _mm256_set1_ps(inv_lateral_grip);
+    const __m256 inv_lon_grip = _mm256_set1_ps(inv_longitudinal_grip);
+
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256 lat = Lookup8(lateral_table, lat_scale, _mm256_loadu_ps(lateral_slip + i));
+        __m256 lon = Lookup8(longitudinal_table, lon_scale, _mm256_loadu_ps(longitudinal_slip + i));
+
+        __m256 u = _mm256_mul_ps(lat, inv_lat_grip);
+        __m256 v = _mm256_mul_ps(lon, inv_lon_grip);
+        __m256 r = _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(u, u), _mm256_mul_ps(v, v)));
+        __m256 scale = _mm256_div_ps(one, _mm256_max_ps(r, one));
+
+        _mm256_storeu_ps(lateral + i, _mm256_mul_ps(lat, scale));
+        _mm256_storeu_ps(longitudinal + i, _mm256_mul_ps(lon, scale));
+    }
+    return i;
+}
+#endif // TYREMODEL_HAS_AVX2
+
+void TyreModel::evaluateBatch(TyreModelBackend batch_backend, const float* lateral_slip, const float* longitudinal_slip, size_t count,
+                              float* lateral, float* longitudinal) const
+{
+    size_t done = 0;
+#ifdef TYREMODEL_HAS_AVX2
+    if ( batch_backend == TYREMODEL_AVX2 )
+        done = EvaluateAVX2(lateral_table, lateral_scale, longitudinal_table, longitudinal_scale,
+                            inv_lateral_grip, inv_longitudinal_grip, lateral_slip, longitudinal_slip, count, lateral, longitudinal);
+#endif
+    for (size_t i = done; i < count; ++i)
+        evaluate(lateral_slip[i], longitudinal_slip[i], &lateral[i], &longitudinal[i]);
+}
+
+TyreModelBackend TyreModel_BestBackend()
+{
+#ifdef TYREMODEL_HAS_AVX2
+    if ( __builtin_cpu_supports("avx2") )
+        return TYREMODEL_AVX2;
+#endif
+    return TYREMODEL_SCALAR;
+}
+
+const char* TyreModel_BackendName(TyreModelBackend backend)
+{
+    return backend == TYREMODEL_AVX2 ? "avx2" : "escalar";
+}
+
+void TyreModel_Benchmark(int repetitions)
+{
+    typedef std::chrono::steady_clock clock;
+
+    TyreModel model;
+    const TyreModelParams& params = model.getParams();
+
+    // Erro da interpolação, sem a elipse, relativo ao pico de cada curva
+    double max_error[2] = { 0.0, 0.0 };
+    const TyreCurve* curves[2] = { &params.lateral, &params.longitudinal };
+    const int samples = 100000;
+    for (int i = 0; i <= samples; ++i)
+    {
+        float lateral, longitudinal;
+        float lateral_slip = params.lateral.max_slip * i / samples;
+        float longitudinal_slip = params.longitudinal.max_slip * i / samples;
+        model.evaluate(lateral_slip, 0.0f, &lateral, &longitudinal);
+        max_error[0] = std::max(max_error[0], (double)std::fabs(lateral - TyreModel_Pacejka(*curves[0], lateral_slip)) / curves[0]->d);
+        model.evaluate(0.0f, longitudinal_slip, &lateral, &longitudinal);
+        max_error[1] = std::max(max_error[1], (double)std::fabs(longitudinal - TyreModel_Pacejka(*curves[1], longitudinal_slip)) / curves[1]->d);
+    }
+
+    printf("Benchmark do modelo de pneus: tabelas de %d intervalos (%lu bytes), %d repetições\n",
+           TYRE_TABLE_SIZE, (unsigned long)(2 * (TYRE_TABLE_SIZE + 2) * sizeof(float)), repetitions);
+    printf("  lateral:      pico em %.3f, erro máximo da tabela %.3f%% do pico\n", model.getPeakLateralSlip(), 100.0 * max_error[0]);
+    printf("  longitudinal: pico em %.3f, erro máximo da tabela %.3f%% do pico\n", model.getPeakLongitudinalSlip(), 100.0 * max_error[1]);
+
+    TyreModelBackend best = TyreModel_BestBackend();
+    printf("%8s  %16s", "pneus", "fórmula (ns)");
+    for (int b = TYREMODEL_SCALAR; b <= best; ++b)
+        printf("  %12s", TyreModel_BackendName((TyreModelBackend)b));
+    printf("  %14s\n", "max. diferença");
+
+    const size_t counts[3] = { 1000, 10000, 100000 };
+    srand(99);
+    for (int c = 0; c < 3; ++c)
+    {
+        size_t count = counts[c];
+        std::vector<float> lateral_slip(count), longitudinal_slip(count);
+        for (size_t i = 0; i < count; ++i)
+        {
+            lateral_slip[i] = 2.0f * rand() / (float)RAND_MAX - 1.0f;
+            longitudinal_slip[i] = 4.0f * rand() / (float)RAND_MAX - 2.0f;
+        }
+
+        std::vector<float> exact_lateral(count), exact_longitudinal(count);
+        double best_ns = 1e30;
+        for (int r = 0; r < repetitions; ++r)
+        {
+            clock::time_point start = clock::now();
+            model.evaluateBatchExact(lateral_slip.data(), longitudinal_slip.data(), count, exact_lateral.data(), exact_longitudinal.data());
+            best_ns = std::min(best_ns, std::chrono::duration<double, std::nano>(clock::now() - start).count() / count);
+        }
+        printf("%8lu  %16.2f", (unsigned long)count, best_ns);
+
+        bool same = true;
+        std::vector<float> lateral[2], longitudinal[2];
+        for (int b = TYREMODEL_SCALAR; b <= best; ++b)
+        {
+            lateral[b].resize(count);
+            longitudinal[b].resize(count);
+            best_ns = 1e30;
+            for (int r = 0; r < repetitions; ++r)
+            {
+                clock::time_point start = clock::now();
+                model.evaluateBatch((TyreModelBackend)b, lateral_slip.data(), longitudinal_slip.data(), count,
+                                    lateral[b].data(), longitudinal[b].data());
+                best_ns = std::min(best_ns, std::chrono::duration<double, std::nano>(clock::now() - start).count() / count);
+            }
+            printf("  %12.2f", best_ns);
+            same = same && lateral[b] == lateral[0] && longitudinal[b] == longitudinal[0];
+        }
+
+        float max_difference = 0.0f;
+        for (size_t i = 0; i < count; ++i)
+            max_difference = std::max(max_difference, std::max(std::fabs(lateral[0][i] - exact_lateral[i]),
+                                                                std::fabs(longitudinal[0][i] - exact_longitudinal[i])));
+        printf("  %14.4f%s\n", max_difference, same ? "" : "  ATENÇÃO: implementações diferentes");
+    }
+}
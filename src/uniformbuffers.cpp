@@ -0,0 +1,106 @@
+// Constantes dos shaders em UBOs. Veja comentários em "uniformbuffers.h".
+#include <cstring>
+
+#include "uniformbuffers.h"
+
+UniformRing::UniformRing()
+    : buffer_id(0)
+    , segment_size(0)
+    , alignment(256)
+    , current_segment(0)
+{
+    for (int i = 0; i < NUM_SEGMENTS; ++i)
+        fences[i] = 0;
+}
+
+void UniformRing::init(size_t bytes_per_frame)
+{
+    GLint offset_alignment = 0;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &offset_alignment);
+    if ( offset_alignment > 0 )
+        alignment = (size_t)offset_alignment;
+
+    segment_size = (bytes_per_frame + alignment - 1) / alignment * alignment;
+
+    glGenBuffers(1, &buffer_id);
+    glBindBuffer(GL_UNIFORM_BUFFER, buffer_id);
+    glBufferData(GL_UNIFORM_BUFFER, NUM_SEGMENTS * segment_size, NULL, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void UniformRing::beginFrame()
+{
+    staging.clear();
+}
+
+size_t UniformRing::append(const void* data, size_t size)
+{
+    size_t offset = (staging.size() + alignment - 1) / alignment * alignment;
+    staging.resize(offset + size);
+    memcpy(&staging[offset], data, size);
+    return offset;
+}
+
+void UniformRing::waitSegment(int segment)
+{
+    if ( fences[segment] == 0 )
+        return;
+
+    // Normalmente o quadro de NUM_SEGMENTS quadros atrás já terminou, e a
+    // espera retorna imediatamente.
+    while ( glClientWaitSync(fences[segment], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED )
+        ;
+    glDeleteSync(fences[segment]);
+    fences[segment] = 0;
+}
+
+void UniformRing::upload()
+{
+    if ( staging.empty() )
+        return;
+
+    glBindBuffer(GL_UNIFORM_BUFFER, buffer_id);
+
+    // Se o quadro não cabe no trecho, recriamos o buffer com trechos maiores
+    // (após a GPU terminar de usar todos os trechos antigos).
+    if ( staging.size() > segment_size )
+    {
+        for (int i = 0; i < NUM_SEGMENTS; ++i)
+            waitSegment(i);
+        while ( segment_size < staging.size() )
+            segment_size *= 2;
+        glBufferData(GL_UNIFORM_BUFFER, NUM_SEGMENTS * segment_size, NULL, GL_DYNAMIC_DRAW);
+    }
+
+    waitSegment(current_segment);
+
+    // A GPU não está usando este trecho (veja a espera acima), então o
+    // mapeamento não precisa ser sincronizado.
+    void* destination = glMapBufferRange(GL_UNIFORM_BUFFER, current_segment * segment_size, staging.size(),
+                                         GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+    if ( destination != NULL )
+    {
+        memcpy(destination, staging.data(), staging.size());
+        glUnmapBuffer(GL_UNIFORM_BUFFER);
+    }
+    else
+    {
+        glBufferSubData(GL_UNIFORM_BUFFER, current_segment * segment_size, staging.size(), staging.data());
+    }
+
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void UniformRing::bindRange(GLuint binding, size_t offset, size_t size) const
+{
+    glBindBufferRange(GL_UNIFORM_BUFFER, binding, buffer_id, current_segment * segment_size + offset, size);
+}
+
+void UniformRing::endFrame()
+{
+    if ( staging.empty() )
+        return;
+
+    fences[current_segment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    current_segment = (current_segment + 1) % NUM_SEGMENTS;
+}
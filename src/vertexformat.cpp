@@ -0,0 +1,330 @@
+// Formato compacto de vértices. Veja comentários em "vertexformat.h".
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+
+#include <glm/geometric.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/packing.hpp>
+
+#include "vertexformat.h"
+
+namespace
+{
+
+// Índices de "mesh" entre first_vertex e first_vertex + num_vertices?
+bool ShapeIndicesInRange(const MeshView& mesh, const MeshShape& shape)
+{
+    for (size_t i = 0; i < shape.num_indices; ++i)
+    {
+        uint32_t index = mesh.indices[shape.first_index + i];
+        if ( index < shape.first_vertex || index >= shape.first_vertex + shape.num_vertices )
+            return false;
+    }
+    return true;
+}
+
+// Objeto ao qual pertence cada vértice da malha (para quantizar a posição com
+// a bounding box correta)
+bool ShapeOfEachVertex(const MeshView& mesh, size_t num_vertices, std::vector<uint32_t>* shape_of_vertex)
+{
+    shape_of_vertex->assign(num_vertices, 0xFFFFFFFFu);
+    for (size_t s = 0; s < mesh.shapes.size(); ++s)
+    {
+        const MeshShape& shape = mesh.shapes[s];
+        if ( shape.first_vertex + shape.num_vertices > num_vertices || !ShapeIndicesInRange(mesh, shape) )
+            return false;
+        for (size_t v = shape.first_vertex; v < shape.first_vertex + shape.num_vertices; ++v)
+            (*shape_of_vertex)[v] = (uint32_t)s;
+    }
+    return true;
+}
+
+float SignNotZero(float value)
+{
+    return value >= 0.0f ? 1.0f : -1.0f;
+}
+
+int16_t QuantizeSnorm16(float value)
+{
+    value = std::min(1.0f, std::max(-1.0f, value));
+    return (int16_t)std::floor(value * 32767.0f + 0.5f);
+}
+
+float DequantizeSnorm16(int16_t value)
+{
+    return std::max((float)value / 32767.0f, -1.0f);
+}
+
+} // namespace
+
+uint16_t VertexFormat_QuantizeUnorm16(float value, float min, float max)
+{
+    if ( !(max > min) )
+        return 0;
+    float t = (value - min) / (max - min);
+    t = std::min(1.0f, std::max(0.0f, t));
+    return (uint16_t)std::floor(t * 65535.0f + 0.5f);
+}
+
+float VertexFormat_DequantizeUnorm16(uint16_t value, float min, float max)
+{
+    float t = (float)value / 65535.0f;
+    return min + (max - min) * t;
+}
+
+void VertexFormat_OctEncode(const glm::vec3& normal, int16_t out[2])
+{
+    // Projetamos a normal no octaedro |x|+|y|+|z| = 1 e "dobramos" o
+    // hemisfério inferior (z < 0) sobre os cantos do quadrado [-1,1]².
+    float length1 = std::fabs(normal.x) + std::fabs(normal.y) + std::fabs(normal.z);
+    if ( length1 == 0.0f )
+    {
+        out[0] = out[1] = 0;
+        return;
+    }
+
+    float x = normal.x / length1;
+    float y = normal.y / length1;
+    if ( normal.z < 0.0f )
+    {
+        float folded_x = (1.0f - std::fabs(y)) * SignNotZero(x);
+        float folded_y = (1.0f - std::fabs(x)) * SignNotZero(y);
+        x = folded_x;
+        y = folded_y;
+    }
+
+    // Testamos os arredondamentos vizinhos e ficamos com o que, decodificado,
+    // fica mais próximo da normal original.
+    glm::vec3 n = glm::normalize(normal);
+    float best_dot = -2.0f;
+    for (int dx = 0; dx <= 1; ++dx)
+    {
+        for (int dy = 0; dy <= 1; ++dy)
+        {
+            int16_t candidate[2];
+            candidate[0] = (int16_t)std::max(-32767.0f, std::min(32767.0f, (dx ? std::ceil(x * 32767.0f) : std::floor(x * 32767.0f))));
+            candidate[1] = (int16_t)std::max(-32767.0f, std::min(32767.0f, (dy ? std::ceil(y * 32767.0f) : std::floor(y * 32767.0f))));
+            float d = glm::dot(VertexFormat_OctDecode(candidate), n);
+            if ( d > best_dot )
+            {
+                best_dot = d;
+                out[0] = candidate[0];
+                out[1] = candidate[1];
+            }
+        }
+    }
+}
+
+glm::vec3 VertexFormat_OctDecode(const int16_t encoded[2])
+{
+    float x = DequantizeSnorm16(encoded[0]);
+    float y = DequantizeSnorm16(encoded[1]);
+    glm::vec3 n(x, y, 1.0f - std::fabs(x) - std::fabs(y));
+    if ( n.z < 0.0f )
+    {
+        n.x = (1.0f - std::fabs(y)) * SignNotZero(x);
+        n.y = (1.0f - std::fabs(x)) * SignNotZero(y);
+    }
+    return glm::normalize(n);
+}
+
+uint16_t VertexFormat_FloatToHalf(float value)
+{
+    return glm::packHalf1x16(value);
+}
+
+float VertexFormat_HalfToFloat(uint16_t value)
+{
+    return glm::unpackHalf1x16(value);
+}
+
+bool VertexFormat_BuildCompact(const MeshView& mesh, CompactMesh* compact)
+{
+    const size_t num_vertices = mesh.num_model_coefficients / 4;
+    const bool has_normals   = mesh.num_normal_coefficients == 4*num_vertices && num_vertices > 0;
+    const bool has_texcoords = mesh.num_texture_coefficients == 2*num_vertices && num_vertices > 0;
+
+    // Atributos desalinhados (um objeto com normais e outro sem, por
+    // exemplo) não podem ser intercalados
+    if ( (mesh.num_normal_coefficients > 0 && !has_normals) || (mesh.num_texture_coefficients > 0 && !has_texcoords) )
+        return false;
+
+    std::vector<uint32_t> shape_of_vertex;
+    if ( !ShapeOfEachVertex(mesh, num_vertices, &shape_of_vertex) )
+        return false;
+
+    std::vector<CompactVertex> vertices(num_vertices);
+    for (size_t v = 0; v < num_vertices; ++v)
+    {
+        CompactVertex& out = vertices[v];
+        memset(&out, 0, sizeof(out));
+
+        // Vértices que não pertencem a nenhum objeto nunca são desenhados
+        if ( shape_of_vertex[v] == 0xFFFFFFFFu )
+            continue;
+
+        const MeshShape& shape = mesh.shapes[shape_of_vertex[v]];
+        const float* p = &mesh.model_coefficients[4*v];
+        out.position[0] = VertexFormat_QuantizeUnorm16(p[0], shape.bbox_min.x, shape.bbox_max.x);
+        out.position[1] = VertexFormat_QuantizeUnorm16(p[1], shape.bbox_min.y, shape.bbox_max.y);
+        out.position[2] = VertexFormat_QuantizeUnorm16(p[2], shape.bbox_min.z, shape.bbox_max.z);
+
+        if ( has_normals )
+        {
+            const float* n = &mesh.normal_coefficients[4*v];
+            VertexFormat_OctEncode(glm::vec3(n[0], n[1], n[2]), out.normal);
+        }
+
+        if ( has_texcoords )
+        {
+            for (int i = 0; i < 2; ++i)
+            {
+                float uv = mesh.texture_coefficients[2*v + i];
+                out.texcoord[i] = VertexFormat_FloatToHalf(uv);
+                if ( !(std::fabs(VertexFormat_HalfToFloat(out.texcoord[i]) - uv) <= VERTEXFORMAT_MAX_TEXCOORD_ERROR) )
+                    return false;
+            }
+        }
+    }
+
+    // Índices: 16 bits relativos ao primeiro vértice do objeto quando
+    // possível, senão 32 bits. Segmentos de 32 bits são alinhados em 4 bytes.
+    std::vector<uint8_t> indices;
+    std::vector<CompactShape> shapes(mesh.shapes.size());
+    for (size_t s = 0; s < mesh.shapes.size(); ++s)
+    {
+        const MeshShape& shape = mesh.shapes[s];
+        CompactShape& out = shapes[s];
+        out.indices_16bit = shape.num_vertices <= 65536;
+        out.base_vertex = (uint32_t)shape.first_vertex;
+
+        if ( !out.indices_16bit )
+            indices.resize((indices.size() + 3) & ~(size_t)3);
+        out.index_offset = indices.size();
+
+        for (size_t i = 0; i < shape.num_indices; ++i)
+        {
+            uint32_t index = mesh.indices[shape.first_index + i] - out.base_vertex;
+            if ( out.indices_16bit )
+            {
+                uint16_t index16 = (uint16_t)index;
+                indices.insert(indices.end(), (const uint8_t*)&index16, (const uint8_t*)&index16 + sizeof(index16));
+            }
+            else
+                indices.insert(indices.end(), (const uint8_t*)&index, (const uint8_t*)&index + sizeof(index));
+        }
+    }
+
+    compact->vertices.swap(vertices);
+    compact->indices.swap(indices);
+    compact->shapes.swap(shapes);
+    return true;
+}
+
+bool VertexFormat_Compare(const char* name, const MeshView& mesh)
+{
+    CompactMesh compact;
+    if ( !VertexFormat_BuildCompact(mesh, &compact) )
+    {
+        printf("%s: não pode ser convertido para o formato compacto (usará floats)\n", name);
+        return true;
+    }
+
+    const float width = 1920.0f;
+    const float height = 1080.0f;
+
+    double max_pixel_error = 0.0;
+    double max_normal_error_degrees = 0.0;
+    double max_texcoord_error = 0.0;
+
+    for (size_t s = 0; s < mesh.shapes.size(); ++s)
+    {
+        const MeshShape& shape = mesh.shapes[s];
+        const CompactShape& compact_shape = compact.shapes[s];
+
+        // Câmera olhando para o centro da bounding box, próxima o suficiente
+        // para que o objeto ocupe a tela toda (pior caso para o erro em pixels)
+        glm::vec3 center = (shape.bbox_min + shape.bbox_max) * 0.5f;
+        float radius = glm::length(shape.bbox_max - shape.bbox_min) * 0.5f;
+        if ( radius <= 0.0f )
+            continue;
+        glm::vec3 eye = center + glm::normalize(glm::vec3(1.0f, 0.7f, 1.3f)) * (1.2f * radius);
+        glm::mat4 view = glm::lookAt(eye, center, glm::vec3(0.0f, 1.0f, 0.0f));
+        glm::mat4 projection = glm::perspective(glm::radians(60.0f), width / height, 0.1f * radius, 10.0f * radius);
+        glm::mat4 view_projection = projection * view;
+
+        for (size_t i = 0; i < shape.num_indices; ++i)
+        {
+            size_t v = mesh.indices[shape.first_index + i];
+
+            size_t compact_index;
+            if ( compact_shape.indices_16bit )
+            {
+                uint16_t index16;
+                memcpy(&index16, &compact.indices[compact_shape.index_offset + 2*i], sizeof(index16));
+                compact_index = index16;
+            }
+            else
+            {
+                uint32_t index32;
+                memcpy(&index32, &compact.indices[compact_shape.index_offset + 4*i], sizeof(index32));
+                compact_index = index32;
+            }
+            const CompactVertex& cv = compact.vertices[compact_index + compact_shape.base_vertex];
+
+            const float* p = &mesh.model_coefficients[4*v];
+            glm::vec4 position(p[0], p[1], p[2], 1.0f);
+            glm::vec4 compact_position(VertexFormat_DequantizeUnorm16(cv.position[0], shape.bbox_min.x, shape.bbox_max.x),
+                                       VertexFormat_DequantizeUnorm16(cv.position[1], shape.bbox_min.y, shape.bbox_max.y),
+                                       VertexFormat_DequantizeUnorm16(cv.position[2], shape.bbox_min.z, shape.bbox_max.z),
+                                       1.0f);
+
+            glm::vec4 clip = view_projection * position;
+            glm::vec4 compact_clip = view_projection * compact_position;
+            if ( clip.w > 0.0f && compact_clip.w > 0.0f )
+            {
+                glm::vec2 screen(clip.x / clip.w * 0.5f * width, clip.y / clip.w * 0.5f * height);
+                glm::vec2 compact_screen(compact_clip.x / compact_clip.w * 0.5f * width, compact_clip.y / compact_clip.w * 0.5f * height);
+                max_pixel_error = std::max(max_pixel_error, (double)glm::length(screen - compact_screen));
+            }
+
+            if ( mesh.num_normal_coefficients > 0 )
+            {
+                const float* n = &mesh.normal_coefficients[4*v];
+                glm::vec3 normal(n[0], n[1], n[2]);
+                if ( glm::length(normal) > 0.0f )
+                {
+                    float d = glm::dot(glm::normalize(normal), VertexFormat_OctDecode(cv.normal));
+                    double angle = std::acos(std::min(1.0f, std::max(-1.0f, d))) * 180.0 / M_PI;
+                    max_normal_error_degrees = std::max(max_normal_error_degrees, angle);
+                }
+            }
+
+            if ( mesh.num_texture_coefficients > 0 )
+            {
+                for (int k = 0; k < 2; ++k)
+                {
+                    double error = std::fabs(VertexFormat_HalfToFloat(cv.texcoord[k]) - mesh.texture_coefficients[2*v + k]);
+                    max_texcoord_error = std::max(max_texcoord_error, error);
+                }
+            }
+        }
+    }
+
+    const size_t num_vertices = mesh.num_model_coefficients / 4;
+    size_t float_bytes = num_vertices * 4 * sizeof(float)
+                       + mesh.num_normal_coefficients * sizeof(float)
+                       + mesh.num_texture_coefficients * sizeof(float)
+                       + mesh.num_indices * sizeof(uint32_t);
+    size_t compact_bytes = compact.vertices.size() * sizeof(CompactVertex) + compact.indices.size();
+
+    bool ok = max_pixel_error < 0.5;
+    printf("%s: %lu vértices, %lu índices\n", name, (unsigned long)num_vertices, (unsigned long)mesh.num_indices);
+    printf("  memória de GPU: %.1f KB (floats) -> %.1f KB (compacto), %.2fx menor\n",
+           float_bytes / 1024.0, compact_bytes / 1024.0, (double)float_bytes / compact_bytes);
+    printf("  erro máximo: %.3f pixels (1920x1080), %.4f graus nas normais, %.6f nas coordenadas de textura: %s\n",
+           max_pixel_error, max_normal_error_degrees, max_texcoord_error, ok ? "OK" : "FALHOU");
+    return ok;
+}